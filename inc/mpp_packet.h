@@ -28,6 +28,7 @@ extern "C" {
  *
  * mpp_packet_init = mpp_packet_new + mpp_packet_set_data + mpp_packet_set_size
  * mpp_packet_copy_init = mpp_packet_init + memcpy
+ *                        NOTE: no memcpy on packet with buffer or release callback
  */
 MPP_RET mpp_packet_new(MppPacket *packet);
 MPP_RET mpp_packet_init(MppPacket *packet, void *data, size_t size);
@@ -70,6 +71,20 @@ MPP_RET mpp_packet_set_extra_data(MppPacket packet);
 void        mpp_packet_set_buffer(MppPacket packet, MppBuffer buffer);
 MppBuffer   mpp_packet_get_buffer(const MppPacket packet);
 
+/*
+ * borrowed data interface
+ *
+ * When a packet without MppBuffer has a release callback, the copy made by
+ * mpp_packet_copy_init (decoder put_packet) refers to the caller's memory
+ * instead of copying the data. The callback is called with ctx and the data
+ * pointer when mpp releases the copy. The memory must stay valid until then
+ * and must have 256 readable bytes after the data for parser reading.
+ * The packet passed to the callback is not released by the callback.
+ */
+typedef void (*MppPacketRelease)(void *ctx, void *data);
+
+void    mpp_packet_set_release(MppPacket packet, MppPacketRelease release, void *ctx);
+
 /*
  * data access interface
  */
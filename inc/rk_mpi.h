@@ -54,6 +54,9 @@
  * the control api set is for mpp context control including:
  * control  : similiar to ioctl in kernel driver, setup or get mpp internal parameter
  * reset    : clear all data in mpp context, reset to initialized status
+ *
+ * the event api set is for multiplexing multiple contexts on one thread:
+ * get_event_fd : get level triggered readiness fd of input / output port for epoll
  * the simple api set is for simple codec usage including:
  *
  *
@@ -158,10 +161,30 @@ typedef struct MppApi_t {
      */
     MPP_RET (*control)(MppCtx ctx, MpiCmd cmd, MppParam param);
 
+    // event interface
+    /**
+     * @brief get a file descriptor for port readiness notification
+     *        The fd is level triggered and readable (POLLIN) while the port
+     *        is ready. It can be added to poll / select / epoll together
+     *        with fds of other contexts. The fd is owned by mpp, do not read
+     *        or close it. It is only supported on linux.
+     *        For decoder input port is ready when put_packet can accept a
+     *        new packet and output port is ready when get_frame has frame.
+     *        For encoder and task mode the port is ready when poll on the
+     *        port will not wait.
+     *        After the fd is got non-block get_frame does not sleep on empty.
+     * @param ctx The context of mpp
+     * @param type input port or output port
+     * @param fd pointer of the returned file descriptor
+     * @return 0 for success, others for failure
+     */
+    MPP_RET (*get_event_fd)(MppCtx ctx, MppPortType type, RK_S32 *fd);
+
     /**
-     * @brief The reserved segment
+     * @brief The reserved segment, new function pointer takes its space
+     *        from here to keep the size of MppApi unchanged
      */
-    RK_U32 reserv[16];
+    RK_U32 reserv[16 - sizeof(void *) / sizeof(RK_U32)];
 } MppApi;
 
 
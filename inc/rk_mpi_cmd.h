@@ -17,6 +17,9 @@
 #ifndef __RK_MPI_CMD_H__
 #define __RK_MPI_CMD_H__
 
+#include "rk_type.h"
+#include "mpp_err.h"
+
 /*
  * Command id bit usage is defined as follows:
  * bit 20 - 23  - module id
@@ -83,6 +86,7 @@ typedef enum {
     MPP_DEC_SET_DISABLE_ERROR,          /* When set it will disable sw/hw error (H.264 / H.265) */
     MPP_DEC_SET_IMMEDIATE_OUT,
     MPP_DEC_SET_ENABLE_DEINTERLACE,     /* MPP enable deinterlace by default. Vpuapi can disable it */
+    MPP_DEC_SET_THREAD_POOL,            /* Need to setup before init. Run on process shared worker threads */
     MPP_DEC_CMD_END,
 
     MPP_ENC_CMD_BASE                    = CMD_MODULE_CODEC | CMD_CTX_ID_ENC,
@@ -108,6 +112,7 @@ typedef enum {
     MPP_ENC_SET_QP_RANGE,               /* used for adjusting qp range, the parameter can be 1 or 2 */
     MPP_ENC_SET_ROI_CFG,                /* set MppEncROICfg structure */
     MPP_ENC_SET_CTU_QP,                 /* for H265 Encoder,set CTU's size and QP */
+    MPP_ENC_SET_CFG_KV,                 /* set MppEncCfgKvSet structure, all pairs are applied as one MPP_ENC_SET_CFG */
 
     /* User define rate control stategy API control */
     MPP_ENC_CFG_RC_API                  = CMD_MODULE_CODEC | CMD_CTX_ID_ENC | CMD_ENC_CFG_RC_API,
@@ -140,6 +145,9 @@ typedef enum {
     MPP_ENC_CFG_MISC                    = CMD_MODULE_CODEC | CMD_CTX_ID_ENC | CMD_ENC_CFG_MISC,
     MPP_ENC_SET_HEADER_MODE,            /* set MppEncHeaderMode */
     MPP_ENC_GET_HEADER_MODE,            /* get MppEncHeaderMode */
+    MPP_ENC_POST_CTRL,                  /* queue MppEncCtrlReq without waiting, applied before next frame */
+    MPP_ENC_SET_CTRL_CB,                /* set MppEncCtrlCb called when queued control is done */
+    MPP_ENC_GET_CTRL_STATUS,            /* get MppEncCtrlStatus of queued control */
 
     MPP_ENC_CFG_SPLIT                   = CMD_MODULE_CODEC | CMD_CTX_ID_ENC | CMD_ENC_CFG_SPLIT,
     MPP_ENC_SET_SPLIT,                  /* set MppEncSliceSplit structure */
@@ -164,6 +172,40 @@ typedef enum {
     MPI_CMD_BUTT,
 } MpiCmd;
 
+/*
+ * Queued encoder control
+ *
+ * MPP_ENC_POST_CTRL queues cmd / param and returns a sequence number at once.
+ * Queued commands are done in posting order by encoder thread before next
+ * frame is started. param is not copied so it should be kept valid until the
+ * command is done. Completion can be polled by MPP_ENC_GET_CTRL_STATUS or
+ * got from the callback set by MPP_ENC_SET_CTRL_CB which is called on the
+ * encoder thread.
+ */
+typedef struct MppEncCtrlReq_t {
+    MpiCmd              cmd;
+    void                *param;
+    /* output sequence number, starting from 1 */
+    RK_U32              seq;
+} MppEncCtrlReq;
+
+typedef void (*MppEncCtrlCallback)(void *ctx, RK_U32 seq, MpiCmd cmd, MPP_RET ret);
+
+typedef struct MppEncCtrlCb_t {
+    MppEncCtrlCallback  callback;
+    void                *ctx;
+} MppEncCtrlCb;
+
+typedef struct MppEncCtrlStatus_t {
+    /* last posted sequence and last done sequence */
+    RK_U32              seq_post;
+    RK_U32              seq_done;
+    /* failed command count and the last failed one */
+    RK_U32              err_cnt;
+    RK_U32              err_seq;
+    MPP_RET             err_ret;
+} MppEncCtrlStatus;
+
 #include "rk_venc_cmd.h"
 #include "rk_venc_cfg.h"
 #include "rk_venc_ref.h"
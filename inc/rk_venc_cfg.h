@@ -22,6 +22,33 @@
 
 typedef void* MppEncCfg;
 
+/*
+ * MppEncCfgKey is the handle of one config item found by name. Key is valid
+ * in the whole process so it can be got once and then used to access the
+ * config item without the name lookup on each set / get.
+ */
+typedef void* MppEncCfgKey;
+
+typedef union MppEncCfgVal_u {
+    RK_S32          s32;
+    RK_U32          u32;
+    RK_S64          s64;
+    RK_U64          u64;
+    void            *ptr;
+} MppEncCfgVal;
+
+/* value is accessed by the set type of the key */
+typedef struct MppEncCfgKv_t {
+    MppEncCfgKey    key;
+    MppEncCfgVal    val;
+} MppEncCfgKv;
+
+/* parameter of MPP_ENC_SET_CFG_KV */
+typedef struct MppEncCfgKvSet_t {
+    MppEncCfgKv     *kv;
+    RK_S32          count;
+} MppEncCfgKvSet;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,6 +68,23 @@ MPP_RET mpp_enc_cfg_get_s64(MppEncCfg cfg, const char *name, RK_S64 *val);
 MPP_RET mpp_enc_cfg_get_u64(MppEncCfg cfg, const char *name, RK_U64 *val);
 MPP_RET mpp_enc_cfg_get_ptr(MppEncCfg cfg, const char *name, void **val);
 
+MPP_RET mpp_enc_cfg_get_key(const char *name, MppEncCfgKey *key);
+
+MPP_RET mpp_enc_cfg_set_s32_by_key(MppEncCfg cfg, MppEncCfgKey key, RK_S32 val);
+MPP_RET mpp_enc_cfg_set_u32_by_key(MppEncCfg cfg, MppEncCfgKey key, RK_U32 val);
+MPP_RET mpp_enc_cfg_set_s64_by_key(MppEncCfg cfg, MppEncCfgKey key, RK_S64 val);
+MPP_RET mpp_enc_cfg_set_u64_by_key(MppEncCfg cfg, MppEncCfgKey key, RK_U64 val);
+MPP_RET mpp_enc_cfg_set_ptr_by_key(MppEncCfg cfg, MppEncCfgKey key, void *val);
+
+MPP_RET mpp_enc_cfg_get_s32_by_key(MppEncCfg cfg, MppEncCfgKey key, RK_S32 *val);
+MPP_RET mpp_enc_cfg_get_u32_by_key(MppEncCfg cfg, MppEncCfgKey key, RK_U32 *val);
+MPP_RET mpp_enc_cfg_get_s64_by_key(MppEncCfg cfg, MppEncCfgKey key, RK_S64 *val);
+MPP_RET mpp_enc_cfg_get_u64_by_key(MppEncCfg cfg, MppEncCfgKey key, RK_U64 *val);
+MPP_RET mpp_enc_cfg_get_ptr_by_key(MppEncCfg cfg, MppEncCfgKey key, void **val);
+
+/* set count key / value pairs to config */
+MPP_RET mpp_enc_cfg_set_kv(MppEncCfg cfg, MppEncCfgKv *kv, RK_S32 count);
+
 void mpp_enc_cfg_show(void);
 
 #ifdef __cplusplus
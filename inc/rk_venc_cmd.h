@@ -148,6 +148,36 @@
  *   +                          +                 +                       +
  */
 
+/*
+ * Base parameter
+ */
+typedef enum MppEncBaseCfgChange_e {
+    MPP_ENC_BASE_CFG_CHANGE_PIPE_DEPTH  = (1 << 0),
+    MPP_ENC_BASE_CFG_CHANGE_ALL         = (0xFFFFFFFF),
+} MppEncBaseCfgChange;
+
+#define MPP_ENC_PIPE_DEPTH_MAX          4
+
+typedef struct MppEncBaseCfg_t {
+    RK_U32  change;
+
+    /*
+     * pipe_depth - max frame count encoding at the same time
+     *
+     * 1 - sync mode (default). Input frame is returned after its packet is
+     *     output.
+     * N - async mode. Up to N frames are in hardware at the same time when the
+     *     hardware supports it. Input frame is returned once its hardware task
+     *     is started and its buffer is referenced by encoder until the packet
+     *     is output. So user should NOT write the frame buffer again until the
+     *     corresponding packet is got.
+     *
+     * NOTE: the depth falls back to 1 when the hardware can not run multiple
+     * tasks. On re-encode the later tasks in hardware are encoded again.
+     */
+    RK_S32  pipe_depth;
+} MppEncBaseCfg;
+
 /*
  * Rate control parameter
  */
@@ -1019,6 +1049,21 @@ typedef struct MppEncROICfg_t {
     MppEncROIRegion     *regions;      /**< ROI parameters */
 } MppEncROICfg;
 
+/**
+ * @brief MPP encoder's per block qp map
+ *
+ * One relative qp delta for each 16x16 block in raster order. The map is
+ * the base of the roi config and the ROI regions are applied on top of it.
+ * The map size should match the encoding size, blocks out of the map keep
+ * the frame qp.
+ */
+typedef struct MppEncQpMap_t {
+    RK_S32              width;          /**< block count in horizontal */
+    RK_S32              height;         /**< block count in vertical */
+    RK_S32              stride;         /**< byte stride of one block line */
+    RK_S8               *qp_delta;      /**< relative qp of each block */
+} MppEncQpMap;
+
 /*
  * Mpp OSD parameter
  *
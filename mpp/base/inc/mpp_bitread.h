@@ -158,6 +158,8 @@ RK_U32  mpp_has_more_rbsp_data(BitReadCtx_t * bitctx);
 
 //!< align bits and get current pointer
 RK_U8  *mpp_align_get_bits(BitReadCtx_t *bitctx);
+//!< find the end byte of 00 00 01 start code with previous bytes in prefix
+RK_S32  mpp_find_start_code_end(const RK_U8 *buf, RK_S32 len, RK_U32 prefix);
 
 #ifdef  __cplusplus
 }
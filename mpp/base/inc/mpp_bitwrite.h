@@ -22,14 +22,19 @@
 
 /*
  * Mpp bitstream writer for H.264/H.265
+ *
+ * Bits are collected in a 64-bit accumulator and written to stream 8 bytes at
+ * a time. The accumulator is written out on flush, align and trailing, so
+ * byte_cnt and buffered_bits are only byte exact after these calls.
  */
 typedef struct MppWriteCtx_t {
     RK_U8 *buffer;          /* point to first byte of stream */
     RK_U8 *stream;          /* Pointer to next byte of stream */
     RK_U32 size;            /* Byte size of stream buffer */
     RK_U32 byte_cnt;        /* Byte counter */
-    RK_U32 byte_buffer;     /* Byte buffer */
-    RK_U32 buffered_bits;   /* Amount of bits in byte buffer, [0-7] */
+    RK_U64 cache;           /* Bit accumulator */
+    RK_U32 buffered_bits;   /* Amount of bits in accumulator, [0-63], [0-7] after flush */
+    RK_U32 cache_emul;      /* Bits in accumulator need emulation prevention */
     RK_U32 zero_bytes;      /* Amount of consecutive zero bytes */
     RK_S32 overflow;        /* This will signal a buffer overflow */
     RK_U32 emul_cnt;        /* Counter for emulation_3_byte, needed in SEI */
@@ -40,13 +45,15 @@ MPP_RET mpp_writer_reset(MppWriteCtx *ctx);
 
 /* check overflow status */
 MPP_RET mpp_writer_status(MppWriteCtx *ctx);
-/* write bit in last byte to memory */
+/* write all bits in accumulator to memory, the last partial byte included */
 void mpp_writer_flush(MppWriteCtx *ctx);
+/* skip len bits already in memory from a byte aligned position */
+void mpp_writer_skip_bits(MppWriteCtx *ctx, RK_S32 len);
 
-/* write raw bit without emulation prevention 0x03 byte */
+/* write raw bit (1-32) without emulation prevention 0x03 byte */
 void mpp_writer_put_raw_bits(MppWriteCtx *ctx, RK_S32 val, RK_S32 len);
 
-/* write bit with emulation prevention 0x03 byte */
+/* write bit (1-32) with emulation prevention 0x03 byte */
 void mpp_writer_put_bits(MppWriteCtx *ctx, RK_S32 val, RK_S32 len);
 
 /* insert zero bits until byte-aligned */
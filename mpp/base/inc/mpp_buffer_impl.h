@@ -19,6 +19,7 @@
 
 #include "mpp_list.h"
 #include "mpp_common.h"
+#include "mpp_thread.h"
 #include "mpp_allocator.h"
 
 #define MPP_BUF_DBG_FUNCTION            (0x00000001)
@@ -60,7 +61,11 @@ struct MppBufferImpl_t {
     // used flag is for used/unused list detection
     RK_U32              used;
     RK_U32              internal;
+    // ref_count is updated by atomic operation and only the 0 <-> 1 transition
+    // takes the group buf_lock to move buffer between used and unused list
     RK_S32              ref_count;
+    // group will not be destroyed until all its buffers are released
+    MppBufferGroupImpl  *group;
     struct list_head    list_status;
 };
 
@@ -84,6 +89,9 @@ struct MppBufferGroupImpl_t {
     MppAllocator        allocator;
     MppAllocatorApi     *alloc_api;
 
+    // lock for buffer list / counter / log in this group
+    pthread_mutex_t     buf_lock;
+
     // thread that will be signal on buffer return
     MppBufCallback      callback;
     void                *arg;
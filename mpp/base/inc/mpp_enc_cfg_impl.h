@@ -19,6 +19,7 @@
 
 #include "mpp_trie.h"
 #include "mpp_enc_cfg.h"
+#include "rk_venc_cfg.h"
 
 typedef struct MppEncCfgImpl_t {
     RK_S32              size;
@@ -26,4 +27,19 @@ typedef struct MppEncCfgImpl_t {
     MppEncCfgSet        cfg;
 } MppEncCfgImpl;
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reset cfg to the current encoder config as the base of a new change batch.
+ * All change flags are cleared and the handles owned by encoder are not
+ * copied.
+ */
+MPP_RET mpp_enc_cfg_stage(MppEncCfg cfg, const MppEncCfgSet *curr);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /*__MPP_ENC_CFG_IMPL_H__*/
@@ -27,16 +27,8 @@ typedef struct MppMetaDef_t {
     MppMetaType         type;
 } MppMetaDef;
 
-typedef struct MppMetaImpl_t {
-    char                tag[MPP_TAG_SIZE];
-    const char          *caller;
-    RK_S32              meta_id;
-    RK_S32              ref_count;
-
-    struct list_head    list_meta;
-    struct list_head    list_node;
-    RK_S32              node_count;
-} MppMetaImpl;
+/* max key count supported by the key bitmap in MppMetaImpl */
+#define META_KEY_MAX            32
 
 typedef union MppMetaVal_u {
     RK_S32              val_s32;
@@ -47,15 +39,22 @@ typedef union MppMetaVal_u {
     MppBuffer           buffer;
 } MppMetaVal;
 
-typedef struct MppMetaNode_t {
-    struct list_head    list_meta;
-    struct list_head    list_node;
-    MppMetaImpl         *meta;
-    RK_S32              node_id;
+/*
+ * Each key has a fixed slot indexed by its position in meta_defs and
+ * node_mask records which slot is valid. MppMetaImpl is recycled by the
+ * meta service pool so no heap allocation is on set / get path.
+ */
+typedef struct MppMetaImpl_t {
+    char                tag[MPP_TAG_SIZE];
+    const char          *caller;
+    RK_S32              meta_id;
+    RK_S32              ref_count;
 
-    RK_S32              type_id;
-    MppMetaVal          val;
-} MppMetaNode;
+    // link to meta pool free list
+    struct list_head    list_meta;
+    RK_U32              node_mask;
+    MppMetaVal          vals[META_KEY_MAX];
+} MppMetaImpl;
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,7 +62,7 @@ extern "C" {
 
 RK_S32 mpp_meta_size(MppMeta meta);
 MPP_RET mpp_meta_inc_ref(MppMeta meta);
-MppMetaNode *mpp_meta_next_node(MppMeta meta);
+void mpp_meta_dump(MppMeta meta);
 
 #ifdef __cplusplus
 }
@@ -22,6 +22,7 @@
 #define MPP_PACKET_FLAG_EOS             (0x00000001)
 #define MPP_PACKET_FLAG_EXTRA_DATA      (0x00000002)
 #define MPP_PACKET_FLAG_INTERNAL        (0x00000004)
+#define MPP_PACKET_FLAG_BORROWED        (0x00000008)
 
 /*
  * mpp_packet_imp structure
@@ -48,6 +49,10 @@ typedef struct MppPacketImpl_t {
 
     MppBuffer   buffer;
     MppMeta     meta;
+
+    // release callback for borrowed data
+    MppPacketRelease release;
+    void        *release_ctx;
 } MppPacketImpl;
 
 #ifdef __cplusplus
@@ -59,6 +64,8 @@ extern "C" {
 MPP_RET mpp_packet_reset(MppPacketImpl *packet);
 MPP_RET mpp_packet_copy(MppPacket dst, MppPacket src);
 MPP_RET mpp_packet_append(MppPacket dst, MppPacket src);
+/* give borrowed data back to caller without calling its release callback */
+MPP_RET mpp_packet_drop_borrow(MppPacket packet);
 
 /* pointer check function */
 MPP_RET check_is_mpp_packet(void *ptr);
@@ -118,6 +118,9 @@ MPP_RET _mpp_port_dequeue(const char *caller, MppPort port, MppTask *task);
 MPP_RET _mpp_port_enqueue(const char *caller, MppPort port, MppTask task);
 MPP_RET _mpp_port_awake(const char *caller, MppPort port);
 
+/* level triggered fd which is readable while the port has task to dequeue */
+MPP_RET mpp_port_get_fd(MppPort port, RK_S32 *fd);
+
 #ifdef __cplusplus
 }
 #endif
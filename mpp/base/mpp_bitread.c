@@ -21,6 +21,8 @@
 #include "mpp_mem.h"
 #include "mpp_bitread.h"
 
+#define HAVE_ZERO_BYTE(x)   (((x) - 0x0101010101010101ULL) & ~(x) & 0x8080808080808080ULL)
+#define HAVE_03_BYTE(x)     HAVE_ZERO_BYTE((x) ^ 0x0303030303030303ULL)
 
 static MPP_RET update_curbyte(BitReadCtx_t *bitctx)
 {
@@ -50,6 +52,122 @@ static MPP_RET update_curbyte(BitReadCtx_t *bitctx)
     return MPP_OK;
 }
 
+/*
+ * Cached word access
+ *
+ * The parsers read data_ / bytes_left_ / num_remaining_bits_in_curr_byte_
+ * directly between two bit reads, so the context stays at byte granularity
+ * and the 64-bit cache is built on each call: the unread bits of curr_byte_
+ * followed by the next 8 stream bytes loaded as one big-endian word.
+ *
+ * The word is only used when it contains no 0x03 byte, then no emulation
+ * prevention byte can be hidden in it. Otherwise, and at the stream end,
+ * the byte-wise update_curbyte path is used.
+ */
+static RK_U64 load_be64(const RK_U8 *p)
+{
+    return ((RK_U64)p[0] << 56) | ((RK_U64)p[1] << 48) |
+           ((RK_U64)p[2] << 40) | ((RK_U64)p[3] << 32) |
+           ((RK_U64)p[4] << 24) | ((RK_U64)p[5] << 16) |
+           ((RK_U64)p[6] << 8) | ((RK_U64)p[7]);
+}
+
+/*
+ * Return the unread bits left aligned in cache and the count of valid bits
+ * in it. The next stream word is only loaded when num_bits is not covered
+ * by curr_byte_.
+ */
+static RK_S32 bitread_peek(BitReadCtx_t *bitctx, RK_S32 num_bits,
+                           RK_U64 *cache, RK_U64 *word)
+{
+    RK_S32 remain = bitctx->num_remaining_bits_in_curr_byte_;
+    RK_U64 val = remain ? (RK_U64)bitctx->curr_byte_ << (64 - remain) : 0;
+
+    *cache = val;
+    if (num_bits <= remain || bitctx->bytes_left_ < 8)
+        return remain;
+
+    val = load_be64(bitctx->data_);
+    if (bitctx->need_prevention_detection && HAVE_03_BYTE(val))
+        return remain;
+
+    *word = val;
+    *cache |= val >> remain;
+
+    return 64;
+}
+
+/* consume num_bits from the cache returned by bitread_peek */
+static void bitread_consume(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_U64 word)
+{
+    RK_S32 need = num_bits - bitctx->num_remaining_bits_in_curr_byte_;
+
+    if (need > 0) {
+        RK_S32 bytes = (need + 7) >> 3;
+        RK_U64 prev = (RK_U64)bitctx->prev_two_bytes_;
+
+        prev = (bytes > 1) ? (word >> (64 - 8 * bytes)) : ((prev << 8) | (word >> 56));
+        bitctx->prev_two_bytes_ = prev & 0xffff;
+        bitctx->curr_byte_ = bitctx->data_[bytes - 1];
+        bitctx->data_ += bytes;
+        bitctx->bytes_left_ -= bytes;
+        bitctx->num_remaining_bits_in_curr_byte_ = bytes * 8 - need;
+    } else {
+        bitctx->num_remaining_bits_in_curr_byte_ = -need;
+    }
+    bitctx->used_bits += num_bits;
+}
+
+/* byte-wise read of 0 to 32 bits for stream end and emulation prevention */
+static MPP_RET bitread_slow(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_U32 *out)
+{
+    RK_S32 bits_left = num_bits;
+    RK_U64 val = 0;
+
+    while (bitctx->num_remaining_bits_in_curr_byte_ < bits_left) {
+        // Take all that's left in current byte, shift to make space for the rest.
+        val |= (RK_U64)bitctx->curr_byte_ << (bits_left - bitctx->num_remaining_bits_in_curr_byte_);
+        bits_left -= bitctx->num_remaining_bits_in_curr_byte_;
+        if (update_curbyte(bitctx)) {
+            return  MPP_ERR_READ_BIT;
+        }
+    }
+    val |= bitctx->curr_byte_ >> (bitctx->num_remaining_bits_in_curr_byte_ - bits_left);
+    *out = (RK_U32)(val & ((1ULL << num_bits) - 1));
+    bitctx->num_remaining_bits_in_curr_byte_ -= bits_left;
+    bitctx->used_bits += num_bits;
+
+    return MPP_OK;
+}
+
+static MPP_RET bitread_read(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_U32 *out)
+{
+    RK_U64 cache;
+    RK_U64 word = 0;
+
+    if (num_bits <= 0) {
+        *out = 0;
+        return MPP_OK;
+    }
+
+    // bits in curr_byte_ only
+    if (num_bits <= bitctx->num_remaining_bits_in_curr_byte_) {
+        bitctx->num_remaining_bits_in_curr_byte_ -= num_bits;
+        *out = (RK_U32)(bitctx->curr_byte_ >> bitctx->num_remaining_bits_in_curr_byte_) &
+               ((1 << num_bits) - 1);
+        bitctx->used_bits += num_bits;
+        return MPP_OK;
+    }
+
+    if (bitread_peek(bitctx, num_bits, &cache, &word) < num_bits)
+        return bitread_slow(bitctx, num_bits, out);
+
+    *out = (RK_U32)(cache >> (64 - num_bits));
+    bitread_consume(bitctx, num_bits, word);
+
+    return MPP_OK;
+}
+
 /*!
 ***********************************************************************
 * \brief
@@ -60,25 +178,12 @@ static MPP_RET update_curbyte(BitReadCtx_t *bitctx)
 */
 MPP_RET mpp_read_bits(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_S32 *out)
 {
-    RK_S32 bits_left = num_bits;
     *out = 0;
     if (num_bits > 31) {
         return  MPP_ERR_READ_BIT;
     }
-    while (bitctx->num_remaining_bits_in_curr_byte_ < bits_left) {
-        // Take all that's left in current byte, shift to make space for the rest.
-        *out |= (bitctx->curr_byte_ << (bits_left - bitctx->num_remaining_bits_in_curr_byte_));
-        bits_left -= bitctx->num_remaining_bits_in_curr_byte_;
-        if (update_curbyte(bitctx)) {
-            return  MPP_ERR_READ_BIT;
-        }
-    }
-    *out |= (bitctx->curr_byte_ >> (bitctx->num_remaining_bits_in_curr_byte_ - bits_left));
-    *out &= ((1 << num_bits) - 1);
-    bitctx->num_remaining_bits_in_curr_byte_ -= bits_left;
-    bitctx->used_bits += num_bits;
 
-    return MPP_OK;
+    return bitread_read(bitctx, num_bits, (RK_U32 *)out);
 }
 /*!
 ***********************************************************************
@@ -88,21 +193,11 @@ MPP_RET mpp_read_bits(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_S32 *out)
 */
 MPP_RET mpp_read_longbits(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_U32 *out)
 {
-    RK_S32 val = 0, val1 = 0;
-
-    if (num_bits < 32)
-        return mpp_read_bits(bitctx, num_bits, (RK_S32 *)out);
-
-    if (mpp_read_bits(bitctx, 16, &val)) {
-        return  MPP_ERR_READ_BIT;
-    }
-    if (mpp_read_bits(bitctx, (num_bits - 16), &val1)) {
+    if (num_bits > 32) {
         return  MPP_ERR_READ_BIT;
     }
 
-    *out = (RK_U32)((val << 16) | val1);
-
-    return MPP_OK;
+    return bitread_read(bitctx, num_bits, out);
 }
 /*!
 ***********************************************************************
@@ -117,6 +212,25 @@ MPP_RET mpp_skip_bits(BitReadCtx_t *bitctx, RK_S32 num_bits)
     while (bitctx->num_remaining_bits_in_curr_byte_ < bits_left) {
         // Take all that's left in current byte, shift to make space for the rest.
         bits_left -= bitctx->num_remaining_bits_in_curr_byte_;
+        bitctx->num_remaining_bits_in_curr_byte_ = 0;
+
+        // Skip whole words without 0x03 byte, keep the last byte for curr_byte_.
+        if (bits_left > 8 && bitctx->bytes_left_ >= 8) {
+            RK_U64 word = load_be64(bitctx->data_);
+
+            if (!bitctx->need_prevention_detection || !HAVE_03_BYTE(word)) {
+                RK_S32 bytes = MPP_MIN((bits_left - 1) >> 3, 8);
+                RK_U64 prev = (RK_U64)bitctx->prev_two_bytes_;
+
+                prev = (bytes > 1) ? (word >> (64 - 8 * bytes)) : ((prev << 8) | (word >> 56));
+                bitctx->prev_two_bytes_ = prev & 0xffff;
+                bitctx->data_ += bytes;
+                bitctx->bytes_left_ -= bytes;
+                bits_left -= bytes * 8;
+                continue;
+            }
+        }
+
         if (update_curbyte(bitctx)) {
             return  MPP_ERR_READ_BIT;
         }
@@ -134,13 +248,7 @@ MPP_RET mpp_skip_bits(BitReadCtx_t *bitctx, RK_S32 num_bits)
 */
 MPP_RET mpp_skip_longbits(BitReadCtx_t *bitctx, RK_S32 num_bits)
 {
-    if (mpp_skip_bits(bitctx, 16)) {
-        return  MPP_ERR_READ_BIT;
-    }
-    if (mpp_skip_bits(bitctx, (num_bits - 16))) {
-        return  MPP_ERR_READ_BIT;
-    }
-    return MPP_OK;
+    return mpp_skip_bits(bitctx, num_bits);
 }
 /*!
 ***********************************************************************
@@ -150,15 +258,7 @@ MPP_RET mpp_skip_longbits(BitReadCtx_t *bitctx, RK_S32 num_bits)
 */
 MPP_RET mpp_show_bits(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_S32 *out)
 {
-    MPP_RET ret = MPP_ERR_UNKNOW;
-    BitReadCtx_t tmp_ctx = *bitctx;
-
-    if (num_bits < 32)
-        ret = mpp_read_bits(&tmp_ctx, num_bits, out);
-    else
-        ret = mpp_read_longbits(&tmp_ctx, num_bits, (RK_U32 *)out);
-
-    return ret;
+    return mpp_show_longbits(bitctx, num_bits, (RK_U32 *)out);
 }
 /*!
 ***********************************************************************
@@ -168,12 +268,27 @@ MPP_RET mpp_show_bits(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_S32 *out)
 */
 MPP_RET mpp_show_longbits(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_U32 *out)
 {
-    MPP_RET ret = MPP_ERR_UNKNOW;
-    BitReadCtx_t tmp_ctx = *bitctx;
+    RK_U64 cache;
+    RK_U64 word = 0;
+
+    if (num_bits > 32) {
+        return  MPP_ERR_READ_BIT;
+    }
+
+    if (num_bits <= 0) {
+        *out = 0;
+        return MPP_OK;
+    }
+
+    if (bitread_peek(bitctx, num_bits, &cache, &word) < num_bits) {
+        BitReadCtx_t tmp_ctx = *bitctx;
+
+        return bitread_slow(&tmp_ctx, num_bits, out);
+    }
 
-    ret = mpp_read_longbits(&tmp_ctx, num_bits, out);
+    *out = (RK_U32)(cache >> (64 - num_bits));
 
-    return ret;
+    return MPP_OK;
 }
 /*!
 ***********************************************************************
@@ -186,6 +301,26 @@ MPP_RET mpp_read_ue(BitReadCtx_t *bitctx, RK_U32 *val)
     RK_S32 num_bits = -1;
     RK_S32 bit;
     RK_S32 rest;
+    RK_U64 cache;
+    RK_U64 word = 0;
+    RK_S32 valid = bitread_peek(bitctx, 0, &cache, &word);
+    RK_S32 zeros = cache ? __builtin_clzll(cache) : 64;
+
+    // Count the leading zeros in the cache, the whole code of 2 * zeros + 1
+    // bits must be in the cache. Otherwise fall back to bit by bit reading.
+    if (zeros * 2 + 1 > valid) {
+        valid = bitread_peek(bitctx, valid + 1, &cache, &word);
+        zeros = cache ? __builtin_clzll(cache) : 64;
+    }
+
+    if (zeros < 32 && zeros * 2 + 1 <= valid) {
+        RK_S32 len = zeros * 2 + 1;
+
+        *val = (RK_U32)(cache >> (64 - len)) - 1;
+        bitread_consume(bitctx, len, word);
+        return MPP_OK;
+    }
+
     // Count the number of contiguous zero bits.
     do {
         if (mpp_read_bits(bitctx, 1, &bit)) {
@@ -298,3 +433,58 @@ RK_U8 *mpp_align_get_bits(BitReadCtx_t *bitctx)
         mpp_skip_bits(bitctx, n);
     return bitctx->data_;
 }
+/*!
+***********************************************************************
+* \brief
+*   find the byte which completes a 00 00 01 start code
+*   prefix holds the bytes before buf in its low bits, the same as the
+*   byte-wise (prefix << 8 | byte) shift register used by the parsers.
+*   Return the index of the 01 byte or len when no start code is found.
+***********************************************************************
+*/
+
+RK_S32 mpp_find_start_code_end(const RK_U8 *buf, RK_S32 len, RK_U32 prefix)
+{
+    RK_S32 i = 0;
+
+    if (len <= 0)
+        return 0;
+
+    /* start code across the previous data */
+    if (((prefix << 8 | buf[0]) & 0x00FFFFFF) == 0x00000001)
+        return 0;
+
+    if (len > 1 && ((prefix << 16 | buf[0] << 8 | buf[1]) & 0x00FFFFFF) == 0x00000001)
+        return 1;
+
+    while (i + 2 < len) {
+        /* skip the words without any zero byte */
+        while (i + 8 <= len) {
+            RK_U64 val;
+
+            memcpy(&val, buf + i, sizeof(val));
+            if (HAVE_ZERO_BYTE(val))
+                break;
+
+            i += 8;
+        }
+
+        /* check each byte position in the word with zero byte */
+        {
+            RK_S32 end = MPP_MIN(i + 8, len - 2);
+
+            for (; i < end; i++) {
+                if (buf[i + 2] > 1) {
+                    /* neither i + 1 nor i + 2 can be the start position */
+                    i += 2;
+                    continue;
+                }
+
+                if (!buf[i] && !buf[i + 1] && buf[i + 2] == 1)
+                    return i + 2;
+            }
+        }
+    }
+
+    return len;
+}
@@ -19,9 +19,13 @@
 
 #include "mpp_bitwrite.h"
 
+/* 0x80 in each zero byte position */
+#define ZERO_BYTE_MASK(x)   (~((((x) & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | \
+                              (x) | 0x7f7f7f7f7f7f7f7fULL))
+
 MPP_RET mpp_writer_status(MppWriteCtx *ctx)
 {
-    if (ctx->byte_cnt > ctx->size) {
+    if (ctx->overflow || ctx->byte_cnt > ctx->size) {
         ctx->overflow = 1;
         return MPP_NOK;
     }
@@ -33,8 +37,9 @@ MPP_RET mpp_writer_reset(MppWriteCtx *ctx)
 {
     ctx->stream = ctx->buffer;
     ctx->byte_cnt = 0;
-    ctx->byte_buffer = 0;
+    ctx->cache = 0;
     ctx->buffered_bits = 0;
+    ctx->cache_emul = 0;
     ctx->zero_bytes = 0;
     ctx->overflow = 0;
     ctx->emul_cnt = 0;
@@ -47,14 +52,8 @@ MPP_RET mpp_writer_init(MppWriteCtx *ctx, void *p, RK_S32 size)
     MPP_RET ret;
 
     ctx->buffer = p;
-    ctx->stream = p;
     ctx->size = size;
-    ctx->byte_cnt = 0;
-    ctx->overflow = 0;
-    ctx->byte_buffer = 0;
-    ctx->buffered_bits = 0;
-    ctx->zero_bytes = 0;
-    ctx->emul_cnt = 0;
+    mpp_writer_reset(ctx);
 
     ret = mpp_writer_status(ctx);
     if (ret)
@@ -63,148 +62,222 @@ MPP_RET mpp_writer_init(MppWriteCtx *ctx, void *p, RK_S32 size)
     return ret;
 }
 
-void mpp_writer_put_raw_bits(MppWriteCtx *ctx, RK_S32 val, RK_S32 len)
+static void writer_store_byte(MppWriteCtx *ctx, RK_U8 byte)
 {
-    RK_S32 bits;
-    RK_U32 byte_buffer = ctx->byte_buffer;
-    RK_U8*stream = ctx->stream;
-
-    if (mpp_writer_status(ctx))
+    if (ctx->byte_cnt >= ctx->size) {
+        ctx->overflow = 1;
         return;
+    }
 
-    mpp_assert(val < (1 << len));
-    mpp_assert(len < 25);
+    *ctx->stream++ = byte;
+    ctx->byte_cnt++;
+}
 
-    bits = len + ctx->buffered_bits;
-    val <<= (32 - bits);
-    byte_buffer = byte_buffer | val;
+static void writer_put_byte(MppWriteCtx *ctx, RK_U8 byte, RK_U32 emul)
+{
+    if (emul) {
+        if (ctx->zero_bytes == 2 && byte < 4) {
+            writer_store_byte(ctx, 3);
+            ctx->zero_bytes = 0;
+            ctx->emul_cnt++;
+        }
 
-    while (bits > 7) {
-        *stream = (RK_U8)(byte_buffer >> 24);
+        ctx->zero_bytes = byte ? 0 : ctx->zero_bytes + 1;
+    }
 
-        bits -= 8;
-        byte_buffer <<= 8;
-        stream++;
-        ctx->byte_cnt++;
+    writer_store_byte(ctx, byte);
+}
+
+/*
+ * Write a full accumulator. Emulation prevention byte is needed before a byte
+ * not larger than 3 following two zero bytes, the zero bytes before this word
+ * included. When no byte needs it the 8 bytes are stored at once.
+ */
+static void writer_put_word(MppWriteCtx *ctx, RK_U64 word)
+{
+    RK_U64 need = 0;
+    RK_S32 i;
+
+    if (ctx->cache_emul) {
+        RK_U64 zero = ZERO_BYTE_MASK(word);
+        RK_U64 small = ZERO_BYTE_MASK(word & 0xfcfcfcfcfcfcfcfcULL);
+        RK_U64 zero1 = (zero >> 8) | (ctx->zero_bytes >= 1 ? (1ULL << 63) : 0);
+        RK_U64 zero2 = (zero >> 16) | (ctx->zero_bytes >= 1 ? (1ULL << 55) : 0) |
+                       (ctx->zero_bytes >= 2 ? (1ULL << 63) : 0);
+
+        need = small & zero1 & zero2;
+        if (!need && ctx->byte_cnt + 8 <= ctx->size) {
+            /* at most two trailing zero bytes without emulation prevention */
+            ctx->zero_bytes = !(zero & 0x80) ? 0 : !(zero & 0x8000) ? 1 : 2;
+        }
     }
 
-    ctx->byte_buffer = byte_buffer;
-    ctx->buffered_bits = (RK_U8)bits;
-    ctx->stream = stream;
+    if (!need && ctx->byte_cnt + 8 <= ctx->size) {
+        RK_U8 *p = ctx->stream;
+
+        p[0] = (RK_U8)(word >> 56);
+        p[1] = (RK_U8)(word >> 48);
+        p[2] = (RK_U8)(word >> 40);
+        p[3] = (RK_U8)(word >> 32);
+        p[4] = (RK_U8)(word >> 24);
+        p[5] = (RK_U8)(word >> 16);
+        p[6] = (RK_U8)(word >> 8);
+        p[7] = (RK_U8)(word);
+
+        ctx->stream += 8;
+        ctx->byte_cnt += 8;
+        return;
+    }
 
-    return;
+    for (i = 56; i >= 0; i -= 8)
+        writer_put_byte(ctx, (RK_U8)(word >> i), ctx->cache_emul);
 }
 
-void mpp_writer_flush(MppWriteCtx *ctx)
+/* write the whole bytes in accumulator and keep the last partial byte */
+static void writer_put_cache(MppWriteCtx *ctx)
 {
-    RK_U32 byte_buffer = ctx->byte_buffer;
-    RK_U8*stream = ctx->stream;
+    RK_S32 bits = ctx->buffered_bits;
 
-    if (mpp_writer_status(ctx))
-        return;
+    while (bits >= 8) {
+        bits -= 8;
+        writer_put_byte(ctx, (RK_U8)(ctx->cache >> bits), ctx->cache_emul);
+    }
 
-    if (ctx->buffered_bits)
-        *stream = (RK_U8)(byte_buffer >> 24);
+    ctx->cache &= (1ULL << bits) - 1;
+    ctx->buffered_bits = bits;
+}
+
+/* bits >= 32 here, fill up the accumulator and write it out */
+static void writer_put_full(MppWriteCtx *ctx, RK_U32 val, RK_S32 len)
+{
+    RK_S32 bits = ctx->buffered_bits;
+    RK_S32 rest = bits + len - 64;
 
-    return;
+    writer_put_word(ctx, (ctx->cache << (64 - bits)) | ((RK_U64)val >> rest));
+    ctx->cache = val & ((1ULL << rest) - 1);
+    ctx->buffered_bits = rest;
 }
 
-void mpp_writer_put_bits(MppWriteCtx * ctx, RK_S32 val, RK_S32 len)
+/*
+ * The bits before switching between raw and emulation prevention mode are
+ * written in the old mode. Same as byte-wise writing the partial byte goes
+ * with the new bits.
+ */
+static void writer_set_emul(MppWriteCtx *ctx, RK_U32 emul)
+{
+    if (ctx->buffered_bits >= 8)
+        writer_put_cache(ctx);
+
+    ctx->cache_emul = emul;
+}
+
+static void writer_put(MppWriteCtx *ctx, RK_U32 val, RK_S32 len, RK_U32 emul)
 {
     RK_S32 bits;
-    RK_U8 *stream = ctx->stream;
-    RK_U32 byte_buffer = ctx->byte_buffer;
 
-    if (val) {
-        mpp_assert(val < (1 << len));
-        mpp_assert(len < 25);
+    if (len <= 0 || len > 32 || ctx->overflow)
+        return;
+
+    val &= 0xffffffffU >> (32 - len);
+
+    if (emul != ctx->cache_emul)
+        writer_set_emul(ctx, emul);
+
+    bits = ctx->buffered_bits + len;
+    if (bits < 64) {
+        ctx->cache = (ctx->cache << len) | val;
+        ctx->buffered_bits = bits;
+        return;
     }
-    bits = len + ctx->buffered_bits;
 
-    byte_buffer = byte_buffer | ((RK_U32) val << (32 - bits));
+    writer_put_full(ctx, val, len);
+}
 
-    while (bits > 7) {
-        RK_S32 zeroBytes = ctx->zero_bytes;
-        RK_S32 byteCnt = ctx->byte_cnt;
+void mpp_writer_put_raw_bits(MppWriteCtx *ctx, RK_S32 val, RK_S32 len)
+{
+    writer_put(ctx, (RK_U32)val, len, 0);
+}
 
-        if (mpp_writer_status(ctx))
-            return;
+void mpp_writer_put_bits(MppWriteCtx * ctx, RK_S32 val, RK_S32 len)
+{
+    writer_put(ctx, (RK_U32)val, len, 1);
+}
 
-        *stream = (RK_U8) (byte_buffer >> 24);
+void mpp_writer_flush(MppWriteCtx *ctx)
+{
+    if (mpp_writer_status(ctx))
+        return;
 
-        byteCnt++;
-        if ((zeroBytes == 2) && (*stream < 4)) {
-            *stream++ = 3;
-            *stream = (RK_U8) (byte_buffer >> 24);
-            byteCnt++;
-            zeroBytes = 0;
-            ctx->emul_cnt++;
-        }
+    writer_put_cache(ctx);
 
-        if (*stream == 0)
-            zeroBytes++;
-        else
-            zeroBytes = 0;
+    if (ctx->buffered_bits && ctx->byte_cnt < ctx->size)
+        *ctx->stream = (RK_U8)(ctx->cache << (8 - ctx->buffered_bits));
+}
 
-        bits -= 8;
-        byte_buffer <<= 8;
-        stream++;
-        ctx->zero_bytes = zeroBytes;
-        ctx->byte_cnt = byteCnt;
-        ctx->stream = stream;
-    }
+void mpp_writer_skip_bits(MppWriteCtx *ctx, RK_S32 len)
+{
+    RK_S32 bits;
+
+    mpp_writer_flush(ctx);
+    mpp_assert(!ctx->buffered_bits);
+
+    ctx->stream += len >> 3;
+    ctx->byte_cnt += len >> 3;
+    ctx->zero_bytes = 0;
+    if (mpp_writer_status(ctx))
+        return;
 
-    ctx->buffered_bits = (RK_U8) bits;
-    ctx->byte_buffer = byte_buffer;
+    /* continue from the partial byte in memory */
+    bits = len & 7;
+    ctx->cache = bits ? (*ctx->stream >> (8 - bits)) : 0;
+    ctx->buffered_bits = bits;
 }
 
 void mpp_writer_align_zero(MppWriteCtx *ctx)
 {
-    if (ctx->buffered_bits)
-        mpp_writer_put_raw_bits(ctx, 0, 8 - ctx->buffered_bits);
+    RK_S32 bits = ctx->buffered_bits & 7;
+
+    if (bits)
+        mpp_writer_put_raw_bits(ctx, 0, 8 - bits);
+
+    mpp_writer_flush(ctx);
 }
 
 void mpp_writer_align_one(MppWriteCtx *ctx)
 {
-    if (ctx->buffered_bits) {
-        RK_S32 len = 8 - ctx->buffered_bits;
+    RK_S32 bits = ctx->buffered_bits & 7;
+
+    if (bits) {
+        RK_S32 len = 8 - bits;
 
         mpp_writer_put_raw_bits(ctx, (1 << len) - 1, len);
     }
+
+    mpp_writer_flush(ctx);
 }
 
 void mpp_writer_trailing(MppWriteCtx *ctx)
 {
+    RK_S32 bits;
+
     mpp_writer_put_bits(ctx, 1, 1);
-    if (ctx->buffered_bits)
-        mpp_writer_put_bits(ctx, 0, 8 - ctx->buffered_bits);
+
+    bits = ctx->buffered_bits & 7;
+    if (bits)
+        mpp_writer_put_bits(ctx, 0, 8 - bits);
+
+    mpp_writer_flush(ctx);
 }
 
 void mpp_writer_put_ue(MppWriteCtx *ctx, RK_U32 val)
 {
-    RK_U32 num_bits = 0;
+    RK_S32 num_bits;
 
     val++;
-    while (val >> ++num_bits);
-
-    if (num_bits > 12) {
-        RK_U32 tmp;
-
-        tmp = num_bits - 1;
-
-        if (tmp > 24) {
-            tmp -= 24;
-            mpp_writer_put_bits(ctx, 0, 24);
-        }
-
-        mpp_writer_put_bits(ctx, 0, tmp);
-
-        if (num_bits > 24) {
-            num_bits -= 24;
-            mpp_writer_put_bits(ctx, val >> num_bits, 24);
-            val = val >> num_bits;
-        }
+    num_bits = val ? 32 - __builtin_clz(val) : 1;
 
+    if (num_bits > 16) {
+        mpp_writer_put_bits(ctx, 0, num_bits - 1);
         mpp_writer_put_bits(ctx, val, num_bits);
     } else {
         mpp_writer_put_bits(ctx, val, 2 * num_bits - 1);
@@ -225,7 +298,7 @@ void mpp_writer_put_se(MppWriteCtx *ctx, RK_S32 val)
 
 RK_S32 mpp_writer_bytes(MppWriteCtx *ctx)
 {
-    return ctx->byte_cnt + (ctx->buffered_bits > 0);
+    return ctx->byte_cnt + ((ctx->buffered_bits + 7) >> 3);
 }
 
 RK_S32 mpp_writer_bits(MppWriteCtx *ctx)
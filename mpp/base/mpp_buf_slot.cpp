@@ -22,6 +22,7 @@
 #include "mpp_mem.h"
 #include "mpp_env.h"
 #include "mpp_list.h"
+#include "mpp_atomic.h"
 #include "mpp_common.h"
 
 #include "mpp_frame_impl.h"
@@ -55,6 +56,7 @@ static RK_U32 buf_slot_idx = 0;
 typedef struct MppBufSlotEntry_t MppBufSlotEntry;
 typedef struct MppBufSlotsImpl_t MppBufSlotsImpl;
 
+/* operation history ring size, must be power of 2 */
 #define SLOT_OPS_MAX_COUNT              1024
 
 typedef enum MppBufSlotOps_e {
@@ -167,10 +169,17 @@ typedef union SlotStatus_u {
         RK_U32  eos         : 1;        // buffer slot is last buffer slot from codec
         RK_U32  has_buffer  : 1;
         RK_U32  has_frame   : 1;
+
+        // unused slot is claimed by one thread to release frame and buffer
+        RK_U32  releasing   : 1;
     };
 } SlotStatus;
 
+#define SLOT_IS_UNUSED(s)   ((s).on_used && !(s).not_ready && !(s).codec_use && \
+                             !(s).hal_output && !(s).hal_use && !(s).queue_use)
+
 typedef struct MppBufSlotLog_t {
+    RK_U32              seq;            // history position + 1, 0 on writing
     RK_S32              index;
     MppBufSlotOps       ops;
     SlotStatus          status_in;
@@ -188,6 +197,13 @@ struct MppBufSlotEntry_t {
     MppBuffer           buffer;
 };
 
+/*
+ * Slot status word is updated by compare and swap so the flag operations
+ * from parser, hal and output thread do not take the lock. The lock only
+ * protects the queues, the slot properties and the info change setup.
+ *
+ * NOTE: slot array is only resized on setup / ready when no slot is in use.
+ */
 struct MppBufSlotsImpl_t {
     Mutex               *lock;
     RK_U32              slots_idx;
@@ -226,8 +242,10 @@ struct MppBufSlotsImpl_t {
     // list for display
     struct list_head    queue[QUEUE_BUTT];
 
-    // list for log
-    mpp_list            *logs;
+    // lock-free ring for operation history
+    MppBufSlotLog       *logs;
+    RK_U32              log_wr;
+    RK_U32              log_rd;
 
     MppBufSlotEntry     *slots;
 };
@@ -293,21 +311,34 @@ static void _dump_slots(const char *caller, MppBufSlotsImpl *impl)
     mpp_log("display count %d\n", impl->display_count);
 
     for (i = 0; i < impl->buf_count; i++, slot++) {
-        SlotStatus status = slot->status;
+        SlotStatus status;
+
+        status.val = MPP_LOAD_ACQUIRE(&slot->status.val);
         mpp_log("slot %2d used %d refer %d decoding %d display %d status %08x\n",
                 i, status.on_used, status.codec_use, status.hal_use, status.queue_use, status.val);
     }
 
     mpp_log("\nslot operation history:\n\n");
 
-    mpp_list *logs = impl->logs;
-    if (logs) {
-        while (logs->list_size()) {
-            MppBufSlotLog log;
-            logs->del_at_head(&log, sizeof(log));
+    if (impl->logs) {
+        RK_U32 end = MPP_LOAD_ACQUIRE(&impl->log_wr);
+        RK_U32 pos = impl->log_rd;
+
+        if (end - pos > SLOT_OPS_MAX_COUNT)
+            pos = end - SLOT_OPS_MAX_COUNT;
+
+        for (; pos != end; pos++) {
+            MppBufSlotLog *entry = &impl->logs[pos & (SLOT_OPS_MAX_COUNT - 1)];
+            MppBufSlotLog log = *entry;
+
+            /* skip the entry overwritten or being written by other thread */
+            if (log.seq != pos + 1 || MPP_LOAD_ACQUIRE(&entry->seq) != pos + 1)
+                continue;
+
             mpp_log("index %2d op: %s status in %08x out %08x",
                     log.index, op_string[log.ops], log.status_in.val, log.status_out.val);
         }
+        impl->log_rd = end;
     }
 
     mpp_assert(0);
@@ -315,27 +346,29 @@ static void _dump_slots(const char *caller, MppBufSlotsImpl *impl)
     return;
 }
 
-static void add_slot_log(mpp_list *logs, RK_S32 index, MppBufSlotOps op, SlotStatus before, SlotStatus after)
+static void add_slot_log(MppBufSlotsImpl *impl, RK_S32 index, MppBufSlotOps op, SlotStatus before, SlotStatus after)
 {
+    MppBufSlotLog *logs = impl->logs;
+
     if (logs) {
-        MppBufSlotLog log = {
-            index,
-            op,
-            before,
-            after,
-        };
-        if (logs->list_size() >= SLOT_OPS_MAX_COUNT)
-            logs->del_at_head(NULL, sizeof(log));
-        logs->add_at_tail(&log, sizeof(log));
+        RK_U32 pos = MPP_FETCH_ADD(&impl->log_wr, 1);
+        MppBufSlotLog *log = &logs[pos & (SLOT_OPS_MAX_COUNT - 1)];
+
+        MPP_STORE_RELEASE(&log->seq, 0);
+        log->index = index;
+        log->ops = op;
+        log->status_in = before;
+        log->status_out = after;
+        MPP_STORE_RELEASE(&log->seq, pos + 1);
     }
 }
 
-static void slot_ops_with_log(MppBufSlotsImpl *impl, MppBufSlotEntry *slot, MppBufSlotOps op, void *arg)
+/* apply operation on status value, return 1 on invalid operation */
+static RK_U32 slot_status_update(SlotStatus *p, MppBufSlotOps op, void *arg)
 {
     RK_U32 error = 0;
-    RK_S32 index = slot->index;
-    SlotStatus status = slot->status;
-    SlotStatus before = status;
+    SlotStatus status = *p;
+
     switch (op) {
     case SLOT_INIT : {
         status.val = 0;
@@ -345,6 +378,7 @@ static void slot_ops_with_log(MppBufSlotsImpl *impl, MppBufSlotEntry *slot, MppB
     } break;
     case SLOT_CLR_ON_USE : {
         status.on_used = 0;
+        status.releasing = 0;
     } break;
     case SLOT_SET_NOT_READY : {
         status.not_ready = 1;
@@ -370,10 +404,8 @@ static void slot_ops_with_log(MppBufSlotsImpl *impl, MppBufSlotEntry *slot, MppB
     case SLOT_CLR_HAL_INPUT : {
         if (status.hal_use)
             status.hal_use--;
-        else {
-            mpp_err("can not clr hal_input on slot %d\n", slot->index);
+        else
             error = 1;
-        }
     } break;
     case SLOT_SET_HAL_OUTPUT : {
         status.hal_output = 1;
@@ -398,17 +430,14 @@ static void slot_ops_with_log(MppBufSlotsImpl *impl, MppBufSlotEntry *slot, MppB
     case SLOT_DEQUEUE_CONVERT : {
         if (status.queue_use)
             status.queue_use--;
-        else {
-            mpp_err("can not clr queue_use on slot %d\n", slot->index);
+        else
             error = 1;
-        }
     } break;
     case SLOT_SET_EOS : {
         status.eos = 1;
     } break;
     case SLOT_CLR_EOS : {
         status.eos = 0;
-        slot->eos = 0;
     } break;
     case SLOT_SET_FRAME : {
         status.has_frame = (arg) ? (1) : (0);
@@ -423,16 +452,37 @@ static void slot_ops_with_log(MppBufSlotsImpl *impl, MppBufSlotEntry *slot, MppB
         status.has_buffer = 0;
     } break;
     default : {
-        mpp_err("found invalid operation code %d\n", op);
         error = 1;
     } break;
     }
-    slot->status = status;
+
+    *p = status;
+    return error;
+}
+
+static void slot_ops_with_log(MppBufSlotsImpl *impl, MppBufSlotEntry *slot, MppBufSlotOps op, void *arg)
+{
+    RK_U32 error = 0;
+    RK_S32 index = slot->index;
+    SlotStatus status;
+    SlotStatus before;
+
+    do {
+        before.val = MPP_LOAD_ACQUIRE(&slot->status.val);
+        status = before;
+        error = slot_status_update(&status, op, arg);
+    } while (!MPP_BOOL_CAS(&slot->status.val, before.val, status.val));
+
+    if (op == SLOT_CLR_EOS)
+        slot->eos = 0;
+
     buf_slot_dbg(BUF_SLOT_DBG_OPS_RUNTIME, "slot %3d index %2d op: %s arg %010p status in %08x out %08x",
                  impl->slots_idx, index, op_string[op], arg, before.val, status.val);
-    add_slot_log(impl->logs, index, op, before, status);
-    if (error)
+    add_slot_log(impl, index, op, before, status);
+    if (error) {
+        mpp_err("found invalid operation %s on slot %d\n", op_string[op], index);
         dump_slots(impl);
+    }
 }
 
 static void init_slot_entry(MppBufSlotsImpl *impl, RK_S32 pos, RK_S32 count)
@@ -455,27 +505,35 @@ static void init_slot_entry(MppBufSlotsImpl *impl, RK_S32 pos, RK_S32 count)
  */
 static void check_entry_unused(MppBufSlotsImpl *impl, MppBufSlotEntry *entry)
 {
-    SlotStatus status = entry->status;
-
-    if (status.on_used &&
-        !status.not_ready &&
-        !status.codec_use &&
-        !status.hal_output &&
-        !status.hal_use &&
-        !status.queue_use) {
-        if (entry->frame) {
-            slot_ops_with_log(impl, entry, SLOT_CLR_FRAME, entry->frame);
-            mpp_frame_deinit(&entry->frame);
-        }
-        if (entry->buffer) {
-            mpp_buffer_put(entry->buffer);
-            slot_ops_with_log(impl, entry, SLOT_CLR_BUFFER, entry->buffer);
-            entry->buffer = NULL;
-        }
+    SlotStatus status;
+    SlotStatus claim;
+
+    /* flags may be cleared by several threads, only one of them does release */
+    do {
+        status.val = MPP_LOAD_ACQUIRE(&entry->status.val);
+        if (!SLOT_IS_UNUSED(status) || status.releasing)
+            return;
+
+        claim = status;
+        claim.releasing = 1;
+    } while (!MPP_BOOL_CAS(&entry->status.val, status.val, claim.val));
 
-        slot_ops_with_log(impl, entry, SLOT_CLR_ON_USE, NULL);
-        impl->used_count--;
+    if (entry->frame) {
+        slot_ops_with_log(impl, entry, SLOT_CLR_FRAME, entry->frame);
+        mpp_frame_deinit(&entry->frame);
     }
+    if (entry->buffer) {
+        mpp_buffer_put(entry->buffer);
+        slot_ops_with_log(impl, entry, SLOT_CLR_BUFFER, entry->buffer);
+        entry->buffer = NULL;
+    }
+
+    /*
+     * decrease used_count before the slot is visible as unused, otherwise
+     * get_unused may take it and increase used_count above buf_count
+     */
+    MPP_FETCH_SUB(&impl->used_count, 1);
+    slot_ops_with_log(impl, entry, SLOT_CLR_ON_USE, NULL);
 }
 
 static void clear_slots_impl(MppBufSlotsImpl *impl)
@@ -506,8 +564,7 @@ static void clear_slots_impl(MppBufSlotsImpl *impl)
     if (impl->info_set)
         mpp_frame_deinit(&impl->info_set);
 
-    if (impl->logs)
-        delete impl->logs;
+    MPP_FREE(impl->logs);
 
     if (impl->lock)
         delete impl->lock;
@@ -540,7 +597,7 @@ MPP_RET mpp_buf_slot_init(MppBufSlots *slots)
         }
 
         if (buf_slot_debug & BUF_SLOT_DBG_OPS_HISTORY) {
-            impl->logs = new mpp_list(NULL);
+            impl->logs = mpp_calloc(MppBufSlotLog, SLOT_OPS_MAX_COUNT);
             if (NULL == impl->logs)
                 break;
         }
@@ -639,6 +696,11 @@ MPP_RET mpp_buf_slot_ready(MppBufSlots slots)
 
     // ready mean the info_set will be copy to info as the new configuration
     if (impl->buf_count != impl->new_count) {
+        /*
+         * set / clr flag access slots without lock so resize is only allowed
+         * when all slots are released
+         */
+        slot_assert(impl, !MPP_LOAD_ACQUIRE(&impl->used_count));
         mpp_realloc(impl->slots, MppBufSlotEntry, impl->new_count);
         init_slot_entry(impl, 0, impl->new_count);
     }
@@ -647,11 +709,7 @@ MPP_RET mpp_buf_slot_ready(MppBufSlots slots)
     mpp_frame_copy(impl->info, impl->info_set);
     impl->buf_size = mpp_frame_get_buf_size(impl->info);
 
-    if (impl->logs) {
-        mpp_list *logs = impl->logs;
-        while (logs->list_size())
-            logs->del_at_head(NULL, sizeof(MppBufSlotLog));
-    }
+    impl->log_rd = MPP_LOAD_ACQUIRE(&impl->log_wr);
     impl->info_changed  = 0;
     return MPP_OK;
 }
@@ -678,16 +736,27 @@ MPP_RET mpp_buf_slot_get_unused(MppBufSlots slots, RK_S32 *index)
     MppBufSlotsImpl *impl = (MppBufSlotsImpl *)slots;
     AutoMutex auto_lock(impl->lock);
     RK_S32 i;
-    MppBufSlotEntry *slot = impl->slots;
-    for (i = 0; i < impl->buf_count; i++, slot++) {
-        if (!slot->status.on_used) {
-            *index = i;
-            slot_ops_with_log(impl, slot, SLOT_SET_ON_USE, NULL);
-            slot_ops_with_log(impl, slot, SLOT_SET_NOT_READY, NULL);
-            impl->used_count++;
-            return MPP_OK;
+
+    /*
+     * used_count is decreased just before the slot is cleared on release.
+     * So rescan when used_count shows a slot is being released.
+     */
+    do {
+        MppBufSlotEntry *slot = impl->slots;
+
+        for (i = 0; i < impl->buf_count; i++, slot++) {
+            SlotStatus status;
+
+            status.val = MPP_LOAD_ACQUIRE(&slot->status.val);
+            if (!status.on_used) {
+                *index = i;
+                slot_ops_with_log(impl, slot, SLOT_SET_ON_USE, NULL);
+                slot_ops_with_log(impl, slot, SLOT_SET_NOT_READY, NULL);
+                MPP_FETCH_ADD(&impl->used_count, 1);
+                return MPP_OK;
+            }
         }
-    }
+    } while (MPP_LOAD_ACQUIRE(&impl->used_count) < impl->buf_count);
 
     *index = -1;
     mpp_err_f("failed to get a unused slot\n");
@@ -704,7 +773,6 @@ MPP_RET mpp_buf_slot_set_flag(MppBufSlots slots, RK_S32 index, SlotUsageType typ
     }
 
     MppBufSlotsImpl *impl = (MppBufSlotsImpl *)slots;
-    AutoMutex auto_lock(impl->lock);
     slot_assert(impl, (index >= 0) && (index < impl->buf_count));
     slot_ops_with_log(impl, &impl->slots[index], set_flag_op[type], NULL);
     return MPP_OK;
@@ -718,13 +786,12 @@ MPP_RET mpp_buf_slot_clr_flag(MppBufSlots slots, RK_S32 index, SlotUsageType typ
     }
 
     MppBufSlotsImpl *impl = (MppBufSlotsImpl *)slots;
-    AutoMutex auto_lock(impl->lock);
     slot_assert(impl, (index >= 0) && (index < impl->buf_count));
     MppBufSlotEntry *slot = &impl->slots[index];
     slot_ops_with_log(impl, slot, clr_flag_op[type], NULL);
 
     if (type == SLOT_HAL_OUTPUT)
-        impl->decode_count++;
+        MPP_FETCH_ADD(&impl->decode_count, 1);
 
     check_entry_unused(impl, slot);
     return MPP_OK;
@@ -762,7 +829,10 @@ MPP_RET mpp_buf_slot_dequeue(MppBufSlots slots, RK_S32 *index, SlotQueueType typ
         return MPP_NOK;
 
     MppBufSlotEntry *slot = list_entry(impl->queue[type].next, MppBufSlotEntry, list);
-    if (slot->status.not_ready)
+    SlotStatus status;
+
+    status.val = MPP_LOAD_ACQUIRE(&slot->status.val);
+    if (status.not_ready)
         return MPP_NOK;
 
     // make sure that this slot is just the next display slot
@@ -923,11 +993,17 @@ MPP_RET mpp_buf_slot_reset(MppBufSlots slots, RK_S32 index)
     AutoMutex auto_lock(impl->lock);
     slot_assert(impl, (index >= 0) && (index < impl->buf_count));
     MppBufSlotEntry *slot = &impl->slots[index];
+    SlotStatus status;
 
     // make sure that this slot is just the next display slot
     list_del_init(&slot->list);
     slot_ops_with_log(impl, slot, SLOT_CLR_QUEUE_USE, NULL);
     slot_ops_with_log(impl, slot, SLOT_DEQUEUE, NULL);
+
+    /* keep used_count matched for the slot resize check on ready */
+    status.val = MPP_LOAD_ACQUIRE(&slot->status.val);
+    if (status.on_used)
+        MPP_FETCH_SUB(&impl->used_count, 1);
     slot_ops_with_log(impl, slot, SLOT_CLR_ON_USE, NULL);
     return MPP_OK;
 }
@@ -980,8 +1056,7 @@ RK_S32 mpp_slots_get_used_count(MppBufSlots slots)
         return 0;
     }
     MppBufSlotsImpl *impl = (MppBufSlotsImpl *)slots;
-    AutoMutex auto_lock(impl->lock);
-    return impl->used_count;
+    return MPP_LOAD_ACQUIRE(&impl->used_count);
 }
 
 RK_S32 mpp_slots_get_unused_count(MppBufSlots slots)
@@ -992,9 +1067,10 @@ RK_S32 mpp_slots_get_unused_count(MppBufSlots slots)
     }
 
     MppBufSlotsImpl *impl = (MppBufSlotsImpl *)slots;
-    AutoMutex auto_lock(impl->lock);
-    slot_assert(impl, (impl->used_count >= 0) && (impl->used_count <= impl->buf_count));
-    return impl->buf_count - impl->used_count;
+    RK_S32 used_count = MPP_LOAD_ACQUIRE(&impl->used_count);
+
+    slot_assert(impl, (used_count >= 0) && (used_count <= impl->buf_count));
+    return impl->buf_count - used_count;
 }
 
 MPP_RET mpp_slots_set_prop(MppBufSlots slots, SlotsPropType type, void *val)
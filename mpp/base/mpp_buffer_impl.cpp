@@ -21,12 +21,14 @@
 #include "mpp_log.h"
 #include "mpp_mem.h"
 #include "mpp_env.h"
+#include "mpp_atomic.h"
 
 #include "mpp_buffer_impl.h"
 
 #define BUFFER_OPS_MAX_COUNT            1024
 
-#define SEARCH_GROUP_BY_ID(id)  ((MppBufferService::get_instance())->get_group_by_id(id))
+#define GROUP_LOCK(group)       pthread_mutex_lock(&(group)->buf_lock)
+#define GROUP_UNLOCK(group)     pthread_mutex_unlock(&(group)->buf_lock)
 
 typedef MPP_RET (*BufferOp)(MppAllocator allocator, MppBufferInfo *data);
 
@@ -57,6 +59,13 @@ typedef struct MppBufLog_t {
     const char          *caller;
 } MppBufLog;
 
+/*
+ * NOTE: MppBufferService lock only protects group create / destroy and the
+ * group list. Buffer list and counter in group is protected by group buf_lock
+ * and buffer ref_count is updated by atomic operation.
+ *
+ * lock order: service lock -> group buf_lock
+ */
 // use this class only need it to init legacy group before main
 class MppBufferService
 {
@@ -151,6 +160,8 @@ static void buffer_group_add_log(MppBufferGroupImpl *group,
     if (group->log_history_en) {
         struct list_head *logs = &group->list_logs;
         MppBufLog *log = mpp_malloc(MppBufLog, 1);
+
+        GROUP_LOCK(group);
         if (log) {
             INIT_LIST_HEAD(&log->list);
             log->group_id   = group->group_id;
@@ -168,6 +179,7 @@ static void buffer_group_add_log(MppBufferGroupImpl *group,
             list_add_tail(&log->list, logs);
             group->log_count++;
         }
+        GROUP_UNLOCK(group);
     }
 }
 
@@ -193,15 +205,22 @@ static void buffer_group_dump_log(MppBufferGroupImpl *group)
     }
 }
 
-static MPP_RET deinit_buffer_no_lock(MppBufferImpl *buffer, const char *caller)
+/*
+ * NOTE: caller should hold the group buf_lock
+ * return 1 when the buffer is the last one of an orphan group and the group
+ * should be released by caller after buf_lock is released.
+ */
+static RK_U32 deinit_buffer_no_lock(MppBufferImpl *buffer, const char *caller)
 {
+    RK_U32 release_group = 0;
+
     if (!MppBufferService::get_instance()->is_finalizing()) {
         mpp_assert(buffer->ref_count == 0);
         mpp_assert(buffer->used == 0);
     }
 
     list_del_init(&buffer->list_status);
-    MppBufferGroupImpl *group = SEARCH_GROUP_BY_ID(buffer->group_id);
+    MppBufferGroupImpl *group = buffer->group;
     if (group) {
         BufferOp func = (group->mode == MPP_BUFFER_INTERNAL) ?
                         (group->alloc_api->free) :
@@ -212,38 +231,44 @@ static MPP_RET deinit_buffer_no_lock(MppBufferImpl *buffer, const char *caller)
 
         buffer_group_add_log(group, buffer, BUF_DESTROY, caller);
 
-        if (group->is_orphan && !group->usage) {
-            MppBufferService::get_instance()->put_group(group);
-        }
+        if (group->is_orphan && !group->usage)
+            release_group = 1;
     } else {
         mpp_assert(MppBufferService::get_instance()->is_finalizing());
     }
 
     mpp_free(buffer);
 
-    return MPP_OK;
+    return release_group;
 }
 
-static MPP_RET inc_buffer_ref_no_lock(MppBufferImpl *buffer, const char *caller)
+static MPP_RET inc_buffer_ref(MppBufferImpl *buffer, const char *caller)
 {
     MPP_RET ret = MPP_OK;
-    MppBufferGroupImpl *group = SEARCH_GROUP_BY_ID(buffer->group_id);
-    if (!buffer->used) {
-        // NOTE: when increasing ref_count the unused buffer must be under certain group
-        mpp_assert(group);
-        buffer->used = 1;
-        if (group) {
+    MppBufferGroupImpl *group = buffer->group;
+
+    buffer_group_add_log(group, buffer, BUF_REF_INC, caller);
+
+    // fast path: buffer is already on used list and only counter is changed
+    if (MPP_FETCH_ADD(&buffer->ref_count, 1) > 0)
+        return ret;
+
+    // NOTE: when increasing ref_count the unused buffer must be under certain group
+    mpp_assert(group);
+    if (group) {
+        GROUP_LOCK(group);
+        if (!buffer->used) {
+            buffer->used = 1;
             list_del_init(&buffer->list_status);
             list_add_tail(&buffer->list_status, &group->list_used);
             group->count_used++;
             group->count_unused--;
-        } else {
-            mpp_err_f("unused buffer without group\n");
-            ret = MPP_NOK;
         }
+        GROUP_UNLOCK(group);
+    } else {
+        mpp_err_f("unused buffer without group\n");
+        ret = MPP_NOK;
     }
-    buffer_group_add_log(group, buffer, BUF_REF_INC, caller);
-    buffer->ref_count++;
     return ret;
 }
 
@@ -258,19 +283,22 @@ MPP_RET mpp_buffer_create(const char *tag, const char *caller,
                           MppBufferGroupImpl *group, MppBufferInfo *info,
                           MppBufferImpl **buffer)
 {
-    AutoMutex auto_lock(MppBufferService::get_lock());
     MPP_BUF_FUNCTION_ENTER();
 
     MPP_RET ret = MPP_OK;
     BufferOp func = NULL;
     MppBufferImpl *p = NULL;
+    MppBufCallback callback = NULL;
+    void *arg = NULL;
 
     if (NULL == group) {
         mpp_err_f("can not create buffer without group\n");
-        ret = MPP_NOK;
-        goto RET;
+        MPP_BUF_FUNCTION_LEAVE();
+        return MPP_NOK;
     }
 
+    GROUP_LOCK(group);
+
     if (group->limit_count && group->buffer_count >= group->limit_count) {
         if (group->log_runtime_en)
             mpp_log_f("group %d reach count limit %d\n", group->group_id, group->limit_count);
@@ -310,6 +338,7 @@ MPP_RET mpp_buffer_create(const char *tag, const char *caller,
     strncpy(p->tag, tag, sizeof(p->tag));
     p->caller = caller;
     p->group_id = group->group_id;
+    p->group = group;
     p->buffer_id = group->buffer_id;
     INIT_LIST_HEAD(&p->list_status);
     list_add_tail(&p->list_status, &group->list_unused);
@@ -324,27 +353,37 @@ MPP_RET mpp_buffer_create(const char *tag, const char *caller,
                          caller);
 
     if (buffer) {
-        inc_buffer_ref_no_lock(p, caller);
+        inc_buffer_ref(p, caller);
         *buffer = p;
     }
 
-    if (group->callback)
-        group->callback(group->arg, group);
+    callback = group->callback;
+    arg = group->arg;
 RET:
+    GROUP_UNLOCK(group);
+
+    if (callback)
+        callback(arg, group);
+
     MPP_BUF_FUNCTION_LEAVE();
     return ret;
 }
 
 MPP_RET mpp_buffer_mmap(MppBufferImpl *buffer, const char* caller)
 {
-    AutoMutex auto_lock(MppBufferService::get_lock());
     MPP_BUF_FUNCTION_ENTER();
 
     MPP_RET ret = MPP_NOK;
-    MppBufferGroupImpl *group = SEARCH_GROUP_BY_ID(buffer->group_id);
+    MppBufferGroupImpl *group = buffer->group;
 
     if (group && group->alloc_api && group->alloc_api->mmap) {
-        ret = group->alloc_api->mmap(group->allocator, &buffer->info);
+        GROUP_LOCK(group);
+        // check again for the buffer may be mapped by other thread
+        if (NULL == buffer->info.ptr)
+            ret = group->alloc_api->mmap(group->allocator, &buffer->info);
+        else
+            ret = MPP_OK;
+        GROUP_UNLOCK(group);
 
         buffer_group_add_log(group, buffer, BUF_MMAP, caller);
     }
@@ -359,10 +398,9 @@ MPP_RET mpp_buffer_mmap(MppBufferImpl *buffer, const char* caller)
 
 MPP_RET mpp_buffer_ref_inc(MppBufferImpl *buffer, const char* caller)
 {
-    AutoMutex auto_lock(MppBufferService::get_lock());
     MPP_BUF_FUNCTION_ENTER();
 
-    MPP_RET ret = inc_buffer_ref_no_lock(buffer, caller);
+    MPP_RET ret = inc_buffer_ref(buffer, caller);
 
     MPP_BUF_FUNCTION_LEAVE();
     return ret;
@@ -371,37 +409,57 @@ MPP_RET mpp_buffer_ref_inc(MppBufferImpl *buffer, const char* caller)
 
 MPP_RET mpp_buffer_ref_dec(MppBufferImpl *buffer, const char* caller)
 {
-    AutoMutex auto_lock(MppBufferService::get_lock());
     MPP_BUF_FUNCTION_ENTER();
 
     MPP_RET ret = MPP_OK;
-    MppBufferGroupImpl *group = SEARCH_GROUP_BY_ID(buffer->group_id);
+    MppBufferGroupImpl *group = buffer->group;
+    RK_S32 ref_count;
+
     if (group)
         buffer_group_add_log(group, buffer, BUF_REF_DEC, caller);
 
-    if (buffer->ref_count <= 0) {
+    ref_count = MPP_SUB_FETCH(&buffer->ref_count, 1);
+    if (ref_count < 0) {
+        MPP_FETCH_ADD(&buffer->ref_count, 1);
         mpp_err_f("found non-positive ref_count %d caller %s\n",
-                  buffer->ref_count, buffer->caller);
+                  ref_count + 1, buffer->caller);
         mpp_abort();
         ret = MPP_NOK;
-    } else {
-        buffer->ref_count--;
-        if (0 == buffer->ref_count) {
+    } else if (0 == ref_count && NULL == group) {
+        mpp_err_f("buffer %p found NULL group caller %s\n", buffer, caller);
+        ret = MPP_NOK;
+    } else if (0 == ref_count) {
+        MppBufCallback callback = NULL;
+        void *arg = NULL;
+        RK_U32 release_group = 0;
+
+        GROUP_LOCK(group);
+        // check again under lock for the buffer may be reused by other thread
+        if (0 == buffer->ref_count && buffer->used) {
             buffer->used = 0;
             list_del_init(&buffer->list_status);
+            group->count_used--;
             if (group == MppBufferService::get_instance()->get_misc(group->mode, group->type)) {
-                deinit_buffer_no_lock(buffer, caller);
+                release_group = deinit_buffer_no_lock(buffer, caller);
             } else {
                 if (buffer->discard) {
-                    deinit_buffer_no_lock(buffer, caller);
+                    release_group = deinit_buffer_no_lock(buffer, caller);
                 } else {
                     list_add_tail(&buffer->list_status, &group->list_unused);
                     group->count_unused++;
                 }
             }
-            group->count_used--;
-            if (group->callback)
-                group->callback(group->arg, group);
+            callback = group->callback;
+            arg = group->arg;
+        }
+        GROUP_UNLOCK(group);
+
+        if (release_group) {
+            // the last buffer of orphan group is gone then destroy the group
+            AutoMutex auto_lock(MppBufferService::get_lock());
+            MppBufferService::get_instance()->put_group(group);
+        } else if (callback) {
+            callback(arg, group);
         }
     }
 
@@ -411,11 +469,12 @@ MPP_RET mpp_buffer_ref_dec(MppBufferImpl *buffer, const char* caller)
 
 MppBufferImpl *mpp_buffer_get_unused(MppBufferGroupImpl *p, size_t size)
 {
-    AutoMutex auto_lock(MppBufferService::get_lock());
     MPP_BUF_FUNCTION_ENTER();
 
     MppBufferImpl *buffer = NULL;
 
+    GROUP_LOCK(p);
+
     if (!list_empty(&p->list_unused)) {
         MppBufferImpl *pos, *n;
         RK_S32 found = 0;
@@ -426,7 +485,7 @@ MppBufferImpl *mpp_buffer_get_unused(MppBufferGroupImpl *p, size_t size)
                         size, pos->buffer_id, pos->info.size);
             if (pos->info.size >= size) {
                 buffer = pos;
-                inc_buffer_ref_no_lock(buffer, __FUNCTION__);
+                inc_buffer_ref(buffer, __FUNCTION__);
                 found = 1;
                 break;
             } else {
@@ -442,6 +501,8 @@ MppBufferImpl *mpp_buffer_get_unused(MppBufferGroupImpl *p, size_t size)
             mpp_err_f("can not found match buffer with size larger than %d\n", size);
     }
 
+    GROUP_UNLOCK(p);
+
     MPP_BUF_FUNCTION_LEAVE();
     return buffer;
 }
@@ -502,7 +563,6 @@ MPP_RET mpp_buffer_group_deinit(MppBufferGroupImpl *p)
 
 MPP_RET mpp_buffer_group_reset(MppBufferGroupImpl *p)
 {
-    AutoMutex auto_lock(MppBufferService::get_lock());
     if (NULL == p) {
         mpp_err_f("found NULL pointer\n");
         return MPP_ERR_NULL_PTR;
@@ -512,6 +572,8 @@ MPP_RET mpp_buffer_group_reset(MppBufferGroupImpl *p)
 
     buffer_group_add_log(p, NULL, GRP_RESET, NULL);
 
+    GROUP_LOCK(p);
+
     if (!list_empty(&p->list_used)) {
         MppBufferImpl *pos, *n;
         list_for_each_entry_safe(pos, n, &p->list_used, MppBufferImpl, list_status) {
@@ -529,6 +591,8 @@ MPP_RET mpp_buffer_group_reset(MppBufferGroupImpl *p)
         }
     }
 
+    GROUP_UNLOCK(p);
+
     MPP_BUF_FUNCTION_LEAVE();
     return MPP_OK;
 }
@@ -536,7 +600,6 @@ MPP_RET mpp_buffer_group_reset(MppBufferGroupImpl *p)
 MPP_RET mpp_buffer_group_set_callback(MppBufferGroupImpl *p,
                                       MppBufCallback callback, void *arg)
 {
-    AutoMutex auto_lock(MppBufferService::get_lock());
     if (NULL == p) {
         mpp_err_f("found NULL pointer\n");
         return MPP_ERR_NULL_PTR;
@@ -544,8 +607,10 @@ MPP_RET mpp_buffer_group_set_callback(MppBufferGroupImpl *p,
 
     MPP_BUF_FUNCTION_ENTER();
 
+    GROUP_LOCK(p);
     p->callback = callback;
     p->arg      = arg;
+    GROUP_UNLOCK(p);
 
     MPP_BUF_FUNCTION_LEAVE();
     return MPP_OK;
@@ -559,6 +624,8 @@ void mpp_buffer_group_dump(MppBufferGroupImpl *group, const char *caller)
     mpp_log("type %s\n", type2str[group->type]);
     mpp_log("limit size %d count %d\n", group->limit_size, group->limit_count);
 
+    GROUP_LOCK(group);
+
     mpp_log("used buffer count %d\n", group->count_used);
 
     MppBufferImpl *pos, *n;
@@ -572,6 +639,8 @@ void mpp_buffer_group_dump(MppBufferGroupImpl *group, const char *caller)
     }
 
     buffer_group_dump_log(group);
+
+    GROUP_UNLOCK(group);
 }
 
 void mpp_buffer_service_dump()
@@ -686,6 +755,12 @@ MppBufferGroupImpl *MppBufferService::get_group(const char *tag, const char *cal
     INIT_LIST_HEAD(&p->list_used);
     INIT_LIST_HEAD(&p->list_unused);
 
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&p->buf_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
     mpp_env_get_u32("mpp_buffer_debug", &mpp_buffer_debug, 0);
     p->log_runtime_en   = (mpp_buffer_debug & MPP_BUF_DBG_OPS_RUNTIME) ? (1) : (0);
     p->log_history_en   = (mpp_buffer_debug & MPP_BUF_DBG_OPS_HISTORY) ? (1) : (0);
@@ -745,8 +820,12 @@ void MppBufferService::set_misc(MppBufferMode mode, MppBufferType type, MppBuffe
 
 void MppBufferService::put_group(MppBufferGroupImpl *p)
 {
+    RK_U32 destroy = 0;
+
     buffer_group_add_log(p, NULL, GRP_RELEASE, __FUNCTION__);
 
+    GROUP_LOCK(p);
+
     // remove unused list
     if (!list_empty(&p->list_unused)) {
         MppBufferImpl *pos, *n;
@@ -757,7 +836,7 @@ void MppBufferService::put_group(MppBufferGroupImpl *p)
     }
 
     if (list_empty(&p->list_used)) {
-        destroy_group(p);
+        destroy = 1;
     } else {
         if (!finalizing ||
             (finalizing && (mpp_buffer_debug & MPP_BUF_DBG_DUMP_ON_EXIT))) {
@@ -782,7 +861,7 @@ void MppBufferService::put_group(MppBufferGroupImpl *p)
                 p->count_used--;
             }
 
-            destroy_group(p);
+            destroy = 1;
         } else {
             // otherwise move the group to list_orphan and wait for buffer release
             buffer_group_add_log(p, NULL, GRP_ORPHAN, __FUNCTION__);
@@ -791,6 +870,11 @@ void MppBufferService::put_group(MppBufferGroupImpl *p)
             p->is_orphan = 1;
         }
     }
+
+    GROUP_UNLOCK(p);
+
+    if (destroy)
+        destroy_group(p);
 }
 
 void MppBufferService::destroy_group(MppBufferGroupImpl *group)
@@ -823,6 +907,7 @@ void MppBufferService::destroy_group(MppBufferGroupImpl *group)
     mpp_assert(group->allocator);
     mpp_allocator_put(&group->allocator);
     list_del_init(&group->list_group);
+    pthread_mutex_destroy(&group->buf_lock);
     mpp_free(group);
     group_count--;
 
@@ -16,6 +16,8 @@
 
 #define MODULE_TAG "mpp_enc_cfg"
 
+#include <string.h>
+
 #include "rk_venc_cfg.h"
 
 #include "mpp_env.h"
@@ -149,6 +151,8 @@ static const char *cfg_func_names[] = {
     const_strlen( #base":"#name ) +
 
 #define ENTRY_TABLE(ENTRY)  \
+    /* base config */ \
+    ENTRY(base, pipe_depth,     S32, RK_S32,            MPP_ENC_BASE_CFG_CHANGE_PIPE_DEPTH,     base, pipe_depth) \
     /* rc config */ \
     ENTRY(rc,   mode,           S32, MppEncRcMode,      MPP_ENC_RC_CFG_CHANGE_RC_MODE,          rc, rc_mode) \
     ENTRY(rc,   bps_target,     S32, RK_S32,            MPP_ENC_RC_CFG_CHANGE_BPS,              rc, bps_target) \
@@ -322,6 +326,44 @@ MPP_RET mpp_enc_cfg_init(MppEncCfg *cfg)
     return MPP_OK;
 }
 
+MPP_RET mpp_enc_cfg_stage(MppEncCfg cfg, const MppEncCfgSet *curr)
+{
+    if (NULL == cfg || NULL == curr) {
+        mpp_err_f("invalid input cfg %p curr %p\n", cfg, curr);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    MppEncCfgSet *dst = &((MppEncCfgImpl *)cfg)->cfg;
+
+    memcpy(dst, curr, sizeof(*dst));
+
+    dst->base.change = 0;
+    dst->prep.change = 0;
+    dst->rc.change = 0;
+    /* codec change is the first member of all codec config */
+    dst->codec.change = 0;
+    switch (dst->codec.coding) {
+    case MPP_VIDEO_CodingAVC : {
+        dst->codec.h264.vui.change = 0;
+    } break;
+    case MPP_VIDEO_CodingHEVC : {
+        dst->codec.h265.vui.change = 0;
+        dst->codec.h265.sei.change = 0;
+    } break;
+    default : {
+    } break;
+    }
+    dst->split.change = 0;
+    dst->plt_cfg.change = 0;
+
+    dst->ref_cfg = NULL;
+    dst->roi.number = 0;
+    dst->roi.regions = NULL;
+    dst->plt_cfg.plt = NULL;
+
+    return MPP_OK;
+}
+
 MPP_RET mpp_enc_cfg_deinit(MppEncCfg cfg)
 {
     if (NULL == cfg) {
@@ -334,20 +376,34 @@ MPP_RET mpp_enc_cfg_deinit(MppEncCfg cfg)
     return MPP_OK;
 }
 
-#define ENC_CFG_SET_ACCESS(func_name, in_type, func_enum, func_type) \
-    MPP_RET func_name(MppEncCfg cfg, const char *name, in_type val) \
+MPP_RET mpp_enc_cfg_get_key(const char *name, MppEncCfgKey *key)
+{
+    if (NULL == name || NULL == key) {
+        mpp_err_f("invalid input name %p key %p\n", name, key);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    /* name is the first member of MppEncCfgApi */
+    const char **info = mpp_trie_get_info(MppEncCfgService::get()->get_api(), name);
+    if (NULL == info) {
+        mpp_err_f("failed to get key %s\n", name);
+        *key = NULL;
+        return MPP_NOK;
+    }
+
+    *key = (MppEncCfgKey)info;
+    return MPP_OK;
+}
+
+#define ENC_CFG_SET_KEY_ACCESS(func_name, in_type, func_enum, func_type) \
+    MPP_RET func_name(MppEncCfg cfg, MppEncCfgKey key, in_type val) \
     { \
-        if (NULL == cfg || NULL == name) { \
-            mpp_err_f("invalid input cfg %p name %p\n", cfg, name); \
+        if (NULL == cfg || NULL == key) { \
+            mpp_err_f("invalid input cfg %p key %p\n", cfg, key); \
             return MPP_ERR_NULL_PTR; \
         } \
         MppEncCfgImpl *p = (MppEncCfgImpl *)cfg; \
-        const char **info = mpp_trie_get_info(p->api, name); \
-        if (NULL == info) { \
-            mpp_err_f("failed to set %s to %d\n", name, val); \
-            return MPP_NOK; \
-        } \
-        MppEncCfgApi *api = (MppEncCfgApi *)info; \
+        MppEncCfgApi *api = (MppEncCfgApi *)key; \
         if (api->type_set != func_enum) { \
             mpp_err_f("%s expect %s input NOT %s\n", api->name, \
                       cfg_func_names[api->type_set], \
@@ -358,26 +414,21 @@ MPP_RET mpp_enc_cfg_deinit(MppEncCfg cfg)
         return ret; \
     }
 
-ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_s32, RK_S32, SET_S32, CfgSetS32);
-ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_u32, RK_U32, SET_U32, CfgSetU32);
-ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_s64, RK_S64, SET_S64, CfgSetS64);
-ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_u64, RK_U64, SET_U64, CfgSetU64);
-ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_ptr, void *, SET_PTR, CfgSetPtr);
+ENC_CFG_SET_KEY_ACCESS(mpp_enc_cfg_set_s32_by_key, RK_S32, SET_S32, CfgSetS32);
+ENC_CFG_SET_KEY_ACCESS(mpp_enc_cfg_set_u32_by_key, RK_U32, SET_U32, CfgSetU32);
+ENC_CFG_SET_KEY_ACCESS(mpp_enc_cfg_set_s64_by_key, RK_S64, SET_S64, CfgSetS64);
+ENC_CFG_SET_KEY_ACCESS(mpp_enc_cfg_set_u64_by_key, RK_U64, SET_U64, CfgSetU64);
+ENC_CFG_SET_KEY_ACCESS(mpp_enc_cfg_set_ptr_by_key, void *, SET_PTR, CfgSetPtr);
 
-#define ENC_CFG_GET_ACCESS(func_name, in_type, func_enum, func_type) \
-    MPP_RET func_name(MppEncCfg cfg, const char *name, in_type *val) \
+#define ENC_CFG_GET_KEY_ACCESS(func_name, in_type, func_enum, func_type) \
+    MPP_RET func_name(MppEncCfg cfg, MppEncCfgKey key, in_type *val) \
     { \
-        if (NULL == cfg || NULL == name) { \
-            mpp_err_f("invalid input cfg %p name %p\n", cfg, name); \
+        if (NULL == cfg || NULL == key) { \
+            mpp_err_f("invalid input cfg %p key %p\n", cfg, key); \
             return MPP_ERR_NULL_PTR; \
         } \
         MppEncCfgImpl *p = (MppEncCfgImpl *)cfg; \
-        const char **info = mpp_trie_get_info(p->api, name); \
-        if (NULL == info) { \
-            mpp_err_f("failed to set %s to %d\n", name, val); \
-            return MPP_NOK; \
-        } \
-        MppEncCfgApi *api = (MppEncCfgApi *)info; \
+        MppEncCfgApi *api = (MppEncCfgApi *)key; \
         if (api->type_get != func_enum) { \
             mpp_err_f("%s expect %s input not %s\n", api->name, \
                       cfg_func_names[api->type_get], \
@@ -388,11 +439,107 @@ ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_ptr, void *, SET_PTR, CfgSetPtr);
         return ret; \
     }
 
-ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_s32, RK_S32, GET_S32, CfgGetS32);
-ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_u32, RK_U32, GET_U32, CfgGetU32);
-ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_s64, RK_S64, GET_S64, CfgGetS64);
-ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_u64, RK_U64, GET_U64, CfgGetU64);
-ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_ptr, void *, GET_PTR, CfgGetPtr);
+ENC_CFG_GET_KEY_ACCESS(mpp_enc_cfg_get_s32_by_key, RK_S32, GET_S32, CfgGetS32);
+ENC_CFG_GET_KEY_ACCESS(mpp_enc_cfg_get_u32_by_key, RK_U32, GET_U32, CfgGetU32);
+ENC_CFG_GET_KEY_ACCESS(mpp_enc_cfg_get_s64_by_key, RK_S64, GET_S64, CfgGetS64);
+ENC_CFG_GET_KEY_ACCESS(mpp_enc_cfg_get_u64_by_key, RK_U64, GET_U64, CfgGetU64);
+ENC_CFG_GET_KEY_ACCESS(mpp_enc_cfg_get_ptr_by_key, void *, GET_PTR, CfgGetPtr);
+
+#define ENC_CFG_SET_ACCESS(func_name, key_func, in_type) \
+    MPP_RET func_name(MppEncCfg cfg, const char *name, in_type val) \
+    { \
+        if (NULL == cfg || NULL == name) { \
+            mpp_err_f("invalid input cfg %p name %p\n", cfg, name); \
+            return MPP_ERR_NULL_PTR; \
+        } \
+        MppEncCfgImpl *p = (MppEncCfgImpl *)cfg; \
+        const char **info = mpp_trie_get_info(p->api, name); \
+        if (NULL == info) { \
+            mpp_err_f("failed to set %s to %d\n", name, val); \
+            return MPP_NOK; \
+        } \
+        return key_func(cfg, (MppEncCfgKey)info, val); \
+    }
+
+ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_s32, mpp_enc_cfg_set_s32_by_key, RK_S32);
+ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_u32, mpp_enc_cfg_set_u32_by_key, RK_U32);
+ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_s64, mpp_enc_cfg_set_s64_by_key, RK_S64);
+ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_u64, mpp_enc_cfg_set_u64_by_key, RK_U64);
+ENC_CFG_SET_ACCESS(mpp_enc_cfg_set_ptr, mpp_enc_cfg_set_ptr_by_key, void *);
+
+#define ENC_CFG_GET_ACCESS(func_name, key_func, in_type) \
+    MPP_RET func_name(MppEncCfg cfg, const char *name, in_type *val) \
+    { \
+        if (NULL == cfg || NULL == name) { \
+            mpp_err_f("invalid input cfg %p name %p\n", cfg, name); \
+            return MPP_ERR_NULL_PTR; \
+        } \
+        MppEncCfgImpl *p = (MppEncCfgImpl *)cfg; \
+        const char **info = mpp_trie_get_info(p->api, name); \
+        if (NULL == info) { \
+            mpp_err_f("failed to set %s to %d\n", name, val); \
+            return MPP_NOK; \
+        } \
+        return key_func(cfg, (MppEncCfgKey)info, val); \
+    }
+
+ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_s32, mpp_enc_cfg_get_s32_by_key, RK_S32);
+ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_u32, mpp_enc_cfg_get_u32_by_key, RK_U32);
+ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_s64, mpp_enc_cfg_get_s64_by_key, RK_S64);
+ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_u64, mpp_enc_cfg_get_u64_by_key, RK_U64);
+ENC_CFG_GET_ACCESS(mpp_enc_cfg_get_ptr, mpp_enc_cfg_get_ptr_by_key, void *);
+
+MPP_RET mpp_enc_cfg_set_kv(MppEncCfg cfg, MppEncCfgKv *kv, RK_S32 count)
+{
+    if (NULL == cfg || (NULL == kv && count)) {
+        mpp_err_f("invalid input cfg %p kv %p count %d\n", cfg, kv, count);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    MppEncCfgImpl *p = (MppEncCfgImpl *)cfg;
+    MPP_RET ret = MPP_OK;
+    RK_S32 i;
+
+    for (i = 0; i < count; i++) {
+        MppEncCfgApi *api = (MppEncCfgApi *)kv[i].key;
+        MppEncCfgVal *val = &kv[i].val;
+        MPP_RET set_ret = MPP_NOK;
+
+        if (NULL == api) {
+            mpp_err_f("invalid NULL key at %d\n", i);
+            ret = MPP_NOK;
+            continue;
+        }
+
+        mpp_enc_cfg_dbg_set("name %s type %s\n", api->name, cfg_func_names[api->type_set]);
+
+        switch (api->type_set) {
+        case SET_S32 : {
+            set_ret = ((CfgSetS32)api->api_set)(&p->cfg, val->s32);
+        } break;
+        case SET_U32 : {
+            set_ret = ((CfgSetU32)api->api_set)(&p->cfg, val->u32);
+        } break;
+        case SET_S64 : {
+            set_ret = ((CfgSetS64)api->api_set)(&p->cfg, val->s64);
+        } break;
+        case SET_U64 : {
+            set_ret = ((CfgSetU64)api->api_set)(&p->cfg, val->u64);
+        } break;
+        case SET_PTR : {
+            set_ret = ((CfgSetPtr)api->api_set)(&p->cfg, val->ptr);
+        } break;
+        default : {
+            mpp_err_f("%s invalid set type %d\n", api->name, api->type_set);
+        } break;
+        }
+
+        if (set_ret)
+            ret = set_ret;
+    }
+
+    return ret;
+}
 
 void mpp_enc_cfg_show(void)
 {
@@ -18,11 +18,23 @@
 
 #include <string.h>
 
+#include "mpp_env.h"
 #include "mpp_mem.h"
 #include "mpp_list.h"
+#include "mpp_atomic.h"
 
 #include "mpp_meta_impl.h"
 
+#define MPP_META_DBG_FLOW               (0x00000001)
+#define MPP_META_DBG_STATS              (0x00000010)
+
+#define meta_dbg(flag, fmt, ...)        _mpp_dbg(mpp_meta_debug, flag, fmt, ## __VA_ARGS__)
+
+/* max recycled meta count kept in meta pool */
+#define META_POOL_MAX                   256
+
+static RK_U32 mpp_meta_debug = 0;
+
 static MppMetaDef meta_defs[] = {
     /* categorized by type */
     /* data flow type */
@@ -44,6 +56,7 @@ static MppMetaDef meta_defs[] = {
     {   KEY_LONG_REF_IDX,       TYPE_S32,       },
 
     {   KEY_ROI_DATA,           TYPE_PTR,       },
+    {   KEY_QP_MAP_DATA,        TYPE_PTR,       },
     {   KEY_OSD_DATA,           TYPE_PTR,       },
     {   KEY_USER_DATA,          TYPE_PTR,       },
     {   KEY_MV_LIST,            TYPE_PTR,       },
@@ -63,12 +76,15 @@ private:
     MppMetaService(const MppMetaService &);
     MppMetaService &operator=(const MppMetaService &);
 
-    struct list_head    mlist_meta;
-    struct list_head    mlist_node;
+    // recycled meta for reuse
+    struct list_head    mlist_free;
 
     RK_U32              meta_id;
     RK_U32              meta_count;
-    RK_U32              node_count;
+    RK_U32              free_count;
+    // statistic of meta malloc and reuse
+    RK_U32              alloc_count;
+    RK_U32              reuse_count;
 
 public:
     static MppMetaService *get_instance() {
@@ -90,42 +106,35 @@ public:
 
     MppMetaImpl  *get_meta(const char *tag, const char *caller);
     void          put_meta(MppMetaImpl *meta);
-    void          inc_ref(MppMetaImpl *meta);
-
-    MppMetaNode  *get_node(MppMetaImpl *meta, RK_S32 index);
-    void          put_node(MppMetaNode *node);
-    MppMetaNode  *find_node(MppMetaImpl *meta, RK_S32 index);
-    MppMetaNode  *next_node(MppMetaImpl *meta);
 };
 
 MppMetaService::MppMetaService()
     : meta_id(0),
       meta_count(0),
-      node_count(0)
+      free_count(0),
+      alloc_count(0),
+      reuse_count(0)
 {
-    INIT_LIST_HEAD(&mlist_meta);
-    INIT_LIST_HEAD(&mlist_node);
+    mpp_env_get_u32("mpp_meta_debug", &mpp_meta_debug, 0);
+    // key index must fit in node_mask
+    mpp_assert(MPP_ARRAY_ELEMS(meta_defs) <= META_KEY_MAX);
+
+    INIT_LIST_HEAD(&mlist_free);
 }
 
 MppMetaService::~MppMetaService()
 {
-    mpp_assert(list_empty(&mlist_meta));
-    mpp_assert(list_empty(&mlist_node));
+    mpp_assert(meta_count == 0);
 
-    while (!list_empty(&mlist_meta)) {
-        MppMetaImpl *pos, *n;
-        list_for_each_entry_safe(pos, n, &mlist_meta, MppMetaImpl, list_meta) {
-            put_meta(pos);
-        }
-    }
+    meta_dbg(MPP_META_DBG_STATS, "meta alloc %d reuse %d leak %d\n",
+             alloc_count, reuse_count, meta_count);
 
-    mpp_assert(list_empty(&mlist_node));
+    while (!list_empty(&mlist_free)) {
+        MppMetaImpl *impl = list_entry(mlist_free.next, MppMetaImpl, list_meta);
 
-    while (!list_empty(&mlist_node)) {
-        MppMetaNode *pos, *n;
-        list_for_each_entry_safe(pos, n, &mlist_node, MppMetaNode, list_node) {
-            put_node(pos);
-        }
+        list_del_init(&impl->list_meta);
+        mpp_free(impl);
+        free_count--;
     }
 }
 
@@ -144,128 +153,51 @@ RK_S32 MppMetaService::get_index_of_key(MppMetaKey key, MppMetaType type)
 
 MppMetaImpl *MppMetaService::get_meta(const char *tag, const char *caller)
 {
-    MppMetaImpl *impl = mpp_malloc(MppMetaImpl, 1);
-    if (impl) {
-        const char *tag_src = (tag) ? (tag) : (MODULE_TAG);
-        strncpy(impl->tag, tag_src, sizeof(impl->tag));
-        impl->caller = caller;
-        impl->meta_id = meta_id++;
-        INIT_LIST_HEAD(&impl->list_meta);
-        INIT_LIST_HEAD(&impl->list_node);
-        impl->ref_count = 1;
-        impl->node_count = 0;
+    MppMetaImpl *impl = NULL;
 
-        list_add_tail(&impl->list_meta, &mlist_meta);
-        meta_count++;
+    if (!list_empty(&mlist_free)) {
+        impl = list_entry(mlist_free.next, MppMetaImpl, list_meta);
+        list_del_init(&impl->list_meta);
+        free_count--;
+        reuse_count++;
     } else {
-        mpp_err_f("failed to malloc meta data\n");
-    }
-    return impl;
-}
-
-void MppMetaService::put_meta(MppMetaImpl *meta)
-{
-    mpp_assert(meta->ref_count);
-    if (meta->ref_count)
-        meta->ref_count--;
-
-    if (meta->ref_count)
-        return;
-
-    while (!list_empty(&meta->list_node)) {
-        MppMetaNode *node = list_entry(meta->list_node.next, MppMetaNode, list_meta);
-        put_node(node);
-    }
-    mpp_assert(meta->node_count == 0);
-    list_del_init(&meta->list_meta);
-    meta_count--;
-    mpp_free(meta);
-}
-
-void MppMetaService::inc_ref(MppMetaImpl *meta)
-{
-    mpp_assert(meta->ref_count);
-    meta->ref_count++;
-}
-
-MppMetaNode *MppMetaService::find_node(MppMetaImpl *meta, RK_S32 type_id)
-{
-    MppMetaNode *node = NULL;
-    if (meta->node_count) {
-        MppMetaNode *n, *pos;
-
-        list_for_each_entry_safe(pos, n, &meta->list_node, MppMetaNode, list_meta) {
-            if (pos->type_id == type_id) {
-                node = pos;
-                break;
-            }
+        impl = mpp_malloc(MppMetaImpl, 1);
+        if (NULL == impl) {
+            mpp_err_f("failed to malloc meta data\n");
+            return NULL;
         }
+        INIT_LIST_HEAD(&impl->list_meta);
+        alloc_count++;
     }
-    return node;
-}
 
-MppMetaNode *MppMetaService::next_node(MppMetaImpl *meta)
-{
-    MppMetaNode *node = NULL;
-    if (meta->node_count) {
-        node = list_entry(meta->list_node.next, MppMetaNode, list_meta);
-
-        list_del_init(&node->list_meta);
-        list_del_init(&node->list_node);
-        meta->node_count--;
-        node_count--;
-    }
-    return node;
-}
+    const char *tag_src = (tag) ? (tag) : (MODULE_TAG);
+    strncpy(impl->tag, tag_src, sizeof(impl->tag));
+    impl->caller = caller;
+    impl->meta_id = meta_id++;
+    impl->ref_count = 1;
+    impl->node_mask = 0;
+    meta_count++;
 
-MppMetaNode *MppMetaService::get_node(MppMetaImpl *meta, RK_S32 type_id)
-{
-    MppMetaNode *node = find_node(meta, type_id);
-
-    if (NULL == node) {
-        node = mpp_malloc(MppMetaNode, 1);
-        if (node) {
-            INIT_LIST_HEAD(&node->list_meta);
-            INIT_LIST_HEAD(&node->list_node);
-            node->meta = meta;
-            node->node_id = meta->meta_id++;
-            node->type_id = type_id;
-            memset(&node->val, 0, sizeof(node->val));
-
-            meta->node_count++;
-            list_add_tail(&node->list_meta, &meta->list_node);
-            list_add_tail(&node->list_node, &mlist_node);
-            node_count++;
-        } else {
-            mpp_err_f("failed to malloc meta data node\n");
-        }
-    }
+    meta_dbg(MPP_META_DBG_FLOW, "meta %d get from %s\n", impl->meta_id, caller);
 
-    return node;
+    return impl;
 }
 
-void MppMetaService::put_node(MppMetaNode *node)
+void MppMetaService::put_meta(MppMetaImpl *meta)
 {
-    MppMetaImpl *meta = node->meta;
-    list_del_init(&node->list_meta);
-    list_del_init(&node->list_node);
-    meta->node_count--;
-    node_count--;
+    meta_dbg(MPP_META_DBG_FLOW, "meta %d put with mask %08x\n",
+             meta->meta_id, meta->node_mask);
+
     // TODO: may be we need to release MppFrame / MppPacket / MppBuffer here
-    switch (meta_defs[node->type_id].type) {
-    case TYPE_FRAME : {
-        // mpp_frame_deinit(&node->val.frame);
-    } break;
-    case TYPE_PACKET : {
-        // mpp_packet_deinit(&node->val.packet);
-    } break;
-    case TYPE_BUFFER : {
-        //mpp_buffer_put(node->val.buffer);
-    } break;
-    default : {
-    } break;
+    meta->node_mask = 0;
+    meta_count--;
+
+    if (free_count < META_POOL_MAX) {
+        list_add_tail(&meta->list_meta, &mlist_free);
+        free_count++;
+    } else {
+        mpp_free(meta);
     }
-    mpp_free(node);
 }
 
 MPP_RET mpp_meta_get_with_tag(MppMeta *meta, const char *tag, const char *caller)
@@ -289,9 +221,15 @@ MPP_RET mpp_meta_put(MppMeta meta)
         return MPP_ERR_NULL_PTR;
     }
 
+    MppMetaImpl *impl = (MppMetaImpl *)meta;
+    RK_S32 ref_count = MPP_SUB_FETCH(&impl->ref_count, 1);
+
+    mpp_assert(ref_count >= 0);
+    if (ref_count)
+        return MPP_OK;
+
     MppMetaService *service = MppMetaService::get_instance();
     AutoMutex auto_lock(service->get_lock());
-    MppMetaImpl *impl = (MppMetaImpl *)meta;
     service->put_meta(impl);
     return MPP_OK;
 }
@@ -303,10 +241,10 @@ MPP_RET mpp_meta_inc_ref(MppMeta meta)
         return MPP_ERR_NULL_PTR;
     }
 
-    MppMetaService *service = MppMetaService::get_instance();
-    AutoMutex auto_lock(service->get_lock());
     MppMetaImpl *impl = (MppMetaImpl *)meta;
-    service->inc_ref(impl);
+    RK_S32 ref_count = MPP_FETCH_ADD(&impl->ref_count, 1);
+
+    mpp_assert(ref_count > 0);
     return MPP_OK;
 }
 
@@ -319,57 +257,65 @@ RK_S32 mpp_meta_size(MppMeta meta)
 
     MppMetaImpl *impl = (MppMetaImpl *)meta;
 
-    return impl->node_count;
+    return __builtin_popcount(impl->node_mask);
 }
 
-MppMetaNode *mpp_meta_next_node(MppMeta meta)
+void mpp_meta_dump(MppMeta meta)
 {
     if (NULL == meta) {
         mpp_err_f("found NULL input\n");
-        return NULL;
+        return ;
     }
 
     MppMetaImpl *impl = (MppMetaImpl *)meta;
-    MppMetaService *service = MppMetaService::get_instance();
-    AutoMutex auto_lock(service->get_lock());
-    MppMetaNode *node = service->next_node(impl);
+    RK_U32 mask = impl->node_mask;
+    RK_U32 i;
+
+    mpp_log("meta %p id %d tag %s caller %s mask %08x\n", impl,
+            impl->meta_id, impl->tag, impl->caller, mask);
+
+    for (i = 0; i < MPP_ARRAY_ELEMS(meta_defs); i++) {
+        RK_U32 key = meta_defs[i].key;
+        RK_U32 type = meta_defs[i].type;
 
-    return node;
+        if (!(mask & (1 << i)))
+            continue;
+
+        mpp_log("key %c%c%c%c type %c%c%c%c val %llx\n",
+                (key >> 24) & 0xff, (key >> 16) & 0xff,
+                (key >> 8) & 0xff, key & 0xff,
+                (type >> 24) & 0xff, (type >> 16) & 0xff,
+                (type >> 8) & 0xff, type & 0xff,
+                impl->vals[i].val_s64);
+    }
 }
 
 static MPP_RET set_val_by_key(MppMetaImpl *meta, MppMetaKey key, MppMetaType type, MppMetaVal *val)
 {
-    MPP_RET ret = MPP_NOK;
     MppMetaService *service = MppMetaService::get_instance();
-    AutoMutex auto_lock(service->get_lock());
     RK_S32 index = service->get_index_of_key(key, type);
     if (index < 0)
-        return ret;
+        return MPP_NOK;
 
-    MppMetaNode *node = service->get_node(meta, index);
-    if (node) {
-        node->val = *val;
-        ret = MPP_OK;
-    }
-    return ret;
+    meta->vals[index] = *val;
+    MPP_FETCH_OR(&meta->node_mask, 1 << index);
+    return MPP_OK;
 }
 
+/* get will take the value away from meta like the former node removal */
 static MPP_RET get_val_by_key(MppMetaImpl *meta, MppMetaKey key, MppMetaType type, MppMetaVal *val)
 {
-    MPP_RET ret = MPP_NOK;
     MppMetaService *service = MppMetaService::get_instance();
-    AutoMutex auto_lock(service->get_lock());
     RK_S32 index = service->get_index_of_key(key, type);
     if (index < 0)
-        return ret;
+        return MPP_NOK;
 
-    MppMetaNode *node = service->find_node(meta, index);
-    if (node) {
-        *val = node->val;
-        service->put_node(node);
-        ret = MPP_OK;
-    }
-    return ret;
+    if (!(meta->node_mask & (1 << index)))
+        return MPP_NOK;
+
+    *val = meta->vals[index];
+    MPP_FETCH_AND(&meta->node_mask, ~(1 << index));
+    return MPP_OK;
 }
 
 MPP_RET mpp_meta_set_s32(MppMeta meta, MppMetaKey key, RK_S32 val)
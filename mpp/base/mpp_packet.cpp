@@ -121,6 +121,11 @@ MPP_RET mpp_packet_copy_init(MppPacket *packet, const MppPacket src)
     if (src_impl->buffer) {
         /* if source packet has buffer just create a new reference to buffer */
         mpp_buffer_inc_ref(src_impl->buffer);
+    } else if (src_impl->release && !(src_impl->flag & MPP_PACKET_FLAG_BORROWED)) {
+        /* borrow caller's memory and return it by callback on deinit */
+        MppPacketImpl *p = (MppPacketImpl *)pkt;
+        p->flag &= ~MPP_PACKET_FLAG_INTERNAL;
+        p->flag |= MPP_PACKET_FLAG_BORROWED;
     } else {
         /*
          * NOTE: only copy valid data
@@ -140,7 +145,10 @@ MPP_RET mpp_packet_copy_init(MppPacket *packet, const MppPacket src)
         MppPacketImpl *p = (MppPacketImpl *)pkt;
         p->data = p->pos = pos;
         p->size = p->length = length;
+        p->flag &= ~MPP_PACKET_FLAG_BORROWED;
         p->flag |= MPP_PACKET_FLAG_INTERNAL;
+        p->release = NULL;
+        p->release_ctx = NULL;
 
         if (length) {
             memcpy(pos, src_impl->pos, length);
@@ -155,6 +163,20 @@ MPP_RET mpp_packet_copy_init(MppPacket *packet, const MppPacket src)
     return MPP_OK;
 }
 
+MPP_RET mpp_packet_drop_borrow(MppPacket packet)
+{
+    if (check_is_mpp_packet(packet)) {
+        mpp_err_f("found invalid input %p\n", packet);
+        return MPP_ERR_UNKNOW;
+    }
+
+    MppPacketImpl *p = (MppPacketImpl *)packet;
+    p->flag &= ~MPP_PACKET_FLAG_BORROWED;
+    p->release = NULL;
+    p->release_ctx = NULL;
+    return MPP_OK;
+}
+
 MPP_RET mpp_packet_deinit(MppPacket *packet)
 {
     if (NULL == packet || check_is_mpp_packet(*packet)) {
@@ -171,6 +193,9 @@ MPP_RET mpp_packet_deinit(MppPacket *packet)
     if (p->flag & MPP_PACKET_FLAG_INTERNAL)
         mpp_free(p->data);
 
+    if ((p->flag & MPP_PACKET_FLAG_BORROWED) && p->release)
+        p->release(p->release_ctx, p->data);
+
     if (p->meta)
         mpp_meta_put(p->meta);
 
@@ -285,6 +310,16 @@ void mpp_packet_set_buffer(MppPacket packet, MppBuffer buffer)
     }
 }
 
+void mpp_packet_set_release(MppPacket packet, MppPacketRelease release, void *ctx)
+{
+    if (check_is_mpp_packet(packet))
+        return ;
+
+    MppPacketImpl *p = (MppPacketImpl *)packet;
+    p->release = release;
+    p->release_ctx = ctx;
+}
+
 MppBuffer mpp_packet_get_buffer(const MppPacket packet)
 {
     if (check_is_mpp_packet(packet))
@@ -21,6 +21,7 @@
 #include "mpp_env.h"
 #include "mpp_log.h"
 #include "mpp_mem.h"
+#include "mpp_eventfd.h"
 
 #include "mpp_task_impl.h"
 #include "mpp_meta_impl.h"
@@ -41,6 +42,8 @@ typedef struct MppTaskStatusInfo_t {
     RK_S32              count;
     MppTaskStatus       status;
     Condition           *cond;
+    // readiness fd for external poll created on request
+    MppEventFd          event;
 } MppTaskStatusInfo;
 
 typedef struct MppTaskQueueImpl_t {
@@ -91,6 +94,12 @@ static inline void setup_mpp_task_name(MppTaskImpl *task)
     task->name = module_name;
 }
 
+static inline void task_update_event(MppTaskStatusInfo *info)
+{
+    if (info->event)
+        mpp_eventfd_update(info->event, info->count > 0);
+}
+
 MPP_RET check_mpp_task_name(MppTask task)
 {
     if (task && ((MppTaskImpl *)task)->name == module_name)
@@ -247,6 +256,7 @@ MPP_RET _mpp_port_dequeue(const char *caller, MppPort port, MppTask *task)
     list_add_tail(&task_impl->list, &next->list);
     next->count++;
     task_impl->status = next->status;
+    task_update_event(curr);
 
     mpp_task_dbg_flow("mpp %p %s from %s dequeue %s port task %p %s -> %s done\n",
                       queue->mpp, queue->name, caller,
@@ -294,6 +304,7 @@ MPP_RET _mpp_port_enqueue(const char *caller, MppPort port, MppTask task)
     list_add_tail(&task_impl->list, &next->list);
     next->count++;
     task_impl->status = next->status;
+    task_update_event(next);
 
     mpp_task_dbg_flow("mpp %p %s from %s enqueue %s port task %p %s -> %s done\n",
                       queue->mpp, queue->name, caller,
@@ -331,6 +342,31 @@ MPP_RET _mpp_port_awake(const char *caller, MppPort port)
     return MPP_OK;
 }
 
+MPP_RET mpp_port_get_fd(MppPort port, RK_S32 *fd)
+{
+    MppPortImpl *port_impl = (MppPortImpl *)port;
+    MppTaskStatusInfo *curr = NULL;
+
+    if (NULL == port || NULL == fd) {
+        mpp_err_f("invalid input port %p fd %p\n", port, fd);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    AutoMutex auto_lock(port_impl->queue->lock);
+
+    curr = &port_impl->queue->info[port_impl->status_curr];
+    if (NULL == curr->event) {
+        MPP_RET ret = mpp_eventfd_init(&curr->event);
+        if (ret)
+            return ret;
+
+        task_update_event(curr);
+    }
+
+    *fd = mpp_eventfd_get_fd(curr->event);
+    return MPP_OK;
+}
+
 MPP_RET mpp_task_queue_init(MppTaskQueue *queue, void *mpp, const char *name)
 {
     if (NULL == queue) {
@@ -443,6 +479,7 @@ MPP_RET mpp_task_queue_setup(MppTaskQueue queue, RK_S32 task_count)
         list_add_tail(&tasks[i].list, &info->list);
         info->count++;
     }
+    task_update_event(info);
     impl->ready = 1;
     return MPP_OK;
 }
@@ -472,14 +509,7 @@ MPP_RET mpp_task_queue_deinit(MppTaskQueue queue)
                           &p->tasks[i], p->tasks[i].status,
                           mpp_meta_size(meta));
 
-                while (mpp_meta_size(meta)) {
-                    MppMetaNode *node = mpp_meta_next_node(meta);
-
-                    mpp_err_f("meta %p node %p id %d type %d\n",
-                              meta, node, node->node_id, node->type_id);
-
-                    MPP_FREE(node);
-                }
+                mpp_meta_dump(meta);
             }
 
             mpp_assert(p->tasks[i].status == MPP_INPUT_PORT ||
@@ -508,6 +538,12 @@ MPP_RET mpp_task_queue_deinit(MppTaskQueue queue)
         delete p->info[MPP_OUTPUT_PORT].cond;
         p->info[MPP_OUTPUT_PORT].cond = NULL;
     }
+    for (RK_S32 i = 0; i < MPP_TASK_STATUS_BUTT; i++) {
+        if (p->info[i].event) {
+            mpp_eventfd_deinit(p->info[i].event);
+            p->info[i].event = NULL;
+        }
+    }
     mpp_free(p);
     return MPP_OK;
 }
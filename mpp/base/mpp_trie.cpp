@@ -82,6 +82,8 @@ static RK_S32 trie_get_node(MppTrieImpl *trie)
 
     n->idx = idx;
     n->info_id = -1;
+    /* nodes from realloc are not cleared */
+    memset(n->next, 0, sizeof(n->next));
 
     trie_dbg_cnt("get node %d\n", idx);
 
@@ -196,12 +198,13 @@ MPP_RET mpp_trie_add_info(MppTrie trie, const char **info)
         trie_dbg_set("trie %p add %s at %2d char %c:%3d:%x:%x node %d -> %d\n",
                      trie, s, i, key, key, key0, key1, idx, next);
 
+        /* node array may be reallocated on getting new node */
         if (!next) {
             next = trie_get_node(p);
-            node->next[key0] = next;
+            p->nodes[idx].next[key0] = next;
 
             trie_dbg_set("trie %p add %s at %2d char %c:%3d node %d -> %d as new key0\n",
-                         trie, s, i, key, key, node->idx, next);
+                         trie, s, i, key, key, idx, next);
         }
 
         idx = next;
@@ -213,10 +216,10 @@ MPP_RET mpp_trie_add_info(MppTrie trie, const char **info)
 
         if (!next) {
             next = trie_get_node(p);
-            node->next[key1] = next;
+            p->nodes[idx].next[key1] = next;
 
             trie_dbg_set("trie %p add %s at %2d char %c:%3d node %d -> %d as new child\n",
-                         trie, s, i, key, key, node->idx, next);
+                         trie, s, i, key, key, idx, next);
         }
 
         idx = next;
@@ -17,12 +17,20 @@
 #define MODULE_TAG "mpp_bit_test"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "mpp_log.h"
+#include "mpp_time.h"
 #include "mpp_common.h"
+#include "mpp_bitread.h"
 #include "mpp_bitwrite.h"
 
 #define BIT_WRITER_BUFFER_SIZE  1024
+#define BIT_READER_BUFFER_SIZE  (64 * 1024)
+#define BIT_READER_CHECK_LOOP   200
+#define BIT_READER_BENCH_LOOP   50
+#define BIT_WRITER_CHECK_LOOP   200
+#define BIT_WRITER_BENCH_LOOP   20
 
 /*
  * type is for operation type
@@ -80,6 +88,421 @@ void proc_bit_ops(MppWriteCtx *writer, BitOps *ops)
     }
 }
 
+/*
+ * Reference byte-wise bit writer
+ *
+ * It is the writer before the 64-bit accumulator. The stream and emulation
+ * prevention byte count must match between the two writers.
+ */
+typedef struct RefWriter_t {
+    RK_U8  *stream;
+    RK_U32 byte_cnt;
+    RK_U32 byte_buffer;
+    RK_U32 buffered_bits;
+    RK_U32 zero_bytes;
+    RK_U32 emul_cnt;
+} RefWriter;
+
+__attribute__((noinline)) static void ref_put_bits(RefWriter *ctx, RK_U32 val, RK_S32 len, RK_S32 emul)
+{
+    RK_S32 bits = len + ctx->buffered_bits;
+    RK_U32 byte_buffer = ctx->byte_buffer | (val << (32 - bits));
+
+    while (bits > 7) {
+        RK_U8 byte = (RK_U8)(byte_buffer >> 24);
+
+        if (emul) {
+            if (ctx->zero_bytes == 2 && byte < 4) {
+                ctx->stream[ctx->byte_cnt++] = 3;
+                ctx->zero_bytes = 0;
+                ctx->emul_cnt++;
+            }
+            ctx->zero_bytes = byte ? 0 : ctx->zero_bytes + 1;
+        }
+
+        ctx->stream[ctx->byte_cnt++] = byte;
+        bits -= 8;
+        byte_buffer <<= 8;
+    }
+
+    ctx->byte_buffer = byte_buffer;
+    ctx->buffered_bits = bits;
+}
+
+static void ref_put_ue(RefWriter *ctx, RK_U32 val)
+{
+    RK_S32 num_bits = 0;
+
+    val++;
+    while (val >> ++num_bits);
+
+    ref_put_bits(ctx, 0, num_bits - 1, 1);
+    ref_put_bits(ctx, val, num_bits, 1);
+}
+
+static void ref_trailing(RefWriter *ctx)
+{
+    ref_put_bits(ctx, 1, 1, 1);
+    if (ctx->buffered_bits)
+        ref_put_bits(ctx, 0, 8 - ctx->buffered_bits, 1);
+}
+
+/*
+ * type is for writer check operation type
+ * 0 - raw bits (1-24)
+ * 1 - bits with detection (1-24)
+ * 2 - ue
+ * 3 - align zero
+ */
+static void proc_write_ops(MppWriteCtx *writer, RefWriter *ref, RK_S32 type, RK_U32 val, RK_S32 len)
+{
+    switch (type) {
+    case 0 : {
+        mpp_writer_put_raw_bits(writer, val, len);
+        ref_put_bits(ref, val, len, 0);
+    } break;
+    case 1 : {
+        mpp_writer_put_bits(writer, val, len);
+        ref_put_bits(ref, val, len, 1);
+    } break;
+    case 2 : {
+        mpp_writer_put_ue(writer, val);
+        ref_put_ue(ref, val);
+    } break;
+    default : {
+        mpp_writer_align_zero(writer);
+        if (ref->buffered_bits)
+            ref_put_bits(ref, 0, 8 - ref->buffered_bits, 0);
+    } break;
+    }
+}
+
+/* value with many zero bits for emulation prevention check */
+static RK_U32 rand_bits(RK_S32 len)
+{
+    RK_U32 val = (rand() & 1) ? (RK_U32)rand() : (RK_U32)(rand() & 3);
+
+    return val & ((1U << len) - 1);
+}
+
+static MPP_RET bit_writer_check(RK_U8 *buf, RK_U8 *buf_ref, RK_S32 size)
+{
+    RK_S32 loop;
+
+    for (loop = 0; loop < BIT_WRITER_CHECK_LOOP; loop++) {
+        MppWriteCtx writer;
+        RefWriter ref;
+        RK_S32 ops = 1 + rand() % 400;
+        RK_S32 i;
+
+        memset(&ref, 0, sizeof(ref));
+        ref.stream = buf_ref;
+        mpp_writer_init(&writer, buf, size);
+
+        for (i = 0; i < ops; i++) {
+            RK_S32 type = rand() % 16;
+            RK_S32 len = 1 + rand() % 24;
+
+            /* mostly bits with detection like the slice header */
+            type = (type < 2) ? 0 : (type < 12) ? 1 : (type < 15) ? 2 : 3;
+            proc_write_ops(&writer, &ref, type, (type == 2) ? rand_bits(16) : rand_bits(len), len);
+        }
+
+        mpp_writer_trailing(&writer);
+        ref_trailing(&ref);
+
+        if (writer.byte_cnt != ref.byte_cnt || writer.emul_cnt != ref.emul_cnt ||
+            mpp_writer_status(&writer) || memcmp(buf, buf_ref, ref.byte_cnt)) {
+            mpp_err("loop %d ops %d bytes %d emul %d mismatch ref %d %d\n", loop, ops,
+                    writer.byte_cnt, writer.emul_cnt, ref.byte_cnt, ref.emul_cnt);
+            return MPP_NOK;
+        }
+    }
+
+    mpp_log("bit writer check %d streams pass\n", BIT_WRITER_CHECK_LOOP);
+    return MPP_OK;
+}
+
+static RK_S64 bit_writer_bench(RK_U8 *buf, RK_S32 size, RK_S32 ref)
+{
+    RK_S64 start = mpp_time();
+    RK_S32 loop;
+
+    for (loop = 0; loop < BIT_WRITER_BENCH_LOOP; loop++) {
+        MppWriteCtx writer;
+        RefWriter ref_writer;
+        RK_U32 i;
+
+        memset(&ref_writer, 0, sizeof(ref_writer));
+        ref_writer.stream = buf;
+        mpp_writer_init(&writer, buf, size);
+
+        /* header style mix of flags, fixed length fields and ue */
+        for (i = 0; i < (RK_U32)size / 4; i++) {
+            RK_S32 len = (i & 1) ? 1 : 1 + (i & 15);
+            RK_U32 val = (i * 0x9e3779b9) >> (32 - len);
+
+            if (ref) {
+                if ((i & 3) == 3)
+                    ref_put_ue(&ref_writer, val);
+                else
+                    ref_put_bits(&ref_writer, val, len, 1);
+            } else {
+                if ((i & 3) == 3)
+                    mpp_writer_put_ue(&writer, val);
+                else
+                    mpp_writer_put_bits(&writer, val, len);
+            }
+        }
+    }
+
+    return mpp_time() - start;
+}
+
+/*
+ * Reference byte-wise bit reader
+ *
+ * It is the reader before the cached word access. The context fields after
+ * each operation must match between the two readers. The read functions are
+ * not inlined to be compared with the library reader in the benchmark.
+ */
+static MPP_RET ref_update_curbyte(BitReadCtx_t *bitctx)
+{
+    if (bitctx->bytes_left_ < 1)
+        return MPP_ERR_READ_BIT;
+
+    if (bitctx->need_prevention_detection && (*bitctx->data_ == 0x03) &&
+        ((bitctx->prev_two_bytes_ & 0xffff) == 0)) {
+        ++bitctx->data_;
+        --bitctx->bytes_left_;
+        ++bitctx->emulation_prevention_bytes_;
+        bitctx->prev_two_bytes_ = 0xffff;
+        if (bitctx->bytes_left_ < 1)
+            return MPP_ERR_READ_BIT;
+    }
+
+    bitctx->curr_byte_ = *bitctx->data_++ & 0xff;
+    --bitctx->bytes_left_;
+    bitctx->num_remaining_bits_in_curr_byte_ = 8;
+    bitctx->prev_two_bytes_ = (bitctx->prev_two_bytes_ << 8) | bitctx->curr_byte_;
+
+    return MPP_OK;
+}
+
+__attribute__((noinline)) static MPP_RET ref_read_bits(BitReadCtx_t *bitctx, RK_S32 num_bits, RK_U32 *out)
+{
+    RK_S32 bits_left = num_bits;
+    RK_U64 val = 0;
+
+    while (bitctx->num_remaining_bits_in_curr_byte_ < bits_left) {
+        val |= (RK_U64)bitctx->curr_byte_ << (bits_left - bitctx->num_remaining_bits_in_curr_byte_);
+        bits_left -= bitctx->num_remaining_bits_in_curr_byte_;
+        if (ref_update_curbyte(bitctx))
+            return MPP_ERR_READ_BIT;
+    }
+    val |= bitctx->curr_byte_ >> (bitctx->num_remaining_bits_in_curr_byte_ - bits_left);
+    *out = (RK_U32)(val & ((1ULL << num_bits) - 1));
+    bitctx->num_remaining_bits_in_curr_byte_ -= bits_left;
+    bitctx->used_bits += num_bits;
+
+    return MPP_OK;
+}
+
+static MPP_RET ref_skip_bits(BitReadCtx_t *bitctx, RK_S32 num_bits)
+{
+    RK_S32 bits_left = num_bits;
+
+    while (bitctx->num_remaining_bits_in_curr_byte_ < bits_left) {
+        bits_left -= bitctx->num_remaining_bits_in_curr_byte_;
+        if (ref_update_curbyte(bitctx))
+            return MPP_ERR_READ_BIT;
+    }
+    bitctx->num_remaining_bits_in_curr_byte_ -= bits_left;
+    bitctx->used_bits += num_bits;
+
+    return MPP_OK;
+}
+
+__attribute__((noinline)) static MPP_RET ref_read_ue(BitReadCtx_t *bitctx, RK_U32 *val)
+{
+    RK_S32 num_bits = -1;
+    RK_U32 bit;
+    RK_U32 rest = 0;
+
+    do {
+        if (ref_read_bits(bitctx, 1, &bit))
+            return MPP_ERR_READ_BIT;
+        num_bits++;
+    } while (bit == 0);
+    if (num_bits > 31)
+        return MPP_ERR_READ_BIT;
+
+    if (num_bits > 0 && ref_read_bits(bitctx, num_bits, &rest))
+        return MPP_ERR_READ_BIT;
+
+    *val = (RK_U32)((1ULL << num_bits) - 1) + rest;
+
+    return MPP_OK;
+}
+
+/*
+ * type is for reader operation type
+ * 0 - read bits (1-31)
+ * 1 - read long bits (32)
+ * 2 - show bits (1-32)
+ * 3 - skip bits (1-300)
+ * 4 - read ue
+ * 5 - read se
+ */
+typedef enum BitReadOpsType_e {
+    BIT_READ,
+    BIT_READ_LONG,
+    BIT_SHOW,
+    BIT_SKIP,
+    BIT_READ_UE,
+    BIT_READ_SE,
+    BIT_READ_OPS_BUTT,
+} BitReadOpsType;
+
+static MPP_RET proc_read_ops(BitReadCtx_t *bitctx, RK_S32 ref, BitReadOpsType type,
+                             RK_S32 len, RK_U32 *val)
+{
+    MPP_RET ret = MPP_OK;
+
+    switch (type) {
+    case BIT_READ : {
+        ret = ref ? ref_read_bits(bitctx, len, val) :
+              mpp_read_bits(bitctx, len, (RK_S32 *)val);
+    } break;
+    case BIT_READ_LONG : {
+        ret = ref ? ref_read_bits(bitctx, 32, val) :
+              mpp_read_longbits(bitctx, 32, val);
+    } break;
+    case BIT_SHOW : {
+        if (ref) {
+            BitReadCtx_t tmp = *bitctx;
+
+            ret = ref_read_bits(&tmp, len, val);
+        } else {
+            ret = mpp_show_longbits(bitctx, len, val);
+        }
+    } break;
+    case BIT_SKIP : {
+        ret = ref ? ref_skip_bits(bitctx, len) : mpp_skip_bits(bitctx, len);
+    } break;
+    case BIT_READ_UE : {
+        ret = ref ? ref_read_ue(bitctx, val) : mpp_read_ue(bitctx, val);
+    } break;
+    case BIT_READ_SE : {
+        /* se is mapped from ue so the ue value is compared */
+        if (ref) {
+            ret = ref_read_ue(bitctx, val);
+        } else {
+            RK_S32 se = 0;
+
+            ret = mpp_read_se(bitctx, &se);
+            *val = (se > 0) ? (RK_U32)(se * 2 - 1) : (RK_U32)(-se * 2);
+        }
+    } break;
+    default : {
+        ret = MPP_NOK;
+    } break;
+    }
+
+    return ret;
+}
+
+/* stream with many zero and 0x03 bytes for emulation prevention check */
+static void fill_stream(RK_U8 *buf, RK_S32 size)
+{
+    RK_S32 i;
+
+    for (i = 0; i < size; i++) {
+        RK_S32 sel = rand() & 7;
+
+        buf[i] = (sel < 3) ? 0 : (sel == 3) ? 3 : (sel == 4) ? 1 : (RK_U8)rand();
+    }
+}
+
+static MPP_RET bit_reader_check(RK_U8 *buf)
+{
+    RK_S32 loop;
+
+    for (loop = 0; loop < BIT_READER_CHECK_LOOP; loop++) {
+        RK_S32 size = 1 + rand() % 256;
+        BitReadCtx_t ctx;
+        BitReadCtx_t ref;
+
+        fill_stream(buf, size);
+        mpp_set_bitread_ctx(&ctx, buf, size);
+        if (loop & 1)
+            mpp_set_pre_detection(&ctx);
+        ref = ctx;
+
+        while (1) {
+            BitReadOpsType type = (BitReadOpsType)(rand() % BIT_READ_OPS_BUTT);
+            RK_S32 len = (type == BIT_SKIP) ? 1 + rand() % 300 :
+                         (type == BIT_SHOW) ? 1 + rand() % 32 : 1 + rand() % 31;
+            RK_U32 val = 0;
+            RK_U32 val_ref = 0;
+            MPP_RET ret = proc_read_ops(&ctx, 0, type, len, &val);
+            MPP_RET ret_ref = proc_read_ops(&ref, 1, type, len, &val_ref);
+
+            if (ret != ret_ref) {
+                mpp_err("loop %d type %d len %d ret %d mismatch ref %d\n",
+                        loop, type, len, ret, ret_ref);
+                return MPP_NOK;
+            }
+
+            /* context is not compared after error */
+            if (ret)
+                break;
+
+            if (val != val_ref || ctx.data_ != ref.data_ ||
+                ctx.bytes_left_ != ref.bytes_left_ ||
+                ctx.num_remaining_bits_in_curr_byte_ != ref.num_remaining_bits_in_curr_byte_ ||
+                (ctx.curr_byte_ & 0xff) != (ref.curr_byte_ & 0xff) ||
+                ctx.used_bits != ref.used_bits) {
+                mpp_err("loop %d type %d len %d val %x mismatch ref %x\n",
+                        loop, type, len, val, val_ref);
+                return MPP_NOK;
+            }
+        }
+    }
+
+    mpp_log("bit reader check %d streams pass\n", BIT_READER_CHECK_LOOP);
+    return MPP_OK;
+}
+
+static RK_S64 bit_reader_bench(RK_U8 *buf, RK_S32 size, RK_S32 ref, RK_U32 *sum)
+{
+    RK_S64 start = mpp_time();
+    RK_S32 loop;
+
+    for (loop = 0; loop < BIT_READER_BENCH_LOOP; loop++) {
+        BitReadCtx_t ctx;
+        RK_U32 val = 0;
+        RK_S32 i = 0;
+
+        mpp_set_bitread_ctx(&ctx, buf, size);
+        mpp_set_pre_detection(&ctx);
+
+        /* header parser style mix of flags, fixed length fields and ue */
+        while (1) {
+            BitReadOpsType type = (i & 3) == 3 ? BIT_READ_UE : BIT_READ;
+            RK_S32 len = (i & 1) ? 1 : 1 + (i & 15);
+
+            if (proc_read_ops(&ctx, ref, type, len, &val))
+                break;
+
+            *sum += val;
+            i++;
+        }
+    }
+
+    return mpp_time() - start;
+}
+
 int main()
 {
     MPP_RET ret = MPP_ERR_UNKNOW;
@@ -113,6 +536,54 @@ int main()
 
     mpp_log("stream %s\n", buf);
 
+    free(data);
+    size = BIT_READER_BUFFER_SIZE;
+    data = malloc(size);
+    if (NULL == data) {
+        mpp_err("mpp_bit_test malloc failed\n");
+        goto TEST_FAILED;
+    }
+
+    ret = bit_writer_check(data, (RK_U8 *)data + size / 2, size / 2);
+    if (ret)
+        goto TEST_FAILED;
+
+    {
+        RK_S64 time = bit_writer_bench(data, size, 0);
+        RK_S64 time_ref = bit_writer_bench(data, size, 1);
+
+        mpp_log("bit writer bench %d KB x %d: accumulator %lld us byte-wise %lld us\n",
+                (RK_S32)(size / 1024), BIT_WRITER_BENCH_LOOP, time, time_ref);
+    }
+
+    ret = bit_reader_check(data);
+    if (ret)
+        goto TEST_FAILED;
+
+    /* benchmark on random stream where 0x03 bytes are rare */
+    {
+        RK_U8 *p = (RK_U8 *)data;
+        RK_U32 sum = 0;
+        RK_U32 sum_ref = 0;
+        RK_S64 time;
+        RK_S64 time_ref;
+
+        for (i = 0; i < size; i++)
+            p[i] = (RK_U8)rand();
+
+        time = bit_reader_bench(p, size, 0, &sum);
+        time_ref = bit_reader_bench(p, size, 1, &sum_ref);
+
+        mpp_log("bit reader bench %d KB x %d: cached %lld us byte-wise %lld us\n",
+                (RK_S32)(size / 1024), BIT_READER_BENCH_LOOP, time, time_ref);
+
+        if (sum != sum_ref) {
+            mpp_err("bit reader bench result %x mismatch ref %x\n", sum, sum_ref);
+            ret = MPP_NOK;
+            goto TEST_FAILED;
+        }
+    }
+
     ret = MPP_OK;
 TEST_FAILED:
     if (data)
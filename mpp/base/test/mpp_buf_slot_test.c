@@ -0,0 +1,206 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_buf_slot_test"
+
+#include <sched.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mpp_log.h"
+#include "mpp_time.h"
+#include "mpp_atomic.h"
+#include "mpp_common.h"
+#include "mpp_buffer.h"
+#include "mpp_buf_slot.h"
+
+/*
+ * buffer slot multi-thread status test
+ *
+ * The parser role takes all slots and marks them as reference, hardware
+ * input / output and queued. Then one thread per role clears its flag on
+ * all slots at the same time like parser, hal and output thread do.
+ * Each slot must be released exactly once with its buffer returned.
+ * Meanwhile the get thread takes the released slots like the parser does
+ * and checks the unused count.
+ */
+#define SLOT_TEST_COUNT         16
+#define SLOT_TEST_LOOP          2000
+#define SLOT_TEST_HAL_REF       2
+#define SLOT_TEST_BUF_SIZE      (SZ_1K)
+
+typedef struct SlotTestCtx_t {
+    MppBufSlots         slots;
+    SlotUsageType       type;
+    RK_S32              count;
+    RK_S64              time;
+    /* set when the clear threads are finished */
+    RK_U32              done;
+} SlotTestCtx;
+
+static void *slot_clr_proc(void *arg)
+{
+    SlotTestCtx *ctx = (SlotTestCtx *)arg;
+    RK_S64 start = mpp_time();
+    RK_S32 i, j;
+
+    for (i = 0; i < SLOT_TEST_COUNT; i++)
+        for (j = 0; j < ctx->count; j++)
+            mpp_buf_slot_clr_flag(ctx->slots, i, ctx->type);
+
+    ctx->time = mpp_time() - start;
+    return NULL;
+}
+
+static void *slot_get_proc(void *arg)
+{
+    SlotTestCtx *ctx = (SlotTestCtx *)arg;
+
+    /* run until all slots are released by the clear threads */
+    while (!MPP_LOAD_ACQUIRE(&ctx->done) || mpp_slots_get_used_count(ctx->slots)) {
+        RK_S32 index = -1;
+
+        /* same check as decoder before parsing */
+        if (!mpp_slots_get_unused_count(ctx->slots)) {
+            sched_yield();
+            continue;
+        }
+
+        mpp_buf_slot_get_unused(ctx->slots, &index);
+        /* aborts when used count is above slot count */
+        mpp_slots_get_unused_count(ctx->slots);
+
+        mpp_buf_slot_set_flag(ctx->slots, index, SLOT_CODEC_READY);
+        mpp_buf_slot_set_flag(ctx->slots, index, SLOT_CODEC_USE);
+        mpp_buf_slot_clr_flag(ctx->slots, index, SLOT_CODEC_USE);
+    }
+
+    return NULL;
+}
+
+static MPP_RET slot_test_round(MppBufSlots slots, MppBufferGroup group,
+                               SlotTestCtx *ctxs, RK_S32 ctx_count)
+{
+    pthread_t threads[SLOT_USAGE_BUTT];
+    pthread_t getter;
+    SlotTestCtx get_ctx;
+    RK_S32 i, j;
+
+    for (i = 0; i < SLOT_TEST_COUNT; i++) {
+        MppBuffer buffer = NULL;
+        RK_S32 index = -1;
+
+        mpp_buf_slot_get_unused(slots, &index);
+        if (index < 0)
+            return MPP_NOK;
+
+        mpp_buffer_get(group, &buffer, SLOT_TEST_BUF_SIZE);
+        mpp_buf_slot_set_prop(slots, index, SLOT_BUFFER, buffer);
+        mpp_buffer_put(buffer);
+
+        mpp_buf_slot_set_flag(slots, index, SLOT_CODEC_USE);
+        mpp_buf_slot_set_flag(slots, index, SLOT_HAL_OUTPUT);
+        for (j = 0; j < SLOT_TEST_HAL_REF; j++)
+            mpp_buf_slot_set_flag(slots, index, SLOT_HAL_INPUT);
+        mpp_buf_slot_set_flag(slots, index, SLOT_QUEUE_USE);
+    }
+
+    if (mpp_slots_get_unused_count(slots))
+        return MPP_NOK;
+
+    memset(&get_ctx, 0, sizeof(get_ctx));
+    get_ctx.slots = slots;
+
+    pthread_create(&getter, NULL, slot_get_proc, &get_ctx);
+    for (i = 0; i < ctx_count; i++)
+        pthread_create(&threads[i], NULL, slot_clr_proc, &ctxs[i]);
+    for (i = 0; i < ctx_count; i++)
+        pthread_join(threads[i], NULL);
+    MPP_FETCH_ADD(&get_ctx.done, 1);
+    pthread_join(getter, NULL);
+
+    if (mpp_slots_get_used_count(slots)) {
+        mpp_err("found %d slots not released\n", mpp_slots_get_used_count(slots));
+        return MPP_NOK;
+    }
+
+    if (mpp_buffer_group_unused(group) != SLOT_TEST_COUNT) {
+        mpp_err("found buffer not released\n");
+        return MPP_NOK;
+    }
+
+    return MPP_OK;
+}
+
+int main()
+{
+    MppBufSlots slots = NULL;
+    MppBufferGroup group = NULL;
+    SlotTestCtx ctxs[4];
+    RK_S64 time[4] = { 0 };
+    MPP_RET ret = MPP_NOK;
+    RK_S32 i;
+
+    mpp_log("mpp_buf_slot_test start\n");
+
+    if (mpp_buf_slot_init(&slots))
+        goto DONE;
+
+    mpp_buf_slot_setup(slots, SLOT_TEST_COUNT);
+
+    if (mpp_buffer_group_get_internal(&group, MPP_BUFFER_TYPE_NORMAL))
+        goto DONE;
+
+    mpp_buffer_group_limit_config(group, SLOT_TEST_BUF_SIZE, SLOT_TEST_COUNT);
+
+    memset(ctxs, 0, sizeof(ctxs));
+    ctxs[0].type = SLOT_CODEC_USE;
+    ctxs[1].type = SLOT_HAL_OUTPUT;
+    ctxs[2].type = SLOT_HAL_INPUT;
+    ctxs[3].type = SLOT_QUEUE_USE;
+    for (i = 0; i < 4; i++) {
+        ctxs[i].slots = slots;
+        ctxs[i].count = (ctxs[i].type == SLOT_HAL_INPUT) ? SLOT_TEST_HAL_REF : 1;
+    }
+
+    for (i = 0; i < SLOT_TEST_LOOP; i++) {
+        RK_S32 j;
+
+        ret = slot_test_round(slots, group, ctxs, 4);
+        if (ret) {
+            mpp_err("round %d failed\n", i);
+            break;
+        }
+
+        for (j = 0; j < 4; j++)
+            time[j] += ctxs[j].time;
+    }
+
+    if (!ret) {
+        for (i = 0; i < 4; i++)
+            mpp_log("clr flag %d: %.3f us per operation\n", ctxs[i].type,
+                    (float)time[i] / (SLOT_TEST_LOOP * SLOT_TEST_COUNT * ctxs[i].count));
+    }
+
+DONE:
+    if (slots)
+        mpp_buf_slot_deinit(slots);
+    if (group)
+        mpp_buffer_group_put(group);
+
+    mpp_log("mpp_buf_slot_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
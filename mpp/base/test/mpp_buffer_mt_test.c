@@ -0,0 +1,163 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_buffer_mt_test"
+
+#include <string.h>
+
+#include "mpp_log.h"
+#include "mpp_time.h"
+#include "mpp_common.h"
+#include "mpp_buffer.h"
+
+/*
+ * multi-thread buffer get / put stress test
+ *
+ * Each thread simulates one codec context doing buffer get / inc_ref / put
+ * loop. Two cases are tested:
+ * 1. private group - each thread has its own group like multiple decoders
+ * 2. shared group  - all threads share one group
+ */
+#define MPP_BUFFER_MT_MAX_THREAD        32
+#define MPP_BUFFER_MT_LOOP              20000
+#define MPP_BUFFER_MT_BUF_COUNT         4
+#define MPP_BUFFER_MT_BUF_SIZE          (SZ_1K * 4)
+
+typedef struct MppBufferMtCtx_t {
+    MppBufferGroup      group;
+    RK_S32              loop;
+    RK_S32              error;
+} MppBufferMtCtx;
+
+static void *buffer_mt_loop(void *arg)
+{
+    MppBufferMtCtx *ctx = (MppBufferMtCtx *)arg;
+    MppBuffer buf[MPP_BUFFER_MT_BUF_COUNT];
+    RK_S32 i, j;
+
+    for (i = 0; i < ctx->loop; i++) {
+        for (j = 0; j < MPP_BUFFER_MT_BUF_COUNT; j++) {
+            buf[j] = NULL;
+            if (mpp_buffer_get(ctx->group, &buf[j], MPP_BUFFER_MT_BUF_SIZE)) {
+                ctx->error++;
+                continue;
+            }
+
+            /* simulate frame reference on display and reference list */
+            mpp_buffer_inc_ref(buf[j]);
+        }
+
+        for (j = 0; j < MPP_BUFFER_MT_BUF_COUNT; j++) {
+            if (NULL == buf[j])
+                continue;
+
+            mpp_buffer_put(buf[j]);
+            mpp_buffer_put(buf[j]);
+        }
+    }
+
+    return NULL;
+}
+
+static MPP_RET buffer_mt_run(RK_S32 thread_count, RK_S32 shared)
+{
+    MppBufferMtCtx ctxs[MPP_BUFFER_MT_MAX_THREAD];
+    pthread_t threads[MPP_BUFFER_MT_MAX_THREAD];
+    MppBufferGroup shared_group = NULL;
+    MPP_RET ret = MPP_OK;
+    RK_S64 time_start;
+    RK_S64 time_end;
+    RK_S64 total;
+    RK_S32 i;
+
+    memset(ctxs, 0, sizeof(ctxs));
+
+    if (shared)
+        mpp_buffer_group_get_internal(&shared_group, MPP_BUFFER_TYPE_NORMAL);
+
+    for (i = 0; i < thread_count; i++) {
+        MppBufferMtCtx *ctx = &ctxs[i];
+
+        ctx->loop = MPP_BUFFER_MT_LOOP / thread_count;
+        if (shared)
+            ctx->group = shared_group;
+        else
+            mpp_buffer_group_get_internal(&ctx->group, MPP_BUFFER_TYPE_NORMAL);
+
+        if (NULL == ctx->group) {
+            mpp_err("failed to get buffer group\n");
+            ret = MPP_NOK;
+            goto DONE;
+        }
+    }
+
+    time_start = mpp_time();
+
+    for (i = 0; i < thread_count; i++)
+        pthread_create(&threads[i], NULL, buffer_mt_loop, &ctxs[i]);
+
+    for (i = 0; i < thread_count; i++)
+        pthread_join(threads[i], NULL);
+
+    time_end = mpp_time();
+
+    total = 0;
+    for (i = 0; i < thread_count; i++) {
+        total += ctxs[i].loop * MPP_BUFFER_MT_BUF_COUNT;
+        if (ctxs[i].error) {
+            mpp_err("thread %d get buffer failed %d times\n", i, ctxs[i].error);
+            ret = MPP_NOK;
+        }
+    }
+
+    mpp_log("%s group threads %2d get/put %7lld cost %7lld us %8.2f Kops/s\n",
+            shared ? "shared " : "private", thread_count, total,
+            time_end - time_start,
+            (float)total * 1000 / MPP_MAX(time_end - time_start, 1));
+
+DONE:
+    if (shared) {
+        if (shared_group)
+            mpp_buffer_group_put(shared_group);
+    } else {
+        for (i = 0; i < thread_count; i++)
+            if (ctxs[i].group)
+                mpp_buffer_group_put(ctxs[i].group);
+    }
+
+    return ret;
+}
+
+int main()
+{
+    MPP_RET ret = MPP_OK;
+    RK_S32 shared;
+    RK_S32 count;
+
+    mpp_log("mpp_buffer_mt_test start\n");
+
+    for (shared = 0; shared < 2; shared++) {
+        for (count = 1; count <= MPP_BUFFER_MT_MAX_THREAD; count <<= 1) {
+            ret = buffer_mt_run(count, shared);
+            if (ret)
+                goto DONE;
+        }
+    }
+
+DONE:
+    mpp_log("mpp_buffer_mt_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
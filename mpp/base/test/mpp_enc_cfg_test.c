@@ -16,6 +16,8 @@
 
 #define MODULE_TAG "mpp_enc_cfg_test"
 
+#include <string.h>
+
 #include "mpp_log.h"
 #include "mpp_mem.h"
 #include "mpp_time.h"
@@ -24,6 +26,150 @@
 #include "rk_venc_cfg.h"
 #include "mpp_enc_cfg_impl.h"
 
+#define KEY_TEST_LOOP   10000
+
+static MPP_RET key_test(MppEncCfg cfg)
+{
+    MppEncCfgImpl *impl = (MppEncCfgImpl *)cfg;
+    MppEncCfgKey key_bps = NULL;
+    MppEncCfgKey key_qp_max = NULL;
+    MppEncCfgKey key_split = NULL;
+    MppEncCfgKv kv[3];
+    RK_S64 time_name = 0;
+    RK_S64 time_key = 0;
+    RK_S64 start;
+    RK_S32 bps = 0;
+    RK_S32 i;
+    MPP_RET ret;
+
+    ret = mpp_enc_cfg_get_key("rc:bps_target", &key_bps);
+    ret |= mpp_enc_cfg_get_key("h264:qp_max", &key_qp_max);
+    ret |= mpp_enc_cfg_get_key("split:mode", &key_split);
+    if (ret) {
+        mpp_err("get key failed\n");
+        return MPP_NOK;
+    }
+
+    if (!mpp_enc_cfg_get_key("rc:invalid", &key_bps) || key_bps) {
+        mpp_err("get invalid key should fail\n");
+        return MPP_NOK;
+    }
+    mpp_enc_cfg_get_key("rc:bps_target", &key_bps);
+
+    ret = mpp_enc_cfg_set_s32_by_key(cfg, key_bps, 800000);
+    ret |= mpp_enc_cfg_get_s32_by_key(cfg, key_bps, &bps);
+    if (ret || bps != 800000 || impl->cfg.rc.bps_target != 800000) {
+        mpp_err("set by key failed bps %d\n", bps);
+        return MPP_NOK;
+    }
+
+    impl->cfg.rc.change = 0;
+    kv[0].key = key_bps;
+    kv[0].val.s32 = 1000000;
+    kv[1].key = key_qp_max;
+    kv[1].val.s32 = 40;
+    kv[2].key = key_split;
+    kv[2].val.u32 = 1;
+
+    ret = mpp_enc_cfg_set_kv(cfg, kv, MPP_ARRAY_ELEMS(kv));
+    if (ret || impl->cfg.rc.bps_target != 1000000 ||
+        impl->cfg.codec.h264.qp_max != 40 ||
+        impl->cfg.split.split_mode != 1 ||
+        !(impl->cfg.rc.change & MPP_ENC_RC_CFG_CHANGE_BPS) ||
+        !(impl->cfg.codec.h264.change & MPP_ENC_H264_CFG_CHANGE_QP_LIMIT) ||
+        !(impl->cfg.split.change & MPP_ENC_SPLIT_CFG_CHANGE_MODE)) {
+        mpp_err("set kv failed\n");
+        return MPP_NOK;
+    }
+
+    start = mpp_time();
+    for (i = 0; i < KEY_TEST_LOOP; i++)
+        mpp_enc_cfg_set_s32(cfg, "rc:bps_target", i);
+    time_name = mpp_time() - start;
+
+    start = mpp_time();
+    for (i = 0; i < KEY_TEST_LOOP; i++)
+        mpp_enc_cfg_set_s32_by_key(cfg, key_bps, i);
+    time_key = mpp_time() - start;
+
+    mpp_log("%d set by name %lld us by key %lld us\n",
+            KEY_TEST_LOOP, time_name, time_key);
+
+    return MPP_OK;
+}
+
+static RK_S32 stage_check(MppEncCfgSet *cfg)
+{
+    return cfg->ref_cfg || cfg->roi.number || cfg->roi.regions ||
+           cfg->plt_cfg.plt || cfg->base.change || cfg->prep.change ||
+           cfg->plt_cfg.change || cfg->codec.h264.vui.change;
+}
+
+static MPP_RET kv_batch_test(MppEncCfg cfg)
+{
+    MppEncCfgImpl *impl = (MppEncCfgImpl *)cfg;
+    MppEncCfgSet *stage = &impl->cfg;
+    MppEncCfgSet curr;
+    MppEncROIRegion region;
+    MppEncOSDPlt plt;
+    MppEncCfgKv kv[2];
+    MPP_RET ret;
+
+    /* current encoder config with owned handles and stale change flags */
+    memset(&curr, 0, sizeof(curr));
+    curr.codec.coding = MPP_VIDEO_CodingAVC;
+    curr.ref_cfg = (MppEncRefCfg)&curr;
+    curr.roi.number = 1;
+    curr.roi.regions = &region;
+    curr.plt_cfg.plt = &plt;
+    curr.plt_cfg.change = MPP_ENC_OSD_PLT_CFG_CHANGE_ALL;
+    curr.base.change = MPP_ENC_BASE_CFG_CHANGE_ALL;
+    curr.rc.change = MPP_ENC_RC_CFG_CHANGE_ALL;
+    curr.prep.change = MPP_ENC_PREP_CFG_CHANGE_ALL;
+    curr.split.change = MPP_ENC_SPLIT_CFG_CHANGE_ALL;
+    curr.codec.h264.change = MPP_ENC_H264_CFG_CHANGE_ALL;
+    curr.codec.h264.vui.change = 1;
+
+    /* first batch: rc bps and h264 qp limit */
+    ret = mpp_enc_cfg_stage(cfg, &curr);
+    ret |= mpp_enc_cfg_get_key("rc:bps_target", &kv[0].key);
+    ret |= mpp_enc_cfg_get_key("h264:qp_max", &kv[1].key);
+    kv[0].val.s32 = 2000000;
+    kv[1].val.s32 = 45;
+    ret |= mpp_enc_cfg_set_kv(cfg, kv, 2);
+    if (ret || stage_check(stage) ||
+        stage->rc.change != MPP_ENC_RC_CFG_CHANGE_BPS ||
+        stage->codec.h264.change != MPP_ENC_H264_CFG_CHANGE_QP_LIMIT ||
+        stage->split.change) {
+        mpp_err("kv batch 1 failed rc %x h264 %x split %x\n",
+                stage->rc.change, stage->codec.h264.change,
+                stage->split.change);
+        return MPP_NOK;
+    }
+
+    /* encoder takes the values but keeps its change flags and handles */
+    curr.rc.bps_target = stage->rc.bps_target;
+    curr.codec.h264.qp_max = stage->codec.h264.qp_max;
+
+    /* second batch: split mode only */
+    ret = mpp_enc_cfg_stage(cfg, &curr);
+    ret |= mpp_enc_cfg_get_key("split:mode", &kv[0].key);
+    kv[0].val.u32 = 1;
+    ret |= mpp_enc_cfg_set_kv(cfg, kv, 1);
+    if (ret || stage_check(stage) || stage->rc.change ||
+        stage->codec.h264.change ||
+        stage->split.change != MPP_ENC_SPLIT_CFG_CHANGE_MODE ||
+        stage->rc.bps_target != 2000000 ||
+        stage->codec.h264.qp_max != 45) {
+        mpp_err("kv batch 2 failed rc %x h264 %x split %x\n",
+                stage->rc.change, stage->codec.h264.change,
+                stage->split.change);
+        return MPP_NOK;
+    }
+
+    return MPP_OK;
+}
+
 int main()
 {
     MPP_RET ret = MPP_OK;
@@ -70,6 +216,18 @@ int main()
 
     mpp_log("after  get: rc mode %d bps_target %d\n", rc_mode, bps_target);
 
+    ret = key_test(cfg);
+    if (ret) {
+        mpp_enc_cfg_deinit(cfg);
+        goto DONE;
+    }
+
+    ret = kv_batch_test(cfg);
+    if (ret) {
+        mpp_enc_cfg_deinit(cfg);
+        goto DONE;
+    }
+
     ret = mpp_enc_cfg_deinit(cfg);
     if (ret) {
         mpp_err("mpp_enc_cfg_deinit failed\n");
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_meta_test"
+
+#include <stdlib.h>
+
+#include "mpp_env.h"
+#include "mpp_log.h"
+#include "mpp_time.h"
+#include "mpp_meta.h"
+
+/*
+ * meta function check and set / get benchmark
+ *
+ * The benchmark runs the encoder style meta usage: get a meta, set several
+ * keys, get them back and put the meta. Meta alloc / reuse count is printed
+ * on exit by mpp_meta_debug stats flag.
+ *
+ * usage: mpp_meta_test [loop count]
+ */
+#define MPP_META_TEST_LOOP      100000
+
+static MPP_RET meta_check(void)
+{
+    MppMeta meta = NULL;
+    MppFrame frame = (MppFrame)&meta;
+    MppFrame frame_out = NULL;
+    RK_S32 val = 0;
+    RK_S64 val64 = 0;
+    void *ptr = NULL;
+    MPP_RET ret = MPP_NOK;
+
+    if (mpp_meta_get(&meta))
+        return MPP_NOK;
+
+    if (mpp_meta_size(meta))
+        goto DONE;
+
+    mpp_meta_set_s32(meta, KEY_OUTPUT_INTRA, 1);
+    mpp_meta_set_s32(meta, KEY_OUTPUT_INTRA, 2);
+    mpp_meta_set_frame(meta, KEY_INPUT_FRAME, frame);
+    mpp_meta_set_ptr(meta, KEY_ROI_DATA, &val);
+    if (mpp_meta_size(meta) != 3)
+        goto DONE;
+
+    /* key with wrong type should be rejected */
+    if (!mpp_meta_set_s64(meta, KEY_OUTPUT_INTRA, 3))
+        goto DONE;
+    if (!mpp_meta_get_s64(meta, KEY_OUTPUT_INTRA, &val64))
+        goto DONE;
+
+    /* the last set value is returned and get takes it away */
+    if (mpp_meta_get_s32(meta, KEY_OUTPUT_INTRA, &val) || val != 2)
+        goto DONE;
+    if (!mpp_meta_get_s32(meta, KEY_OUTPUT_INTRA, &val))
+        goto DONE;
+    if (mpp_meta_get_frame(meta, KEY_INPUT_FRAME, &frame_out) || frame_out != frame)
+        goto DONE;
+    if (mpp_meta_get_ptr(meta, KEY_ROI_DATA, &ptr) || ptr != &val)
+        goto DONE;
+    if (!mpp_meta_get_ptr(meta, KEY_OSD_DATA, &ptr) || ptr)
+        goto DONE;
+    if (mpp_meta_size(meta))
+        goto DONE;
+
+    ret = MPP_OK;
+DONE:
+    mpp_meta_put(meta);
+    mpp_log("meta function check %s\n", ret ? "failed" : "pass");
+    return ret;
+}
+
+static MPP_RET meta_bench(RK_S32 loop)
+{
+    MppFrame frame = (MppFrame)&loop;
+    MppPacket packet = (MppPacket)&frame;
+    RK_S64 time_get = 0;
+    RK_S64 time_set = 0;
+    RK_S64 time_read = 0;
+    RK_S64 time_put = 0;
+    RK_S64 start;
+    RK_S32 i;
+
+    for (i = 0; i < loop; i++) {
+        MppMeta meta = NULL;
+        MppFrame frm = NULL;
+        MppPacket pkt = NULL;
+        RK_S32 intra = 0;
+        RK_S32 tid = 0;
+
+        start = mpp_time();
+        mpp_meta_get(&meta);
+        time_get += mpp_time() - start;
+
+        start = mpp_time();
+        mpp_meta_set_frame(meta, KEY_INPUT_FRAME, frame);
+        mpp_meta_set_packet(meta, KEY_OUTPUT_PACKET, packet);
+        mpp_meta_set_s32(meta, KEY_OUTPUT_INTRA, i & 1);
+        mpp_meta_set_s32(meta, KEY_TEMPORAL_ID, i & 3);
+        time_set += mpp_time() - start;
+
+        start = mpp_time();
+        mpp_meta_get_frame(meta, KEY_INPUT_FRAME, &frm);
+        mpp_meta_get_packet(meta, KEY_OUTPUT_PACKET, &pkt);
+        mpp_meta_get_s32(meta, KEY_OUTPUT_INTRA, &intra);
+        mpp_meta_get_s32(meta, KEY_TEMPORAL_ID, &tid);
+        time_read += mpp_time() - start;
+
+        start = mpp_time();
+        mpp_meta_put(meta);
+        time_put += mpp_time() - start;
+
+        if (frm != frame || pkt != packet || intra != (i & 1) || tid != (i & 3)) {
+            mpp_err("meta bench value mismatch at loop %d\n", i);
+            return MPP_NOK;
+        }
+    }
+
+    mpp_log("meta bench loop %d avg ns: get %lld set x4 %lld get x4 %lld put %lld\n",
+            loop, time_get * 1000 / loop, time_set * 1000 / loop,
+            time_read * 1000 / loop, time_put * 1000 / loop);
+
+    return MPP_OK;
+}
+
+int main(int argc, char **argv)
+{
+    RK_S32 loop = MPP_META_TEST_LOOP;
+    MPP_RET ret = MPP_OK;
+
+    if (argc > 1)
+        loop = atoi(argv[1]);
+    if (loop <= 0)
+        loop = MPP_META_TEST_LOOP;
+
+    /* enable meta service alloc / reuse statistic log on exit */
+    mpp_env_set_u32("mpp_meta_debug", 0x10);
+
+    mpp_log("mpp_meta_test start\n");
+
+    ret = meta_check();
+    if (!ret)
+        ret = meta_bench(loop);
+
+    mpp_log("mpp_meta_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
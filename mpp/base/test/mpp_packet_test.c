@@ -17,11 +17,107 @@
 #define MODULE_TAG "mpp_packet_test"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "mpp_log.h"
+#include "mpp_time.h"
 #include "mpp_packet.h"
+#include "mpp_packet_impl.h"
 
 #define MPP_PACKET_TEST_SIZE    1024
+#define MPP_PACKET_BENCH_SIZE   (64 * 1024)
+#define MPP_PACKET_BENCH_LOOP   10000
+
+static void test_release(void *ctx, void *data)
+{
+    RK_S32 *count = (RK_S32 *)ctx;
+
+    (void)data;
+    (*count)++;
+}
+
+/* copy_init on borrowed packet refers to caller data and calls release once */
+static MPP_RET test_borrow(void *data, size_t size)
+{
+    MppPacket src = NULL;
+    MppPacket dst = NULL;
+    RK_S32 count = 0;
+    MPP_RET ret = MPP_NOK;
+
+    mpp_packet_init(&src, data, size);
+
+    /* without release callback the data is copied */
+    mpp_packet_copy_init(&dst, src);
+    if (mpp_packet_get_data(dst) == data)
+        goto DONE;
+    mpp_packet_deinit(&dst);
+
+    mpp_packet_set_release(src, test_release, &count);
+    mpp_packet_copy_init(&dst, src);
+    if (mpp_packet_get_data(dst) != data ||
+        mpp_packet_get_length(dst) != size)
+        goto DONE;
+
+    mpp_packet_deinit(&src);
+    if (count)
+        goto DONE;
+
+    mpp_packet_deinit(&dst);
+    if (count != 1)
+        goto DONE;
+
+    /* copy dropped on queue full must not return the data to caller */
+    mpp_packet_init(&src, data, size);
+    mpp_packet_set_release(src, test_release, &count);
+    mpp_packet_copy_init(&dst, src);
+    mpp_packet_drop_borrow(dst);
+    mpp_packet_deinit(&dst);
+    if (count != 1)
+        goto DONE;
+
+    /* the retried copy still borrows and releases once */
+    mpp_packet_copy_init(&dst, src);
+    if (mpp_packet_get_data(dst) != data)
+        goto DONE;
+
+    mpp_packet_deinit(&dst);
+    if (count != 2)
+        goto DONE;
+
+    ret = MPP_OK;
+DONE:
+    if (src)
+        mpp_packet_deinit(&src);
+    if (dst)
+        mpp_packet_deinit(&dst);
+    return ret;
+}
+
+static void bench_copy_init(void *data, RK_U32 borrow)
+{
+    MppPacket src = NULL;
+    RK_S32 count = 0;
+    RK_S64 start;
+    RK_S32 i;
+
+    mpp_packet_init(&src, data, MPP_PACKET_BENCH_SIZE);
+    if (borrow)
+        mpp_packet_set_release(src, test_release, &count);
+
+    start = mpp_time();
+    for (i = 0; i < MPP_PACKET_BENCH_LOOP; i++) {
+        MppPacket dst = NULL;
+
+        mpp_packet_copy_init(&dst, src);
+        mpp_packet_deinit(&dst);
+    }
+
+    mpp_log("copy_init %s %d bytes: %.3f us per packet\n",
+            borrow ? "borrow" : "copy  ", MPP_PACKET_BENCH_SIZE,
+            (float)(mpp_time() - start) / MPP_PACKET_BENCH_LOOP);
+
+    mpp_packet_deinit(&src);
+}
 
 int main()
 {
@@ -50,7 +146,21 @@ int main()
     }
     mpp_packet_deinit(&packet);
 
+    ret = test_borrow(data, size);
+    if (MPP_OK != ret) {
+        mpp_err("mpp_packet_test borrowed packet check failed\n");
+        goto MPP_PACKET_failed;
+    }
+
     free(data);
+
+    data = calloc(1, MPP_PACKET_BENCH_SIZE + 256);
+    if (data) {
+        bench_copy_init(data, 0);
+        bench_copy_init(data, 1);
+        free(data);
+    }
+
     mpp_log("mpp_packet_test success\n");
     return ret;
 
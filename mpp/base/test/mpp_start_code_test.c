@@ -0,0 +1,83 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_start_code_test"
+
+#include "mpp_log.h"
+#include "mpp_bitread.h"
+
+/*
+ * start code scanner check against a naive byte by byte scan
+ *
+ * The h264d parse_prepare on top of this scanner is checked by
+ * h264d_parse_test on generated and real streams.
+ */
+static RK_U32 rand_seed = 0x12345678;
+
+static RK_U32 rand_u32(void)
+{
+    rand_seed = rand_seed * 1103515245 + 12345;
+    return rand_seed >> 8;
+}
+
+static MPP_RET test_find_start_code(void)
+{
+    RK_U8 buf[64];
+    RK_S32 loop;
+
+    for (loop = 0; loop < 200000; loop++) {
+        RK_S32 len = rand_u32() % sizeof(buf) + 1;
+        RK_U32 prefix = (rand_u32() & 1) ? rand_u32() : rand_u32() & 0xffff01;
+        RK_U32 expect = len;
+        RK_U32 shift = prefix;
+        RK_S32 ret;
+        RK_S32 i;
+
+        /* small alphabet to get many start codes */
+        for (i = 0; i < len; i++)
+            buf[i] = rand_u32() % 3;
+
+        for (i = 0; i < len; i++) {
+            shift = (shift << 8) | buf[i];
+            if ((shift & 0x00FFFFFF) == 0x00000001) {
+                expect = i;
+                break;
+            }
+        }
+
+        ret = mpp_find_start_code_end(buf, len, prefix);
+        if (ret != (RK_S32)expect) {
+            mpp_err("find start code len %d prefix %08x ret %d expect %d\n",
+                    len, prefix, ret, expect);
+            return MPP_NOK;
+        }
+    }
+
+    mpp_log("find start code random check pass\n");
+    return MPP_OK;
+}
+
+int main(void)
+{
+    MPP_RET ret = MPP_OK;
+
+    mpp_log("mpp_start_code_test start\n");
+
+    ret = test_find_start_code();
+
+    mpp_log("mpp_start_code_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
@@ -78,6 +78,8 @@ MPP_RET dummy_dec_init(void *dec, ParserCfg *cfg)
 
     p = (DummyDec *)dec;
     p->frame_slots  = cfg->frame_slots;
+    /* mpp_dec checks unused frame slot before parse so setup slot count here */
+    mpp_buf_slot_setup(p->frame_slots, DUMMY_DEC_FRAME_COUNT);
     p->packet_slots = cfg->packet_slots;
     p->task_count   = cfg->task_count = 2;
     p->stream       = stream;
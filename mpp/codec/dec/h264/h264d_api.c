@@ -415,6 +415,7 @@ MPP_RET h264d_reset(void *decoder)
     p_strm->prefixdata      = 0xffffffff;
     p_strm->nalu_offset     = 0;
     p_strm->nalu_len        = 0;
+    p_strm->nalu_ref        = NULL;
     p_strm->head_offset     = 0;
     p_strm->startcode_found = 0;
     p_strm->endcode_found   = 0;
@@ -50,6 +50,7 @@
 #define H264D_DBG_WRITE_ES_EN       (0x00010000)   //!< write input ts stream
 #define H264D_DBG_FIELD_PAIRED      (0x00020000)
 #define H264D_DBG_DISCONTINUOUS     (0x00040000)
+#define H264D_DBG_BYTE_SCAN         (0x00080000)   //!< scan start code byte by byte
 
 extern RK_U32 rkv_h264d_parse_debug;
 
@@ -925,6 +926,7 @@ typedef struct h264d_curstrm_t {
     RK_S32    nalu_type;
     RK_U32    nalu_len;
     RK_U8     *nalu_buf;       //!< store read nalu data
+    RK_U8     *nalu_ref;       //!< nalu data view in input packet, NULL when in nalu_buf
 
     RK_U32    head_offset;
     RK_U32    head_max_size;
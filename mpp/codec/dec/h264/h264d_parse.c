@@ -36,6 +36,7 @@
 #define  HEAD_SYNTAX_MAX_SIZE        (12800)
 #define NALU_TYPE_NORMAL_LENGTH      (1)
 #define NALU_TYPE_EXT_LENGTH         (5)
+#define NALU_TYPE_SVC_LENGTH         (8)
 
 static const RK_U8 g_start_precode[3] = {0, 0, 1};
 
@@ -128,6 +129,7 @@ static void reset_nalu(H264dCurStream_t *p_strm)
     if (p_strm->endcode_found) {
         p_strm->startcode_found = p_strm->endcode_found;
         p_strm->nalu_len = 0;
+        p_strm->nalu_ref = NULL;
         p_strm->nalu_type = H264_NALU_TYPE_NULL;
         p_strm->endcode_found = 0;
     }
@@ -146,6 +148,92 @@ static void find_prefix_code(RK_U8 *p_data, H264dCurStream_t *p_strm)
     }
 }
 
+static RK_U8 *get_nalu_data(H264dCurStream_t *p_strm)
+{
+    return p_strm->nalu_ref ? p_strm->nalu_ref : p_strm->nalu_buf;
+}
+
+/*
+ * nalu length when judge_is_new_frame has nalu header and 4 bytes of slice
+ * data, the svc extension nalu has 3 more header bytes
+ */
+static RK_U32 get_judge_length(H264dCurStream_t *p_strm)
+{
+    RK_U32 nalu_type = p_strm->nalu_buf[0] & 0x1F;
+
+    if (nalu_type == H264_NALU_TYPE_PREFIX || nalu_type == H264_NALU_TYPE_SLC_EXT)
+        return NALU_TYPE_SVC_LENGTH;
+
+    return NALU_TYPE_EXT_LENGTH;
+}
+
+static MPP_RET reserve_nalu_buf(H264dCurStream_t *p_strm, RK_U32 size)
+{
+    MPP_RET ret = MPP_OK;
+
+    if (p_strm->nalu_len + size > p_strm->nalu_max_size) {
+        RK_U32 add_size = p_strm->nalu_len + size - p_strm->nalu_max_size;
+
+        ret = realloc_buffer(&p_strm->nalu_buf, &p_strm->nalu_max_size,
+                             MPP_MAX(NALU_BUF_ADD_SIZE, add_size));
+    }
+
+    return ret;
+}
+
+/*
+ * Consume the nalu payload in bulk until the byte which completes the next
+ * start code. That byte is left to the byte-wise loop in parse_prepare so
+ * the nalu boundary handling is exactly the same as the byte-wise one.
+ */
+static MPP_RET copy_nalu_data(H264dInputCtx_t *p_Inp, H264dCurStream_t *p_strm,
+                              MppPacketImpl *pkt_impl)
+{
+    MPP_RET ret = MPP_ERR_UNKNOW;
+    RK_U8 *src = &p_Inp->in_buf[p_strm->nalu_offset];
+    RK_S32 size = mpp_find_start_code_end(src, (RK_S32)pkt_impl->length,
+                                          p_strm->prefixdata);
+    RK_S32 i;
+
+    if (!size)
+        return ret = MPP_OK;
+
+    if (p_strm->startcode_found) {
+        /*
+         * When the whole nalu is in current input packet just refer to it
+         * and store_cur_nalu will copy it to the stream buffer directly.
+         */
+        if (!p_strm->nalu_ref && p_strm->nalu_offset >= p_strm->nalu_len)
+            p_strm->nalu_ref = src - p_strm->nalu_len;
+
+        if (p_strm->nalu_ref) {
+            p_strm->nalu_len += size;
+        } else {
+            FUN_CHECK(ret = reserve_nalu_buf(p_strm, size));
+            memcpy(&p_strm->nalu_buf[p_strm->nalu_len], src, size);
+            p_strm->nalu_len += size;
+        }
+    }
+
+    for (i = MPP_MAX(size - 4, 0); i < size; i++)
+        p_strm->prefixdata = (p_strm->prefixdata << 8) | src[i];
+
+    p_strm->curdata = &src[size - 1];
+    p_strm->nalu_offset += size;
+    pkt_impl->length -= size;
+
+    /* input packet will be released so keep the unfinished nalu data */
+    if (!pkt_impl->length && p_strm->nalu_ref) {
+        FUN_CHECK(ret = reserve_nalu_buf(p_strm, 0));
+        memcpy(p_strm->nalu_buf, p_strm->nalu_ref, p_strm->nalu_len);
+        p_strm->nalu_ref = NULL;
+    }
+
+    return ret = MPP_OK;
+__FAILED:
+    return ret;
+}
+
 static MPP_RET parser_nalu_header(H264_SLICE_t *currSlice)
 {
     MPP_RET ret = MPP_ERR_UNKNOW;
@@ -326,6 +414,7 @@ static MPP_RET store_cur_nalu(H264dCurCtx_t *p_Cur, H264dCurStream_t *p_strm, H2
 {
     MPP_RET ret = MPP_ERR_UNKNOW;
     RK_U8 *p_des = NULL;
+    RK_U8 *nalu_data = get_nalu_data(p_strm);
 
     //!< fill head buffer
     if (   (p_strm->nalu_type == H264_NALU_TYPE_SLICE)
@@ -347,7 +436,7 @@ static MPP_RET store_cur_nalu(H264dCurCtx_t *p_Cur, H264dCurStream_t *p_strm, H2
         ((H264dNaluHead_t *)p_des)->is_frame_end  = 0;
         ((H264dNaluHead_t *)p_des)->nalu_type = p_strm->nalu_type;
         ((H264dNaluHead_t *)p_des)->sodb_len = head_size;
-        memcpy(p_des + sizeof(H264dNaluHead_t), p_strm->nalu_buf, head_size);
+        memcpy(p_des + sizeof(H264dNaluHead_t), nalu_data, head_size);
         p_strm->head_offset += add_size;
     }    //!< fill sodb buffer
     if ((p_strm->nalu_type == H264_NALU_TYPE_SLICE)
@@ -361,7 +450,7 @@ static MPP_RET store_cur_nalu(H264dCurCtx_t *p_Cur, H264dCurStream_t *p_strm, H2
 
         p_des = &dxva_ctx->bitstream[dxva_ctx->strm_offset];
         memcpy(p_des, g_start_precode, sizeof(g_start_precode));
-        memcpy(p_des + sizeof(g_start_precode), p_strm->nalu_buf, p_strm->nalu_len);
+        memcpy(p_des + sizeof(g_start_precode), nalu_data, p_strm->nalu_len);
         dxva_ctx->strm_offset += add_size;
     }
     if (rkv_h264d_parse_debug & H264D_DBG_WRITE_ES_EN) {
@@ -371,7 +460,7 @@ static MPP_RET store_cur_nalu(H264dCurCtx_t *p_Cur, H264dCurStream_t *p_strm, H2
             if (p_Inp->spspps_update_flag) {
                 p_des = &p_Inp->spspps_buf[p_Inp->spspps_offset];
                 memcpy(p_des, g_start_precode, sizeof(g_start_precode));
-                memcpy(p_des + sizeof(g_start_precode), p_strm->nalu_buf, p_strm->nalu_len);
+                memcpy(p_des + sizeof(g_start_precode), nalu_data, p_strm->nalu_len);
                 p_Inp->spspps_offset += p_strm->nalu_len + sizeof(g_start_precode);
                 p_Inp->spspps_len = p_Inp->spspps_offset;
             }
@@ -552,16 +641,28 @@ MPP_RET parse_prepare(H264dInputCtx_t *p_Inp, H264dCurCtx_t *p_Cur)
         goto __RETURN;
     }
     while (pkt_impl->length > 0) {
+        /* nalu header bytes are checked byte by byte, the rest are in bulk */
+        if (!(rkv_h264d_parse_debug & H264D_DBG_BYTE_SCAN) &&
+            (!p_strm->startcode_found ||
+             (p_strm->nalu_len >= NALU_TYPE_EXT_LENGTH &&
+              p_strm->nalu_len >= get_judge_length(p_strm)))) {
+            FUN_CHECK(ret = copy_nalu_data(p_Inp, p_strm, pkt_impl));
+            if (!pkt_impl->length)
+                break;
+        }
+
         p_strm->curdata = &p_Inp->in_buf[p_strm->nalu_offset++];
         pkt_impl->length--;
         p_strm->prefixdata = (p_strm->prefixdata << 8) | (*p_strm->curdata);
-        if (p_strm->startcode_found) {
+        if (p_strm->startcode_found && p_strm->nalu_ref) {
+            p_strm->nalu_len++;
+        } else if (p_strm->startcode_found) {
             if (p_strm->nalu_len >= p_strm->nalu_max_size) {
                 FUN_CHECK(ret = realloc_buffer(&p_strm->nalu_buf, &p_strm->nalu_max_size, NALU_BUF_ADD_SIZE));
             }
             p_strm->nalu_buf[p_strm->nalu_len++] = *p_strm->curdata;
             if ((p_strm->nalu_len == NALU_TYPE_NORMAL_LENGTH)
-                || (p_strm->nalu_len == NALU_TYPE_EXT_LENGTH)) {
+                || (p_strm->nalu_len == get_judge_length(p_strm))) {
                 FUN_CHECK(ret = judge_is_new_frame(p_Cur, p_strm));
                 if (p_Cur->p_Dec->is_new_frame) {
                     FUN_CHECK(ret = add_empty_nalu(&p_Cur->strm));
@@ -576,9 +677,11 @@ MPP_RET parse_prepare(H264dInputCtx_t *p_Inp, H264dCurCtx_t *p_Cur)
         find_prefix_code(p_strm->curdata, p_strm);
 
         if (p_strm->endcode_found) {
+            RK_U8 *nalu_data = get_nalu_data(p_strm);
+
             p_strm->nalu_len -= START_PREFIX_3BYTE;
             if (p_strm->nalu_len > START_PREFIX_3BYTE) {
-                while (p_strm->nalu_buf[p_strm->nalu_len - 1] == 0x00) {
+                while (nalu_data[p_strm->nalu_len - 1] == 0x00) {
                     p_strm->nalu_len--;
                 }
             }
@@ -599,6 +702,11 @@ __RETURN:
 
     return ret = MPP_OK;
 __FAILED:
+    /* the consumed bytes are gone, keep offset valid for next packet */
+    p_Inp->in_length = pkt_impl->length;
+    if (!p_Inp->in_length)
+        p_strm->nalu_offset = 0;
+
     return ret;
 }
 
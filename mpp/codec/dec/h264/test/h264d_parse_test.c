@@ -0,0 +1,439 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "h264d_parse_test"
+
+#include <string.h>
+
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_time.h"
+#include "mpp_common.h"
+#include "mpp_packet.h"
+
+#include "h264d_global.h"
+#include "h264d_parse.h"
+
+/*
+ * parse_prepare start code scan equivalence test and benchmark
+ *
+ * Two parser contexts run parse_prepare in lock step on the same packets.
+ * The reference one scans byte by byte with H264D_DBG_BYTE_SCAN and the
+ * other one uses the bulk scan. After each call the stream state, the
+ * stored nalu headers and the slice stream must be exactly the same.
+ *
+ * Packets are cut from the stream in random size and the packet memory is
+ * scribbled after it is consumed to catch nalu referring to a gone packet.
+ *
+ * The corpus is generated streams and optional Annex-B files from command
+ * line: h264d_parse_test [file0.h264 file1.h264 ...]
+ */
+#define STREAM_GEN_COUNT        64
+#define STREAM_GEN_SIZE         SZ_256K
+#define STREAM_BENCH_SIZE       (SZ_1M * 32)
+#define STREAM_BENCH_LOOP       4
+
+typedef struct H264dParseCtx_t {
+    H264_DecCtx_t       dec;
+    H264dInputCtx_t     inp;
+    H264dCurCtx_t       cur;
+    H264dDxvaCtx_t      dxva;
+    MppPacket           pkt;
+    RK_U32              byte_scan;
+    RK_S32              task_cnt;
+} H264dParseCtx;
+
+static RK_U32 rand_seed = 0x12345678;
+
+static RK_U32 rand_u32(void)
+{
+    rand_seed = rand_seed * 1103515245 + 12345;
+    return rand_seed >> 8;
+}
+
+static MPP_RET parse_ctx_init(H264dParseCtx **ctx, RK_U32 byte_scan)
+{
+    H264dParseCtx *p = mpp_calloc(H264dParseCtx, 1);
+    H264dCurStream_t *strm = NULL;
+
+    if (NULL == p)
+        return MPP_ERR_MALLOC;
+
+    p->dec.p_Inp = &p->inp;
+    p->dec.p_Cur = &p->cur;
+    p->dec.dxva_ctx = &p->dxva;
+    p->inp.p_Dec = &p->dec;
+    p->inp.p_Cur = &p->cur;
+    p->cur.p_Dec = &p->dec;
+    p->cur.p_Inp = &p->inp;
+    p->dxva.p_Dec = &p->dec;
+
+    strm = &p->cur.strm;
+    strm->nalu_max_size = NALU_BUF_MAX_SIZE;
+    strm->nalu_buf = mpp_malloc(RK_U8, strm->nalu_max_size);
+    strm->head_max_size = HEAD_BUF_MAX_SIZE;
+    strm->head_buf = mpp_malloc(RK_U8, strm->head_max_size);
+    strm->prefixdata = 0xffffffff;
+    p->dxva.max_strm_size = BITSTREAM_MAX_SIZE;
+    p->dxva.bitstream = mpp_malloc(RK_U8, p->dxva.max_strm_size);
+    p->byte_scan = byte_scan;
+
+    *ctx = p;
+
+    if (NULL == strm->nalu_buf || NULL == strm->head_buf || NULL == p->dxva.bitstream)
+        return MPP_ERR_MALLOC;
+
+    return MPP_OK;
+}
+
+static void parse_ctx_deinit(H264dParseCtx *p)
+{
+    if (NULL == p)
+        return ;
+
+    MPP_FREE(p->cur.strm.nalu_buf);
+    MPP_FREE(p->cur.strm.head_buf);
+    MPP_FREE(p->dxva.bitstream);
+    mpp_free(p);
+}
+
+/* one parse_prepare call like h264d_prepare on packet */
+static MPP_RET parse_ctx_run(H264dParseCtx *p, RK_U32 eos)
+{
+    MPP_RET ret;
+
+    p->inp.in_pkt = p->pkt;
+    p->inp.in_length = mpp_packet_get_length(p->pkt);
+    p->inp.in_buf = (RK_U8 *)mpp_packet_get_pos(p->pkt);
+    p->inp.pkt_eos = eos;
+
+    if (p->byte_scan)
+        rkv_h264d_parse_debug |= H264D_DBG_BYTE_SCAN;
+    else
+        rkv_h264d_parse_debug &= ~H264D_DBG_BYTE_SCAN;
+
+    ret = parse_prepare(&p->inp, &p->cur);
+    if (p->inp.task_valid)
+        p->task_cnt++;
+
+    return ret;
+}
+
+static MPP_RET parse_ctx_check(const char *name, H264dParseCtx *ref,
+                               H264dParseCtx *dut, RK_U32 strm_start,
+                               RK_U32 head_start)
+{
+    H264dCurStream_t *s0 = &ref->cur.strm;
+    H264dCurStream_t *s1 = &dut->cur.strm;
+
+    if (ref->dec.nalu_ret != dut->dec.nalu_ret ||
+        ref->inp.task_valid != dut->inp.task_valid ||
+        ref->inp.in_length != dut->inp.in_length ||
+        mpp_packet_get_length(ref->pkt) != mpp_packet_get_length(dut->pkt)) {
+        mpp_err("%s task %d return mismatch nalu_ret %d:%d valid %d:%d len %d:%d\n",
+                name, ref->task_cnt, ref->dec.nalu_ret, dut->dec.nalu_ret,
+                ref->inp.task_valid, dut->inp.task_valid,
+                (RK_S32)ref->inp.in_length, (RK_S32)dut->inp.in_length);
+        return MPP_NOK;
+    }
+
+    if (s0->nalu_offset != s1->nalu_offset || s0->nalu_len != s1->nalu_len ||
+        s0->nalu_type != s1->nalu_type || s0->prefixdata != s1->prefixdata ||
+        s0->startcode_found != s1->startcode_found ||
+        s0->endcode_found != s1->endcode_found) {
+        mpp_err("%s task %d stream mismatch offset %d:%d nalu len %d:%d type %d:%d\n",
+                name, ref->task_cnt, s0->nalu_offset, s1->nalu_offset,
+                s0->nalu_len, s1->nalu_len, s0->nalu_type, s1->nalu_type);
+        return MPP_NOK;
+    }
+
+    /* only new stored data is compared, the older one is checked already */
+    if (s0->head_offset != s1->head_offset ||
+        (s0->head_offset > head_start &&
+         memcmp(s0->head_buf + head_start, s1->head_buf + head_start,
+                s0->head_offset - head_start))) {
+        mpp_err("%s task %d nalu head mismatch size %d:%d\n", name,
+                ref->task_cnt, s0->head_offset, s1->head_offset);
+        return MPP_NOK;
+    }
+
+    if (ref->dxva.strm_offset != dut->dxva.strm_offset ||
+        (ref->dxva.strm_offset > strm_start &&
+         memcmp(ref->dxva.bitstream + strm_start, dut->dxva.bitstream + strm_start,
+                ref->dxva.strm_offset - strm_start))) {
+        mpp_err("%s task %d slice stream mismatch size %d:%d\n", name,
+                ref->task_cnt, ref->dxva.strm_offset, dut->dxva.strm_offset);
+        return MPP_NOK;
+    }
+
+    return MPP_OK;
+}
+
+static MPP_RET parse_ctx_step(const char *name, H264dParseCtx *ref,
+                              H264dParseCtx *dut, RK_U32 eos)
+{
+    RK_U32 strm_start = ref->dxva.strm_offset;
+    RK_U32 head_start = ref->cur.strm.head_offset;
+    MPP_RET ret0 = parse_ctx_run(ref, eos);
+    MPP_RET ret1 = parse_ctx_run(dut, eos);
+
+    if (ret0 != ret1) {
+        mpp_err("%s task %d parse_prepare return %d:%d\n", name,
+                ref->task_cnt, ret0, ret1);
+        return MPP_NOK;
+    }
+
+    if (ref->inp.task_valid)
+        head_start = 0;
+
+    ret0 = parse_ctx_check(name, ref, dut, strm_start, head_start);
+
+    /* task is taken by parser and stream buffer is reused */
+    if (ref->inp.task_valid) {
+        ref->dxva.strm_offset = 0;
+        dut->dxva.strm_offset = 0;
+    }
+
+    return ret0;
+}
+
+static MPP_RET check_parse(const char *name, const RK_U8 *data, RK_S32 len)
+{
+    RK_S32 max_chunks[] = { 0, 1, 3, 7, 64, 4096 };
+    MPP_RET ret = MPP_OK;
+    RK_U32 i;
+
+    for (i = 0; i < MPP_ARRAY_ELEMS(max_chunks) && !ret; i++) {
+        H264dParseCtx *ref = NULL;
+        H264dParseCtx *dut = NULL;
+        RK_S32 pos = 0;
+
+        ret = parse_ctx_init(&ref, 1);
+        if (!ret)
+            ret = parse_ctx_init(&dut, 0);
+
+        while (!ret && pos < len) {
+            RK_S32 chunk = max_chunks[i] ? (RK_S32)(rand_u32() % max_chunks[i]) + 1 : len;
+            RK_U8 *buf = NULL;
+
+            chunk = MPP_MIN(chunk, len - pos);
+            buf = mpp_malloc(RK_U8, chunk);
+            if (NULL == buf) {
+                ret = MPP_ERR_MALLOC;
+                break;
+            }
+
+            memcpy(buf, data + pos, chunk);
+            mpp_packet_init(&ref->pkt, buf, chunk);
+            mpp_packet_init(&dut->pkt, buf, chunk);
+
+            while (!ret && mpp_packet_get_length(ref->pkt))
+                ret = parse_ctx_step(name, ref, dut, 0);
+
+            /* packet is returned to user and its memory is reused */
+            memset(buf, 0xa5, chunk);
+            mpp_packet_deinit(&ref->pkt);
+            mpp_packet_deinit(&dut->pkt);
+            MPP_FREE(buf);
+
+            pos += chunk;
+        }
+
+        /* flush last nalu by eos */
+        if (!ret) {
+            mpp_packet_init(&ref->pkt, NULL, 0);
+            mpp_packet_init(&dut->pkt, NULL, 0);
+            ret = parse_ctx_step(name, ref, dut, 1);
+            mpp_packet_deinit(&ref->pkt);
+            mpp_packet_deinit(&dut->pkt);
+        }
+
+        if (ret)
+            mpp_err("%s max chunk %d failed\n", name, max_chunks[i]);
+
+        parse_ctx_deinit(ref);
+        parse_ctx_deinit(dut);
+    }
+
+    return ret;
+}
+
+/*
+ * generate annex-b stream with emulation prevention
+ * zero_rate controls the zero byte probability to stress the scanner
+ */
+static RK_S32 gen_stream(RK_U8 *buf, RK_S32 size, RK_S32 max_nalu, RK_U32 zero_rate)
+{
+    RK_S32 pos = 0;
+
+    while (pos + 8 < size) {
+        RK_S32 nalu_size = rand_u32() % max_nalu + 1;
+        RK_S32 zeros = 0;
+        RK_S32 i;
+
+        /* random 3 / 4 bytes start code and leading zero bytes */
+        if (rand_u32() & 1)
+            buf[pos++] = 0;
+        buf[pos++] = 0;
+        buf[pos++] = 0;
+        buf[pos++] = 1;
+        /* non-zero nalu header */
+        buf[pos++] = (rand_u32() % 0x7f) + 1;
+
+        for (i = 0; i < nalu_size && pos + 2 < size; i++) {
+            RK_U8 byte = (rand_u32() % zero_rate) ? (RK_U8)rand_u32() : 0;
+
+            if (zeros >= 2 && byte <= 3) {
+                buf[pos++] = 3;
+                zeros = 0;
+            }
+
+            buf[pos++] = byte;
+            zeros = byte ? 0 : zeros + 1;
+        }
+
+        /* cabac_zero_word / trailing zero bytes */
+        if (!(rand_u32() % 4) && pos + 2 < size) {
+            buf[pos++] = 0;
+            buf[pos++] = 0;
+        }
+    }
+
+    return pos;
+}
+
+static MPP_RET test_corpus_file(const char *file)
+{
+    FILE *fp = fopen(file, "rb");
+    RK_U8 *data = NULL;
+    RK_S32 len = 0;
+    MPP_RET ret = MPP_NOK;
+
+    if (NULL == fp) {
+        mpp_err("failed to open %s\n", file);
+        return MPP_NOK;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    data = mpp_malloc(RK_U8, len);
+    if (data && (RK_S32)fread(data, 1, len, fp) == len)
+        ret = check_parse(file, data, len);
+
+    mpp_log("corpus %s size %d %s\n", file, len, ret ? "failed" : "pass");
+
+    MPP_FREE(data);
+    fclose(fp);
+    return ret;
+}
+
+static void bench_parse(void)
+{
+    RK_U8 *data = mpp_malloc(RK_U8, STREAM_BENCH_SIZE);
+    RK_S32 len;
+    RK_U32 byte_scan;
+
+    if (NULL == data)
+        return ;
+
+    /* high bitrate stream: big slices with uniform random payload */
+    len = gen_stream(data, STREAM_BENCH_SIZE, SZ_512K, 256);
+
+    for (byte_scan = 0; byte_scan < 2; byte_scan++) {
+        RK_S64 start = mpp_time();
+        RK_S64 cost;
+        RK_S32 count = 0;
+        RK_S32 i;
+
+        for (i = 0; i < STREAM_BENCH_LOOP; i++) {
+            H264dParseCtx *p = NULL;
+            RK_S32 pos = 0;
+
+            if (parse_ctx_init(&p, byte_scan)) {
+                parse_ctx_deinit(p);
+                break;
+            }
+
+            while (pos < len) {
+                RK_S32 chunk = MPP_MIN(SZ_256K, len - pos);
+
+                mpp_packet_init(&p->pkt, data + pos, chunk);
+                while (mpp_packet_get_length(p->pkt)) {
+                    parse_ctx_run(p, 0);
+                    /* only the split speed is measured, drop stored data */
+                    p->dxva.strm_offset = 0;
+                    p->cur.strm.head_offset = 0;
+                }
+                mpp_packet_deinit(&p->pkt);
+                pos += chunk;
+            }
+
+            count = p->task_cnt;
+            parse_ctx_deinit(p);
+        }
+
+        cost = mpp_time() - start;
+        mpp_log("%s scan %d task %7.2f MB/s\n", byte_scan ? "byte" : "bulk", count,
+                (float)len * STREAM_BENCH_LOOP / MPP_MAX(cost, 1));
+    }
+
+    MPP_FREE(data);
+}
+
+int main(int argc, char **argv)
+{
+    RK_U32 zero_rates[] = { 2, 4, 16, 256 };
+    RK_S32 max_nalus[] = { 4, 64, 4096 };
+    RK_U8 *data = NULL;
+    MPP_RET ret = MPP_OK;
+    RK_S32 i;
+
+    mpp_log("h264d_parse_test start\n");
+
+    data = mpp_malloc(RK_U8, STREAM_GEN_SIZE);
+    if (NULL == data) {
+        ret = MPP_ERR_MALLOC;
+        goto DONE;
+    }
+
+    for (i = 0; i < STREAM_GEN_COUNT; i++) {
+        RK_U32 zero_rate = zero_rates[i % MPP_ARRAY_ELEMS(zero_rates)];
+        RK_S32 max_nalu = max_nalus[i % MPP_ARRAY_ELEMS(max_nalus)];
+        RK_S32 len = gen_stream(data, STREAM_GEN_SIZE, max_nalu, zero_rate);
+        char name[32];
+
+        snprintf(name, sizeof(name), "gen_%d", i);
+        ret = check_parse(name, data, len);
+        if (ret)
+            goto DONE;
+    }
+    mpp_log("generated corpus %d streams pass\n", STREAM_GEN_COUNT);
+
+    for (i = 1; i < argc; i++) {
+        ret = test_corpus_file(argv[i]);
+        if (ret)
+            goto DONE;
+    }
+
+    bench_parse();
+
+DONE:
+    MPP_FREE(data);
+    mpp_log("h264d_parse_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
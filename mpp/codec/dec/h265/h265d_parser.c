@@ -1450,6 +1450,22 @@ RK_S32 mpp_hevc_extract_rbsp(HEVCContext *s, const RK_U8 *src, int length,
     }
 #endif
 
+    /*
+     * Emulation prevention bytes are skipped by bitread pre-detection so the
+     * nal just refers to the input stream here. Slice nal is copied once into
+     * the hal stream buffer by h265d_syntax_fill_slice and the other nals are
+     * kept in rbsp_buffer by hevc_keep_nal.
+     */
+    nal->data = src;
+    nal->size = length;
+
+    return length;
+}
+
+static MPP_RET hevc_keep_nal(HEVCNAL *nal)
+{
+    RK_S32 length = nal->size;
+
     if (length + MPP_INPUT_BUFFER_PADDING_SIZE > nal->rbsp_buffer_size) {
         RK_S32 min_size = length + MPP_INPUT_BUFFER_PADDING_SIZE;
         mpp_free(nal->rbsp_buffer);
@@ -1457,17 +1473,17 @@ RK_S32 mpp_hevc_extract_rbsp(HEVCContext *s, const RK_U8 *src, int length,
         min_size = MPP_MAX(17 * min_size / 16 + 32, min_size);
         nal->rbsp_buffer = mpp_malloc(RK_U8, min_size);
         if (nal->rbsp_buffer == NULL) {
-            min_size = 0;
+            nal->rbsp_buffer_size = 0;
+            return MPP_ERR_NOMEM;
         }
         nal->rbsp_buffer_size = min_size;
     }
 
-    memcpy(nal->rbsp_buffer, src, length);
+    memcpy(nal->rbsp_buffer, nal->data, length);
     nal->data = nal->rbsp_buffer;
-    nal->size = length;
 
     memset(nal->rbsp_buffer + length, 0, MPP_INPUT_BUFFER_PADDING_SIZE);
-    return length;
+    return MPP_OK;
 }
 
 static RK_S32 split_nal_units(HEVCContext *s, RK_U8 *buf, RK_U32 length)
@@ -1568,6 +1584,13 @@ static RK_S32 split_nal_units(HEVCContext *s, RK_U8 *buf, RK_U32 length)
         mpp_set_pre_detection(&s->HEVClc->gb);
         hls_nal_unit(s);
 
+        /* input stream may be released before parse so keep non-slice nal */
+        if (s->nal_unit_type >= NAL_VPS) {
+            ret = hevc_keep_nal(nal);
+            if (ret)
+                goto fail;
+        }
+
         if (s->nal_unit_type < NAL_VPS) {
 
             if (nal->size != consumed)
@@ -694,11 +694,7 @@ RK_S32 h264e_slice_write(H264eSlice *slice, void *p, RK_U32 size)
 
     mpp_writer_flush(s);
 
-    bitCnt = s->buffered_bits + s->byte_cnt * 8;
-
-    // update on cabac mode
-    if (slice->entropy_coding_mode)
-        bitCnt = s->buffered_bits + s->byte_cnt * 8;
+    bitCnt = mpp_writer_bits(s);
 
     if (h264e_debug & H264E_DBG_SLICE) {
         RK_S32 pos = 0;
@@ -715,8 +711,16 @@ RK_S32 h264e_slice_write(H264eSlice *slice, void *p, RK_U32 size)
     return bitCnt;
 }
 
-static RK_S32 frame_no = 0;
+#define HAVE_03_BYTE(x) \
+    ((((x) ^ 0x0303030303030303ULL) - 0x0101010101010101ULL) & \
+     ~((x) ^ 0x0303030303030303ULL) & 0x8080808080808080ULL)
 
+/*
+ * Move slice data from src_bit in src to dst_bit in dst.
+ * The emulation prevention bytes in src are removed and the data is written
+ * through the bit writer which inserts the emulation prevention bytes for
+ * dst. Return the change of emulation prevention byte count.
+ */
 RK_S32 h264e_slice_move(RK_U8 *dst, RK_U8 *src, RK_S32 dst_bit, RK_S32 src_bit, RK_S32 src_size)
 {
     RK_S32 dst_byte = dst_bit / 8;
@@ -739,99 +743,67 @@ RK_S32 h264e_slice_move(RK_U8 *dst, RK_U8 *src, RK_S32 dst_bit, RK_S32 src_bit,
         return diff_len;
     }
 
+    MppWriteCtx stream;
+    MppWriteCtx *s = &stream;
     RK_U8 *psrc = src + src_byte;
-    RK_U8 *pdst = dst + dst_byte;
-
-    RK_U16 tmp16a, tmp16b, tmp16c, last_tmp, dst_mask;
-    RK_U8 tmp0, tmp1;
-    RK_U32 loop = src_len + (src_bit_r > 0);
-    RK_U32 i = 0;
-    RK_U32 src_zero_cnt = 0;
-    RK_U32 dst_zero_cnt = 0;
-    RK_U32 dst_len = 0;
-
-    last_tmp = (RK_U16)pdst[0];
-    dst_mask = 0xFFFF << (8 - dst_bit_r);
+    RK_S32 zero_cnt = (psrc[0] == 0);
+    RK_S32 i = 1;
 
-    h264e_dbg_slice("bit [%d %d] [%d %d] [%d %d] loop %d mask %04x last %04x\n",
+    h264e_dbg_slice("bit [%d %d] [%d %d] [%d %d] len %d\n",
                     src_bit, dst_bit, src_byte, dst_byte,
-                    src_bit_r, dst_bit_r, loop, dst_mask, last_tmp);
-
-    for (i = 0; i < loop; i++) {
-        if (psrc[0] == 0) {
-            src_zero_cnt++;
-        } else {
-            src_zero_cnt = 0;
-        }
-
-        // tmp0 tmp1 is next two non-aligned bytes from src
-        tmp0 = psrc[0];
-        tmp1 = (i < loop - 1) ? psrc[1] : 0;
-
-        if (src_zero_cnt >= 2 && tmp1 == 3) {
-            if (h264e_debug & H264E_DBG_SLICE)
-                mpp_log("found 03 at src pos %d %02x %02x %02x %02x %02x %02x %02x %02x\n",
-                        i, psrc[-2], psrc[-1], psrc[0], psrc[1], psrc[2],
-                        psrc[3], psrc[4], psrc[5]);
-
-            psrc++;
-            i++;
-            tmp1 = psrc[1];
-            src_zero_cnt = 0;
-            diff_len--;
-        }
-        // get U16 data
-        tmp16a = ((RK_U16)tmp0 << 8) | (RK_U16)tmp1;
-
-        if (src_bit_r) {
-            tmp16b = tmp16a << src_bit_r;
-        } else {
-            tmp16b = tmp16a;
-        }
-
-        if (dst_bit_r)
-            tmp16c = tmp16b >> dst_bit_r | ((last_tmp << 8) & dst_mask);
-        else
-            tmp16c = tmp16b;
-
-        pdst[0] = (tmp16c >> 8) & 0xFF;
-        pdst[1] = tmp16c & 0xFF;
-
-        if (h264e_debug & H264E_DBG_SLICE) {
-            if (i < 10) {
-                mpp_log("%03d src [%04x] -> [%04x] + last [%04x] -> %04x\n", i, tmp16a, tmp16b, last_tmp, tmp16c);
-            }
-            if (i >= loop - 10) {
-                mpp_log("%03d src [%04x] -> [%04x] + last [%04x] -> %04x\n", i, tmp16a, tmp16b, last_tmp, tmp16c);
+                    src_bit_r, dst_bit_r, src_len);
+
+    /* at most one 0x03 byte is inserted for every two bytes */
+    mpp_writer_init(s, dst, dst_byte + src_len + src_len / 2 + 2);
+    mpp_writer_skip_bits(s, dst_bit);
+
+    /* first byte is partially used by the old slice header */
+    mpp_writer_put_bits(s, psrc[0] & (0xff >> src_bit_r), 8 - src_bit_r);
+
+    while (i < src_len) {
+        RK_U8 byte;
+
+        /* copy 8 bytes at once when there is no 0x03 byte */
+        if (i + 8 <= src_len) {
+            RK_U64 val = ((RK_U64)psrc[i + 0] << 56) | ((RK_U64)psrc[i + 1] << 48) |
+                         ((RK_U64)psrc[i + 2] << 40) | ((RK_U64)psrc[i + 3] << 32) |
+                         ((RK_U64)psrc[i + 4] << 24) | ((RK_U64)psrc[i + 5] << 16) |
+                         ((RK_U64)psrc[i + 6] << 8) | ((RK_U64)psrc[i + 7]);
+
+            if (!HAVE_03_BYTE(val)) {
+                mpp_writer_put_bits(s, (RK_U32)(val >> 32), 32);
+                mpp_writer_put_bits(s, (RK_U32)val, 32);
+
+                if (val & 0xff)
+                    zero_cnt = 0;
+                else if (val & 0xff00)
+                    zero_cnt = 1;
+                else
+                    zero_cnt = 2;
+
+                i += 8;
+                continue;
             }
         }
 
-        if (dst_zero_cnt == 2 && pdst[0] <= 0x3) {
-            if (h264e_debug & H264E_DBG_SLICE)
-                mpp_log("found 03 at dst frame %d pos %d\n", frame_no, dst_len);
-
-            pdst[2] = pdst[1];
-            pdst[1] = pdst[0];
-            pdst[0] = 0x3;
-            pdst++;
-            diff_len++;
-            dst_len++;
-            dst_zero_cnt = 0;
+        byte = psrc[i++];
+        if (zero_cnt >= 2 && byte == 3) {
+            h264e_dbg_slice("found 03 at src pos %d\n", i - 1);
+            zero_cnt = 0;
+            diff_len--;
+            continue;
         }
 
-        if (pdst[0] == 0)
-            dst_zero_cnt++;
-        else
-            dst_zero_cnt = 0;
-
-        last_tmp = tmp16c;
-
-        psrc++;
-        pdst++;
-        dst_len++;
+        zero_cnt = byte ? 0 : zero_cnt + 1;
+        mpp_writer_put_bits(s, byte, 8);
     }
 
-    frame_no++;
+    /* pad the last byte with zero and check it for emulation prevention */
+    if (s->buffered_bits & 7)
+        mpp_writer_put_bits(s, 0, 8 - (s->buffered_bits & 7));
+
+    mpp_writer_flush(s);
+    diff_len += s->emul_cnt;
 
     return diff_len;
 }
@@ -906,7 +878,7 @@ RK_S32 h264e_slice_write_prefix_nal_unit_svc(H264ePrefixNal *prefix, void *p, RK
 
     mpp_writer_flush(s);
 
-    bitCnt = s->buffered_bits + s->byte_cnt * 8;
+    bitCnt = mpp_writer_bits(s);
 
     return bitCnt;
 }
@@ -0,0 +1,261 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "h264e_slice_test"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_time.h"
+
+#include "h264e_slice.h"
+
+/*
+ * h264e_slice_move check and benchmark
+ *
+ * The slice data of a random escaped nal is moved to a new bit position and
+ * compared with the byte-wise reference. Then multi-megabyte slices are moved
+ * by both for the benchmark.
+ *
+ * usage: h264e_slice_test [bench slice size in MB]
+ */
+#define SLICE_CHECK_LOOP        500
+#define SLICE_CHECK_SIZE        512
+#define SLICE_BENCH_SIZE        4
+#define SLICE_BENCH_LOOP        4
+#define SLICE_BENCH_ZERO_RATIO  16
+/* room for reference reading and writing past the end */
+#define SLICE_PADDING           16
+
+/* the byte-wise slice move before the bit writer version */
+static RK_S32 ref_slice_move(RK_U8 *dst, RK_U8 *src, RK_S32 dst_bit, RK_S32 src_bit, RK_S32 src_size)
+{
+    RK_S32 dst_byte = dst_bit / 8;
+    RK_S32 src_byte = src_bit / 8;
+    RK_S32 dst_bit_r = dst_bit & 7;
+    RK_S32 src_bit_r = src_bit & 7;
+    RK_S32 src_len = src_size - src_byte;
+    RK_S32 diff_len = 0;
+    RK_U8 *psrc = src + src_byte;
+    RK_U8 *pdst = dst + dst_byte;
+    RK_U16 tmp16a, tmp16b, tmp16c, last_tmp, dst_mask;
+    RK_U8 tmp0, tmp1;
+    RK_U32 loop = src_len + (src_bit_r > 0);
+    RK_U32 src_zero_cnt = 0;
+    RK_U32 dst_zero_cnt = 0;
+    RK_U32 i;
+
+    if (src_bit_r == 0 && dst_bit_r == 0) {
+        memcpy(dst + dst_byte, src + src_byte, src_len);
+        return diff_len;
+    }
+
+    last_tmp = (RK_U16)pdst[0];
+    dst_mask = 0xFFFF << (8 - dst_bit_r);
+
+    for (i = 0; i < loop; i++) {
+        if (psrc[0] == 0)
+            src_zero_cnt++;
+        else
+            src_zero_cnt = 0;
+
+        tmp0 = psrc[0];
+        tmp1 = (i < loop - 1) ? psrc[1] : 0;
+
+        if (src_zero_cnt >= 2 && tmp1 == 3) {
+            psrc++;
+            i++;
+            tmp1 = psrc[1];
+            src_zero_cnt = 0;
+            diff_len--;
+        }
+
+        tmp16a = ((RK_U16)tmp0 << 8) | (RK_U16)tmp1;
+        tmp16b = src_bit_r ? tmp16a << src_bit_r : tmp16a;
+        tmp16c = dst_bit_r ? (tmp16b >> dst_bit_r | ((last_tmp << 8) & dst_mask)) : tmp16b;
+
+        pdst[0] = (tmp16c >> 8) & 0xFF;
+        pdst[1] = tmp16c & 0xFF;
+
+        if (dst_zero_cnt == 2 && pdst[0] <= 0x3) {
+            pdst[2] = pdst[1];
+            pdst[1] = pdst[0];
+            pdst[0] = 0x3;
+            pdst++;
+            diff_len++;
+            dst_zero_cnt = 0;
+        }
+
+        if (pdst[0] == 0)
+            dst_zero_cnt++;
+        else
+            dst_zero_cnt = 0;
+
+        last_tmp = tmp16c;
+        psrc++;
+        pdst++;
+    }
+
+    return diff_len;
+}
+
+/*
+ * random escaped nal ending with rbsp stop bit, one of zero_ratio bytes
+ * is zero in rbsp
+ */
+static RK_S32 gen_slice(RK_U8 *buf, RK_S32 size, RK_S32 zero_ratio)
+{
+    RK_S32 zero_cnt = 0;
+    RK_S32 len = 0;
+
+    while (len < size - 2) {
+        RK_U8 byte = (rand() % zero_ratio) ? (RK_U8)(1 + rand() % 255) : 0;
+
+        if (zero_cnt == 2 && byte < 4) {
+            buf[len++] = 3;
+            zero_cnt = 0;
+        }
+
+        buf[len++] = byte;
+        zero_cnt = byte ? 0 : zero_cnt + 1;
+    }
+
+    buf[len++] = 0x80;
+    return len;
+}
+
+/* output length computed in the same way as the stream amend in hal */
+static RK_S32 get_move_len(RK_U8 *src, RK_S32 size, RK_S32 dst_bit, RK_S32 src_bit, RK_S32 diff)
+{
+    RK_U8 tail = src[size - 1];
+    RK_S32 tail_0bit = 0;
+
+    while (!(tail & 1) && tail_0bit < 8) {
+        tail >>= 1;
+        tail_0bit++;
+    }
+
+    return (size * 8 - tail_0bit + dst_bit - src_bit + diff * 8 + 7) / 8;
+}
+
+static MPP_RET slice_move_check(void)
+{
+    RK_S32 buf_size = SLICE_CHECK_SIZE * 2 + SLICE_PADDING;
+    RK_U8 *src = mpp_calloc(RK_U8, buf_size);
+    RK_U8 *dst = mpp_calloc(RK_U8, buf_size);
+    RK_U8 *ref = mpp_calloc(RK_U8, buf_size);
+    MPP_RET ret = MPP_NOK;
+    RK_S32 loop;
+
+    if (!src || !dst || !ref)
+        goto DONE;
+
+    for (loop = 0; loop < SLICE_CHECK_LOOP; loop++) {
+        RK_S32 size = gen_slice(src, 16 + rand() % SLICE_CHECK_SIZE, 1 + loop % 4);
+        RK_S32 src_bit = rand() % 64;
+        RK_S32 dst_bit = rand() % 64;
+        RK_S32 diff;
+        RK_S32 diff_ref;
+        RK_S32 len;
+        RK_S32 i;
+
+        for (i = 0; i < buf_size; i++)
+            dst[i] = ref[i] = (RK_U8)rand();
+
+        /* header writer leaves zero bits after the header in the last byte */
+        dst[dst_bit / 8] &= 0xff << (8 - (dst_bit & 7));
+        ref[dst_bit / 8] = dst[dst_bit / 8];
+
+        diff = h264e_slice_move(dst, src, dst_bit, src_bit, size);
+        diff_ref = ref_slice_move(ref, src, dst_bit, src_bit, size);
+        len = get_move_len(src, size, dst_bit, src_bit, diff);
+
+        if (diff != diff_ref || memcmp(dst, ref, len)) {
+            mpp_err("loop %d size %d bit src %d dst %d diff %d mismatch ref %d\n",
+                    loop, size, src_bit, dst_bit, diff, diff_ref);
+            goto DONE;
+        }
+    }
+
+    ret = MPP_OK;
+DONE:
+    MPP_FREE(src);
+    MPP_FREE(dst);
+    MPP_FREE(ref);
+    mpp_log("slice move check %s\n", ret ? "failed" : "pass");
+    return ret;
+}
+
+static MPP_RET slice_move_bench(RK_S32 size)
+{
+    RK_S32 buf_size = size * 2 + SLICE_PADDING;
+    RK_U8 *src = mpp_calloc(RK_U8, buf_size);
+    RK_U8 *dst = mpp_calloc(RK_U8, buf_size);
+    RK_S64 time = 0;
+    RK_S64 time_ref = 0;
+    RK_S64 start;
+    RK_S32 loop;
+
+    if (!src || !dst) {
+        MPP_FREE(src);
+        MPP_FREE(dst);
+        return MPP_NOK;
+    }
+
+    size = gen_slice(src, size, SLICE_BENCH_ZERO_RATIO);
+
+    for (loop = 0; loop < SLICE_BENCH_LOOP; loop++) {
+        RK_S32 src_bit = 8 + loop * 3 + 1;
+        RK_S32 dst_bit = 8 + loop * 5 + 2;
+
+        start = mpp_time();
+        h264e_slice_move(dst, src, dst_bit, src_bit, size);
+        time += mpp_time() - start;
+
+        start = mpp_time();
+        ref_slice_move(dst, src, dst_bit, src_bit, size);
+        time_ref += mpp_time() - start;
+    }
+
+    mpp_log("slice move %d bytes x %d: writer %lld us byte-wise %lld us\n",
+            size, SLICE_BENCH_LOOP, time, time_ref);
+
+    MPP_FREE(src);
+    MPP_FREE(dst);
+    return MPP_OK;
+}
+
+int main(int argc, char **argv)
+{
+    RK_S32 size = SLICE_BENCH_SIZE;
+    MPP_RET ret;
+
+    if (argc > 1)
+        size = atoi(argv[1]);
+    if (size <= 0)
+        size = SLICE_BENCH_SIZE;
+
+    mpp_log("h264e_slice_test start\n");
+
+    ret = slice_move_check();
+    if (!ret)
+        ret = slice_move_bench(size << 20);
+
+    mpp_log("h264e_slice_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
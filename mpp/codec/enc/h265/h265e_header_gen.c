@@ -71,6 +71,7 @@ static void h265e_nal_encode(RK_U8 *dst, H265eNal *nal)
     mpp_writer_put_bits(&s, nal->i_type, 6);//nal_unit_type
     mpp_writer_put_bits(&s, 0, 6); //nuh_reserved_zero_6bits
     mpp_writer_put_bits(&s, 1, 3); //nuh_temporal_id_plus1
+    mpp_writer_flush(&s);
     dst += 2;
     dst = h265e_nal_escape_c(dst, src, end);
     size = (RK_S32)((dst - orig_dst) - 4);
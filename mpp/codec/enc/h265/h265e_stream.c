@@ -64,8 +64,10 @@ MPP_RET h265e_stream_reset(H265eStream *s)
 
 MPP_RET h265e_stream_realign(H265eStream *s)
 {
-    if (s->enc_stream.buffered_bits)
+    if (mpp_writer_bits(&s->enc_stream) & 7)
         mpp_writer_trailing(&s->enc_stream);
+    else
+        mpp_writer_flush(&s->enc_stream);
     return MPP_OK;
 }
 
@@ -175,7 +177,9 @@ MPP_RET h265e_stream_rbsp_trailing(H265eStream *s)
  */
 MPP_RET h265e_stream_flush(H265eStream *s)
 {
-    if (s->enc_stream.buffered_bits)
+    if (mpp_writer_bits(&s->enc_stream) & 7)
         mpp_writer_trailing(&s->enc_stream);
+    else
+        mpp_writer_flush(&s->enc_stream);
     return MPP_OK;
 }
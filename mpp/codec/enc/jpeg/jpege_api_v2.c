@@ -486,6 +486,7 @@ static MPP_RET jpege_start(void *ctx, HalEncTask *task)
     /* YThumbnail */
     mpp_writer_put_raw_bits(bits, 0x00, 8);
     /* Do NOT write thumbnail */
+    mpp_writer_flush(bits);
     size = mpp_writer_bytes(bits);
     mpp_packet_set_length(pkt, size);
     task->length += size;
@@ -542,6 +543,7 @@ static MPP_RET jpege_add_Prefix(MppPacket pkt, RK_S32 *len, RK_U8 uuid[16],
     for (i = 0; i < size; i++)
         mpp_writer_put_raw_bits(bits, user_data[i], 8);
 
+    mpp_writer_flush(bits);
     app_size = mpp_writer_bytes(bits);
     *len = app_size;
     length += app_size;
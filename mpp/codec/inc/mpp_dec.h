@@ -29,6 +29,7 @@ typedef struct {
     RK_U32              need_split;
     RK_U32              internal_pts;
     RK_U32              immedaite_out;
+    RK_U32              thread_pool;
     void                *mpp;
 } MppDecCfg;
 
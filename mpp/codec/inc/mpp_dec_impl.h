@@ -18,6 +18,7 @@
 #define __MPP_DEC_IMPL_H__
 
 #include "mpp_time.h"
+#include "mpp_thread_pool.h"
 
 #include "mpp.h"
 #include "mpp_parser.h"
@@ -50,6 +51,22 @@ typedef struct MppDecImpl_t {
     MppThread           *thread_parser;
     MppThread           *thread_hal;
 
+    /*
+     * thread pool mode:
+     * parser and hal run as jobs on the process shared thread pool. The
+     * MppThread above are still created for lock and status but never
+     * started. The blocking hardware wait runs on the waiter thread shared
+     * by all decoders on the same device.
+     */
+    RK_U32              use_thread_pool;
+    MppJob              job_parser;
+    MppJob              job_hal;
+    void                *parser_task;
+    void                *hal_task;
+    // hal job stops output for no frame queue room or idle vproc task
+    RK_U32              hal_out_wait;
+    MppDeviceId         device_id;
+
     // common resource
     MppBufSlots         frame_slots;
     MppBufSlots         packet_slots;
@@ -76,6 +93,8 @@ typedef struct MppDecImpl_t {
 
     RK_U32              hal_reset_post;
     RK_U32              hal_reset_done;
+    // parser job has posted hal reset and is waiting for it in pool mode
+    RK_U32              hal_reset_wait;
     sem_t               parser_reset;
     sem_t               hal_reset;
 
@@ -101,6 +120,10 @@ typedef struct MppDecImpl_t {
 extern "C" {
 #endif
 
+/* output frame to mpp frame queue, thd is the caller thread */
+MPP_RET mpp_dec_push_out_frame(Mpp *mpp, MppFrame frame, MppThread *thd);
+/* frame queue room or vproc task is released, resume hal job output */
+MPP_RET mpp_dec_signal_output(Mpp *mpp);
 
 #ifdef __cplusplus
 }
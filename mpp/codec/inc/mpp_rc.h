@@ -29,12 +29,14 @@
  *    size - max valid data number
  *    len  - valid data number
  *    pos  - current load/store position
+ *    sum  - running sum of all valid data
  *    val  - buffer array pointer
  */
 typedef struct {
     RK_S32  size;
     RK_S32  len;
     RK_S32  pos;
+    RK_S64  sum;
     RK_S32  *val;
 } MppData;
 
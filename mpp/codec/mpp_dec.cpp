@@ -22,6 +22,8 @@
 #include "mpp_mem.h"
 #include "mpp_log.h"
 #include "mpp_time.h"
+#include "mpp_list.h"
+#include "mpp_atomic.h"
 
 #include "mpp.h"
 #include "mpp_dec_impl.h"
@@ -49,6 +51,9 @@ static RK_U32 mpp_dec_debug = 0;
 #define dec_dbg_reset(fmt, ...)         mpp_dec_dbg(MPP_DEC_DBG_RESET, fmt, ## __VA_ARGS__)
 #define dec_dbg_notify(fmt, ...)        mpp_dec_dbg_f(MPP_DEC_DBG_NOTIFY, fmt, ## __VA_ARGS__)
 
+/* frame queue full wait time slice in ms */
+#define MPP_DEC_FRAME_PUSH_WAIT         (10)
+
 typedef union PaserTaskWait_u {
     RK_U32          val;
     struct {
@@ -65,7 +70,7 @@ typedef union PaserTaskWait_u {
         RK_U32      task_hnd        : 1;   // 0x0100 MPP_DEC_NOTIFY_TASK_HND_VALID
         RK_U32      prev_task       : 1;   // 0x0200 MPP_DEC_NOTIFY_TASK_PREV_DONE
         RK_U32      dec_pic_match   : 1;   // 0x0400 MPP_DEC_NOTIFY_BUFFER_MATCH
-        RK_U32      reserv0800      : 1;   // 0x0800
+        RK_U32      ts_que_full     : 1;   // 0x0800 MPP_DEC_NOTIFY_TIMESTAMP_POP
 
         RK_U32      dec_pkt_idx     : 1;   // 0x1000
         RK_U32      dec_pkt_buf     : 1;   // 0x2000
@@ -120,6 +125,39 @@ static void dec_task_init(DecTask *task)
     hal_task_info_init(&task->info, MPP_CTX_DEC);
 }
 
+/*
+ * hal job stage in thread pool mode
+ *
+ * The hal job keeps one task on hand across runs:
+ * HAL_JOB_IDLE     - no task on hand, take the next processing task
+ * HAL_JOB_HW_WAIT  - task is posted to device waiter, the waiter does post
+ *                    process and output then signals the hal job
+ * HAL_JOB_OUTPUT   - output is stopped for no room, signaled on room release
+ */
+typedef enum DecHalJobStage_e {
+    HAL_JOB_IDLE,
+    HAL_JOB_HW_WAIT,
+    HAL_JOB_OUTPUT,
+} DecHalJobStage;
+
+typedef struct DecHalTask_t {
+    // list node on device waiter
+    struct list_head    list;
+    Mpp                 *mpp;
+
+    DecHalJobStage      stage;
+    HalTaskHnd          hnd;
+    HalTaskInfo         info;
+    RK_U32              notify_flag;
+
+    // info change / eos frame after display queue output
+    RK_U32              out_tail;
+    RK_S32              out_index;
+
+    // decoder is flushed on reset and display queue output is not done
+    RK_U32              reset_flush;
+} DecHalTask;
+
 /*
  * return MPP_OK for not wait
  * return MPP_NOK for wait
@@ -159,24 +197,48 @@ static MPP_RET check_task_wait(MppDecImpl *dec, DecTask *task)
     return ret;
 }
 
-static RK_U32 reset_parser_thread(Mpp *mpp, DecTask *task)
+/*
+ * NOTE: caller should hold the parser / hal work lock.
+ * In thread pool mode the job is cleared on stop so check it here.
+ */
+static void dec_signal_parser(MppDecImpl *dec)
+{
+    if (dec->use_thread_pool) {
+        if (dec->job_parser)
+            mpp_job_signal(dec->job_parser);
+    } else
+        dec->thread_parser->signal();
+}
+
+static void dec_signal_hal(MppDecImpl *dec)
+{
+    if (dec->use_thread_pool) {
+        if (dec->job_hal)
+            mpp_job_signal(dec->job_hal);
+    } else
+        dec->thread_hal->signal();
+}
+
+static void dec_post_hal_reset(MppDecImpl *dec)
 {
-    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
     MppThread *hal = dec->thread_hal;
-    HalTaskGroup tasks  = dec->tasks;
-    MppBufSlots frame_slots  = dec->frame_slots;
-    MppBufSlots packet_slots = dec->packet_slots;
-    HalDecTask *task_dec = &task->info.dec;
 
     dec_dbg_reset("reset: parser reset start\n");
     dec_dbg_reset("reset: parser wait hal proc reset start\n");
 
     hal->lock();
     dec->hal_reset_post++;
-    hal->signal();
+    dec_signal_hal(dec);
     hal->unlock();
+}
 
-    sem_wait(&dec->hal_reset);
+static RK_U32 reset_parser_proc(Mpp *mpp, DecTask *task)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    HalTaskGroup tasks  = dec->tasks;
+    MppBufSlots frame_slots  = dec->frame_slots;
+    MppBufSlots packet_slots = dec->packet_slots;
+    HalDecTask *task_dec = &task->info.dec;
 
     dec_dbg_reset("reset: parser check hal proc task empty start\n");
 
@@ -233,10 +295,8 @@ static RK_U32 reset_parser_thread(Mpp *mpp, DecTask *task)
             mpp_buf_slot_clr_flag(frame_slots, index, SLOT_QUEUE_USE);
         }
 
-        if (dec->use_preset_time_order) {
-            AutoMutex autoLock(mpp->mTimeStamps->mutex());
-            mpp->mTimeStamps->flush();
-        }
+        if (dec->use_preset_time_order)
+            mpp_ring_queue_flush(mpp->mTimeStamps);
 
         if (task->status.dec_pkt_copy_rdy) {
             mpp_buf_slot_clr_flag(packet_slots, task_dec->input,  SLOT_HAL_INPUT);
@@ -256,6 +316,100 @@ static RK_U32 reset_parser_thread(Mpp *mpp, DecTask *task)
     return MPP_OK;
 }
 
+static RK_U32 reset_parser_thread(Mpp *mpp, DecTask *task)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+
+    dec_post_hal_reset(dec);
+    sem_wait(&dec->hal_reset);
+
+    return reset_parser_proc(mpp, task);
+}
+
+/*
+ * When user stops getting frame the frame queue becomes full and the caller
+ * thread waits here. The wait is broken by reset or stop and the frame is
+ * dropped since the frame queue is flushed on both of them.
+ *
+ * The hal job in thread pool mode never waits. It checks the room before
+ * output by mpp_dec_out_ready so the push only fails on reset.
+ */
+MPP_RET mpp_dec_push_out_frame(Mpp *mpp, MppFrame frame, MppThread *thd)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    RK_S64 timeout = (dec->use_thread_pool && thd == dec->thread_hal) ?
+                     0 : MPP_DEC_FRAME_PUSH_WAIT;
+    MPP_RET ret = MPP_OK;
+
+    do {
+        ret = mpp_ring_queue_push(mpp->mFrames, frame, timeout);
+        if (ret != MPP_ERR_TIMEOUT)
+            break;
+    } while (!MPP_LOAD_ACQUIRE(&dec->reset_flag) &&
+             thd->get_status() == MPP_THREAD_RUNNING);
+
+    if (ret) {
+        dec_dbg_reset("reset: drop output frame %p on frame queue full\n", frame);
+        mpp_frame_deinit(&frame);
+        return ret;
+    }
+
+    mpp->mFramePutCount++;
+    return MPP_OK;
+}
+
+/*
+ * Output room check for the hal job in thread pool mode
+ *
+ * The hal job is the only one taking frame queue room when there is no vproc
+ * and the only one taking idle vproc task, so the room found here is kept
+ * until the frame is put. When there is no room the hal job stops output and
+ * returns. It is signaled by mpp_dec_signal_output when user gets a frame or
+ * vproc returns a task. Frames are dropped on reset so no room is needed.
+ */
+static RK_U32 mpp_dec_out_ready(Mpp *mpp)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    RK_U32 ready = 0;
+
+    if (!dec->use_thread_pool)
+        return 1;
+
+    // pair with the barrier in mpp_dec_signal_output to avoid missing signal
+    dec->hal_out_wait = 1;
+    MPP_SYNC();
+
+    if (dec->vproc)
+        ready = (MPP_OK != hal_task_check_empty(dec->vproc_tasks, TASK_IDLE));
+    else
+        ready = MPP_LOAD_ACQUIRE(&dec->reset_flag) ||
+                (mpp_ring_queue_count(mpp->mFrames) < mpp_ring_queue_size(mpp->mFrames));
+
+    if (ready)
+        dec->hal_out_wait = 0;
+
+    return ready;
+}
+
+MPP_RET mpp_dec_signal_output(Mpp *mpp)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    MppThread *hal = dec->thread_hal;
+
+    if (!dec->use_thread_pool)
+        return MPP_OK;
+
+    MPP_SYNC();
+    if (!MPP_LOAD_ACQUIRE(&dec->hal_out_wait))
+        return MPP_OK;
+
+    hal->lock();
+    dec_signal_hal(dec);
+    hal->unlock();
+
+    return MPP_OK;
+}
+
 /* Overall mpp_dec output frame function */
 static void mpp_dec_put_frame(Mpp *mpp, RK_S32 index, HalDecTaskFlag flags)
 {
@@ -291,18 +445,16 @@ static void mpp_dec_put_frame(Mpp *mpp, RK_S32 index, HalDecTaskFlag flags)
         mpp_assert(!change);
 
         if (dec->vproc) {
-            HalTaskGroup group = dec->vproc_tasks;
             HalTaskHnd hnd = NULL;
             HalTaskInfo task;
             HalDecVprocTask *vproc_task = &task.dec_vproc;
 
-            MPP_RET ret = hal_task_get_hnd(group, TASK_IDLE, &hnd);
-
-            mpp_assert(ret == MPP_OK);
+            dec_vproc_get_task(dec->vproc, &hnd);
 
             vproc_task->flags.val = 0;
             vproc_task->flags.eos = eos;
             vproc_task->input = index;
+            vproc_task->time = mpp_time();
 
             hal_task_hnd_set_info(hnd, &task);
             hal_task_hnd_set_status(hnd, TASK_PROCESSING);
@@ -329,14 +481,12 @@ static void mpp_dec_put_frame(Mpp *mpp, RK_S32 index, HalDecTaskFlag flags)
     if (!change) {
         if (dec->use_preset_time_order) {
             MppPacket pkt = NULL;
-            mpp_list *ts = mpp->mTimeStamps;
 
-            AutoMutex autoLock(ts->mutex());
-            if (ts->list_size()) {
-                ts->del_at_head(&pkt, sizeof(pkt));
+            if (!mpp_ring_queue_pop(mpp->mTimeStamps, (void **)&pkt, 0)) {
                 mpp_frame_set_dts(frame, mpp_packet_get_dts(pkt));
                 mpp_frame_set_pts(frame, mpp_packet_get_pts(pkt));
                 mpp_packet_deinit(&pkt);
+                mpp_dec_notify(dec, MPP_DEC_NOTIFY_TIMESTAMP_POP);
             } else
                 mpp_err_f("pull out packet error.\n");
         }
@@ -354,24 +504,17 @@ static void mpp_dec_put_frame(Mpp *mpp, RK_S32 index, HalDecTaskFlag flags)
     }
 
     if (dec->vproc) {
-        HalTaskGroup group = dec->vproc_tasks;
         HalTaskHnd hnd = NULL;
         HalTaskInfo task;
         HalDecVprocTask *vproc_task = &task.dec_vproc;
-        MPP_RET ret = MPP_OK;
 
-        do {
-            ret = hal_task_get_hnd(group, TASK_IDLE, &hnd);
-            if (ret) {
-                msleep(10);
-            }
-        } while (ret);
-
-        mpp_assert(ret == MPP_OK);
+        dec_vproc_get_task(dec->vproc, &hnd);
 
+        vproc_task->flags.val = 0;
         vproc_task->flags.eos = eos;
         vproc_task->flags.info_change = change;
         vproc_task->input = index;
+        vproc_task->time = mpp_time();
 
         if (!change) {
             mpp_buf_slot_set_flag(slots, index, SLOT_QUEUE_USE);
@@ -384,7 +527,6 @@ static void mpp_dec_put_frame(Mpp *mpp, RK_S32 index, HalDecTaskFlag flags)
         dec_vproc_signal(dec->vproc);
     } else {
         // direct output -> copy a new MppFrame and output
-        mpp_list *list = mpp->mFrames;
         MppFrame out = NULL;
 
         mpp_frame_init(&out);
@@ -393,24 +535,22 @@ static void mpp_dec_put_frame(Mpp *mpp, RK_S32 index, HalDecTaskFlag flags)
         if (mpp_debug & MPP_DBG_PTS)
             mpp_log("output frame pts %lld\n", mpp_frame_get_pts(out));
 
-        list->lock();
-        list->add_at_tail(&out, sizeof(out));
-        mpp->mFramePutCount++;
-        list->signal();
-        list->unlock();
+        mpp_dec_push_out_frame(mpp, out, dec->thread_hal);
 
         if (fake_frame)
             mpp_frame_deinit(&frame);
     }
 }
 
-static void mpp_dec_push_display(Mpp *mpp, HalDecTaskFlag flags)
+/* return MPP_NOK when output is stopped for no room in thread pool mode */
+static MPP_RET mpp_dec_push_display(Mpp *mpp, HalDecTaskFlag flags)
 {
     RK_S32 index = -1;
     MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
     MppBufSlots frame_slots = dec->frame_slots;
     RK_U32 eos = flags.eos;
     HalDecTaskFlag tmp = flags;
+    MPP_RET ret = MPP_OK;
 
     tmp.eos = 0;
     /**
@@ -424,7 +564,15 @@ static void mpp_dec_push_display(Mpp *mpp, HalDecTaskFlag flags)
     tmp.info_change = 0;
 
     dec->thread_hal->lock(THREAD_OUTPUT);
-    while (MPP_OK == mpp_buf_slot_dequeue(frame_slots, &index, QUEUE_DISPLAY)) {
+    while (1) {
+        if (!mpp_dec_out_ready(mpp)) {
+            ret = MPP_NOK;
+            break;
+        }
+
+        if (mpp_buf_slot_dequeue(frame_slots, &index, QUEUE_DISPLAY))
+            break;
+
         /* deal with current frame */
         if (eos && mpp_slots_is_empty(frame_slots, QUEUE_DISPLAY))
             tmp.eos = 1;
@@ -433,6 +581,8 @@ static void mpp_dec_push_display(Mpp *mpp, HalDecTaskFlag flags)
         mpp_buf_slot_clr_flag(frame_slots, index, SLOT_QUEUE_USE);
     }
     dec->thread_hal->unlock(THREAD_OUTPUT);
+
+    return ret;
 }
 
 static void mpp_dec_put_task(Mpp *mpp, DecTask *task)
@@ -443,12 +593,13 @@ static void mpp_dec_put_task(Mpp *mpp, DecTask *task)
     dec->thread_hal->lock();
     hal_task_hnd_set_status(task->hnd, TASK_PROCESSING);
     mpp->mTaskPutCount++;
-    dec->thread_hal->signal();
+    dec_signal_hal(dec);
     dec->thread_hal->unlock();
     task->hnd = NULL;
 }
 
-static void reset_hal_thread(Mpp *mpp)
+/* return MPP_NOK when output is stopped for no room in thread pool mode */
+static MPP_RET reset_hal_output(Mpp *mpp)
 {
     MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
     HalTaskGroup tasks = dec->tasks;
@@ -457,12 +608,18 @@ static void reset_hal_thread(Mpp *mpp)
     RK_S32 index = -1;
     HalTaskHnd  task = NULL;
 
-    /* when hal thread reset output all frames */
     flag.val = 0;
-    mpp_dec_flush(dec);
 
     dec->thread_hal->lock(THREAD_OUTPUT);
-    while (MPP_OK == mpp_buf_slot_dequeue(frame_slots, &index, QUEUE_DISPLAY)) {
+    while (1) {
+        if (!mpp_dec_out_ready(mpp)) {
+            dec->thread_hal->unlock(THREAD_OUTPUT);
+            return MPP_NOK;
+        }
+
+        if (mpp_buf_slot_dequeue(frame_slots, &index, QUEUE_DISPLAY))
+            break;
+
         mpp_dec_put_frame(mpp, index, flag);
         mpp_buf_slot_clr_flag(frame_slots, index, SLOT_QUEUE_USE);
     }
@@ -476,6 +633,17 @@ static void reset_hal_thread(Mpp *mpp)
     }
 
     dec->thread_hal->unlock(THREAD_OUTPUT);
+
+    return MPP_OK;
+}
+
+static void reset_hal_thread(Mpp *mpp)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+
+    /* when hal thread reset output all frames */
+    mpp_dec_flush(dec);
+    reset_hal_output(mpp);
 }
 
 static MPP_RET try_proc_dec_task(Mpp *mpp, DecTask *task)
@@ -507,28 +675,38 @@ static MPP_RET try_proc_dec_task(Mpp *mpp, DecTask *task)
      * 2. get packet for parser preparing
      */
     if (!dec->mpp_pkt_in && !task->status.curr_task_rdy) {
-        mpp_list *packets = mpp->mPackets;
-        AutoMutex autolock(packets->mutex());
+        /* timestamp is never dropped, wait for frame output when it is full */
+        if (dec->use_preset_time_order &&
+            mpp_ring_queue_count(mpp->mTimeStamps) >= mpp_ring_queue_size(mpp->mTimeStamps)) {
+            if (!task->wait.ts_que_full)
+                mpp_log_f("timestamp queue full with %d packets, wait frame output\n",
+                          mpp_ring_queue_size(mpp->mTimeStamps));
+
+            task->wait.ts_que_full = 1;
+            return MPP_NOK;
+        }
+        task->wait.ts_que_full = 0;
 
-        if (!packets->list_size()) {
+        if (mpp_ring_queue_pop(mpp->mPackets, (void **)&dec->mpp_pkt_in, 0)) {
             task->wait.dec_pkt_in = 1;
             return MPP_NOK;
         }
 
         task->wait.dec_pkt_in = 0;
-        packets->del_at_head(&dec->mpp_pkt_in, sizeof(dec->mpp_pkt_in));
         mpp->mPacketGetCount++;
 
         if (dec->use_preset_time_order) {
             MppPacket pkt_in = NULL;
-            mpp_list *ts = mpp->mTimeStamps;
 
-            AutoMutex autoLock(ts->mutex());
             mpp_packet_new(&pkt_in);
             if (pkt_in) {
                 mpp_packet_set_pts(pkt_in, mpp_packet_get_pts(dec->mpp_pkt_in));
                 mpp_packet_set_dts(pkt_in, mpp_packet_get_dts(dec->mpp_pkt_in));
-                ts->add_at_tail(&pkt_in, sizeof(pkt_in));
+                /* room is checked above and parser is the only producer */
+                if (mpp_ring_queue_push(mpp->mTimeStamps, pkt_in, 0)) {
+                    mpp_err_f("push timestamp failed\n");
+                    mpp_packet_deinit(&pkt_in);
+                }
             }
         }
     }
@@ -666,7 +844,7 @@ static MPP_RET try_proc_dec_task(Mpp *mpp, DecTask *task)
 
     /* too many frame delay in dispaly queue */
     if (mpp->mFrames) {
-        task->wait.dis_que_full = (mpp->mFrames->list_size() > 4) ? 1 : 0;
+        task->wait.dis_que_full = (mpp_ring_queue_count(mpp->mFrames) > 4) ? 1 : 0;
         if (task->wait.dis_que_full)
             return MPP_ERR_DISPLAY_FULL;
     }
@@ -829,15 +1007,31 @@ static MPP_RET try_proc_dec_task(Mpp *mpp, DecTask *task)
     return MPP_OK;
 }
 
+static void mpp_dec_parser_exit(Mpp *mpp, DecTask *task)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    MppBufSlots packet_slots = dec->packet_slots;
+    HalDecTask *task_dec = &task->info.dec;
+
+    mpp_clock_pause(dec->clocks[DEC_PRS_TOTAL]);
+
+    mpp_dbg(MPP_DBG_INFO, "mpp_dec_parser_thread is going to exit\n");
+    if (task->hnd && task_dec->valid) {
+        mpp_buf_slot_set_flag(packet_slots, task_dec->input, SLOT_CODEC_READY);
+        mpp_buf_slot_set_flag(packet_slots, task_dec->input, SLOT_HAL_INPUT);
+        mpp_buf_slot_clr_flag(packet_slots, task_dec->input, SLOT_HAL_INPUT);
+    }
+    mpp_buffer_group_clear(mpp->mPacketGroup);
+    mpp_dbg(MPP_DBG_INFO, "mpp_dec_parser_thread exited\n");
+}
+
 void *mpp_dec_parser_thread(void *data)
 {
     Mpp *mpp = (Mpp*)data;
     MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
     MppThread *parser = dec->thread_parser;
-    MppBufSlots packet_slots = dec->packet_slots;
 
     DecTask task;
-    HalDecTask  *task_dec = &task.info.dec;
 
     dec_task_init(&task);
 
@@ -879,17 +1073,121 @@ void *mpp_dec_parser_thread(void *data)
         mpp_clock_pause(dec->clocks[DEC_PRS_PROC]);
     }
 
-    mpp_clock_pause(dec->clocks[DEC_PRS_TOTAL]);
+    mpp_dec_parser_exit(mpp, &task);
+    return NULL;
+}
 
-    mpp_dbg(MPP_DBG_INFO, "mpp_dec_parser_thread is going to exit\n");
-    if (task.hnd && task_dec->valid) {
-        mpp_buf_slot_set_flag(packet_slots, task_dec->input, SLOT_CODEC_READY);
-        mpp_buf_slot_set_flag(packet_slots, task_dec->input, SLOT_HAL_INPUT);
-        mpp_buf_slot_clr_flag(packet_slots, task_dec->input, SLOT_HAL_INPUT);
+/*
+ * when hardware decoding is done:
+ * 1. clear decoding flag (mark buffer is ready)
+ * 2. use get_display to get a new frame with buffer
+ * 3. add frame to output list
+ * repeat 2 and 3 until not frame can be output
+ *
+ * This function does step 1 and returns the notify flag for the task.
+ */
+static RK_U32 mpp_dec_hal_post_task(Mpp *mpp, HalTaskHnd task, HalTaskInfo *task_info)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    MppBufSlots frame_slots = dec->frame_slots;
+    MppBufSlots packet_slots = dec->packet_slots;
+    HalDecTask  *task_dec = &task_info->dec;
+    RK_U32 notify_flag = MPP_DEC_NOTIFY_TASK_HND_VALID;
+
+    mpp_buf_slot_clr_flag(packet_slots, task_dec->input,
+                          SLOT_HAL_INPUT);
+
+    hal_task_hnd_set_status(task, (dec->parser_fast_mode) ?
+                            (TASK_IDLE) : (TASK_PROC_DONE));
+
+    if (dec->parser_fast_mode)
+        notify_flag |= MPP_DEC_NOTIFY_TASK_HND_VALID;
+    else
+        notify_flag |= MPP_DEC_NOTIFY_TASK_PREV_DONE;
+
+    if (task_dec->output >= 0)
+        mpp_buf_slot_clr_flag(frame_slots, task_dec->output, SLOT_HAL_OUTPUT);
+
+    for (RK_U32 i = 0; i < MPP_ARRAY_ELEMS(task_dec->refer); i++) {
+        RK_S32 index = task_dec->refer[i];
+        if (index >= 0)
+            mpp_buf_slot_clr_flag(frame_slots, index, SLOT_HAL_INPUT);
     }
-    mpp_buffer_group_clear(mpp->mPacketGroup);
-    mpp_dbg(MPP_DBG_INFO, "mpp_dec_parser_thread exited\n");
-    return NULL;
+    if (task_dec->flags.eos)
+        mpp_dec_flush(dec);
+
+    return notify_flag;
+}
+
+static void mpp_dec_hal_proc_task(Mpp *mpp, HalTaskHnd task)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    HalTaskInfo task_info;
+    HalDecTask  *task_dec = &task_info.dec;
+    RK_U32 notify_flag = MPP_DEC_NOTIFY_TASK_HND_VALID;
+
+    mpp_clock_start(dec->clocks[DEC_HAL_PROC]);
+    mpp->mTaskGetCount++;
+
+    hal_task_hnd_get_info(task, &task_info);
+
+    /*
+     * check info change flag
+     * if this is a frame with that flag, only output an empty
+     * MppFrame without any image data for info change.
+     */
+    if (task_dec->flags.info_change) {
+        mpp_dec_flush(dec);
+        mpp_dec_push_display(mpp, task_dec->flags);
+        mpp_dec_put_frame(mpp, task_dec->output, task_dec->flags);
+
+        hal_task_hnd_set_status(task, TASK_IDLE);
+        mpp_dec_notify(dec, notify_flag);
+        mpp_clock_pause(dec->clocks[DEC_HAL_PROC]);
+        return ;
+    }
+    /*
+     * check eos task
+     * if this task is invalid while eos flag is set, we will
+     * flush display queue then push the eos frame to info that
+     * all frames have decoded.
+     */
+    if (task_dec->flags.eos &&
+        (!task_dec->valid || task_dec->output < 0)) {
+        mpp_dec_push_display(mpp, task_dec->flags);
+        /*
+         * Use -1 as invalid buffer slot index.
+         * Reason: the last task maybe is a empty task with eos flag
+         * only but this task may go through vproc process also. We need
+         * create a buffer slot index for it.
+         */
+        mpp_dec_put_frame(mpp, -1, task_dec->flags);
+
+        hal_task_hnd_set_status(task, TASK_IDLE);
+        mpp_dec_notify(dec, notify_flag);
+        mpp_clock_pause(dec->clocks[DEC_HAL_PROC]);
+        return ;
+    }
+
+    mpp_clock_start(dec->clocks[DEC_HW_WAIT]);
+    mpp_hal_hw_wait(dec->hal, &task_info);
+    mpp_clock_pause(dec->clocks[DEC_HW_WAIT]);
+
+    notify_flag = mpp_dec_hal_post_task(mpp, task, &task_info);
+    mpp_dec_push_display(mpp, task_dec->flags);
+
+    mpp_dec_notify(dec, notify_flag);
+    mpp_clock_pause(dec->clocks[DEC_HAL_PROC]);
+}
+
+static void mpp_dec_hal_exit(Mpp *mpp)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+
+    mpp_clock_pause(dec->clocks[DEC_HAL_TOTAL]);
+
+    mpp_assert(mpp->mTaskPutCount == mpp->mTaskGetCount);
+    mpp_dbg(MPP_DBG_INFO, "mpp_dec_hal_thread exited\n");
 }
 
 void *mpp_dec_hal_thread(void *data)
@@ -898,12 +1196,7 @@ void *mpp_dec_hal_thread(void *data)
     MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
     MppThread *hal = dec->thread_hal;
     HalTaskGroup tasks = dec->tasks;
-    MppBufSlots frame_slots = dec->frame_slots;
-    MppBufSlots packet_slots = dec->packet_slots;
-
     HalTaskHnd  task = NULL;
-    HalTaskInfo task_info;
-    HalDecTask  *task_dec = &task_info.dec;
 
     mpp_clock_start(dec->clocks[DEC_HAL_TOTAL]);
 
@@ -934,101 +1227,392 @@ void *mpp_dec_hal_thread(void *data)
         }
 
         if (task) {
-            RK_U32 notify_flag = MPP_DEC_NOTIFY_TASK_HND_VALID;
+            mpp_dec_hal_proc_task(mpp, task);
+            task = NULL;
+        }
+    }
 
-            mpp_clock_start(dec->clocks[DEC_HAL_PROC]);
-            mpp->mTaskGetCount++;
+    mpp_dec_hal_exit(mpp);
+    return NULL;
+}
 
-            hal_task_hnd_get_info(task, &task_info);
+/*
+ * Thread pool mode job functions
+ *
+ * The job function runs the thread loop above until it has to wait. Instead
+ * of waiting on condition it returns zero and the job will be signaled
+ * again by mpp_dec_notify / mpp_dec_put_task. Blocking wait is
+ * not allowed in job since the worker is shared by all decoders. So the
+ * parser posts hal reset and checks the reset done semaphore on each run,
+ * the hal posts hardware wait to the device waiter and stops output when
+ * there is no room for frame.
+ */
+static RK_S32 mpp_dec_parser_job(void *data)
+{
+    Mpp *mpp = (Mpp*)data;
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    MppThread *parser = dec->thread_parser;
+    DecTask *task = (DecTask *)dec->parser_task;
 
-            /*
-             * check info change flag
-             * if this is a frame with that flag, only output an empty
-             * MppFrame without any image data for info change.
-             */
-            if (task_dec->flags.info_change) {
-                mpp_dec_flush(dec);
-                mpp_dec_push_display(mpp, task_dec->flags);
-                mpp_dec_put_frame(mpp, task_dec->output, task_dec->flags);
-
-                hal_task_hnd_set_status(task, TASK_IDLE);
-                task = NULL;
-                mpp_dec_notify(dec, notify_flag);
-                mpp_clock_pause(dec->clocks[DEC_HAL_PROC]);
-                continue;
-            }
-            /*
-             * check eos task
-             * if this task is invalid while eos flag is set, we will
-             * flush display queue then push the eos frame to info that
-             * all frames have decoded.
-             */
-            if (task_dec->flags.eos &&
-                (!task_dec->valid || task_dec->output < 0)) {
-                mpp_dec_push_display(mpp, task_dec->flags);
-                /*
-                 * Use -1 as invalid buffer slot index.
-                 * Reason: the last task maybe is a empty task with eos flag
-                 * only but this task may go through vproc process also. We need
-                 * create a buffer slot index for it.
-                 */
-                mpp_dec_put_frame(mpp, -1, task_dec->flags);
-
-                hal_task_hnd_set_status(task, TASK_IDLE);
-                task = NULL;
-                mpp_dec_notify(dec, notify_flag);
-                mpp_clock_pause(dec->clocks[DEC_HAL_PROC]);
-                continue;
+    while (1) {
+        {
+            AutoMutex autolock(parser->mutex());
+            if (MPP_THREAD_RUNNING != parser->get_status())
+                return 0;
+
+            if (check_task_wait(dec, task))
+                return 0;
+        }
+
+        if (dec->reset_flag) {
+            if (!dec->hal_reset_wait) {
+                dec->hal_reset_wait = 1;
+                dec_post_hal_reset(dec);
             }
 
-            mpp_clock_start(dec->clocks[DEC_HW_WAIT]);
-            mpp_hal_hw_wait(dec->hal, &task_info);
-            mpp_clock_pause(dec->clocks[DEC_HW_WAIT]);
+            // hal job will signal parser job when hal reset is done
+            if (sem_trywait(&dec->hal_reset))
+                return 0;
 
-            /*
-             * when hardware decoding is done:
-             * 1. clear decoding flag (mark buffer is ready)
-             * 2. use get_display to get a new frame with buffer
-             * 3. add frame to output list
-             * repeat 2 and 3 until not frame can be output
-             */
-            mpp_buf_slot_clr_flag(packet_slots, task_dec->input,
-                                  SLOT_HAL_INPUT);
+            dec->hal_reset_wait = 0;
+            reset_parser_proc(mpp, task);
 
-            hal_task_hnd_set_status(task, (dec->parser_fast_mode) ?
-                                    (TASK_IDLE) : (TASK_PROC_DONE));
+            AutoMutex autolock(parser->mutex(THREAD_CONTROL));
+            dec->reset_flag = 0;
+            sem_post(&dec->parser_reset);
+            continue;
+        }
 
-            if (dec->parser_fast_mode)
-                notify_flag |= MPP_DEC_NOTIFY_TASK_HND_VALID;
-            else
-                notify_flag |= MPP_DEC_NOTIFY_TASK_PREV_DONE;
+        mpp_clock_start(dec->clocks[DEC_PRS_PROC]);
+        try_proc_dec_task(mpp, task);
+        mpp_clock_pause(dec->clocks[DEC_PRS_PROC]);
+    }
 
-            task = NULL;
+    return 0;
+}
 
-            if (task_dec->output >= 0)
-                mpp_buf_slot_clr_flag(frame_slots, task_dec->output, SLOT_HAL_OUTPUT);
+/*
+ * Device hardware waiter for thread pool mode
+ *
+ * There is no non-blocking way to check hardware done and the blocking
+ * mpp_hal_hw_wait can not run on the shared pool workers. Instead of one hal
+ * thread for each decoder there is one waiter thread for each device. The
+ * hal job posts the started task to the waiter of its device and returns.
+ * The waiter waits the tasks in post order. When one is done it does the
+ * post process and output of the task then signals the hal job. The device
+ * runs tasks in the order they are started so waiting in order does not
+ * delay the tasks behind.
+ */
+typedef struct MppDecHwDev_t {
+    MppDeviceId         id;
+    pthread_t           thd;
+    RK_U32              started;
+    Condition           *cond;
+    struct list_head    list;
+    // task under hardware wait
+    DecHalTask          *curr;
+} MppDecHwDev;
+
+class MppDecHwWaiter
+{
+private:
+    // avoid any unwanted function
+    MppDecHwWaiter();
+    ~MppDecHwWaiter();
+    MppDecHwWaiter(const MppDecHwWaiter &);
+    MppDecHwWaiter &operator=(const MppDecHwWaiter &);
+
+    static void *waiter_loop(void *arg);
+
+    Mutex               mLock;
+    // task done on all devices for cancel
+    Condition           mDone;
+    RK_S32              mQuit;
+    MppDecHwDev         mDevs[DEV_ID_BUTT];
+
+public:
+    static MppDecHwWaiter *get_instance() {
+        static MppDecHwWaiter instance;
+        return &instance;
+    }
 
-            for (RK_U32 i = 0; i < MPP_ARRAY_ELEMS(task_dec->refer); i++) {
-                RK_S32 index = task_dec->refer[i];
-                if (index >= 0)
-                    mpp_buf_slot_clr_flag(frame_slots, index, SLOT_HAL_INPUT);
-            }
-            if (task_dec->flags.eos)
-                mpp_dec_flush(dec);
-            mpp_dec_push_display(mpp, task_dec->flags);
+    MPP_RET post(MppDeviceId id, DecHalTask *task);
+    void cancel(MppDeviceId id, DecHalTask *task);
+};
 
-            mpp_dec_notify(dec, notify_flag);
-            mpp_clock_pause(dec->clocks[DEC_HAL_PROC]);
-        }
+MppDecHwWaiter::MppDecHwWaiter()
+    : mQuit(0)
+{
+    RK_S32 i;
+
+    for (i = 0; i < DEV_ID_BUTT; i++) {
+        MppDecHwDev *dev = &mDevs[i];
+
+        dev->id = (MppDeviceId)i;
+        dev->started = 0;
+        dev->cond = new Condition();
+        dev->curr = NULL;
+        INIT_LIST_HEAD(&dev->list);
     }
+}
 
-    mpp_clock_pause(dec->clocks[DEC_HAL_TOTAL]);
+MppDecHwWaiter::~MppDecHwWaiter()
+{
+    RK_S32 i;
+
+    mLock.lock();
+    mQuit = 1;
+    for (i = 0; i < DEV_ID_BUTT; i++)
+        mDevs[i].cond->signal();
+    mLock.unlock();
+
+    for (i = 0; i < DEV_ID_BUTT; i++) {
+        MppDecHwDev *dev = &mDevs[i];
+
+        if (dev->started)
+            pthread_join(dev->thd, NULL);
+
+        if (!list_empty(&dev->list))
+            mpp_err("device %d waiter quit with task posted\n", i);
+
+        delete dev->cond;
+    }
+}
+
+/* return MPP_NOK when output is stopped for no room */
+static MPP_RET mpp_dec_hal_job_output(Mpp *mpp, DecHalTask *task)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    HalDecTask *task_dec = &task->info.dec;
+
+    if (mpp_dec_push_display(mpp, task_dec->flags))
+        return MPP_NOK;
+
+    /* info change / eos frame goes after all frames in display queue */
+    if (task->out_tail) {
+        if (!mpp_dec_out_ready(mpp))
+            return MPP_NOK;
+
+        mpp_dec_put_frame(mpp, task->out_index, task_dec->flags);
+        hal_task_hnd_set_status(task->hnd, TASK_IDLE);
+        task->out_tail = 0;
+    }
+
+    mpp_dec_notify(dec, task->notify_flag);
+    task->hnd = NULL;
+
+    return MPP_OK;
+}
+
+static void mpp_dec_hw_wait_task(DecHalTask *task)
+{
+    Mpp *mpp = task->mpp;
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    MppThread *hal = dec->thread_hal;
+    DecHalJobStage stage = HAL_JOB_IDLE;
+
+    mpp_clock_start(dec->clocks[DEC_HW_WAIT]);
+    mpp_hal_hw_wait(dec->hal, &task->info);
+    mpp_clock_pause(dec->clocks[DEC_HW_WAIT]);
+
+    /*
+     * Output here to save one switch to the hal job. The hal job does not
+     * touch the task while it is in hardware wait stage. Output never blocks
+     * so the waiter is not delayed for long.
+     */
+    task->notify_flag = mpp_dec_hal_post_task(mpp, task->hnd, &task->info);
+    if (mpp_dec_hal_job_output(mpp, task))
+        stage = HAL_JOB_OUTPUT;
+
+    /*
+     * The hal job returns on signal while the task is in hardware wait. So
+     * signal it when output is stopped, new task is put or reset is posted.
+     * Otherwise do the all done notify for it.
+     */
+    hal->lock();
+    task->stage = stage;
+    if (stage != HAL_JOB_IDLE || dec->hal_reset_post != dec->hal_reset_done ||
+        hal_task_check_empty(dec->tasks, TASK_PROCESSING))
+        dec_signal_hal(dec);
+    else
+        mpp_dec_notify(dec, MPP_DEC_NOTIFY_TASK_ALL_DONE);
+    hal->unlock();
+}
+
+void *MppDecHwWaiter::waiter_loop(void *arg)
+{
+    MppDecHwDev *dev = (MppDecHwDev *)arg;
+    MppDecHwWaiter *waiter = get_instance();
+
+    while (1) {
+        DecHalTask *task = NULL;
+
+        {
+            AutoMutex autolock(waiter->mLock);
+
+            while (!waiter->mQuit && list_empty(&dev->list))
+                dev->cond->wait(waiter->mLock);
+
+            if (waiter->mQuit)
+                break;
+
+            task = list_entry(dev->list.next, DecHalTask, list);
+            list_del_init(&task->list);
+            dev->curr = task;
+        }
+
+        mpp_dec_hw_wait_task(task);
+
+        AutoMutex autolock(waiter->mLock);
+        dev->curr = NULL;
+        waiter->mDone.broadcast();
+    }
 
-    mpp_assert(mpp->mTaskPutCount == mpp->mTaskGetCount);
-    mpp_dbg(MPP_DBG_INFO, "mpp_dec_hal_thread exited\n");
     return NULL;
 }
 
+MPP_RET MppDecHwWaiter::post(MppDeviceId id, DecHalTask *task)
+{
+    MppDecHwDev *dev = &mDevs[id];
+    AutoMutex autolock(mLock);
+
+    if (!dev->started) {
+        char name[THREAD_NAME_LEN];
+
+        if (pthread_create(&dev->thd, NULL, waiter_loop, dev)) {
+            mpp_err_f("failed to create device %d waiter\n", id);
+            return MPP_NOK;
+        }
+
+        snprintf(name, sizeof(name), "mpp_hw_wait_%d", id);
+#ifndef ARMLINUX
+        pthread_setname_np(dev->thd, name);
+#endif
+        dev->started = 1;
+    }
+
+    list_add_tail(&task->list, &dev->list);
+    dev->cond->signal();
+    return MPP_OK;
+}
+
+/* remove the task from waiter or wait until its hardware wait is done */
+void MppDecHwWaiter::cancel(MppDeviceId id, DecHalTask *task)
+{
+    MppDecHwDev *dev = &mDevs[id];
+    AutoMutex autolock(mLock);
+
+    list_del_init(&task->list);
+    while (dev->curr == task)
+        mDone.wait(mLock);
+}
+
+/* return MPP_NOK when the task waits for hardware done or output room */
+static MPP_RET mpp_dec_hal_job_proc(Mpp *mpp, DecHalTask *task)
+{
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    HalDecTask *task_dec = &task->info.dec;
+
+    if (task->stage == HAL_JOB_IDLE) {
+        mpp->mTaskGetCount++;
+        hal_task_hnd_get_info(task->hnd, &task->info);
+        task->notify_flag = MPP_DEC_NOTIFY_TASK_HND_VALID;
+
+        /*
+         * info change task and eos task without valid frame only output
+         * frames as mpp_dec_hal_proc_task does
+         */
+        if (task_dec->flags.info_change) {
+            mpp_dec_flush(dec);
+            task->out_tail = 1;
+            task->out_index = task_dec->output;
+            task->stage = HAL_JOB_OUTPUT;
+        } else if (task_dec->flags.eos &&
+                   (!task_dec->valid || task_dec->output < 0)) {
+            task->out_tail = 1;
+            task->out_index = -1;
+            task->stage = HAL_JOB_OUTPUT;
+        } else {
+            task->stage = HAL_JOB_HW_WAIT;
+            if (!MppDecHwWaiter::get_instance()->post(dec->device_id, task))
+                return MPP_NOK;
+
+            // no waiter thread then wait here as the last resort
+            mpp_hal_hw_wait(dec->hal, &task->info);
+            task->notify_flag = mpp_dec_hal_post_task(mpp, task->hnd, &task->info);
+            task->stage = HAL_JOB_OUTPUT;
+        }
+    }
+
+    if (mpp_dec_hal_job_output(mpp, task))
+        return MPP_NOK;
+
+    task->stage = HAL_JOB_IDLE;
+    return MPP_OK;
+}
+
+static RK_S32 mpp_dec_hal_job(void *data)
+{
+    Mpp *mpp = (Mpp*)data;
+    MppDecImpl *dec = (MppDecImpl *)mpp->mDec;
+    MppThread *hal = dec->thread_hal;
+    DecHalTask *task = (DecHalTask *)dec->hal_task;
+    MPP_RET ret = MPP_OK;
+
+    while (1) {
+        {
+            AutoMutex work_lock(hal->mutex());
+            if (MPP_THREAD_RUNNING != hal->get_status())
+                return 0;
+
+            // device waiter signals when hardware is done
+            if (task->stage == HAL_JOB_HW_WAIT)
+                return 0;
+
+            if (task->stage == HAL_JOB_IDLE &&
+                hal_task_get_hnd(dec->tasks, TASK_PROCESSING, &task->hnd)) {
+                MppThread *parser = dec->thread_parser;
+
+                // process all task then do reset process
+                if (dec->hal_reset_post == dec->hal_reset_done) {
+                    mpp_dec_notify(dec, MPP_DEC_NOTIFY_TASK_ALL_DONE);
+                    return 0;
+                }
+
+                if (!task->reset_flush) {
+                    dec_dbg_reset("reset: hal reset start\n");
+                    mpp_dec_flush(dec);
+                    task->reset_flush = 1;
+                }
+
+                if (reset_hal_output(mpp))
+                    return 0;
+
+                task->reset_flush = 0;
+                dec_dbg_reset("reset: hal reset done\n");
+                dec->hal_reset_done++;
+                sem_post(&dec->hal_reset);
+
+                // parser job polls the reset semaphore when signaled
+                parser->lock();
+                dec_signal_parser(dec);
+                parser->unlock();
+                continue;
+            }
+        }
+
+        mpp_clock_start(dec->clocks[DEC_HAL_PROC]);
+        ret = mpp_dec_hal_job_proc(mpp, task);
+        mpp_clock_pause(dec->clocks[DEC_HAL_PROC]);
+
+        // signaled by device waiter or mpp_dec_signal_output
+        if (ret)
+            return 0;
+    }
+
+    return 0;
+}
+
 static MPP_RET dec_release_task_in_port(MppPort port)
 {
     MPP_RET ret = MPP_OK;
@@ -1260,8 +1844,10 @@ MPP_RET mpp_dec_init(MppDec *dec, MppDecCfg *cfg)
     RK_S32 hal_task_count = 0;
     MppDecImpl *p = NULL;
     IOInterruptCB cb = {NULL, NULL};
+    RK_U32 thread_pool = 0;
 
     mpp_env_get_u32("mpp_dec_debug", &mpp_dec_debug, 0);
+    mpp_env_get_u32("mpp_dec_thread_pool", &thread_pool, 0);
     dec_dbg_func("in\n");
 
     if (NULL == dec || NULL == cfg) {
@@ -1337,6 +1923,7 @@ MPP_RET mpp_dec_init(MppDec *dec, MppDecCfg *cfg)
         p->parser = parser;
         p->hal    = hal;
         p->tasks  = hal_cfg.tasks;
+        p->device_id = hal_cfg.device_id;
         p->frame_slots  = frame_slots;
         p->packet_slots = packet_slots;
 
@@ -1345,6 +1932,9 @@ MPP_RET mpp_dec_init(MppDec *dec, MppDecCfg *cfg)
         p->parser_fast_mode     = cfg->fast_mode;
         p->parser_internal_pts  = cfg->internal_pts;
         p->enable_deinterlace   = 1;
+        /* MJPEG advanced thread is not supported in thread pool mode */
+        p->use_thread_pool      = (coding != MPP_VIDEO_CodingMJPEG) &&
+                                  (cfg->thread_pool || thread_pool);
 
         p->statistics_en        = (mpp_dec_debug & MPP_DEC_DBG_TIMING) ? 1 : 0;
 
@@ -1434,6 +2024,91 @@ MPP_RET mpp_dec_deinit(MppDec ctx)
     return MPP_OK;
 }
 
+static MPP_RET mpp_dec_start_job(MppDecImpl *dec)
+{
+    DecTask *task = mpp_calloc(DecTask, 1);
+    DecHalTask *hal_task = mpp_calloc(DecHalTask, 1);
+
+    if (NULL == task || NULL == hal_task) {
+        mpp_err_f("failed to malloc parser / hal task\n");
+        MPP_FREE(task);
+        MPP_FREE(hal_task);
+        return MPP_ERR_MALLOC;
+    }
+
+    dec_task_init(task);
+    dec->parser_task = task;
+    dec->hal_reset_wait = 0;
+
+    INIT_LIST_HEAD(&hal_task->list);
+    hal_task->mpp = (Mpp *)dec->mpp;
+    hal_task->stage = HAL_JOB_IDLE;
+    hal_task_info_init(&hal_task->info, MPP_CTX_DEC);
+    dec->hal_task = hal_task;
+    dec->hal_out_wait = 0;
+
+    if (mpp_job_get(&dec->job_parser, "mpp_dec_parser", mpp_dec_parser_job, dec->mpp) ||
+        mpp_job_get(&dec->job_hal, "mpp_dec_hal", mpp_dec_hal_job, dec->mpp)) {
+        if (dec->job_parser) {
+            mpp_job_put(dec->job_parser);
+            dec->job_parser = NULL;
+        }
+        MPP_FREE(dec->parser_task);
+        MPP_FREE(dec->hal_task);
+        return MPP_NOK;
+    }
+
+    // thread is not started in pool mode. Just mark it running for status check
+    dec->thread_parser->set_status(MPP_THREAD_RUNNING);
+    dec->thread_hal->set_status(MPP_THREAD_RUNNING);
+
+    mpp_clock_start(dec->clocks[DEC_PRS_TOTAL]);
+    mpp_clock_start(dec->clocks[DEC_HAL_TOTAL]);
+
+    mpp_job_signal(dec->job_parser);
+    mpp_job_signal(dec->job_hal);
+
+    return MPP_OK;
+}
+
+static void mpp_dec_stop_job(MppDecImpl *dec)
+{
+    Mpp *mpp = (Mpp *)dec->mpp;
+    MppThread *parser = dec->thread_parser;
+    MppThread *hal = dec->thread_hal;
+    MppJob job_parser;
+    MppJob job_hal;
+
+    // clear job under lock so that no one can signal it after put
+    parser->lock();
+    parser->set_status(MPP_THREAD_STOPPING);
+    job_parser = dec->job_parser;
+    dec->job_parser = NULL;
+    parser->unlock();
+
+    hal->lock();
+    hal->set_status(MPP_THREAD_STOPPING);
+    job_hal = dec->job_hal;
+    dec->job_hal = NULL;
+    hal->unlock();
+
+    mpp_job_put(job_parser);
+    mpp_job_put(job_hal);
+    dec->hal_out_wait = 0;
+
+    // hardware wait on device waiter may still access hal task
+    MppDecHwWaiter::get_instance()->cancel(dec->device_id, (DecHalTask *)dec->hal_task);
+
+    mpp_dec_parser_exit(mpp, (DecTask *)dec->parser_task);
+    mpp_dec_hal_exit(mpp);
+
+    MPP_FREE(dec->parser_task);
+    MPP_FREE(dec->hal_task);
+
+    parser->set_status(MPP_THREAD_UNINITED);
+    hal->set_status(MPP_THREAD_UNINITED);
+}
+
 MPP_RET mpp_dec_start(MppDec ctx)
 {
     MPP_RET ret = MPP_OK;
@@ -1447,8 +2122,15 @@ MPP_RET mpp_dec_start(MppDec ctx)
         dec->thread_hal = new MppThread(mpp_dec_hal_thread,
                                         dec->mpp, "mpp_dec_hal");
 
-        dec->thread_parser->start();
-        dec->thread_hal->start();
+        if (dec->use_thread_pool && mpp_dec_start_job(dec)) {
+            mpp_err_f("failed to start on thread pool, fallback to thread\n");
+            dec->use_thread_pool = 0;
+        }
+
+        if (!dec->use_thread_pool) {
+            dec->thread_parser->start();
+            dec->thread_hal->start();
+        }
     } else {
         dec->thread_parser = new MppThread(mpp_dec_advanced_thread,
                                            dec->mpp, "mpp_dec_parser");
@@ -1466,11 +2148,15 @@ MPP_RET mpp_dec_stop(MppDec ctx)
 
     dec_dbg_func("%p in\n", dec);
 
-    if (dec->thread_parser)
-        dec->thread_parser->stop();
+    if (dec->use_thread_pool && dec->parser_task) {
+        mpp_dec_stop_job(dec);
+    } else {
+        if (dec->thread_parser)
+            dec->thread_parser->stop();
 
-    if (dec->thread_hal)
-        dec->thread_hal->stop();
+        if (dec->thread_hal)
+            dec->thread_hal->stop();
+    }
 
     if (dec->thread_parser) {
         delete dec->thread_parser;
@@ -1535,6 +2221,9 @@ MPP_RET mpp_dec_notify(MppDec ctx, RK_U32 flag)
 
     dec_dbg_func("%p in flag %08x\n", dec, flag);
 
+    if (flag & MPP_DEC_NOTIFY_FRAME_DEQUEUE)
+        mpp_dec_signal_output((Mpp *)dec->mpp);
+
     thd_dec->lock();
     {
         RK_U32 old_flag = dec->parser_notify_flag;
@@ -1544,7 +2233,7 @@ MPP_RET mpp_dec_notify(MppDec ctx, RK_U32 flag)
             (dec->parser_notify_flag & dec->parser_status_flag)) {
             dec_dbg_notify("%p status %08x notify %08x signal\n", dec,
                            dec->parser_status_flag, dec->parser_notify_flag);
-            thd_dec->signal();
+            dec_signal_parser(dec);
         }
     }
     thd_dec->unlock();
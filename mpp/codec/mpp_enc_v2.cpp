@@ -22,9 +22,12 @@
 #include "mpp_env.h"
 #include "mpp_log.h"
 #include "mpp_mem.h"
+#include "mpp_list.h"
 #include "mpp_info.h"
+#include "mpp_time.h"
 #include "mpp_common.h"
 
+#include "mpp_frame_impl.h"
 #include "mpp_packet_impl.h"
 
 #include "mpp.h"
@@ -39,6 +42,9 @@
 
 RK_U32 mpp_enc_debug = 0;
 
+/* hal wait longer than this is treated as blocked until hardware finished */
+#define MPP_ENC_HW_WAIT_BLOCK_US    200
+
 typedef union MppEncHeaderStatus_u {
     RK_U32 val;
     struct {
@@ -56,6 +62,42 @@ typedef struct RcApiStatus_t {
     RK_U32              rc_api_user_cfg : 1;
 } RcApiStatus;
 
+/*
+ * One frame encoding is split into two stages:
+ * submit  - from rc frame start to hardware start
+ * collect - from hardware wait to rc frame end and packet output
+ * In async mode up to pipe_depth tasks can be between the two stages.
+ */
+typedef struct EncPipeTask_t {
+    /* input task held until output in sync mode, NULL in async mode */
+    MppTask             task_in;
+    /* user frame in sync mode or referenced copy in async mode */
+    MppFrame            frame;
+    MppPacket           packet;
+
+    EncRcTask           rc_task;
+    HalTaskInfo         info;
+
+    RK_U32              hw_started;
+    RK_U32              finished;
+    RK_U32              input_waited;
+    /*
+     * hardware result dropped by re-encode of an earlier task. The task is
+     * started again from hal stage without frm.reencode so rc and hal see a
+     * normal start.
+     */
+    RK_U32              replay;
+    RK_S64              start_time;
+} EncPipeTask;
+
+/* control queued by MPP_ENC_POST_CTRL */
+typedef struct EncCtrlNode_t {
+    struct list_head    list;
+    MpiCmd              cmd;
+    void                *param;
+    RK_U32              seq;
+} EncCtrlNode;
+
 typedef struct MppEncImpl_t {
     MppCodingType       coding;
     EncImpl             impl;
@@ -73,7 +115,6 @@ typedef struct MppEncImpl_t {
     RK_S32              rc_cfg_updated;
     RcApiBrief          rc_brief;
     RcCtx               rc_ctx;
-    EncRcTask           rc_task;
 
     MppThread           *thread_enc;
     void                *mpp;
@@ -90,6 +131,8 @@ typedef struct MppEncImpl_t {
 
     /* Encoder configure set */
     MppEncCfgSet        cfg;
+    /* staging config for MPP_ENC_SET_CFG_KV used by encoder thread */
+    MppEncCfg           cfg_kv;
 
     /* control process */
     RK_U32              cmd_send;
@@ -99,6 +142,12 @@ typedef struct MppEncImpl_t {
     MPP_RET             *cmd_ret;
     sem_t               enc_ctrl;
 
+    /* queued control done by encoder thread before next frame */
+    Mutex               ctrl_lock;
+    struct list_head    ctrl_list;
+    MppEncCtrlStatus    ctrl_status;
+    MppEncCtrlCb        ctrl_cb;
+
     // legacy support for MPP_ENC_GET_EXTRA_INFO
     MppPacket           hdr_pkt;
     void                *hdr_buf;
@@ -114,6 +163,19 @@ typedef struct MppEncImpl_t {
     RK_S32              rc_cfg_pos;
     RK_S32              rc_cfg_length;
     RK_S32              rc_cfg_size;
+
+    /*
+     * submit / collect pipeline
+     * pipe_cnt tasks from pipe_rd are submitted and waiting for output
+     */
+    RK_S32              hw_task_count;
+    EncPipeTask         pipe[MPP_ENC_PIPE_DEPTH_MAX];
+    RK_S32              pipe_rd;
+    RK_S32              pipe_cnt;
+
+    /* estimated hardware time for waiting next input in async mode */
+    RK_S64              hw_time;
+    RK_S64              hw_done_time;
 } MppEncImpl;
 
 typedef union EncTaskWait_u {
@@ -173,7 +235,6 @@ typedef struct EncTask_t {
     EncTaskStatus   status;
     EncTaskWait     wait;
     EncFrmStatus    frm;
-    HalTaskInfo     info;
 } EncTask;
 
 static RK_U8 uuid_version[16] = {
@@ -448,9 +509,9 @@ static RK_S32 check_rc_gop_update(MpiCmd cmd, MppEncCfgSet *cfg)
     return 0;
 }
 
-static void mpp_enc_proc_cfg(MppEncImpl *enc)
+static void mpp_enc_proc_cfg(MppEncImpl *enc, MpiCmd cmd, void *param, MPP_RET *cmd_ret)
 {
-    switch (enc->cmd) {
+    switch (cmd) {
     case MPP_ENC_GET_HDR_SYNC :
     case MPP_ENC_GET_EXTRA_INFO : {
         /*
@@ -466,39 +527,39 @@ static void mpp_enc_proc_cfg(MppEncImpl *enc)
             enc->hdr_status.ready = 1;
         }
 
-        if (enc->cmd == MPP_ENC_GET_EXTRA_INFO) {
+        if (cmd == MPP_ENC_GET_EXTRA_INFO) {
             mpp_err("Please use MPP_ENC_GET_HDR_SYNC instead of unsafe MPP_ENC_GET_EXTRA_INFO\n");
             mpp_err("NOTE: MPP_ENC_GET_HDR_SYNC needs MppPacket input\n");
 
-            *(MppPacket *)enc->param = enc->hdr_pkt;
+            *(MppPacket *)param = enc->hdr_pkt;
         } else {
-            mpp_packet_copy((MppPacket)enc->param, enc->hdr_pkt);
+            mpp_packet_copy((MppPacket)param, enc->hdr_pkt);
         }
 
         enc->hdr_status.added_by_ctrl = 1;
     } break;
     case MPP_ENC_GET_RC_API_ALL : {
-        RcApiQueryAll *query = (RcApiQueryAll *)enc->param;
+        RcApiQueryAll *query = (RcApiQueryAll *)param;
 
         rc_brief_get_all(query);
     } break;
     case MPP_ENC_GET_RC_API_BY_TYPE : {
-        RcApiQueryType *query = (RcApiQueryType *)enc->param;
+        RcApiQueryType *query = (RcApiQueryType *)param;
 
         rc_brief_get_by_type(query);
     } break;
     case MPP_ENC_SET_RC_API_CFG : {
-        const RcImplApi *api = (const RcImplApi *)enc->param;
+        const RcImplApi *api = (const RcImplApi *)param;
 
         rc_api_add(api);
     } break;
     case MPP_ENC_GET_RC_API_CURRENT : {
-        RcApiBrief *dst = (RcApiBrief *)enc->param;
+        RcApiBrief *dst = (RcApiBrief *)param;
 
         *dst = enc->rc_brief;
     } break;
     case MPP_ENC_SET_RC_API_CURRENT : {
-        RcApiBrief *src = (RcApiBrief *)enc->param;
+        RcApiBrief *src = (RcApiBrief *)param;
 
         mpp_assert(src->type == enc->coding);
         enc->rc_brief = *src;
@@ -506,40 +567,40 @@ static void mpp_enc_proc_cfg(MppEncImpl *enc)
         enc->rc_status.rc_api_updated = 1;
     } break;
     case MPP_ENC_SET_HEADER_MODE : {
-        if (enc->param) {
-            MppEncHeaderMode mode = *((MppEncHeaderMode *)enc->param);
+        if (param) {
+            MppEncHeaderMode mode = *((MppEncHeaderMode *)param);
 
             if (mode < MPP_ENC_HEADER_MODE_BUTT) {
                 enc->hdr_mode = mode;
                 enc_dbg_ctrl("header mode set to %d\n", mode);
             } else {
                 mpp_err_f("invalid header mode %d\n", mode);
-                *enc->cmd_ret = MPP_NOK;
+                *cmd_ret = MPP_NOK;
             }
         } else {
             mpp_err_f("invalid NULL ptr on setting header mode\n");
-            *enc->cmd_ret = MPP_NOK;
+            *cmd_ret = MPP_NOK;
         }
     } break;
     case MPP_ENC_SET_SEI_CFG : {
-        if (enc->param) {
-            MppEncSeiMode mode = *((MppEncSeiMode *)enc->param);
+        if (param) {
+            MppEncSeiMode mode = *((MppEncSeiMode *)param);
 
             if (mode <= MPP_ENC_SEI_MODE_ONE_FRAME) {
                 enc->sei_mode = mode;
                 enc_dbg_ctrl("sei mode set to %d\n", mode);
             } else {
                 mpp_err_f("invalid sei mode %d\n", mode);
-                *enc->cmd_ret = MPP_NOK;
+                *cmd_ret = MPP_NOK;
             }
         } else {
             mpp_err_f("invalid NULL ptr on setting header mode\n");
-            *enc->cmd_ret = MPP_NOK;
+            *cmd_ret = MPP_NOK;
         }
     } break;
     case MPP_ENC_SET_REF_CFG : {
         MPP_RET ret = MPP_OK;
-        MppEncRefCfg src = (MppEncRefCfg)enc->param;
+        MppEncRefCfg src = (MppEncRefCfg)param;
         MppEncRefCfg dst = enc->cfg.ref_cfg;
 
         if (NULL == src)
@@ -553,20 +614,20 @@ static void mpp_enc_proc_cfg(MppEncImpl *enc)
         ret = mpp_enc_ref_cfg_copy(dst, src);
         if (ret) {
             mpp_err_f("failed to copy ref cfg ret %d\n", ret);
-            *enc->cmd_ret = ret;
+            *cmd_ret = ret;
         }
 
         ret = mpp_enc_refs_set_cfg(enc->refs, dst);
         if (ret) {
             mpp_err_f("failed to set ref cfg ret %d\n", ret);
-            *enc->cmd_ret = ret;
+            *cmd_ret = ret;
         }
 
         if (mpp_enc_refs_update_hdr(enc->refs))
             enc->hdr_status.val = 0;
     } break;
     case MPP_ENC_SET_OSD_PLT_CFG : {
-        MppEncOSDPltCfg *src = (MppEncOSDPltCfg *)enc->param;
+        MppEncOSDPltCfg *src = (MppEncOSDPltCfg *)param;
         MppEncOSDPltCfg *dst = &enc->cfg.plt_cfg;
         RK_U32 change = src->change;
 
@@ -594,18 +655,68 @@ static void mpp_enc_proc_cfg(MppEncImpl *enc)
             enc_dbg_ctrl("plt type %d data %p\n", dst->type, src->plt);
         }
     } break;
+    case MPP_ENC_SET_IDR_FRAME : {
+        /* only queued idr request is done here */
+        enc->frm_cfg.force_flag |= ENC_FORCE_IDR;
+        enc->frm_cfg.force_idr++;
+    } break;
+    case MPP_ENC_SET_CFG_KV : {
+        MppEncCfgKvSet *set = (MppEncCfgKvSet *)param;
+        MPP_RET ret;
+
+        if (NULL == enc->cfg_kv && mpp_enc_cfg_init(&enc->cfg_kv)) {
+            *cmd_ret = MPP_ERR_NOMEM;
+            return;
+        }
+
+        /*
+         * Start from current config as one change flag covers a group of
+         * items and clear the change flags left by the last config.
+         */
+        mpp_enc_cfg_stage(enc->cfg_kv, &enc->cfg);
+
+        enc_dbg_ctrl("set %d config pairs\n", set->count);
+
+        ret = mpp_enc_cfg_set_kv(enc->cfg_kv, set->kv, set->count);
+        if (ret) {
+            *cmd_ret = ret;
+            return;
+        }
+
+        /* all pairs are applied as one MPP_ENC_SET_CFG */
+        mpp_enc_proc_cfg(enc, MPP_ENC_SET_CFG, enc->cfg_kv, cmd_ret);
+        return;
+    } break;
+    case MPP_ENC_SET_CFG : {
+        MppEncBaseCfg *src = &((MppEncCfgImpl *)param)->cfg.base;
+        MppEncBaseCfg *dst = &enc->cfg.base;
+
+        if (src->change & MPP_ENC_BASE_CFG_CHANGE_PIPE_DEPTH) {
+            if (src->pipe_depth < 1 || src->pipe_depth > MPP_ENC_PIPE_DEPTH_MAX) {
+                mpp_err_f("invalid pipe depth %d\n", src->pipe_depth);
+                *cmd_ret = MPP_NOK;
+            } else {
+                dst->pipe_depth = src->pipe_depth;
+                enc_dbg_ctrl("pipe depth set to %d hw task %d\n",
+                             dst->pipe_depth, enc->hw_task_count);
+            }
+        }
+        src->change = 0;
+
+        enc_impl_proc_cfg(enc->impl, cmd, param);
+    } break;
     default : {
-        enc_impl_proc_cfg(enc->impl, enc->cmd, enc->param);
+        enc_impl_proc_cfg(enc->impl, cmd, param);
     } break;
     }
 
-    if (check_resend_hdr(enc->cmd, enc->param, &enc->cfg)) {
+    if (check_resend_hdr(cmd, param, &enc->cfg)) {
         enc->frm_cfg.force_flag |= ENC_FORCE_IDR;
         enc->hdr_status.val = 0;
     }
-    if (check_rc_cfg_update(enc->cmd, &enc->cfg))
+    if (check_rc_cfg_update(cmd, &enc->cfg))
         enc->rc_status.rc_api_user_cfg = 1;
-    if (check_rc_gop_update(enc->cmd, &enc->cfg))
+    if (check_rc_gop_update(cmd, &enc->cfg))
         mpp_enc_refs_set_rc_igop(enc->refs, enc->cfg.rc.gop);
 }
 
@@ -757,23 +868,510 @@ static void set_rc_cfg(RcCfg *cfg, MppEncCfgSet *cfg_set)
     }
 }
 
+static RK_S32 get_pipe_depth(MppEncImpl *enc)
+{
+    return MPP_CLIP3(1, enc->hw_task_count, enc->cfg.base.pipe_depth);
+}
+
+static void update_hw_time(MppEncImpl *enc, EncPipeTask *pipe, RK_S64 wait_start)
+{
+    RK_S64 now = mpp_time();
+
+    /*
+     * When hal wait blocks the task is just finished and the time from its
+     * hardware start is accurate. Otherwise the task had finished before wait
+     * and the estimated time decays.
+     */
+    if (now - wait_start > MPP_ENC_HW_WAIT_BLOCK_US)
+        enc->hw_time = now - MPP_MAX(pipe->start_time, enc->hw_done_time);
+    else
+        enc->hw_time -= enc->hw_time >> 3;
+
+    enc->hw_done_time = now;
+}
+
+static void mpp_enc_task_done(EncPipeTask *pipe)
+{
+    HalEncTask *hal_task = &pipe->info.enc;
+    MppPacket packet = pipe->packet;
+    MppMeta meta = mpp_packet_get_meta(packet);
+
+    /* setup output packet and meta data */
+    mpp_packet_set_length(packet, hal_task->length);
+
+    if (hal_task->mv_info)
+        mpp_meta_set_buffer(meta, KEY_MOTION_INFO, hal_task->mv_info);
+
+    mpp_meta_set_s32(meta, KEY_OUTPUT_INTRA, pipe->rc_task.frm.is_intra);
+
+    pipe->finished = 1;
+}
+
+/* submit stage part which is run again on re-encode */
+static MPP_RET mpp_enc_submit_hw(MppEncImpl *enc, EncPipeTask *pipe)
+{
+    Mpp *mpp = (Mpp *)enc->mpp;
+    EncImpl impl = enc->impl;
+    MppEncHal hal = enc->enc_hal;
+    EncRcTask *rc_task = &pipe->rc_task;
+    EncCpbStatus *cpb = &rc_task->cpb;
+    EncFrmStatus *frm = &rc_task->frm;
+    HalEncTask *hal_task = &pipe->info.enc;
+    MppFrame frame = pipe->frame;
+    MppPacket packet = pipe->packet;
+    MPP_RET ret = MPP_OK;
+
+TASK_REENCODE:
+    // 15. restore and process dpb
+    if (!frm->reencode && !pipe->replay) {
+        if (!frm->re_dpb_proc) {
+            enc_dbg_detail("task %d enc proc dpb\n", frm->seq_idx);
+            mpp_enc_refs_get_cpb(enc->refs, cpb);
+
+            enc_dbg_frm_status("frm %d start ***********************************\n", cpb->curr.seq_idx);
+            RUN_ENC_IMPL_FUNC(enc_impl_proc_dpb, impl, hal_task, mpp, ret);
+
+            enc_dbg_frm_status("frm %d compare\n", cpb->curr.seq_idx);
+            enc_dbg_frm_status("seq_idx      %d vs %d\n", frm->seq_idx, cpb->curr.seq_idx);
+            enc_dbg_frm_status("is_idr       %d vs %d\n", frm->is_idr, cpb->curr.is_idr);
+            enc_dbg_frm_status("is_intra     %d vs %d\n", frm->is_intra, cpb->curr.is_intra);
+            enc_dbg_frm_status("is_non_ref   %d vs %d\n", frm->is_non_ref, cpb->curr.is_non_ref);
+            enc_dbg_frm_status("is_lt_ref    %d vs %d\n", frm->is_lt_ref, cpb->curr.is_lt_ref);
+            enc_dbg_frm_status("lt_idx       %d vs %d\n", frm->lt_idx, cpb->curr.lt_idx);
+            enc_dbg_frm_status("temporal_id  %d vs %d\n", frm->temporal_id, cpb->curr.temporal_id);
+            enc_dbg_frm_status("frm %d done  ***********************************\n", cpb->curr.seq_idx);
+        }
+
+        enc_dbg_detail("task %d rc frame start\n", frm->seq_idx);
+        RUN_ENC_RC_FUNC(rc_frm_start, enc->rc_ctx, rc_task, mpp, ret);
+        if (frm->re_dpb_proc)
+            goto TASK_REENCODE;
+
+        // 16. generate header before hardware stream
+        if (enc->hdr_mode == MPP_ENC_HEADER_MODE_EACH_IDR &&
+            frm->is_intra &&
+            !enc->hdr_status.added_by_change &&
+            !enc->hdr_status.added_by_ctrl &&
+            !enc->hdr_status.added_by_mode) {
+            enc_dbg_detail("task %d IDR header length %d\n",
+                           frm->seq_idx, enc->hdr_len);
+
+            mpp_packet_append(packet, enc->hdr_pkt);
+
+            hal_task->header_length = enc->hdr_len;
+            hal_task->length += enc->hdr_len;
+            enc->hdr_status.added_by_mode = 1;
+        }
+    }
+
+    // check for header adding
+    if (hal_task->length != mpp_packet_get_length(packet)) {
+        mpp_err_f("header adding check failed: task length is not match to packet length %d vs %d\n",
+                  hal_task->length, mpp_packet_get_length(packet));
+    }
+
+    /* 17. Add all prefix info before encoding */
+    if (!frm->reencode && !pipe->replay) {
+        if (frm->is_idr && enc->sei_mode >= MPP_ENC_SEI_MODE_ONE_SEQ) {
+            RK_S32 length = 0;
+
+            enc_impl_add_prefix(impl, packet, &length, uuid_version,
+                                enc->version_info, enc->version_length);
+
+            hal_task->sei_length += length;
+            hal_task->length += length;
+
+            length = 0;
+            enc_impl_add_prefix(impl, packet, &length, uuid_rc_cfg,
+                                enc->rc_cfg_info, enc->rc_cfg_length);
+
+            hal_task->sei_length += length;
+            hal_task->length += length;
+        }
+
+        if (mpp_frame_has_meta(frame)) {
+            MppMeta frm_meta = mpp_frame_get_meta(frame);
+            MppEncUserData *user_data = NULL;
+
+            mpp_meta_get_ptr(frm_meta, KEY_USER_DATA, (void**)&user_data);
+
+            if (user_data) {
+                if (user_data->pdata && user_data->len) {
+                    RK_S32 length = 0;
+
+                    enc_impl_add_prefix(impl, packet, &length, uuid_usr_data,
+                                        user_data->pdata, user_data->len);
+
+                    hal_task->sei_length += length;
+                    hal_task->length += length;
+                } else
+                    mpp_err_f("failed to insert user data %p len %d\n",
+                              user_data->pdata, user_data->len);
+            }
+        }
+    }
+
+    // check for user data adding
+    if (hal_task->length != mpp_packet_get_length(packet)) {
+        mpp_err_f("user data adding check failed: task length is not match to packet length %d vs %d\n",
+                  hal_task->length, mpp_packet_get_length(packet));
+    }
+
+    enc_dbg_detail("task %d enc proc hal\n", frm->seq_idx);
+    RUN_ENC_IMPL_FUNC(enc_impl_proc_hal, impl, hal_task, mpp, ret);
+
+    enc_dbg_detail("task %d hal get task\n", frm->seq_idx);
+    RUN_ENC_HAL_FUNC(mpp_enc_hal_get_task, hal, hal_task, mpp, ret);
+
+    /* replayed task keeps the quality decided on its first start */
+    if (!pipe->replay) {
+        enc_dbg_detail("task %d rc hal start\n", frm->seq_idx);
+        RUN_ENC_RC_FUNC(rc_hal_start, enc->rc_ctx, rc_task, mpp, ret);
+    }
+
+    enc_dbg_detail("task %d hal generate reg\n", frm->seq_idx);
+    RUN_ENC_HAL_FUNC(mpp_enc_hal_gen_regs, hal, hal_task, mpp, ret);
+
+    enc_dbg_detail("task %d hal start\n", frm->seq_idx);
+    RUN_ENC_HAL_FUNC(mpp_enc_hal_start, hal, hal_task, mpp, ret);
+
+    pipe->hw_started = 1;
+    pipe->start_time = mpp_time();
+
+TASK_DONE:
+    return ret;
+}
+
+/* submit stage: from frame drop check to hardware start */
+static MPP_RET mpp_enc_submit(MppEncImpl *enc, EncTask *task, EncPipeTask *pipe,
+                              MppTask task_in)
+{
+    Mpp *mpp = (Mpp *)enc->mpp;
+    EncImpl impl = enc->impl;
+    MppEncRefFrmUsrCfg *frm_cfg = &enc->frm_cfg;
+    EncRcTask *rc_task = &pipe->rc_task;
+    EncFrmStatus *frm = &rc_task->frm;
+    HalEncTask *hal_task = &pipe->info.enc;
+    MppFrame frame = pipe->frame;
+    MppPacket packet = pipe->packet;
+    MPP_RET ret = MPP_OK;
+
+    // 8. all task ready start encoding one frame
+    reset_hal_enc_task(hal_task);
+    reset_enc_rc_task(rc_task);
+    hal_task->rc_task = rc_task;
+    hal_task->frm_cfg = frm_cfg;
+    frm->seq_idx = task->seq_idx++;
+    rc_task->frame = frame;
+
+    enc_dbg_detail("task seq idx %d start\n", frm->seq_idx);
+
+    /*
+     * 9. check and create packet for output
+     * if there is available buffer in the input frame do encoding
+     */
+    if (NULL == packet) {
+        /* NOTE: set buffer w * h * 1.5 to avoid buffer overflow */
+        RK_U32 width  = enc->cfg.prep.width;
+        RK_U32 height = enc->cfg.prep.height;
+        RK_U32 size = MPP_ALIGN(width, 16) * MPP_ALIGN(height, 16) * 3 / 2;
+        MppBuffer buffer = NULL;
+
+        mpp_assert(size);
+        mpp_buffer_get(mpp->mPacketGroup, &buffer, size);
+        mpp_packet_init_with_buffer(&packet, buffer);
+        /* NOTE: clear length for output */
+        mpp_packet_set_length(packet, 0);
+        mpp_buffer_put(buffer);
+
+        enc_dbg_detail("create output pkt %p buf %p\n", packet, buffer);
+        pipe->packet = packet;
+    }
+
+    mpp_assert(packet);
+
+    // 10. bypass pts to output
+    {
+        RK_S64 pts = mpp_frame_get_pts(frame);
+        mpp_packet_set_pts(packet, pts);
+        enc_dbg_detail("task %d pts %lld\n", frm->seq_idx, pts);
+    }
+
+    // 11. check frame drop by frame rate conversion
+    RUN_ENC_RC_FUNC(rc_frm_check_drop, enc->rc_ctx, rc_task, mpp, ret);
+    task->status.rc_check_frm_drop = 1;
+    enc_dbg_detail("task %d drop %d\n", frm->seq_idx, frm->drop);
+
+    // when the frame should be dropped just return empty packet
+    if (frm->drop) {
+        hal_task->valid = 0;
+        hal_task->length = 0;
+        goto TASK_DONE;
+    }
+
+    // start encoder task process here
+    hal_task->valid = 1;
+
+    // 12. generate header before hardware stream
+    if (!enc->hdr_status.ready) {
+        /* config cpb before generating header */
+        enc_impl_gen_hdr(impl, enc->hdr_pkt);
+        enc->hdr_len = mpp_packet_get_length(enc->hdr_pkt);
+        enc->hdr_status.ready = 1;
+
+        enc_dbg_detail("task %d update header length %d\n",
+                       frm->seq_idx, enc->hdr_len);
+
+        mpp_packet_append(packet, enc->hdr_pkt);
+        hal_task->header_length = enc->hdr_len;
+        hal_task->length += enc->hdr_len;
+        enc->hdr_status.added_by_change = 1;
+    }
+
+    mpp_assert(hal_task->length == mpp_packet_get_length(packet));
+
+    // 13. setup input frame and output packet
+    hal_task->frame  = frame;
+    hal_task->input  = mpp_frame_get_buffer(frame);
+    hal_task->packet = packet;
+    hal_task->output = mpp_packet_get_buffer(packet);
+    hal_task->length = mpp_packet_get_length(packet);
+    mpp_task_meta_get_buffer(task_in, KEY_MOTION_INFO, &hal_task->mv_info);
+
+    /* 14. check frm_meta data force key in input frame and start one frame */
+    enc_dbg_detail("task %d enc start\n", frm->seq_idx);
+    RUN_ENC_IMPL_FUNC(enc_impl_start, impl, hal_task, mpp, ret);
+
+    // 14. setup user_cfg to dpb
+    if (frm_cfg->force_flag) {
+        mpp_enc_refs_set_usr_cfg(enc->refs, frm_cfg);
+        frm_cfg->force_flag = 0;
+    }
+
+    // 15. backup dpb
+    mpp_enc_refs_stash(enc->refs);
+    task->status.enc_backup = 1;
+
+    ret = mpp_enc_submit_hw(enc, pipe);
+
+TASK_DONE:
+    return ret;
+}
+
+/*
+ * Re-encode changes the reconstruction referenced by the later tasks in
+ * hardware. Wait them done and drop their results for replay.
+ */
+static void mpp_enc_drain_later(MppEncImpl *enc, EncPipeTask *pipe)
+{
+    Mpp *mpp = (Mpp *)enc->mpp;
+    MppEncHal hal = enc->enc_hal;
+    RK_S32 pos = (pipe - enc->pipe + MPP_ENC_PIPE_DEPTH_MAX - enc->pipe_rd) % MPP_ENC_PIPE_DEPTH_MAX;
+    MPP_RET ret = MPP_OK;
+    RK_S32 i;
+
+    for (i = pos + 1; i < enc->pipe_cnt; i++) {
+        EncPipeTask *later = &enc->pipe[(enc->pipe_rd + i) % MPP_ENC_PIPE_DEPTH_MAX];
+        HalEncTask *hal_task = &later->info.enc;
+
+        if (!later->hw_started)
+            continue;
+
+        enc_dbg_reenc("task %d drained by re-encode\n", later->rc_task.frm.seq_idx);
+        ret = mpp_enc_hal_wait(hal, hal_task);
+        if (!ret)
+            ret = mpp_enc_hal_ret_task(hal, hal_task);
+        if (ret)
+            mpp_err("mpp %p drain task %d failed return %d", mpp,
+                    later->rc_task.frm.seq_idx, ret);
+
+        later->hw_started = 0;
+        later->replay = 1;
+    }
+}
+
+/* restart the drained tasks in order after the re-encode is done */
+static void mpp_enc_replay_later(MppEncImpl *enc, EncPipeTask *pipe)
+{
+    RK_S32 pos = (pipe - enc->pipe + MPP_ENC_PIPE_DEPTH_MAX - enc->pipe_rd) % MPP_ENC_PIPE_DEPTH_MAX;
+    RK_S32 i;
+
+    for (i = pos + 1; i < enc->pipe_cnt; i++) {
+        EncPipeTask *later = &enc->pipe[(enc->pipe_rd + i) % MPP_ENC_PIPE_DEPTH_MAX];
+        HalEncTask *hal_task = &later->info.enc;
+
+        if (!later->replay)
+            continue;
+
+        enc_dbg_reenc("task %d replay\n", later->rc_task.frm.seq_idx);
+        hal_task->length -= hal_task->hw_length;
+        hal_task->hw_length = 0;
+        mpp_enc_submit_hw(enc, later);
+        later->replay = 0;
+    }
+}
+
+/* collect stage: from hardware wait to rc frame end with re-encode loop */
+static void mpp_enc_collect(MppEncImpl *enc, EncPipeTask *pipe)
+{
+    Mpp *mpp = (Mpp *)enc->mpp;
+    MppEncHal hal = enc->enc_hal;
+    MppEncRcCfg *rc_cfg = &enc->cfg.rc;
+    EncRcTask *rc_task = &pipe->rc_task;
+    EncFrmStatus *frm = &rc_task->frm;
+    HalEncTask *hal_task = &pipe->info.enc;
+    MPP_RET ret = MPP_OK;
+
+    while (pipe->hw_started) {
+        RK_S64 wait_start = mpp_time();
+
+        pipe->hw_started = 0;
+
+        enc_dbg_detail("task %d hal wait\n", frm->seq_idx);
+        RUN_ENC_HAL_FUNC(mpp_enc_hal_wait,  hal, hal_task, mpp, ret);
+        update_hw_time(enc, pipe, wait_start);
+
+        enc_dbg_detail("task %d rc hal end\n", frm->seq_idx);
+        RUN_ENC_RC_FUNC(rc_hal_end, enc->rc_ctx, rc_task, mpp, ret);
+
+        enc_dbg_detail("task %d hal ret task\n", frm->seq_idx);
+        RUN_ENC_HAL_FUNC(mpp_enc_hal_ret_task, hal, hal_task, mpp, ret);
+
+        frm->reencode = 0;
+        enc_dbg_detail("task %d rc frame end\n", frm->seq_idx);
+        RUN_ENC_RC_FUNC(rc_frm_end, enc->rc_ctx, rc_task, mpp, ret);
+
+        if (frm->reencode_times < rc_cfg->max_reenc_times && frm->reencode) {
+            mpp_enc_drain_later(enc, pipe);
+            //mpp_enc_refs_rollback(enc->refs);
+            enc_dbg_reenc("reencode time %d\n", frm->reencode_times);
+            hal_task->length -= hal_task->hw_length;
+            hal_task->hw_length = 0;
+            frm->reencode_times++;
+            mpp_enc_submit_hw(enc, pipe);
+        } else {
+            frm->reencode = 0;
+            frm->reencode_times = 0;
+        }
+    }
+
+    mpp_enc_replay_later(enc, pipe);
+
+TASK_DONE:
+    mpp_enc_task_done(pipe);
+}
+
+/* finish all tasks in hardware before changing encoder status */
+static void mpp_enc_collect_all(MppEncImpl *enc)
+{
+    RK_S32 i;
+
+    for (i = 0; i < enc->pipe_cnt; i++) {
+        EncPipeTask *pipe = &enc->pipe[(enc->pipe_rd + i) % MPP_ENC_PIPE_DEPTH_MAX];
+
+        if (!pipe->finished)
+            mpp_enc_collect(enc, pipe);
+    }
+}
+
+static void mpp_enc_return(EncPipeTask *pipe, MppPort input)
+{
+    MppFrame frame = pipe->frame;
+
+    if (pipe->task_in) {
+        mpp_task_meta_set_frame(pipe->task_in, KEY_INPUT_FRAME, frame);
+        mpp_port_enqueue(input, pipe->task_in);
+    } else if (frame) {
+        /* release frame copy in async mode */
+        mpp_frame_deinit(&frame);
+    }
+
+    memset(pipe, 0, sizeof(*pipe));
+}
+
+static void mpp_enc_output(MppEncImpl *enc, MppPort input, MppPort output,
+                           MppTask task_out)
+{
+    EncPipeTask *pipe = &enc->pipe[enc->pipe_rd];
+    MppFrame frame = pipe->frame;
+    MppPacket packet = pipe->packet;
+
+    /*
+     * First return output packet.
+     * Then enqueue task back to input port.
+     * Final user will release the mpp_frame they had input.
+     */
+    if (NULL == packet)
+        mpp_packet_new(&packet);
+
+    if (frame && mpp_frame_get_eos(frame))
+        mpp_packet_set_eos(packet);
+    else
+        mpp_packet_clr_eos(packet);
+
+    mpp_task_meta_set_packet(task_out, KEY_OUTPUT_PACKET, packet);
+    mpp_port_enqueue(output, task_out);
+
+    pipe->packet = NULL;
+    mpp_enc_return(pipe, input);
+
+    enc->pipe_rd = (enc->pipe_rd + 1) % MPP_ENC_PIPE_DEPTH_MAX;
+    enc->pipe_cnt--;
+}
+
+static void mpp_enc_proc_ctrl_queue(MppEncImpl *enc)
+{
+    EncCtrlNode *pos, *n;
+    struct list_head list;
+
+    INIT_LIST_HEAD(&list);
+
+    {
+        AutoMutex auto_lock(&enc->ctrl_lock);
+
+        list_for_each_entry_safe(pos, n, &enc->ctrl_list, EncCtrlNode, list) {
+            list_del_init(&pos->list);
+            list_add_tail(&pos->list, &list);
+        }
+    }
+
+    list_for_each_entry_safe(pos, n, &list, EncCtrlNode, list) {
+        MppEncCtrlCb cb;
+        MPP_RET ret = MPP_OK;
+
+        enc_dbg_detail("ctrl queue proc %d cmd %08x\n", pos->seq, pos->cmd);
+        mpp_enc_proc_cfg(enc, pos->cmd, pos->param, &ret);
+
+        {
+            AutoMutex auto_lock(&enc->ctrl_lock);
+            MppEncCtrlStatus *status = &enc->ctrl_status;
+
+            status->seq_done = pos->seq;
+            if (ret) {
+                status->err_cnt++;
+                status->err_seq = pos->seq;
+                status->err_ret = ret;
+            }
+            cb = enc->ctrl_cb;
+        }
+
+        if (cb.callback)
+            cb.callback(cb.ctx, pos->seq, pos->cmd, ret);
+
+        list_del_init(&pos->list);
+        mpp_free(pos);
+    }
+}
+
 void *mpp_enc_thread(void *data)
 {
     Mpp *mpp = (Mpp*)data;
     MppEncImpl *enc = (MppEncImpl *)mpp->mEnc;
-    EncImpl impl = enc->impl;
-    MppEncHal hal = enc->enc_hal;
     MppThread *thd_enc  = enc->thread_enc;
     MppEncCfgSet *cfg = &enc->cfg;
     MppEncRcCfg *rc_cfg = &cfg->rc;
     MppEncPrepCfg *prep_cfg = &cfg->prep;
-    EncRcTask *rc_task = &enc->rc_task;
-    EncCpbStatus *cpb = &rc_task->cpb;
-    EncFrmStatus *frm = &rc_task->frm;
-    MppEncRefFrmUsrCfg *frm_cfg = &enc->frm_cfg;
     EncTask task;
-    HalTaskInfo *task_info = &task.info;
-    HalEncTask *hal_task = &task_info->enc;
     MppPort input  = mpp_task_queue_get_port(mpp->mInputTaskQueue,  MPP_PORT_OUTPUT);
     MppPort output = mpp_task_queue_get_port(mpp->mOutputTaskQueue, MPP_PORT_INPUT);
     MppTask task_in = NULL;
@@ -781,6 +1379,7 @@ void *mpp_enc_thread(void *data)
     MPP_RET ret = MPP_OK;
     MppFrame frame = NULL;
     MppPacket packet = NULL;
+    RK_S64 wait_ms = 0;
 
     memset(&task, 0, sizeof(task));
 
@@ -790,14 +1389,22 @@ void *mpp_enc_thread(void *data)
             if (MPP_THREAD_RUNNING != thd_enc->get_status())
                 break;
 
-            if (check_enc_task_wait(enc, &task))
-                thd_enc->wait();
+            if (check_enc_task_wait(enc, &task)) {
+                if (wait_ms)
+                    thd_enc->timedwait(wait_ms);
+                else
+                    thd_enc->wait();
+            }
+            wait_ms = 0;
         }
 
         // 1. process user control
         if (enc->cmd_send != enc->cmd_recv) {
+            // NOTE: config change should not affect the tasks in hardware
+            mpp_enc_collect_all(enc);
+
             enc_dbg_detail("ctrl proc %d cmd %08x\n", enc->cmd_recv, enc->cmd);
-            mpp_enc_proc_cfg(enc);
+            mpp_enc_proc_cfg(enc, enc->cmd, enc->param, enc->cmd_ret);
             sem_post(&enc->enc_ctrl);
             enc->cmd_recv++;
             enc_dbg_detail("ctrl proc %d done send %d\n", enc->cmd_recv,
@@ -805,9 +1412,18 @@ void *mpp_enc_thread(void *data)
             continue;
         }
 
+        // 1.1 process queued user control
+        if (enc->ctrl_status.seq_post != enc->ctrl_status.seq_done) {
+            mpp_enc_collect_all(enc);
+            mpp_enc_proc_ctrl_queue(enc);
+            continue;
+        }
+
         // 2. process reset
         if (enc->reset_flag) {
             enc_dbg_detail("thread reset start\n");
+            /* NOTE: packets of the tasks in hardware are still output */
+            mpp_enc_collect_all(enc);
             {
                 AutoMutex autolock(thd_enc->mutex());
                 enc->status_flag = 0;
@@ -824,6 +1440,8 @@ void *mpp_enc_thread(void *data)
         if (!enc->rc_status.rc_api_inited || enc->rc_status.rc_api_updated) {
             RcApiBrief *brief = &enc->rc_brief;
 
+            mpp_enc_collect_all(enc);
+
             if (enc->rc_ctx) {
                 enc_dbg_detail("rc deinit %p\n", enc->rc_ctx);
                 rc_deinit(enc->rc_ctx);
@@ -850,34 +1468,74 @@ void *mpp_enc_thread(void *data)
             ret = mpp_port_poll(input, MPP_POLL_NON_BLOCK);
             if (ret) {
                 task.wait.enc_frm_in = 1;
-                continue;
+            } else {
+                task.status.task_in_rdy = 1;
+                task.wait.enc_frm_in = 0;
+                enc_dbg_detail("task in ready\n");
             }
-
-            task.status.task_in_rdy = 1;
-            task.wait.enc_frm_in = 0;
-            enc_dbg_detail("task in ready\n");
         }
 
-        // 5. check output task
-        if (!task.status.task_out_rdy) {
-            ret = mpp_port_poll(output, MPP_POLL_NON_BLOCK);
-            if (ret) {
-                task.wait.enc_pkt_out = 1;
-                continue;
+        /*
+         * 5. collect the oldest task when the pipeline is full or there is
+         * no more input frame
+         */
+        if (enc->pipe_cnt &&
+            (enc->pipe_cnt >= get_pipe_depth(enc) || !task.status.task_in_rdy)) {
+            EncPipeTask *pipe = &enc->pipe[enc->pipe_rd];
+
+            if (!pipe->finished) {
+                /*
+                 * Give user a chance to put next frame while the hardware is
+                 * still running instead of blocking on hardware wait.
+                 */
+                if (enc->pipe_cnt < get_pipe_depth(enc) && !pipe->input_waited) {
+                    RK_S64 remain = MPP_MAX(pipe->start_time, enc->hw_done_time) +
+                                    enc->hw_time - mpp_time();
+
+                    pipe->input_waited = 1;
+                    if (remain > 0) {
+                        wait_ms = (remain + 999) / 1000;
+                        enc_dbg_detail("task %d wait input %lld ms\n",
+                                       pipe->rc_task.frm.seq_idx, wait_ms);
+                        continue;
+                    }
+                }
+
+                mpp_enc_collect(enc, pipe);
+            }
+
+            if (!task.status.task_out_rdy) {
+                ret = mpp_port_poll(output, MPP_POLL_NON_BLOCK);
+                if (ret) {
+                    task.wait.enc_pkt_out = 1;
+                    continue;
+                }
+
+                task.status.task_out_rdy = 1;
+                task.wait.enc_pkt_out = 0;
+                enc_dbg_detail("task out ready\n");
             }
 
-            task.status.task_out_rdy = 1;
-            task.wait.enc_pkt_out = 0;
-            enc_dbg_detail("task out ready\n");
+            ret = mpp_port_dequeue(output, &task_out);
+            mpp_assert(task_out);
+
+            mpp_enc_output(enc, input, output, task_out);
+            enc_dbg_detail("task output done remain %d\n", enc->pipe_cnt);
+
+            task_out = NULL;
+            task.status.task_out_rdy = 0;
+            /* check input again for next task */
+            task.wait.val = 0;
+            continue;
         }
 
-        // get tasks from both input and output
+        if (!task.status.task_in_rdy)
+            continue;
+
+        // get task from input
         ret = mpp_port_dequeue(input, &task_in);
         mpp_assert(task_in);
 
-        ret = mpp_port_dequeue(output, &task_out);
-        mpp_assert(task_out);
-
         /*
          * frame will be return to input.
          * packet will be sent to output.
@@ -887,15 +1545,37 @@ void *mpp_enc_thread(void *data)
 
         enc_dbg_detail("task dequeue done frm %p pkt %p\n", frame, packet);
 
+        EncPipeTask *pipe = &enc->pipe[(enc->pipe_rd + enc->pipe_cnt) % MPP_ENC_PIPE_DEPTH_MAX];
+
+        pipe->packet = packet;
+        enc->pipe_cnt++;
+
+        if (get_pipe_depth(enc) > 1) {
+            /*
+             * async mode: keep a copy of the frame with buffer referenced and
+             * return input task to user once the hardware is started
+             */
+            if (frame) {
+                MppBuffer buffer = mpp_frame_get_buffer(frame);
+
+                mpp_frame_init(&pipe->frame);
+                mpp_frame_copy(pipe->frame, frame);
+                if (buffer)
+                    mpp_buffer_inc_ref(buffer);
+            }
+        } else {
+            pipe->task_in = task_in;
+            pipe->frame = frame;
+        }
+
         /*
          * 6. check empty task for signaling
          * If there is no input frame just return empty packet task
          */
-        if (NULL == frame)
-            goto TASK_RETURN;
-
-        if (NULL == mpp_frame_get_buffer(frame))
-            goto TASK_RETURN;
+        if (NULL == frame || NULL == mpp_frame_get_buffer(frame)) {
+            pipe->finished = 1;
+            goto TASK_SUBMITTED;
+        }
 
         // 7. check and update rate control config
         if (enc->rc_status.rc_api_user_cfg) {
@@ -923,272 +1603,20 @@ void *mpp_enc_thread(void *data)
                               usr_cfg.i_quality_delta);
         }
 
-        // 8. all task ready start encoding one frame
-        reset_hal_enc_task(hal_task);
-        reset_enc_rc_task(rc_task);
-        hal_task->rc_task = rc_task;
-        hal_task->frm_cfg = frm_cfg;
-        frm->seq_idx = task.seq_idx++;
-        rc_task->frame = frame;
-
-        enc_dbg_detail("task seq idx %d start\n", frm->seq_idx);
-
-        /*
-         * 9. check and create packet for output
-         * if there is available buffer in the input frame do encoding
-         */
-        if (NULL == packet) {
-            /* NOTE: set buffer w * h * 1.5 to avoid buffer overflow */
-            RK_U32 width  = enc->cfg.prep.width;
-            RK_U32 height = enc->cfg.prep.height;
-            RK_U32 size = MPP_ALIGN(width, 16) * MPP_ALIGN(height, 16) * 3 / 2;
-            MppBuffer buffer = NULL;
-
-            mpp_assert(size);
-            mpp_buffer_get(mpp->mPacketGroup, &buffer, size);
-            mpp_packet_init_with_buffer(&packet, buffer);
-            /* NOTE: clear length for output */
-            mpp_packet_set_length(packet, 0);
-            mpp_buffer_put(buffer);
-
-            enc_dbg_detail("create output pkt %p buf %p\n", packet, buffer);
-        }
-
-        mpp_assert(packet);
-
-        // 10. bypass pts to output
-        {
-            RK_S64 pts = mpp_frame_get_pts(frame);
-            mpp_packet_set_pts(packet, pts);
-            enc_dbg_detail("task %d pts %lld\n", frm->seq_idx, pts);
-        }
-
-        // 11. check frame drop by frame rate conversion
-        RUN_ENC_RC_FUNC(rc_frm_check_drop, enc->rc_ctx, rc_task, mpp, ret);
-        task.status.rc_check_frm_drop = 1;
-        enc_dbg_detail("task %d drop %d\n", frm->seq_idx, frm->drop);
-
-        // when the frame should be dropped just return empty packet
-        if (frm->drop) {
-            hal_task->valid = 0;
-            hal_task->length = 0;
-            goto TASK_DONE;
-        }
-
-        // start encoder task process here
-        hal_task->valid = 1;
-
-        // 12. generate header before hardware stream
-        if (!enc->hdr_status.ready) {
-            /* config cpb before generating header */
-            enc_impl_gen_hdr(impl, enc->hdr_pkt);
-            enc->hdr_len = mpp_packet_get_length(enc->hdr_pkt);
-            enc->hdr_status.ready = 1;
-
-            enc_dbg_detail("task %d update header length %d\n",
-                           frm->seq_idx, enc->hdr_len);
-
-            mpp_packet_append(packet, enc->hdr_pkt);
-            hal_task->header_length = enc->hdr_len;
-            hal_task->length += enc->hdr_len;
-            enc->hdr_status.added_by_change = 1;
-        }
-
-        mpp_assert(hal_task->length == mpp_packet_get_length(packet));
+        // 8 ~ 17. run task until hardware start
+        mpp_enc_submit(enc, &task, pipe, task_in);
 
-        // 13. setup input frame and output packet
-        hal_task->frame  = frame;
-        hal_task->input  = mpp_frame_get_buffer(frame);
-        hal_task->packet = packet;
-        hal_task->output = mpp_packet_get_buffer(packet);
-        hal_task->length = mpp_packet_get_length(packet);
-        mpp_task_meta_get_buffer(task_in, KEY_MOTION_INFO, &hal_task->mv_info);
+        // dropped or failed task is done without hardware
+        if (!pipe->hw_started)
+            mpp_enc_task_done(pipe);
 
-        /* 14. check frm_meta data force key in input frame and start one frame */
-        enc_dbg_detail("task %d enc start\n", frm->seq_idx);
-        RUN_ENC_IMPL_FUNC(enc_impl_start, impl, hal_task, mpp, ret);
-
-        // 14. setup user_cfg to dpb
-        if (frm_cfg->force_flag) {
-            mpp_enc_refs_set_usr_cfg(enc->refs, frm_cfg);
-            frm_cfg->force_flag = 0;
+    TASK_SUBMITTED:
+        if (NULL == pipe->task_in) {
+            mpp_task_meta_set_frame(task_in, KEY_INPUT_FRAME, frame);
+            mpp_port_enqueue(input, task_in);
         }
 
-        // 15. backup dpb
-        mpp_enc_refs_stash(enc->refs);
-        task.status.enc_backup = 1;
-
-    TASK_REENCODE:
-        // 15. restore and process dpb
-        if (!frm->reencode) {
-            if (!frm->re_dpb_proc) {
-                enc_dbg_detail("task %d enc proc dpb\n", frm->seq_idx);
-                mpp_enc_refs_get_cpb(enc->refs, cpb);
-
-                enc_dbg_frm_status("frm %d start ***********************************\n", cpb->curr.seq_idx);
-                RUN_ENC_IMPL_FUNC(enc_impl_proc_dpb, impl, hal_task, mpp, ret);
-
-                enc_dbg_frm_status("frm %d compare\n", cpb->curr.seq_idx);
-                enc_dbg_frm_status("seq_idx      %d vs %d\n", frm->seq_idx, cpb->curr.seq_idx);
-                enc_dbg_frm_status("is_idr       %d vs %d\n", frm->is_idr, cpb->curr.is_idr);
-                enc_dbg_frm_status("is_intra     %d vs %d\n", frm->is_intra, cpb->curr.is_intra);
-                enc_dbg_frm_status("is_non_ref   %d vs %d\n", frm->is_non_ref, cpb->curr.is_non_ref);
-                enc_dbg_frm_status("is_lt_ref    %d vs %d\n", frm->is_lt_ref, cpb->curr.is_lt_ref);
-                enc_dbg_frm_status("lt_idx       %d vs %d\n", frm->lt_idx, cpb->curr.lt_idx);
-                enc_dbg_frm_status("temporal_id  %d vs %d\n", frm->temporal_id, cpb->curr.temporal_id);
-                enc_dbg_frm_status("frm %d done  ***********************************\n", cpb->curr.seq_idx);
-            }
-
-            enc_dbg_detail("task %d rc frame start\n", frm->seq_idx);
-            RUN_ENC_RC_FUNC(rc_frm_start, enc->rc_ctx, rc_task, mpp, ret);
-            task.status.enc_proc_dpb = 1;
-            if (frm->re_dpb_proc)
-                goto TASK_REENCODE;
-
-            // 16. generate header before hardware stream
-            if (enc->hdr_mode == MPP_ENC_HEADER_MODE_EACH_IDR &&
-                frm->is_intra &&
-                !enc->hdr_status.added_by_change &&
-                !enc->hdr_status.added_by_ctrl &&
-                !enc->hdr_status.added_by_mode) {
-                enc_dbg_detail("task %d IDR header length %d\n",
-                               frm->seq_idx, enc->hdr_len);
-
-                mpp_packet_append(packet, enc->hdr_pkt);
-
-                hal_task->header_length = enc->hdr_len;
-                hal_task->length += enc->hdr_len;
-                enc->hdr_status.added_by_mode = 1;
-            }
-        }
-
-        // check for header adding
-        if (hal_task->length != mpp_packet_get_length(packet)) {
-            mpp_err_f("header adding check failed: task length is not match to packet length %d vs %d\n",
-                      hal_task->length, mpp_packet_get_length(packet));
-        }
-
-        /* 17. Add all prefix info before encoding */
-        if (!frm->reencode) {
-            if (frm->is_idr && enc->sei_mode >= MPP_ENC_SEI_MODE_ONE_SEQ) {
-                RK_S32 length = 0;
-
-                enc_impl_add_prefix(impl, packet, &length, uuid_version,
-                                    enc->version_info, enc->version_length);
-
-                hal_task->sei_length += length;
-                hal_task->length += length;
-
-                length = 0;
-                enc_impl_add_prefix(impl, packet, &length, uuid_rc_cfg,
-                                    enc->rc_cfg_info, enc->rc_cfg_length);
-
-                hal_task->sei_length += length;
-                hal_task->length += length;
-            }
-
-            if (mpp_frame_has_meta(frame)) {
-                MppMeta frm_meta = mpp_frame_get_meta(frame);
-                MppEncUserData *user_data = NULL;
-
-                mpp_meta_get_ptr(frm_meta, KEY_USER_DATA, (void**)&user_data);
-
-                if (user_data) {
-                    if (user_data->pdata && user_data->len) {
-                        RK_S32 length = 0;
-
-                        enc_impl_add_prefix(impl, packet, &length, uuid_usr_data,
-                                            user_data->pdata, user_data->len);
-
-                        hal_task->sei_length += length;
-                        hal_task->length += length;
-                    } else
-                        mpp_err_f("failed to insert user data %p len %d\n",
-                                  user_data->pdata, user_data->len);
-                }
-            }
-        }
-
-        // check for user data adding
-        if (hal_task->length != mpp_packet_get_length(packet)) {
-            mpp_err_f("user data adding check failed: task length is not match to packet length %d vs %d\n",
-                      hal_task->length, mpp_packet_get_length(packet));
-        }
-
-        enc_dbg_detail("task %d enc proc hal\n", frm->seq_idx);
-        RUN_ENC_IMPL_FUNC(enc_impl_proc_hal, impl, hal_task, mpp, ret);
-
-        enc_dbg_detail("task %d hal get task\n", frm->seq_idx);
-        RUN_ENC_HAL_FUNC(mpp_enc_hal_get_task, hal, hal_task, mpp, ret);
-
-        enc_dbg_detail("task %d rc hal start\n", frm->seq_idx);
-        RUN_ENC_RC_FUNC(rc_hal_start, enc->rc_ctx, rc_task, mpp, ret);
-
-        enc_dbg_detail("task %d hal generate reg\n", frm->seq_idx);
-        RUN_ENC_HAL_FUNC(mpp_enc_hal_gen_regs, hal, hal_task, mpp, ret);
-
-        enc_dbg_detail("task %d hal start\n", frm->seq_idx);
-        RUN_ENC_HAL_FUNC(mpp_enc_hal_start, hal, hal_task, mpp, ret);
-
-        enc_dbg_detail("task %d hal wait\n", frm->seq_idx);
-        RUN_ENC_HAL_FUNC(mpp_enc_hal_wait,  hal, hal_task, mpp, ret);
-
-        enc_dbg_detail("task %d rc hal end\n", frm->seq_idx);
-        RUN_ENC_RC_FUNC(rc_hal_end, enc->rc_ctx, rc_task, mpp, ret);
-
-        enc_dbg_detail("task %d hal ret task\n", frm->seq_idx);
-        RUN_ENC_HAL_FUNC(mpp_enc_hal_ret_task, hal, hal_task, mpp, ret);
-
-        frm->reencode = 0;
-        enc_dbg_detail("task %d rc frame end\n", frm->seq_idx);
-        RUN_ENC_RC_FUNC(rc_frm_end, enc->rc_ctx, rc_task, mpp, ret);
-
-        if (frm->reencode_times < rc_cfg->max_reenc_times && frm->reencode) {
-            //mpp_enc_refs_rollback(enc->refs);
-            enc_dbg_reenc("reencode time %d\n", frm->reencode_times);
-            hal_task->length -= hal_task->hw_length;
-            hal_task->hw_length = 0;
-            frm->reencode_times++;
-            goto TASK_REENCODE;
-        } else {
-            frm->reencode = 0;
-            frm->reencode_times = 0;
-        }
-    TASK_DONE:
-        /* setup output packet and meta data */
-        mpp_packet_set_length(packet, hal_task->length);
-
-        {
-            MppMeta meta = mpp_packet_get_meta(packet);
-
-            if (hal_task->mv_info)
-                mpp_meta_set_buffer(meta, KEY_MOTION_INFO, hal_task->mv_info);
-
-            mpp_meta_set_s32(meta, KEY_OUTPUT_INTRA, frm->is_intra);
-        }
-
-    TASK_RETURN:
-        /*
-         * First return output packet.
-         * Then enqueue task back to input port.
-         * Final user will release the mpp_frame they had input.
-         */
-        if (NULL == packet)
-            mpp_packet_new(&packet);
-
-        if (frame && mpp_frame_get_eos(frame))
-            mpp_packet_set_eos(packet);
-        else
-            mpp_packet_clr_eos(packet);
-
-        mpp_task_meta_set_packet(task_out, KEY_OUTPUT_PACKET, packet);
-        mpp_port_enqueue(output, task_out);
-
-        mpp_task_meta_set_frame(task_in, KEY_INPUT_FRAME, frame);
-        mpp_port_enqueue(input, task_in);
-
         task_in = NULL;
-        task_out = NULL;
         packet = NULL;
         frame = NULL;
 
@@ -1197,6 +1625,20 @@ void *mpp_enc_thread(void *data)
         enc->hdr_status.ready = 1;
     }
 
+    // finish tasks in hardware and release the tasks not output
+    mpp_enc_collect_all(enc);
+    while (enc->pipe_cnt) {
+        EncPipeTask *pipe = &enc->pipe[enc->pipe_rd];
+
+        if (pipe->packet)
+            mpp_packet_deinit(&pipe->packet);
+
+        mpp_enc_return(pipe, input);
+
+        enc->pipe_rd = (enc->pipe_rd + 1) % MPP_ENC_PIPE_DEPTH_MAX;
+        enc->pipe_cnt--;
+    }
+
     // clear remain task in output port
     release_task_in_port(input);
     release_task_in_port(mpp->mOutputPort);
@@ -1242,6 +1684,7 @@ MPP_RET mpp_enc_init_v2(MppEnc *enc, MppEncInitCfg *cfg)
     enc_hal_cfg.cfg = &p->cfg;
     enc_hal_cfg.work_mode = HAL_MODE_LIBVPU;
     enc_hal_cfg.device_id = DEV_VEPU;
+    enc_hal_cfg.task_count = 1;
 
     ctrl_cfg.coding = coding;
     ctrl_cfg.dev_id = DEV_VEPU;
@@ -1268,6 +1711,7 @@ MPP_RET mpp_enc_init_v2(MppEnc *enc, MppEncInitCfg *cfg)
     p->coding   = coding;
     p->impl     = impl;
     p->enc_hal  = enc_hal;
+    p->hw_task_count = MPP_CLIP3(1, MPP_ENC_PIPE_DEPTH_MAX, enc_hal_cfg.task_count);
     p->mpp      = cfg->mpp;
     p->sei_mode = MPP_ENC_SEI_MODE_ONE_SEQ;
     p->version_info = get_mpp_version();
@@ -1285,6 +1729,7 @@ MPP_RET mpp_enc_init_v2(MppEnc *enc, MppEncInitCfg *cfg)
     }
 
     /* NOTE: setup configure coding for check */
+    p->cfg.base.pipe_depth = 1;
     p->cfg.codec.coding = coding;
     p->cfg.plt_cfg.plt = &p->cfg.plt_data;
     mpp_enc_ref_cfg_init(&p->cfg.ref_cfg);
@@ -1293,6 +1738,7 @@ MPP_RET mpp_enc_init_v2(MppEnc *enc, MppEncInitCfg *cfg)
 
     sem_init(&p->enc_reset, 0, 0);
     sem_init(&p->enc_ctrl, 0, 0);
+    INIT_LIST_HEAD(&p->ctrl_list);
 
     *enc = p;
     return ret;
@@ -1330,6 +1776,21 @@ MPP_RET mpp_enc_deinit_v2(MppEnc ctx)
         enc->cfg.ref_cfg = NULL;
     }
 
+    if (enc->cfg_kv) {
+        mpp_enc_cfg_deinit(enc->cfg_kv);
+        enc->cfg_kv = NULL;
+    }
+
+    if (enc->ctrl_list.next) {
+        EncCtrlNode *pos, *n;
+
+        list_for_each_entry_safe(pos, n, &enc->ctrl_list, EncCtrlNode, list) {
+            mpp_log_f("drop queued control %d cmd %08x\n", pos->seq, pos->cmd);
+            list_del_init(&pos->list);
+            mpp_free(pos);
+        }
+    }
+
     if (enc->refs) {
         mpp_enc_refs_deinit(&enc->refs);
         enc->refs = NULL;
@@ -1435,6 +1896,57 @@ MPP_RET mpp_enc_notify_v2(MppEnc ctx, RK_U32 flag)
     return MPP_OK;
 }
 
+static MPP_RET mpp_enc_post_ctrl(MppEncImpl *enc, MppEncCtrlReq *req)
+{
+    MpiCmd cmd = req->cmd;
+    EncCtrlNode *node = NULL;
+
+    switch (cmd) {
+    case MPP_ENC_GET_CFG :
+    case MPP_ENC_GET_PREP_CFG :
+    case MPP_ENC_GET_RC_CFG :
+    case MPP_ENC_GET_CODEC_CFG :
+    case MPP_ENC_GET_HEADER_MODE :
+    case MPP_ENC_GET_OSD_PLT_CFG :
+    case MPP_ENC_POST_CTRL :
+    case MPP_ENC_SET_CTRL_CB :
+    case MPP_ENC_GET_CTRL_STATUS : {
+        mpp_err_f("cmd %08x can not be queued\n", cmd);
+        return MPP_NOK;
+    } break;
+    default : {
+    } break;
+    }
+
+    if (NULL == req->param && cmd != MPP_ENC_SET_IDR_FRAME && cmd != MPP_ENC_SET_REF_CFG) {
+        mpp_err_f("found NULL param enc %p cmd %x\n", enc, cmd);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    node = mpp_malloc(EncCtrlNode, 1);
+    if (NULL == node) {
+        mpp_err_f("failed to malloc control node\n");
+        return MPP_ERR_MALLOC;
+    }
+
+    INIT_LIST_HEAD(&node->list);
+    node->cmd = cmd;
+    node->param = req->param;
+
+    {
+        AutoMutex auto_lock(&enc->ctrl_lock);
+
+        node->seq = ++enc->ctrl_status.seq_post;
+        list_add_tail(&node->list, &enc->ctrl_list);
+    }
+
+    req->seq = node->seq;
+    enc_dbg_ctrl("post cmd %08x param %p seq %d\n", cmd, req->param, req->seq);
+
+    mpp_enc_notify_v2(enc, MPP_ENC_CONTROL);
+    return MPP_OK;
+}
+
 /*
  * preprocess config and rate-control config is common config then they will
  * be done in mpp_enc layer
@@ -1455,6 +1967,27 @@ MPP_RET mpp_enc_control_v2(MppEnc ctx, MpiCmd cmd, void *param)
         return MPP_ERR_NULL_PTR;
     }
 
+    /* queued control does not wait for the encoder thread */
+    switch (cmd) {
+    case MPP_ENC_POST_CTRL : {
+        return mpp_enc_post_ctrl(enc, (MppEncCtrlReq *)param);
+    } break;
+    case MPP_ENC_SET_CTRL_CB : {
+        AutoMutex auto_lock(&enc->ctrl_lock);
+
+        enc->ctrl_cb = *(MppEncCtrlCb *)param;
+        return MPP_OK;
+    } break;
+    case MPP_ENC_GET_CTRL_STATUS : {
+        AutoMutex auto_lock(&enc->ctrl_lock);
+
+        *(MppEncCtrlStatus *)param = enc->ctrl_status;
+        return MPP_OK;
+    } break;
+    default : {
+    } break;
+    }
+
     AutoMutex auto_lock(&enc->lock);
     MPP_RET ret = MPP_OK;
 
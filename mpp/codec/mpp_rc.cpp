@@ -63,6 +63,7 @@ MPP_RET mpp_data_init(MppData **data, RK_S32 size)
     p->size = size;
     p->len = 0;
     p->pos = 0;
+    p->sum = 0;
     p->val = (RK_S32 *)(p + 1);
     *data = p;
 
@@ -79,6 +80,11 @@ void mpp_data_update(MppData *p, RK_S32 val)
 {
     mpp_assert(p);
 
+    /* replace the oldest data when the window is full */
+    if (p->len == p->size)
+        p->sum -= p->val[p->pos];
+
+    p->sum += val;
     p->val[p->pos] = val;
 
     if (++p->pos >= p->size)
@@ -102,7 +108,9 @@ RK_S32 mpp_data_avg(MppData *p, RK_S32 len, RK_S32 num, RK_S32 denorm)
     if (len < 0 || len > p->len)
         len = p->len;
 
-    if (num == denorm) {
+    if (num == denorm && len == p->len) {
+        sum = (RK_S32)p->sum;
+    } else if (num == denorm) {
         i = len;
         while (i--) {
             if (pos)
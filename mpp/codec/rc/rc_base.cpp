@@ -54,7 +54,7 @@ MPP_RET mpp_data_init_v2(MppDataV2 **data, RK_S32 size)
     }
 
     *data = NULL;
-    MppDataV2 *p = mpp_malloc_size(MppDataV2, sizeof(MppDataV2) + sizeof(RK_S32) * size);
+    MppDataV2 *p = mpp_calloc_size(MppDataV2, sizeof(MppDataV2) + sizeof(RK_S32) * size);
     if (NULL == p) {
         mpp_err_f("malloc size %d failed\n", size);
         return MPP_ERR_MALLOC;
@@ -62,13 +62,9 @@ MPP_RET mpp_data_init_v2(MppDataV2 **data, RK_S32 size)
     p->size = size;
     p->len = 0;
     p->pos_w = 0;
+    p->sum = 0;
     p->val = (RK_S32 *)(p + 1);
 
-    if (size <= 8)
-        p->pos_r = 0;
-    else
-        p->pos_r = size;
-
     *data = p;
 
     return MPP_OK;
@@ -86,59 +82,79 @@ void mpp_data_reset_v2(MppDataV2 *p, RK_S32 val)
 
     for (i = 0; i < p->size; i++)
         *data++ = val;
+
+    p->len = p->size;
+    p->pos_w = 0;
+    p->sum = (RK_S64)val * p->size;
 }
 
 void mpp_data_update_v2(MppDataV2 *p, RK_S32 val)
 {
-    mpp_assert(p);
-    RK_S32 *data = p->val;
+    RK_S32 pos = p->pos_w ? p->pos_w - 1 : p->size - 1;
 
-    memmove(data + 1, data, sizeof(RK_S32) * (p->size - 1));
+    /* the oldest data is replaced by the latest one */
+    p->sum += (RK_S64)val - p->val[pos];
+    p->val[pos] = val;
+    p->pos_w = pos;
 
-    data[0] = val;
+    if (p->len < p->size)
+        p->len++;
 }
 
 RK_S32 mpp_data_sum_v2(MppDataV2 *p)
 {
-    RK_S32 i;
-    RK_S32 *data = p->val;
-    RK_S32 sum = 0;
-
-    for (i = 0; i < p->size; i++)
-        sum += *data++;
-
-    return sum;
+    return (RK_S32)p->sum;
 }
+
 RK_S32 mpp_data_mean_v2(MppDataV2 *p)
 {
-    RK_S32 sum = mpp_data_sum_v2(p);
+    RK_S32 sum = (RK_S32)p->sum;
     RK_S32 mean = sum / p->size;
 
     return mean;
 }
 
+RK_S32 mpp_data_latest_v2(MppDataV2 *p)
+{
+    return p->val[p->pos_w];
+}
+
+RK_S32 mpp_data_oldest_v2(MppDataV2 *p)
+{
+    return p->val[p->pos_w ? p->pos_w - 1 : p->size - 1];
+}
+
 RK_S32 mpp_data_sum_with_ratio_v2(MppDataV2 *p, RK_S32 len, RK_S32 num, RK_S32 denorm)
 {
     mpp_assert(p);
 
     RK_S32 i;
+    RK_S32 pos = p->pos_w;
     RK_S64 sum = 0;
-    RK_S32 *data = p->val;
 
     mpp_assert(len <= p->size);
 
     if (num == denorm) {
-        for (i = 0; i < len; i++)
-            sum += *data++;
+        if (len == p->size)
+            return DIV(p->sum, len);
+
+        for (i = 0; i < len; i++) {
+            sum += p->val[pos];
+            if (++pos >= p->size)
+                pos = 0;
+        }
     } else {
         // NOTE: use 64bit to avoid 0 in 32bit
         RK_S64 acc_num = 1;
         RK_S64 acc_denorm = 1;
 
+        /* each weighted term is rounded down so it can not be accumulated */
         for (i = 0; i < len; i++) {
-            sum += p->val[i] * acc_num / acc_denorm;
+            sum += p->val[pos] * acc_num / acc_denorm;
             acc_num *= num;
             acc_denorm *= denorm;
+            if (++pos >= p->size)
+                pos = 0;
         }
     }
 
@@ -29,20 +29,20 @@
  * 1. MppData - data statistic struct
  *    size  - max valid data number
  *    len   - valid data number
- *    pos_r - current data read position
- *    pos_w - current data write position
+ *    pos_w - position of the latest data
+ *    sum   - running sum of all the data in window
  *    val   - buffer array pointer
  *
- *    When statistic length is less than 8 use direct save mode which will move
- *    all the data on each update.
- *    When statistic length is larger than 8 use loop save mode which will
- *    cyclically reuse the data position.
+ *    The data is saved in a ring buffer. Update writes the new data to the
+ *    position before the latest data and adjusts the running sum so that the
+ *    update and the sum / mean of the whole window are O(1).
+ *    The i-th latest data is val[(pos_w + i) % size].
  */
 typedef struct MppDataV2_t {
     RK_S32  size;
     RK_S32  len;
     RK_S32  pos_w;
-    RK_S32  pos_r;
+    RK_S64  sum;
     RK_S32  *val;
 } MppDataV2;
 
@@ -299,6 +299,8 @@ void mpp_data_reset_v2(MppDataV2 *p, RK_S32 val);
 void mpp_data_update_v2(MppDataV2 *p, RK_S32 val);
 RK_S32 mpp_data_sum_v2(MppDataV2 *p);
 RK_S32 mpp_data_mean_v2(MppDataV2 *p);
+RK_S32 mpp_data_latest_v2(MppDataV2 *p);
+RK_S32 mpp_data_oldest_v2(MppDataV2 *p);
 RK_S32 mpp_data_sum_with_ratio_v2(MppDataV2 *p, RK_S32 len, RK_S32 num, RK_S32 denorm);
 
 void mpp_pid_reset_v2(MppPIDCtxV2 *p);
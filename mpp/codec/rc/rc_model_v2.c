@@ -21,6 +21,7 @@
 #include "mpp_env.h"
 #include "mpp_mem.h"
 #include "mpp_common.h"
+#include "rk_venc_cmd.h"
 #include "rc_base.h"
 #include "rc_debug.h"
 #include "rc_model_v2.h"
@@ -52,6 +53,23 @@ static const RK_S8 max_ip_qp_dealt[8] = {
     7, 7, 7, 7, 6, 4, 3, 2
 };
 
+/*
+ * Rate control state written by start / hal_start of one frame. In pipeline
+ * mode the next frame starts before current frame ends so each in-flight
+ * frame keeps its own copy.
+ */
+typedef struct RcModelV2TaskState_t {
+    RK_U32          frame_type;
+    RK_S32          ins_bps;
+    RK_S32          next_i_ratio;
+    RK_S32          next_ratio;
+    RK_S32          pre_i_qp;
+    RK_S32          pre_p_qp;
+    RK_S32          cur_scale_qp;
+    RK_S32          start_qp;
+    RK_S32          reenc_cnt;
+} RcModelV2TaskState;
+
 typedef struct RcModelV2Ctx_t {
     RcCfg           usr_cfg;
     EncRcTaskInfo   hal_cfg;
@@ -109,8 +127,42 @@ typedef struct RcModelV2Ctx_t {
     RK_S32          prev_quality;
 
     RK_S32          reenc_cnt;
+
+    /* per in-flight frame state indexed by seq_idx */
+    RcModelV2TaskState task_state[MPP_ENC_PIPE_DEPTH_MAX];
+    RK_U32          last_seq_idx;
 } RcModelV2Ctx;
 
+static void task_state_save(RcModelV2Ctx *p, RK_U32 seq_idx)
+{
+    RcModelV2TaskState *s = &p->task_state[seq_idx % MPP_ENC_PIPE_DEPTH_MAX];
+
+    s->frame_type   = p->frame_type;
+    s->ins_bps      = p->ins_bps;
+    s->next_i_ratio = p->next_i_ratio;
+    s->next_ratio   = p->next_ratio;
+    s->pre_i_qp     = p->pre_i_qp;
+    s->pre_p_qp     = p->pre_p_qp;
+    s->cur_scale_qp = p->cur_scale_qp;
+    s->start_qp     = p->start_qp;
+    s->reenc_cnt    = p->reenc_cnt;
+}
+
+static void task_state_load(RcModelV2Ctx *p, RK_U32 seq_idx)
+{
+    RcModelV2TaskState *s = &p->task_state[seq_idx % MPP_ENC_PIPE_DEPTH_MAX];
+
+    p->frame_type   = s->frame_type;
+    p->ins_bps      = s->ins_bps;
+    p->next_i_ratio = s->next_i_ratio;
+    p->next_ratio   = s->next_ratio;
+    p->pre_i_qp     = s->pre_i_qp;
+    p->pre_p_qp     = s->pre_p_qp;
+    p->cur_scale_qp = s->cur_scale_qp;
+    p->start_qp     = s->start_qp;
+    p->reenc_cnt    = s->reenc_cnt;
+}
+
 MPP_RET bits_model_deinit(RcModelV2Ctx *ctx)
 {
     rc_dbg_func("enter %p\n", ctx);
@@ -540,7 +592,7 @@ MPP_RET reenc_calc_cbr_ratio(RcModelV2Ctx *ctx, EncRcTaskInfo *cfg)
 {
     RK_S32 stat_time = ctx->usr_cfg.stat_times;
     RK_S32 pre_ins_bps = mpp_data_sum_v2(ctx->stat_bits) / stat_time;
-    RK_S32 ins_bps = (pre_ins_bps * stat_time - ctx->stat_bits->val[0] + cfg->bit_real) / stat_time;
+    RK_S32 ins_bps = (pre_ins_bps * stat_time - mpp_data_latest_v2(ctx->stat_bits) + cfg->bit_real) / stat_time;
     RK_S32 real_bit = cfg->bit_real;
     RK_S32 target_bit = cfg->bit_target;
     RK_S32 target_bps = ctx->target_bps;
@@ -669,7 +721,7 @@ MPP_RET reenc_calc_vbr_ratio(RcModelV2Ctx *ctx, EncRcTaskInfo *cfg)
 {
     RK_S32 stat_time = ctx->usr_cfg.stat_times;
     RK_S32 pre_ins_bps = mpp_data_sum_v2(ctx->stat_bits) / stat_time;
-    RK_S32 ins_bps = (pre_ins_bps * stat_time - ctx->stat_bits->val[0] + cfg->bit_real) / stat_time;
+    RK_S32 ins_bps = (pre_ins_bps * stat_time - mpp_data_latest_v2(ctx->stat_bits) + cfg->bit_real) / stat_time;
     RK_S32 bps_change = ctx->target_bps;
     RK_S32 max_bps_target = ctx->usr_cfg.bps_max;
     RK_S32 real_bit = cfg->bit_real;
@@ -736,7 +788,7 @@ MPP_RET check_re_enc(RcModelV2Ctx *ctx, EncRcTaskInfo *cfg)
     RK_S32 bit_thr = 0;
     RK_S32 stat_time = ctx->usr_cfg.stat_times;
     RK_S32 last_ins_bps = mpp_data_sum_v2(ctx->stat_bits) / stat_time;
-    RK_S32 ins_bps = (last_ins_bps * stat_time - ctx->stat_bits->val[ctx->stat_bits->size - 1]
+    RK_S32 ins_bps = (last_ins_bps * stat_time - mpp_data_oldest_v2(ctx->stat_bits)
                       + cfg->bit_real) / stat_time;
     RK_S32 target_bps;
     RK_S32 ret = MPP_OK;
@@ -803,6 +855,14 @@ MPP_RET rc_model_v2_deinit(void *ctx)
     return MPP_OK;
 }
 
+static RK_U32 get_frame_type(EncFrmStatus *frm)
+{
+    if (frm->ref_mode == REF_TO_PREV_INTRA)
+        return INTER_VI_FRAME;
+
+    return (frm->is_intra) ? (INTRA_FRAME) : (INTER_P_FRAME);
+}
+
 MPP_RET rc_model_v2_start(void *ctx, EncRcTask *task)
 {
     RcModelV2Ctx *p = (RcModelV2Ctx*)ctx;
@@ -845,11 +905,7 @@ MPP_RET rc_model_v2_start(void *ctx, EncRcTask *task)
         return MPP_OK;
     }
 
-    p->frame_type = (frm->is_intra) ? (INTRA_FRAME) : (INTER_P_FRAME);
-
-    if (frm->ref_mode == REF_TO_PREV_INTRA) {
-        p->frame_type = INTER_VI_FRAME;
-    }
+    p->frame_type = get_frame_type(frm);
 
     /* bitrate allocation */
     bits_model_alloc(p, info);
@@ -883,6 +939,8 @@ MPP_RET rc_model_v2_start(void *ctx, EncRcTask *task)
     rc_dbg_rc("quality [%d : %d : %d]\n", info->quality_min, info->quality_target, info->quality_max);
 
     p->reenc_cnt = 0;
+    p->last_seq_idx = frm->seq_idx;
+    task_state_save(p, frm->seq_idx);
 
     rc_dbg_func("leave %p\n", ctx);
 
@@ -1027,6 +1085,7 @@ MPP_RET rc_model_v2_hal_start(void *ctx, EncRcTask *task)
 
     p->start_qp = mpp_clip(p->start_qp, info->quality_min, info->quality_max);
     info->quality_target = p->start_qp;
+    task_state_save(p, frm->seq_idx);
 
     rc_dbg_rc("bitrate [%d : %d : %d] -> [%d : %d : %d]\n",
               bit_min, bit_target, bit_max,
@@ -1051,9 +1110,20 @@ MPP_RET rc_model_v2_end(void *ctx, EncRcTask *task)
     RcModelV2Ctx *p = (RcModelV2Ctx *)ctx;
     EncRcTaskInfo *cfg = (EncRcTaskInfo *)&task->info;
     EncFrmStatus *frm = &task->frm;
+    RK_U32 pipelined = 0;
 
     rc_dbg_func("enter ctx %p cfg %p\n", ctx, cfg);
 
+    /*
+     * In pipeline mode the next task may start before this task ends.
+     * So switch to the state of this task before checking re-encode and
+     * updating bits model, then switch back to the latest started task.
+     */
+    if (p->usr_cfg.mode != RC_FIXQP && frm->seq_idx != p->last_seq_idx) {
+        task_state_load(p, frm->seq_idx);
+        pipelined = 1;
+    }
+
     if (p->usr_cfg.mode != RC_FIXQP &&
         !(task->force.force_flag & ENC_RC_FORCE_QP)) {
         if (check_re_enc(p, cfg)) {
@@ -1082,6 +1152,10 @@ MPP_RET rc_model_v2_end(void *ctx, EncRcTask *task)
     p->pre_target_bits = cfg->bit_target;
     p->pre_real_bits = cfg->bit_real;
 
+    /* re-encode keeps the state of this task for its hal_start */
+    if (pipelined && !frm->reencode)
+        task_state_load(p, p->last_seq_idx);
+
     rc_dbg_func("leave %p\n", ctx);
     return MPP_OK;
 }
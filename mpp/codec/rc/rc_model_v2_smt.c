@@ -118,6 +118,7 @@ typedef struct RcModelV2SmtCtx_t {
     RK_S32 bits_one_gop[1000];
     RK_S32 bits_one_gop_use_flag;
     RK_S32 bits_one_gop_sum;
+    RK_S32 bits_one_gop_acc;
     RK_S32 delta_bits_per_frame;
     RK_S32 frame_cnt_in_gop;
     RK_S32 bits_target_use;
@@ -249,6 +250,7 @@ MPP_RET bits_model_smt_init(RcModelV2SmtCtx *ctx)
     // smt
     ctx->frame_cnt_in_gop = 0;
     ctx->bits_one_gop_use_flag = 0;
+    ctx->bits_one_gop_acc = 0;
     ctx->gop_min = gop_len;
 
     ctx->qp_min = 18;
@@ -356,20 +358,22 @@ MPP_RET bits_model_update_smt(RcModelV2SmtCtx *ctx, RK_S32 real_bit)
 
     ctx->pre_diff_bit_low_rate = ctx->bits_target_low_rate - real_bit;
     ctx->pre_diff_bit_high_rate = ctx->bits_target_high_rate - real_bit;
+    /* keep the sum of the last 1000 frames in current gop */
+    if (ctx->frame_cnt_in_gop >= 1000)
+        ctx->bits_one_gop_acc -= ctx->bits_one_gop[ctx->frame_cnt_in_gop % 1000];
+    ctx->bits_one_gop_acc += real_bit;
     ctx->bits_one_gop[ctx->frame_cnt_in_gop % 1000] = real_bit;
     ctx->frame_cnt_in_gop++;
 
     if (ctx->frame_cnt_in_gop == gop_len) {
         ctx->frame_cnt_in_gop = 0;
         ctx->bits_one_gop_use_flag = 1;
-        ctx->bits_one_gop_sum = 0;
-        RK_S32 i = 0;
+        ctx->bits_one_gop_sum = ctx->bits_one_gop_acc;
+        ctx->bits_one_gop_acc = 0;
         RK_S32 gop_len_save = gop_len;
         if (gop_len > 1000) {
             gop_len_save = 1000;
         }
-        for (i = 0; i < gop_len_save; i++)
-            ctx->bits_one_gop_sum += ctx->bits_one_gop[i];
 
         ctx->delta_bits_per_frame = ctx->bps_target_high_rate / (fps->fps_out_num) - ctx->bits_one_gop_sum / gop_len_save;
     }
@@ -418,7 +422,7 @@ MPP_RET reenc_calc_cbr_ratio_smt(RcModelV2SmtCtx *ctx, EncRcTaskInfo *cfg)
 {
     RK_S32 stat_time = ctx->usr_cfg.stat_times;
     RK_S32 last_ins_bps = mpp_data_sum_v2(ctx->stat_bits) / stat_time;
-    RK_S32 ins_bps = (last_ins_bps - ctx->stat_bits->val[0] + cfg->bit_real) / stat_time;
+    RK_S32 ins_bps = (last_ins_bps - mpp_data_latest_v2(ctx->stat_bits) + cfg->bit_real) / stat_time;
     RK_S32 real_bit = cfg->bit_real;
     RK_S32 target_bit = cfg->bit_target;
     RK_S32 target_bps = ctx->target_bps;
@@ -499,7 +503,7 @@ MPP_RET reenc_calc_vbr_ratio_smt(RcModelV2SmtCtx *ctx, EncRcTaskInfo *cfg)
 {
     RK_S32 stat_time = ctx->usr_cfg.stat_times;
     RK_S32 last_ins_bps = mpp_data_sum_v2(ctx->stat_bits) / stat_time;
-    RK_S32 ins_bps = (last_ins_bps - ctx->stat_bits->val[0] + cfg->bit_real) / stat_time;
+    RK_S32 ins_bps = (last_ins_bps - mpp_data_latest_v2(ctx->stat_bits) + cfg->bit_real) / stat_time;
     RK_S32 bps_change = ctx->target_bps;
     RK_S32 max_bps_target = ctx->usr_cfg.bps_max;
     RK_S32 real_bit = cfg->bit_real;
@@ -556,7 +560,7 @@ MPP_RET check_re_enc_smt(RcModelV2SmtCtx *ctx, EncRcTaskInfo *cfg)
     RK_S32 big_flag = 0;
     RK_S32 stat_time = ctx->usr_cfg.stat_times;
     RK_S32 last_ins_bps = mpp_data_sum_v2(ctx->stat_bits) / stat_time;
-    RK_S32 ins_bps = (last_ins_bps - ctx->stat_bits->val[0] + cfg->bit_real) / stat_time;
+    RK_S32 ins_bps = (last_ins_bps - mpp_data_latest_v2(ctx->stat_bits) + cfg->bit_real) / stat_time;
     RK_S32 target_bps;
     RK_S32 flag1 = 0;
     RK_S32 flag2 = 0;
@@ -993,6 +997,9 @@ MPP_RET rc_model_v2_smt_end(void *ctx, EncRcTask *task)
 
     rc_dbg_func("enter ctx %p cfg %p\n", ctx, cfg);
 
+    /* next task may start before this task ends in pipeline mode */
+    p->frame_type = (task->frm.is_intra) ? (INTRA_FRAME) : (INTER_P_FRAME);
+
     if (check_re_enc_smt(p, cfg)) {
         if (p->usr_cfg.mode == RC_CBR) {
             reenc_calc_cbr_ratio_smt(p, cfg);
@@ -0,0 +1,494 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "rc_sim"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpp_mem.h"
+#include "mpp_log.h"
+#include "mpp_frame.h"
+#include "mpp_common.h"
+#include "rk_venc_cmd.h"
+
+#include "rc_base.h"
+#include "rc_sim.h"
+
+#define RC_SIM_TRACE_INIT       1024
+#define RC_SIM_QP_DEFAULT       26
+
+/* one frame started and not ended in pipeline */
+typedef struct RcSimTask_t {
+    EncRcTask       task;
+    RcSimFrame      frame;
+} RcSimTask;
+
+typedef struct RcSimImpl_t {
+    RcCtx           rc;
+    RcCfg           cfg;
+    MppFrame        frame;
+    RK_S32          mbs;
+    RK_S32          seq_idx;
+    RK_S32          bits_per_frame;
+
+    RcSimTask       tasks[MPP_ENC_PIPE_DEPTH_MAX];
+    RK_S32          task_rd;
+    RK_S32          task_cnt;
+    RK_S32          pipe_depth;
+
+    /* one second bits window */
+    MppDataV2       *win_bits;
+    RK_S32          win_len;
+
+    RK_S64          vbv_level;
+    RK_S64          qp_sum;
+    RK_S64          qp_sum_sq;
+    RK_S64          qp_delta_sum;
+    RK_S32          qp_delta_cnt;
+    RK_S32          qp_last;
+
+    RcSimResult     result;
+} RcSimImpl;
+
+MPP_RET rc_sim_init(RcSim *sim, MppCodingType type, const char *name, RcCfg *cfg)
+{
+    RcSimImpl *p = NULL;
+    RcFpsCfg *fps = NULL;
+    MPP_RET ret = MPP_NOK;
+
+    if (NULL == sim || NULL == cfg) {
+        mpp_err_f("invalid sim %p cfg %p\n", sim, cfg);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    *sim = NULL;
+    p = mpp_calloc(RcSimImpl, 1);
+    if (NULL == p) {
+        mpp_err_f("failed to malloc context\n");
+        return MPP_ERR_MALLOC;
+    }
+
+    p->cfg = *cfg;
+    fps = &p->cfg.fps;
+    if (fps->fps_in_num <= 0)
+        fps->fps_in_num = 30;
+    if (fps->fps_in_denorm <= 0)
+        fps->fps_in_denorm = 1;
+    if (fps->fps_out_num <= 0)
+        fps->fps_out_num = fps->fps_in_num;
+    if (fps->fps_out_denorm <= 0)
+        fps->fps_out_denorm = fps->fps_in_denorm;
+    if (p->cfg.stat_times <= 0)
+        p->cfg.stat_times = 3;
+
+    ret = rc_init(&p->rc, type, &name);
+    if (ret || NULL == p->rc) {
+        mpp_err_f("failed to init rc %s type %x\n", name, type);
+        goto FAILED;
+    }
+
+    ret = rc_update_usr_cfg(p->rc, &p->cfg);
+    if (ret)
+        goto FAILED;
+
+    /* some rc model reads the frame size from input frame */
+    mpp_frame_init(&p->frame);
+    mpp_frame_set_width(p->frame, p->cfg.width);
+    mpp_frame_set_height(p->frame, p->cfg.height);
+
+    p->mbs = MPP_ALIGN(p->cfg.width, 16) / 16 * MPP_ALIGN(p->cfg.height, 16) / 16;
+    p->bits_per_frame = (RK_S32)((RK_S64)p->cfg.bps_target * fps->fps_out_denorm /
+                                 fps->fps_out_num);
+    p->win_len = MPP_MAX(1, fps->fps_out_num / fps->fps_out_denorm);
+    ret = mpp_data_init_v2(&p->win_bits, p->win_len);
+    if (ret)
+        goto FAILED;
+
+    p->pipe_depth = 1;
+    p->qp_last = -1;
+    p->result.vbv_size = (RK_S32)MPP_MIN((RK_S64)p->cfg.bps_max * p->cfg.stat_times,
+                                         0x7fffffff);
+    p->result.bps_win_min = 0x7fffffff;
+    p->result.qp_min = 0x7fffffff;
+
+    *sim = p;
+    return MPP_OK;
+
+FAILED:
+    rc_sim_deinit(p);
+    return ret;
+}
+
+MPP_RET rc_sim_deinit(RcSim sim)
+{
+    RcSimImpl *p = (RcSimImpl *)sim;
+
+    if (NULL == p)
+        return MPP_OK;
+
+    if (p->rc)
+        rc_deinit(p->rc);
+    if (p->frame)
+        mpp_frame_deinit(&p->frame);
+    if (p->win_bits)
+        mpp_data_deinit_v2(p->win_bits);
+
+    MPP_FREE(p);
+    return MPP_OK;
+}
+
+/* rate-qp model: bits double on each 6 qp decrease */
+static RK_S32 rc_sim_scale_bits(RcSimFrame *frame, RK_S32 mbs, RK_S32 qp)
+{
+    double qp_rec = frame->qp_sum ? (double)frame->qp_sum / mbs : RC_SIM_QP_DEFAULT;
+    double bits = frame->bits * pow(2.0, (qp_rec - qp) / 6.0);
+
+    return (RK_S32)MPP_MIN(bits, 0x7fffffff);
+}
+
+static void rc_sim_update_stat(RcSimImpl *p, RcSimFrame *frame, RK_S32 bits, RK_S32 qp)
+{
+    RcSimResult *result = &p->result;
+    RK_S32 win_bps;
+
+    result->encoded++;
+    result->total_bits += bits;
+
+    mpp_data_update_v2(p->win_bits, bits);
+    if (result->encoded >= p->win_len) {
+        win_bps = (RK_S32)((RK_S64)mpp_data_sum_v2(p->win_bits) * p->cfg.fps.fps_out_num /
+                           (p->win_len * p->cfg.fps.fps_out_denorm));
+        result->bps_win_min = MPP_MIN(result->bps_win_min, win_bps);
+        result->bps_win_max = MPP_MAX(result->bps_win_max, win_bps);
+    }
+
+    p->vbv_level += bits - p->bits_per_frame;
+    if (p->vbv_level < 0)
+        p->vbv_level = 0;
+    if (p->vbv_level > result->vbv_max)
+        result->vbv_max = (RK_S32)MPP_MIN(p->vbv_level, 0x7fffffff);
+    if (p->vbv_level > result->vbv_size)
+        result->vbv_overflow++;
+
+    p->qp_sum += qp;
+    p->qp_sum_sq += qp * qp;
+    result->qp_min = MPP_MIN(result->qp_min, qp);
+    result->qp_max = MPP_MAX(result->qp_max, qp);
+
+    if (frame->type == RC_SIM_FRM_P) {
+        if (p->qp_last >= 0) {
+            RK_S32 delta = abs(qp - p->qp_last);
+
+            p->qp_delta_sum += delta;
+            p->qp_delta_cnt++;
+            result->qp_delta_max = MPP_MAX(result->qp_delta_max, delta);
+        }
+        p->qp_last = qp;
+    }
+}
+
+/* hardware encodes the frame with the qp from rc_hal_start */
+static void rc_sim_hal_run(RcSimImpl *p, RcSimTask *t)
+{
+    EncRcTaskInfo *info = &t->task.info;
+    RcSimFrame *frame = &t->frame;
+    RK_S32 qp;
+
+    rc_hal_start(p->rc, &t->task);
+
+    qp = info->quality_target;
+    if (qp < 0)
+        qp = frame->qp_sum ? (frame->qp_sum + p->mbs / 2) / p->mbs : RC_SIM_QP_DEFAULT;
+    if (info->quality_max > 0)
+        qp = mpp_clip(qp, info->quality_min, info->quality_max);
+
+    info->bit_real = rc_sim_scale_bits(frame, p->mbs, qp);
+    info->quality_real = qp;
+    info->madi = frame->madi;
+    info->madp = frame->madp;
+}
+
+/* end the oldest started frame */
+static void rc_sim_task_end(RcSimImpl *p)
+{
+    RcSimTask *t = &p->tasks[p->task_rd];
+    EncFrmStatus *frm = &t->task.frm;
+    EncRcTaskInfo *info = &t->task.info;
+
+    do {
+        rc_hal_end(p->rc, &t->task);
+
+        frm->reencode = 0;
+        rc_frm_end(p->rc, &t->task);
+
+        if (frm->reencode_times >= (RK_U32)p->cfg.max_reencode_times || !frm->reencode)
+            break;
+
+        frm->reencode_times++;
+        p->result.reencoded++;
+        rc_sim_hal_run(p, t);
+    } while (1);
+
+    rc_sim_update_stat(p, &t->frame, info->bit_real, info->quality_real);
+
+    p->task_rd = (p->task_rd + 1) % MPP_ENC_PIPE_DEPTH_MAX;
+    p->task_cnt--;
+}
+
+MPP_RET rc_sim_frame(RcSim sim, RcSimFrame *frame)
+{
+    RcSimImpl *p = (RcSimImpl *)sim;
+    RcSimTask *t = NULL;
+    EncRcTask *task = NULL;
+    EncFrmStatus *frm = NULL;
+
+    if (NULL == p || NULL == frame) {
+        mpp_err_f("invalid sim %p frame %p\n", p, frame);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    t = &p->tasks[(p->task_rd + p->task_cnt) % MPP_ENC_PIPE_DEPTH_MAX];
+    task = &t->task;
+    frm = &task->frm;
+
+    memset(t, 0, sizeof(*t));
+    t->frame = *frame;
+    task->frame = p->frame;
+    frm->valid = 1;
+    frm->seq_idx = p->seq_idx++;
+    frm->is_intra = (frame->type == RC_SIM_FRM_I);
+    frm->is_idr = frm->is_intra;
+    if (frame->type == RC_SIM_FRM_VI)
+        frm->ref_mode = REF_TO_PREV_INTRA;
+
+    p->result.frames++;
+
+    rc_frm_check_drop(p->rc, task);
+    if (frm->drop) {
+        p->result.dropped++;
+        return MPP_OK;
+    }
+
+    rc_frm_start(p->rc, task);
+    rc_sim_hal_run(p, t);
+    p->task_cnt++;
+
+    while (p->task_cnt >= p->pipe_depth)
+        rc_sim_task_end(p);
+
+    return MPP_OK;
+}
+
+MPP_RET rc_sim_set_pipe_depth(RcSim sim, RK_S32 depth)
+{
+    RcSimImpl *p = (RcSimImpl *)sim;
+
+    if (NULL == p || depth < 1 || depth > MPP_ENC_PIPE_DEPTH_MAX) {
+        mpp_err_f("invalid sim %p depth %d\n", p, depth);
+        return MPP_ERR_VALUE;
+    }
+
+    p->pipe_depth = depth;
+    while (p->task_cnt >= p->pipe_depth)
+        rc_sim_task_end(p);
+
+    return MPP_OK;
+}
+
+MPP_RET rc_sim_flush(RcSim sim)
+{
+    RcSimImpl *p = (RcSimImpl *)sim;
+
+    if (NULL == p) {
+        mpp_err_f("invalid sim %p\n", p);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    while (p->task_cnt)
+        rc_sim_task_end(p);
+
+    return MPP_OK;
+}
+
+MPP_RET rc_sim_get_result(RcSim sim, RcSimResult *result)
+{
+    RcSimImpl *p = (RcSimImpl *)sim;
+    RcFpsCfg *fps = NULL;
+    RK_S32 encoded;
+
+    if (NULL == p || NULL == result) {
+        mpp_err_f("invalid sim %p result %p\n", p, result);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    fps = &p->cfg.fps;
+    encoded = p->result.encoded;
+    *result = p->result;
+
+    if (!p->result.frames)
+        return MPP_OK;
+
+    /* bitrate on input frame time including the dropped frames */
+    result->bps_real = (RK_S32)(p->result.total_bits * fps->fps_in_num /
+                                ((RK_S64)p->result.frames * fps->fps_in_denorm));
+    if (p->cfg.bps_target)
+        result->bps_err = (RK_S32)(((RK_S64)result->bps_real - p->cfg.bps_target) * 1000 /
+                                   p->cfg.bps_target);
+
+    if (encoded) {
+        double avg = (double)p->qp_sum / encoded;
+        double var = (double)p->qp_sum_sq / encoded - avg * avg;
+
+        result->qp_avg = (RK_S32)(avg * 100);
+        result->qp_stddev = (RK_S32)(sqrt(MPP_MAX(var, 0)) * 100);
+    }
+
+    if (p->qp_delta_cnt)
+        result->qp_delta_avg = (RK_S32)(p->qp_delta_sum * 100 / p->qp_delta_cnt);
+    if (result->bps_win_min > result->bps_win_max)
+        result->bps_win_min = result->bps_win_max = 0;
+    if (result->qp_min > result->qp_max)
+        result->qp_min = result->qp_max = 0;
+
+    return MPP_OK;
+}
+
+MPP_RET rc_sim_trace_load(const char *file, RcSimFrame **trace, RK_S32 *count)
+{
+    RcSimFrame *frames = NULL;
+    RK_S32 size = RC_SIM_TRACE_INIT;
+    RK_S32 cnt = 0;
+    char line[256];
+    FILE *fp = NULL;
+
+    if (NULL == file || NULL == trace || NULL == count) {
+        mpp_err_f("invalid file %p trace %p count %p\n", file, trace, count);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    *trace = NULL;
+    *count = 0;
+
+    fp = fopen(file, "r");
+    if (NULL == fp) {
+        mpp_err_f("failed to open trace %s\n", file);
+        return MPP_ERR_OPEN_FILE;
+    }
+
+    frames = mpp_malloc(RcSimFrame, size);
+    if (NULL == frames) {
+        fclose(fp);
+        return MPP_ERR_MALLOC;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        RcSimFrame *frame = NULL;
+        char type = 0;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        if (cnt >= size) {
+            RcSimFrame *tmp = mpp_realloc(frames, RcSimFrame, size * 2);
+
+            if (NULL == tmp) {
+                MPP_FREE(frames);
+                fclose(fp);
+                return MPP_ERR_MALLOC;
+            }
+            frames = tmp;
+            size *= 2;
+        }
+
+        frame = &frames[cnt];
+        memset(frame, 0, sizeof(*frame));
+        if (sscanf(line, " %c %d %d %d %d", &type, &frame->bits, &frame->qp_sum,
+                   &frame->madi, &frame->madp) < 3) {
+            mpp_err_f("invalid trace line %d: %s", cnt, line);
+            continue;
+        }
+
+        switch (type) {
+        case 'I' :
+        case 'i' : {
+            frame->type = RC_SIM_FRM_I;
+        } break;
+        case 'V' :
+        case 'v' : {
+            frame->type = RC_SIM_FRM_VI;
+        } break;
+        default : {
+            frame->type = RC_SIM_FRM_P;
+        } break;
+        }
+
+        cnt++;
+    }
+
+    fclose(fp);
+
+    *trace = frames;
+    *count = cnt;
+    return MPP_OK;
+}
+
+MPP_RET rc_sim_trace_gen(RcSimGenCfg *cfg, RcSimFrame **trace, RK_S32 count)
+{
+    RcSimFrame *frames = NULL;
+    RK_U32 seed;
+    RK_S32 mbs;
+    RK_S32 complex = 100;
+    RK_S32 i;
+
+    if (NULL == cfg || NULL == trace || count <= 0) {
+        mpp_err_f("invalid cfg %p trace %p count %d\n", cfg, trace, count);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    *trace = NULL;
+    frames = mpp_malloc(RcSimFrame, count);
+    if (NULL == frames)
+        return MPP_ERR_MALLOC;
+
+    seed = cfg->seed;
+    mbs = MPP_ALIGN(cfg->width, 16) / 16 * MPP_ALIGN(cfg->height, 16) / 16;
+
+    for (i = 0; i < count; i++) {
+        RcSimFrame *frame = &frames[i];
+        /* +-25% frame to frame noise on slowly changing complexity */
+        RK_S32 noise = 75 + rand_r(&seed) % 51;
+        RK_S64 bits;
+
+        if (cfg->scene_len && i && (i % cfg->scene_len) == 0)
+            complex = 40 + rand_r(&seed) % 200;
+
+        bits = (RK_S64)cfg->p_bits * complex / 100 * noise / 100;
+        frame->type = (cfg->igop && (i % cfg->igop) == 0) ? RC_SIM_FRM_I : RC_SIM_FRM_P;
+        if (frame->type == RC_SIM_FRM_I)
+            bits *= cfg->i_scale;
+
+        frame->bits = (RK_S32)MPP_MIN(bits, 0x7fffffff);
+        frame->qp_sum = cfg->qp_base * mbs;
+        frame->madi = complex * 20 / 100 + rand_r(&seed) % 4;
+        frame->madp = complex * noise / 100;
+    }
+
+    *trace = frames;
+    return MPP_OK;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RC_SIM_H__
+#define __RC_SIM_H__
+
+#include "rc.h"
+
+/*
+ * Offline rate control simulation
+ *
+ * RcSim runs one RcImplApi found by coding type and name with the same call
+ * sequence as mpp_enc:
+ *
+ * rc_frm_check_drop -> rc_frm_start -> rc_hal_start -> (hardware)
+ *  -> rc_hal_end -> rc_frm_end -> (rc_hal_start again on reencode)
+ *
+ * With pipe depth N the rc_frm_end of a frame is delayed until N - 1 later
+ * frames are started like the mpp_enc pipeline.
+ *
+ * The hardware is replaced by a frame trace. Each trace frame records the
+ * real bits and qp_sum of one encoded frame with its madi / madp. When the
+ * rc selects a different qp the real bits are scaled by the rate-qp model
+ * bits = bits_rec * 2 ^ ((qp_rec - qp) / 6).
+ *
+ * Trace file is a text file, one frame per line and '#' for comment:
+ * <type> <bits> <qp_sum> <madi> <madp>
+ * type     - I for intra, P for inter, V for inter referencing the last intra
+ * qp_sum   - sum of the qp of all 16x16 blocks
+ */
+typedef void* RcSim;
+
+typedef enum RcSimFrmType_e {
+    RC_SIM_FRM_P,
+    RC_SIM_FRM_I,
+    RC_SIM_FRM_VI,
+    RC_SIM_FRM_BUTT,
+} RcSimFrmType;
+
+typedef struct RcSimFrame_t {
+    RcSimFrmType    type;
+    RK_S32          bits;
+    RK_S32          qp_sum;
+    RK_S32          madi;
+    RK_S32          madp;
+} RcSimFrame;
+
+/* synthetic trace config, the bits are at qp_base */
+typedef struct RcSimGenCfg_t {
+    RK_S32          width;
+    RK_S32          height;
+    RK_S32          igop;
+    /* average inter frame bits at qp_base */
+    RK_S32          p_bits;
+    /* intra frame bits over inter frame bits */
+    RK_S32          i_scale;
+    RK_S32          qp_base;
+    /* one scene change in every scene_len frames, 0 - no scene change */
+    RK_S32          scene_len;
+    RK_U32          seed;
+} RcSimGenCfg;
+
+typedef struct RcSimResult_t {
+    RK_S32          frames;
+    RK_S32          encoded;
+    RK_S32          dropped;
+    RK_S32          reencoded;
+
+    /* bitrate accuracy */
+    RK_S64          total_bits;
+    RK_S32          bps_real;
+    /* error to bps_target in 1/1000 */
+    RK_S32          bps_err;
+    /* min / max bitrate of one second sliding window */
+    RK_S32          bps_win_min;
+    RK_S32          bps_win_max;
+
+    /*
+     * vbv water level in bits
+     * The buffer is filled by frame bits and drained by bps_target per frame.
+     * Its size is bps_max * stat_times.
+     */
+    RK_S32          vbv_size;
+    RK_S32          vbv_max;
+    RK_S32          vbv_overflow;
+
+    /* qp stability in 1/100 */
+    RK_S32          qp_avg;
+    RK_S32          qp_stddev;
+    /* average and max abs qp change between inter frames */
+    RK_S32          qp_delta_avg;
+    RK_S32          qp_delta_max;
+    RK_S32          qp_min;
+    RK_S32          qp_max;
+} RcSimResult;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MPP_RET rc_sim_init(RcSim *sim, MppCodingType type, const char *name, RcCfg *cfg);
+MPP_RET rc_sim_deinit(RcSim sim);
+
+/* feed one input frame, frame may be dropped by the rc */
+MPP_RET rc_sim_frame(RcSim sim, RcSimFrame *frame);
+/* pipe depth 1 ~ MPP_ENC_PIPE_DEPTH_MAX, default 1 */
+MPP_RET rc_sim_set_pipe_depth(RcSim sim, RK_S32 depth);
+/* end all started frames before getting result */
+MPP_RET rc_sim_flush(RcSim sim);
+MPP_RET rc_sim_get_result(RcSim sim, RcSimResult *result);
+
+/* trace is allocated by mpp_malloc and released by mpp_free */
+MPP_RET rc_sim_trace_load(const char *file, RcSimFrame **trace, RK_S32 *count);
+MPP_RET rc_sim_trace_gen(RcSimGenCfg *cfg, RcSimFrame **trace, RK_S32 count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RC_SIM_H__ */
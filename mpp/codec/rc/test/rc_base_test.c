@@ -16,12 +16,219 @@
 
 #define MODULE_TAG "mpp_rc_test"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_common.h"
 #include "rc_base.h"
 
-int main()
+/*
+ * Window replay check
+ *
+ * Replay a frame size trace into the MppDataV2 / MppData windows and compare
+ * every statistic and the latest / oldest data with the reference
+ * implementation which moves the whole window and sums it from scratch.
+ * The trace is a recorded file with one frame size per line given by argv[1]
+ * or a generated trace with I frame, scene change and skip frame by default.
+ *
+ * usage: rc_base_test [trace file]
+ */
+#define REPLAY_FRAMES       20000
+#define REPLAY_GOP          60
+#define REPLAY_WINDOW_CNT   7
+
+typedef struct RefData_t {
+    RK_S32  size;
+    RK_S32  len;
+    RK_S32  pos;
+    RK_S32  *val;
+} RefData;
+
+static RK_S32 ref_div(RK_S64 a, RK_S64 b)
+{
+    return (RK_S32)((a + ((a < 0) ? -b : b) / 2) / b);
+}
+
+static void ref_update_v2(RefData *p, RK_S32 val)
+{
+    memmove(p->val + 1, p->val, sizeof(RK_S32) * (p->size - 1));
+    p->val[0] = val;
+}
+
+static RK_S32 ref_sum_v2(RefData *p)
+{
+    RK_S32 sum = 0;
+    RK_S32 i;
+
+    for (i = 0; i < p->size; i++)
+        sum += p->val[i];
+
+    return sum;
+}
+
+static RK_S32 ref_ratio_v2(RefData *p, RK_S32 len, RK_S32 num, RK_S32 denorm)
+{
+    RK_S64 acc_num = 1;
+    RK_S64 acc_denorm = 1;
+    RK_S64 sum = 0;
+    RK_S32 i;
+
+    for (i = 0; i < len; i++) {
+        sum += p->val[i] * acc_num / acc_denorm;
+        acc_num *= num;
+        acc_denorm *= denorm;
+    }
+
+    return ref_div(sum, len);
+}
+
+static void ref_update(RefData *p, RK_S32 val)
+{
+    p->val[p->pos] = val;
+    if (++p->pos >= p->size)
+        p->pos = 0;
+    if (p->len < p->size)
+        p->len++;
+}
+
+static RK_S32 ref_avg(RefData *p, RK_S32 len)
+{
+    RK_S32 pos = p->pos;
+    RK_S32 sum = 0;
+    RK_S32 i;
+
+    if (!p->len)
+        return 0;
+
+    if (len < 0 || len > p->len)
+        len = p->len;
+
+    for (i = 0; i < len; i++) {
+        pos = pos ? pos - 1 : p->len - 1;
+        sum += p->val[pos];
+    }
+
+    return ref_div(sum, len);
+}
+
+static RK_S32 *replay_load_trace(const char *file, RK_S32 *count)
+{
+    RK_S32 *trace = mpp_malloc(RK_S32, REPLAY_FRAMES);
+    RK_U32 seed = 1;
+    RK_S32 i;
+
+    if (NULL == trace)
+        return NULL;
+
+    if (file) {
+        FILE *fp = fopen(file, "r");
+
+        if (NULL == fp) {
+            mpp_err("failed to open trace %s\n", file);
+            MPP_FREE(trace);
+            return NULL;
+        }
+
+        for (i = 0; i < REPLAY_FRAMES; i++)
+            if (fscanf(fp, "%d", &trace[i]) != 1)
+                break;
+
+        fclose(fp);
+        *count = i;
+        return trace;
+    }
+
+    for (i = 0; i < REPLAY_FRAMES; i++) {
+        RK_S32 bits = 40000 + rand_r(&seed) % 20000;
+
+        if (i % REPLAY_GOP == 0)
+            bits *= 8;
+        if (i % 997 == 500)
+            bits *= 5;
+        if (i % 311 == 100)
+            bits = 0;
+
+        trace[i] = bits;
+    }
+
+    *count = REPLAY_FRAMES;
+    return trace;
+}
+
+static MPP_RET replay_check(const char *file)
+{
+    static const RK_S32 sizes[REPLAY_WINDOW_CNT] = { 1, 2, 5, 8, 30, 60, 1000 };
+    RK_S32 cnt = REPLAY_WINDOW_CNT;
+    MppDataV2 *data[REPLAY_WINDOW_CNT];
+    MppData *data_v1[REPLAY_WINDOW_CNT];
+    RefData ref[REPLAY_WINDOW_CNT];
+    RefData ref_v1[REPLAY_WINDOW_CNT];
+    RK_S32 *trace = NULL;
+    RK_S32 frames = 0;
+    RK_S32 error = 0;
+    RK_S32 i, j;
+
+    trace = replay_load_trace(file, &frames);
+    if (NULL == trace)
+        return MPP_NOK;
+
+    for (j = 0; j < cnt; j++) {
+        mpp_data_init_v2(&data[j], sizes[j]);
+        mpp_data_init(&data_v1[j], sizes[j]);
+        mpp_data_reset_v2(data[j], 1000);
+
+        ref[j].size = ref_v1[j].size = sizes[j];
+        ref[j].len = ref_v1[j].len = 0;
+        ref[j].pos = ref_v1[j].pos = 0;
+        ref[j].val = mpp_malloc(RK_S32, sizes[j]);
+        ref_v1[j].val = mpp_calloc(RK_S32, sizes[j]);
+        for (i = 0; i < sizes[j]; i++)
+            ref[j].val[i] = 1000;
+    }
+
+    for (i = 0; i < frames && !error; i++) {
+        for (j = 0; j < cnt; j++) {
+            RK_S32 size = sizes[j];
+            RK_S32 len = (i % size) + 1;
+
+            mpp_data_update_v2(data[j], trace[i]);
+            mpp_data_update(data_v1[j], trace[i]);
+            ref_update_v2(&ref[j], trace[i]);
+            ref_update(&ref_v1[j], trace[i]);
+
+            if (mpp_data_sum_v2(data[j]) != ref_sum_v2(&ref[j]) ||
+                mpp_data_mean_v2(data[j]) != ref_sum_v2(&ref[j]) / size ||
+                mpp_data_latest_v2(data[j]) != ref[j].val[0] ||
+                mpp_data_oldest_v2(data[j]) != ref[j].val[size - 1] ||
+                mpp_data_sum_with_ratio_v2(data[j], size, 1, 1) != ref_ratio_v2(&ref[j], size, 1, 1) ||
+                mpp_data_sum_with_ratio_v2(data[j], len, 1, 1) != ref_ratio_v2(&ref[j], len, 1, 1) ||
+                (size <= 30 && mpp_data_sum_with_ratio_v2(data[j], size, 3, 4) !=
+                 ref_ratio_v2(&ref[j], size, 3, 4)) ||
+                mpp_data_avg(data_v1[j], -1, 1, 1) != ref_avg(&ref_v1[j], -1) ||
+                mpp_data_avg(data_v1[j], len, 1, 1) != ref_avg(&ref_v1[j], len)) {
+                mpp_err("frame %d window %d mismatch\n", i, size);
+                error = 1;
+                break;
+            }
+        }
+    }
+
+    for (j = 0; j < cnt; j++) {
+        mpp_data_deinit_v2(data[j]);
+        mpp_data_deinit(data_v1[j]);
+        MPP_FREE(ref[j].val);
+        MPP_FREE(ref_v1[j].val);
+    }
+    MPP_FREE(trace);
+
+    mpp_log("replay %d frames window check %s\n", frames, error ? "failed" : "pass");
+    return error ? MPP_NOK : MPP_OK;
+}
+
+int main(int argc, char **argv)
 {
     MPP_RET ret = MPP_OK;
     MppDataV2 *data_2 = NULL;
@@ -67,7 +274,9 @@ int main()
     mpp_data_deinit_v2(data_30);
     mpp_data_deinit_v2(data_2);
 
-    mpp_log("mpp rc test success\n");
+    ret = replay_check((argc > 1) ? argv[1] : NULL);
+
+    mpp_log("mpp rc test %s\n", ret ? "failed" : "success");
 
     return ret;
 }
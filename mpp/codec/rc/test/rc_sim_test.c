@@ -0,0 +1,412 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "rc_sim_test"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_time.h"
+#include "mpp_common.h"
+
+#include "rc_sim.h"
+
+/*
+ * Offline rate control replay tool
+ *
+ * Without -i option a synthetic trace is generated. Without -r / -m option
+ * all rc api and rc mode combinations are run as a regression check which
+ * fails when the bitrate or vbv result is out of the limit.
+ *
+ * -c runs the same trace on multiple channels to measure the rc cost.
+ */
+#define SIM_DEF_FRAMES          3000
+#define SIM_DEF_WIDTH           1920
+#define SIM_DEF_HEIGHT          1080
+#define SIM_DEF_FPS             30
+#define SIM_DEF_GOP             60
+#define SIM_DEF_BPS             (2 * 1024 * 1024)
+
+/* regression limit in 1/1000 */
+#define SIM_CBR_ERR_MAX         100
+#define SIM_VBR_ERR_MAX         150
+
+/* re-encoded frames checked in pipeline mode */
+#define SIM_PIPE_CHECK_MAX      8
+/* inter frame bits spike to trigger inter frame re-encode */
+#define SIM_PIPE_SPIKE_GAP      97
+#define SIM_PIPE_SPIKE_SCALE    8
+
+typedef struct SimTestCfg_t {
+    const char      *trace_file;
+    const char      *rc_name;
+    MppCodingType   type;
+    RcMode          mode;
+    RK_S32          frames;
+    RK_S32          channels;
+    RK_S32          width;
+    RK_S32          height;
+    RK_S32          fps;
+    RK_S32          gop;
+    RK_S32          bps;
+} SimTestCfg;
+
+static const char *rc_mode_name[] = {
+    "cbr",
+    "vbr",
+    "avbr",
+    "cvbr",
+    "qvbr",
+    "fixqp",
+    "learning",
+};
+
+static void sim_test_help(void)
+{
+    mpp_log("usage: rc_sim_test [options]\n");
+    mpp_log("  -i trace file, one frame per line: <I/P/V> <bits> <qp_sum> <madi> <madp>\n");
+    mpp_log("  -t coding type 7 - h264 16777220 - h265, default h264\n");
+    mpp_log("  -r rc api name, default / smart\n");
+    mpp_log("  -m rc mode cbr / vbr / avbr\n");
+    mpp_log("  -n frame count of synthetic trace\n");
+    mpp_log("  -c channel count\n");
+    mpp_log("  -w -h frame size\n");
+    mpp_log("  -f fps -g gop -b target bps\n");
+}
+
+static void sim_test_set_cfg(SimTestCfg *test, RcCfg *cfg, RcMode mode)
+{
+    memset(cfg, 0, sizeof(*cfg));
+
+    cfg->width = test->width;
+    cfg->height = test->height;
+    cfg->mode = mode;
+    cfg->fps.fps_in_num = test->fps;
+    cfg->fps.fps_in_denorm = 1;
+    cfg->fps.fps_out_num = test->fps;
+    cfg->fps.fps_out_denorm = 1;
+    cfg->igop = test->gop;
+    cfg->bps_target = test->bps;
+
+    /* follow the encoder default bps range */
+    if (mode == RC_CBR) {
+        cfg->bps_max = test->bps * 17 / 16;
+        cfg->bps_min = test->bps * 15 / 16;
+    } else {
+        cfg->bps_max = test->bps * 17 / 16;
+        cfg->bps_min = test->bps * 1 / 16;
+    }
+    cfg->stat_times = 3;
+
+    cfg->init_quality = 26;
+    cfg->max_quality = 48;
+    cfg->min_quality = 8;
+    cfg->max_i_quality = 48;
+    cfg->min_i_quality = 8;
+    cfg->i_quality_delta = 3;
+    cfg->layer_bit_prop[0] = 256;
+    cfg->max_reencode_times = 1;
+}
+
+static MPP_RET sim_test_run(SimTestCfg *test, RcSimFrame *trace, RK_S32 count,
+                            const char *name, RcMode mode)
+{
+    RcSim *sims = mpp_calloc(RcSim, test->channels);
+    RcSimResult result;
+    RcCfg cfg;
+    MPP_RET ret = MPP_OK;
+    RK_S64 time;
+    RK_S32 err_max;
+    RK_S32 i, j;
+
+    if (NULL == sims)
+        return MPP_ERR_MALLOC;
+
+    sim_test_set_cfg(test, &cfg, mode);
+
+    for (j = 0; j < test->channels; j++) {
+        ret = rc_sim_init(&sims[j], test->type, name, &cfg);
+        if (ret)
+            goto DONE;
+    }
+
+    time = mpp_time();
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < test->channels; j++)
+            rc_sim_frame(sims[j], &trace[i]);
+    }
+    time = mpp_time() - time;
+
+    rc_sim_get_result(sims[0], &result);
+
+    mpp_log("%-7s %-4s bps %8d err %4d.%d%% win [%8d:%8d] vbv %3d%% over %3d "
+            "qp %2d.%02d std %d.%02d delta %d.%02d max %d range [%d:%d] "
+            "reenc %d drop %d %lld fps\n",
+            name, rc_mode_name[mode], result.bps_real,
+            result.bps_err / 10, abs(result.bps_err % 10),
+            result.bps_win_min, result.bps_win_max,
+            result.vbv_size ? (RK_S32)((RK_S64)result.vbv_max * 100 / result.vbv_size) : 0,
+            result.vbv_overflow,
+            result.qp_avg / 100, result.qp_avg % 100,
+            result.qp_stddev / 100, result.qp_stddev % 100,
+            result.qp_delta_avg / 100, result.qp_delta_avg % 100,
+            result.qp_delta_max, result.qp_min, result.qp_max,
+            result.reencoded, result.dropped,
+            time ? (RK_S64)count * test->channels * 1000000 / time : 0);
+
+    /* CBR must match the target, VBR and AVBR must not exceed the max */
+    if (mode == RC_CBR) {
+        err_max = SIM_CBR_ERR_MAX;
+        if (abs(result.bps_err) > err_max)
+            ret = MPP_NOK;
+    } else {
+        err_max = SIM_VBR_ERR_MAX;
+        if ((RK_S64)result.bps_real * 1000 > (RK_S64)cfg.bps_max * (1000 + err_max))
+            ret = MPP_NOK;
+    }
+
+    if (result.vbv_overflow)
+        ret = MPP_NOK;
+
+    if (ret)
+        mpp_err("%s %s result is out of limit\n", name, rc_mode_name[mode]);
+
+DONE:
+    for (j = 0; j < test->channels; j++)
+        rc_sim_deinit(sims[j]);
+
+    MPP_FREE(sims);
+    return ret;
+}
+
+/*
+ * Pipeline check: the next frame starts before a re-encoded frame ends.
+ * The frame result must match the one without pipeline. Some inter frames
+ * are scaled up to be re-encoded as well as the intra frames.
+ */
+static MPP_RET sim_test_pipe(SimTestCfg *test, RcSimFrame *src, RK_S32 count,
+                             const char *name, RcMode mode)
+{
+    RK_S32 frm_idx[SIM_PIPE_CHECK_MAX];
+    RcSimResult ref[SIM_PIPE_CHECK_MAX];
+    RcSimResult result;
+    RcSimFrame *trace = NULL;
+    RcSim sim = NULL;
+    RcCfg cfg;
+    RK_S32 checks = 0;
+    RK_S32 reencoded = 0;
+    RK_S32 failed = 0;
+    MPP_RET ret = MPP_OK;
+    RK_S32 i, j;
+
+    trace = mpp_malloc(RcSimFrame, count);
+    if (NULL == trace)
+        return MPP_ERR_MALLOC;
+
+    memcpy(trace, src, sizeof(*trace) * count);
+    for (i = SIM_PIPE_SPIKE_GAP; i < count; i += SIM_PIPE_SPIKE_GAP) {
+        if (trace[i].type == RC_SIM_FRM_P)
+            trace[i].bits = (RK_S32)MPP_MIN((RK_S64)trace[i].bits * SIM_PIPE_SPIKE_SCALE,
+                                            0x7fffffff);
+    }
+
+    sim_test_set_cfg(test, &cfg, mode);
+
+    ret = rc_sim_init(&sim, test->type, name, &cfg);
+    if (ret)
+        goto DONE;
+
+    for (i = 0; i + 1 < count && checks < SIM_PIPE_CHECK_MAX; i++) {
+        rc_sim_frame(sim, &trace[i]);
+        rc_sim_get_result(sim, &result);
+        if (result.reencoded > reencoded) {
+            frm_idx[checks] = i;
+            ref[checks] = result;
+            checks++;
+        }
+        reencoded = result.reencoded;
+    }
+    rc_sim_deinit(sim);
+
+    for (j = 0; j < checks; j++) {
+        RK_S32 idx = frm_idx[j];
+
+        ret = rc_sim_init(&sim, test->type, name, &cfg);
+        if (ret)
+            goto DONE;
+
+        for (i = 0; i < idx; i++)
+            rc_sim_frame(sim, &trace[i]);
+
+        /* frame idx ends after frame idx + 1 starts */
+        rc_sim_set_pipe_depth(sim, 2);
+        rc_sim_frame(sim, &trace[idx]);
+        rc_sim_frame(sim, &trace[idx + 1]);
+        rc_sim_get_result(sim, &result);
+        rc_sim_deinit(sim);
+
+        if (result.encoded != ref[j].encoded ||
+            result.reencoded != ref[j].reencoded ||
+            result.total_bits != ref[j].total_bits ||
+            result.qp_avg != ref[j].qp_avg) {
+            mpp_err("%s %s pipeline frame %d bits %lld qp %d reenc %d expect %lld qp %d reenc %d\n",
+                    name, rc_mode_name[mode], idx, result.total_bits,
+                    result.qp_avg, result.reencoded, ref[j].total_bits,
+                    ref[j].qp_avg, ref[j].reencoded);
+            failed++;
+        }
+    }
+
+    mpp_log("%-7s %-4s pipeline %d re-encoded frames %s\n", name,
+            rc_mode_name[mode], checks, failed ? "failed" : "matched");
+    if (failed)
+        ret = MPP_NOK;
+
+DONE:
+    MPP_FREE(trace);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *rc_names[] = { "default", "smart" };
+    static const RcMode rc_modes[] = { RC_CBR, RC_VBR, RC_AVBR };
+    SimTestCfg test;
+    RcSimFrame *trace = NULL;
+    RK_S32 count = 0;
+    MPP_RET ret = MPP_OK;
+    RK_U32 i, j;
+    int ch;
+
+    memset(&test, 0, sizeof(test));
+    test.type = MPP_VIDEO_CodingAVC;
+    test.mode = RC_MODE_BUTT;
+    test.frames = SIM_DEF_FRAMES;
+    test.channels = 1;
+    test.width = SIM_DEF_WIDTH;
+    test.height = SIM_DEF_HEIGHT;
+    test.fps = SIM_DEF_FPS;
+    test.gop = SIM_DEF_GOP;
+    test.bps = SIM_DEF_BPS;
+
+    opterr = 0;
+    while ((ch = getopt(argc, argv, "i:t:r:m:n:c:w:h:f:g:b:")) != -1) {
+        switch (ch) {
+        case 'i' : {
+            test.trace_file = optarg;
+        } break;
+        case 't' : {
+            test.type = (MppCodingType)atoi(optarg);
+        } break;
+        case 'r' : {
+            test.rc_name = optarg;
+        } break;
+        case 'm' : {
+            for (i = 0; i < MPP_ARRAY_ELEMS(rc_mode_name); i++)
+                if (!strcmp(optarg, rc_mode_name[i]))
+                    test.mode = (RcMode)i;
+        } break;
+        case 'n' : {
+            test.frames = atoi(optarg);
+        } break;
+        case 'c' : {
+            test.channels = atoi(optarg);
+        } break;
+        case 'w' : {
+            test.width = atoi(optarg);
+        } break;
+        case 'h' : {
+            test.height = atoi(optarg);
+        } break;
+        case 'f' : {
+            test.fps = atoi(optarg);
+        } break;
+        case 'g' : {
+            test.gop = atoi(optarg);
+        } break;
+        case 'b' : {
+            test.bps = atoi(optarg);
+        } break;
+        default : {
+            sim_test_help();
+            return -1;
+        } break;
+        }
+    }
+
+    if (test.frames <= 0 || test.channels <= 0 || test.width <= 0 ||
+        test.height <= 0 || test.fps <= 0 || test.gop < 0 || test.bps <= 0) {
+        sim_test_help();
+        return -1;
+    }
+
+    if (test.trace_file) {
+        ret = rc_sim_trace_load(test.trace_file, &trace, &count);
+    } else {
+        RcSimGenCfg gen;
+
+        gen.width = test.width;
+        gen.height = test.height;
+        gen.igop = test.gop;
+        /* inter frame is about the average frame size at qp_base */
+        gen.p_bits = test.bps / test.fps;
+        gen.i_scale = 6;
+        gen.qp_base = 30;
+        gen.scene_len = test.fps * 10;
+        gen.seed = 1;
+
+        count = test.frames;
+        ret = rc_sim_trace_gen(&gen, &trace, count);
+    }
+
+    if (ret || !count) {
+        mpp_err("failed to get trace\n");
+        MPP_FREE(trace);
+        return -1;
+    }
+
+    mpp_log("rc sim %d frames %dx%d fps %d gop %d bps %d channels %d\n",
+            count, test.width, test.height, test.fps, test.gop, test.bps,
+            test.channels);
+
+    for (i = 0; i < MPP_ARRAY_ELEMS(rc_names); i++) {
+        if (test.rc_name && strcmp(test.rc_name, rc_names[i]))
+            continue;
+
+        for (j = 0; j < MPP_ARRAY_ELEMS(rc_modes); j++) {
+            if (test.mode != RC_MODE_BUTT && test.mode != rc_modes[j])
+                continue;
+
+            if (sim_test_run(&test, trace, count, rc_names[i], rc_modes[j]))
+                ret = MPP_NOK;
+            if (sim_test_pipe(&test, trace, count, rc_names[i], rc_modes[j]))
+                ret = MPP_NOK;
+        }
+    }
+
+    /* other rc name is run with the selected mode only */
+    if (test.rc_name && strcmp(test.rc_name, rc_names[0]) && strcmp(test.rc_name, rc_names[1]))
+        ret = sim_test_run(&test, trace, count, test.rc_name,
+                           (test.mode != RC_MODE_BUTT) ? test.mode : RC_CBR);
+
+    MPP_FREE(trace);
+
+    mpp_log("rc_sim_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "hal_ps_cache"
+
+#include <string.h>
+
+#include "mpp_mem.h"
+#include "mpp_common.h"
+
+#include "hal_ps_cache.h"
+
+/* FNV-1a on 32bit words, key size is aligned to 4 bytes by caller struct */
+static RK_U32 hal_ps_hash(const void *key, RK_U32 size)
+{
+    const RK_U8 *p = (const RK_U8 *)key;
+    RK_U32 hash = 0x811c9dc5;
+    RK_U32 i;
+
+    for (i = 0; i + 4 <= size; i += 4) {
+        RK_U32 val;
+
+        memcpy(&val, p + i, 4);
+        hash = (hash ^ val) * 0x01000193;
+    }
+
+    for (; i < size; i++)
+        hash = (hash ^ p[i]) * 0x01000193;
+
+    return hash;
+}
+
+RK_U32 hal_ps_cache_match(HalPsCache *cache, RK_S32 id, const void *key, RK_U32 size)
+{
+    RK_U32 hash = hal_ps_hash(key, size);
+
+    if (cache->key && cache->id == id && cache->size == size &&
+        cache->hash == hash && !memcmp(cache->key, key, size))
+        return 1;
+
+    if (size > cache->max_size) {
+        MPP_FREE(cache->key);
+        cache->key = mpp_malloc_size(void, size);
+        cache->max_size = cache->key ? size : 0;
+    }
+
+    if (cache->key) {
+        memcpy(cache->key, key, size);
+        cache->id = id;
+        cache->hash = hash;
+        cache->size = size;
+    }
+
+    return 0;
+}
+
+void hal_ps_cache_reset(HalPsCache *cache)
+{
+    cache->id = -1;
+    cache->size = 0;
+}
+
+void hal_ps_cache_deinit(HalPsCache *cache)
+{
+    MPP_FREE(cache->key);
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HAL_PS_CACHE_H__
+#define __HAL_PS_CACHE_H__
+
+#include "rk_type.h"
+
+/*
+ * Parameter set packet cache
+ *
+ * Decoder hal packs the sps / pps / scaling list syntax into packet buffers
+ * for hardware on every frame while the syntax only changes with the stream.
+ * One cache entry is attached to one packet buffer and records the key of
+ * the content currently in the buffer. The key is the parameter set id plus
+ * the syntax elements used by the packet. It is matched by id and content
+ * hash first and then by full compare.
+ *
+ * hal_ps_cache_match returns 1 when the buffer already holds the packet for
+ * the key. Otherwise the new key is recorded and 0 is returned, then the
+ * caller must rebuild the packet into the buffer.
+ */
+typedef struct HalPsCache_t {
+    RK_S32      id;
+    RK_U32      hash;
+    RK_U32      size;
+    RK_U32      max_size;
+    void        *key;
+} HalPsCache;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+RK_U32 hal_ps_cache_match(HalPsCache *cache, RK_S32 id, const void *key, RK_U32 size);
+/* drop the recorded key when buffer content is changed outside the cache */
+void hal_ps_cache_reset(HalPsCache *cache);
+void hal_ps_cache_deinit(HalPsCache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_PS_CACHE_H__ */
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "hal_table"
+
+#include <string.h>
+#include <pthread.h>
+
+#include "mpp_env.h"
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_list.h"
+#include "mpp_common.h"
+
+#include "hal_table.h"
+
+#define HAL_TABLE_DBG_INFO              (0x00000001)
+
+#define hal_table_dbg(flag, fmt, ...)   _mpp_dbg(hal_table_debug, flag, fmt, ## __VA_ARGS__)
+#define hal_table_dbg_f(flag, fmt, ...) _mpp_dbg_f(hal_table_debug, flag, fmt, ## __VA_ARGS__)
+
+#define hal_table_dbg_info(fmt, ...)    hal_table_dbg_f(HAL_TABLE_DBG_INFO, fmt, ## __VA_ARGS__)
+
+typedef struct HalTableNode_t {
+    struct list_head    list;
+
+    MppCtxType          type;
+    MppCodingType       coding;
+    RK_S32              index;
+    size_t              size;
+
+    MppBuffer           buf;
+    RK_S32              ref;
+} HalTableNode;
+
+static RK_U32 hal_table_debug = 0;
+static pthread_mutex_t hal_table_lock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(hal_table_list);
+static MppBufferGroup hal_table_group = NULL;
+
+static HalTableNode *hal_table_find(MppCtxType type, MppCodingType coding, RK_S32 index)
+{
+    HalTableNode *pos, *n;
+
+    list_for_each_entry_safe(pos, n, &hal_table_list, HalTableNode, list) {
+        if (pos->type == type && pos->coding == coding && pos->index == index)
+            return pos;
+    }
+
+    return NULL;
+}
+
+static MPP_RET hal_table_get_impl(MppBuffer *buf, MppCtxType type, MppCodingType coding,
+                                  RK_S32 index, size_t size, HalTableGen gen,
+                                  const void *src)
+{
+    HalTableNode *node = NULL;
+    MPP_RET ret = MPP_OK;
+    void *ptr = NULL;
+
+    if (NULL == buf || !size) {
+        mpp_err_f("invalid buf %p size %d\n", buf, size);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    *buf = NULL;
+
+    pthread_mutex_lock(&hal_table_lock);
+
+    node = hal_table_find(type, coding, index);
+    if (node) {
+        if (node->size < size) {
+            mpp_err_f("table %d:%x:%d size %d mismatch require %d\n",
+                      type, coding, index, node->size, size);
+            ret = MPP_ERR_VALUE;
+            goto DONE;
+        }
+
+        node->ref++;
+        *buf = node->buf;
+        hal_table_dbg_info("share table %d:%x:%d ref %d\n", type, coding, index, node->ref);
+        goto DONE;
+    }
+
+    if (NULL == hal_table_group) {
+        mpp_env_get_u32("hal_table_debug", &hal_table_debug, 0);
+
+        ret = mpp_buffer_group_get_internal(&hal_table_group, MPP_BUFFER_TYPE_ION);
+        if (ret) {
+            mpp_err_f("get buffer group failed ret %d\n", ret);
+            goto DONE;
+        }
+    }
+
+    node = mpp_calloc(HalTableNode, 1);
+    if (NULL == node) {
+        ret = MPP_ERR_MALLOC;
+        goto DONE;
+    }
+
+    ret = mpp_buffer_get(hal_table_group, &node->buf, size);
+    if (ret) {
+        mpp_err_f("get table %d:%x:%d buffer size %d failed\n", type, coding, index, size);
+        MPP_FREE(node);
+        goto DONE;
+    }
+
+    ptr = mpp_buffer_get_ptr(node->buf);
+    if (src)
+        memcpy(ptr, src, size);
+    else if (gen)
+        gen(ptr, size, index);
+    else
+        memset(ptr, 0, size);
+
+    INIT_LIST_HEAD(&node->list);
+    node->type = type;
+    node->coding = coding;
+    node->index = index;
+    node->size = size;
+    node->ref = 1;
+    list_add_tail(&node->list, &hal_table_list);
+
+    *buf = node->buf;
+    hal_table_dbg_info("create table %d:%x:%d size %d\n", type, coding, index, size);
+
+DONE:
+    pthread_mutex_unlock(&hal_table_lock);
+    return ret;
+}
+
+MPP_RET hal_table_get(MppBuffer *buf, MppCtxType type, MppCodingType coding,
+                      RK_S32 index, size_t size, HalTableGen gen)
+{
+    return hal_table_get_impl(buf, type, coding, index, size, gen, NULL);
+}
+
+MPP_RET hal_table_get_const(MppBuffer *buf, MppCtxType type, MppCodingType coding,
+                            RK_S32 index, const void *src, size_t size)
+{
+    return hal_table_get_impl(buf, type, coding, index, size, NULL, src);
+}
+
+MPP_RET hal_table_put(MppBuffer buf)
+{
+    HalTableNode *pos, *n;
+    MPP_RET ret = MPP_NOK;
+
+    if (NULL == buf)
+        return MPP_OK;
+
+    pthread_mutex_lock(&hal_table_lock);
+
+    list_for_each_entry_safe(pos, n, &hal_table_list, HalTableNode, list) {
+        if (pos->buf != buf)
+            continue;
+
+        ret = MPP_OK;
+        if (--pos->ref > 0)
+            break;
+
+        hal_table_dbg_info("release table %d:%x:%d\n", pos->type, pos->coding, pos->index);
+
+        list_del_init(&pos->list);
+        mpp_buffer_put(pos->buf);
+        MPP_FREE(pos);
+        break;
+    }
+
+    if (ret)
+        mpp_err_f("invalid table buffer %p\n", buf);
+
+    if (list_empty(&hal_table_list) && hal_table_group) {
+        mpp_buffer_group_put(hal_table_group);
+        hal_table_group = NULL;
+    }
+
+    pthread_mutex_unlock(&hal_table_lock);
+    return ret;
+}
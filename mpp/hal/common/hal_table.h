@@ -0,0 +1,52 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HAL_TABLE_H__
+#define __HAL_TABLE_H__
+
+#include "rk_type.h"
+#include "mpp_buffer.h"
+
+/*
+ * Shared read-only hardware table buffer
+ *
+ * Constant tables like the cabac context init table are the same for all the
+ * hal instances of one codec. The table buffer is keyed by (ctx type, coding,
+ * index) and is created and filled once when the first instance gets it. The
+ * following instances share the same buffer by reference count and the buffer
+ * is released when the last instance puts it.
+ *
+ * The table content is generated by the gen function of the first getter
+ * directly into the buffer. Hardware must only read the table.
+ */
+typedef void (*HalTableGen)(void *dst, size_t size, RK_S32 index);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MPP_RET hal_table_get(MppBuffer *buf, MppCtxType type, MppCodingType coding,
+                      RK_S32 index, size_t size, HalTableGen gen);
+/* copy constant table from src instead of generating */
+MPP_RET hal_table_get_const(MppBuffer *buf, MppCtxType type, MppCodingType coding,
+                            RK_S32 index, const void *src, size_t size);
+MPP_RET hal_table_put(MppBuffer buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_TABLE_H__ */
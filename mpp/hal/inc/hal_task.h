@@ -36,6 +36,8 @@ typedef struct HalDecVprocTask_t {
     HalDecVprocTaskFlag     flags;
 
     RK_S32                  input;
+    // hand-off time for queue wait statistics
+    RK_S64                  time;
 } HalDecVprocTask;
 
 typedef struct HalTask_u {
@@ -28,6 +28,8 @@ typedef struct MppEncHalCfg_t {
     // output for enc_impl
     HalWorkMode     work_mode;
     MppDeviceId     device_id;
+    // max hardware task count which can be started before waiting
+    RK_S32          task_count;
 } MppEncHalCfg;
 
 typedef struct MppEncHalApi_t {
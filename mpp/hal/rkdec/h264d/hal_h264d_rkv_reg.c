@@ -29,6 +29,7 @@
 
 #include "mpp_device.h"
 
+#include "hal_ps_cache.h"
 #include "hal_h264d_global.h"
 #include "hal_h264d_rkv_reg.h"
 
@@ -47,6 +48,9 @@ typedef struct h264d_rkv_buf_t {
     MppBuffer rps;
     MppBuffer sclst;
     H264dRkvRegs_t *regs;
+    /* packet content already in spspps / sclst buffer */
+    HalPsCache spspps_cache;
+    HalPsCache sclst_cache;
 } H264dRkvBuf_t;
 
 typedef struct h264d_rkv_reg_ctx_t {
@@ -62,6 +66,8 @@ typedef struct h264d_rkv_reg_ctx_t {
     MppBuffer rps_buf;
     MppBuffer sclst_buf;
     H264dRkvRegs_t *regs;
+    HalPsCache *spspps_cache;
+    HalPsCache *sclst_cache;
 } H264dRkvRegCtx_t;
 
 const RK_U32 rkv_cabac_table[928] = {
@@ -570,6 +576,8 @@ MPP_RET rkv_h264d_init(void *hal, MppHalCfg *cfg)
         reg_ctx->spspps_buf = reg_ctx->reg_buf[0].spspps;
         reg_ctx->rps_buf = reg_ctx->reg_buf[0].rps;
         reg_ctx->sclst_buf = reg_ctx->reg_buf[0].sclst;
+        reg_ctx->spspps_cache = &reg_ctx->reg_buf[0].spspps_cache;
+        reg_ctx->sclst_cache = &reg_ctx->reg_buf[0].sclst_cache;
     }
 
     //!< copy cabac table bytes
@@ -607,6 +615,8 @@ MPP_RET rkv_h264d_deinit(void *hal)
         mpp_buffer_put(reg_ctx->reg_buf[i].spspps);
         mpp_buffer_put(reg_ctx->reg_buf[i].rps);
         mpp_buffer_put(reg_ctx->reg_buf[i].sclst);
+        hal_ps_cache_deinit(&reg_ctx->reg_buf[i].spspps_cache);
+        hal_ps_cache_deinit(&reg_ctx->reg_buf[i].sclst_cache);
     }
     mpp_buffer_put(reg_ctx->cabac_buf);
     mpp_buffer_put(reg_ctx->errinfo_buf);
@@ -642,23 +652,30 @@ MPP_RET rkv_h264d_gen_regs(void *hal, HalTaskInfo *task)
                 reg_ctx->rps_buf = reg_ctx->reg_buf[i].rps;
                 reg_ctx->sclst_buf = reg_ctx->reg_buf[i].sclst;
                 reg_ctx->regs = reg_ctx->reg_buf[i].regs;
+                reg_ctx->spspps_cache = &reg_ctx->reg_buf[i].spspps_cache;
+                reg_ctx->sclst_cache = &reg_ctx->reg_buf[i].sclst_cache;
                 reg_ctx->reg_buf[i].valid = 1;
                 break;
             }
         }
     }
 
+    /*
+     * spspps packet carries the per frame dpb flags, so it is always packed
+     * and the 256 copies are only refreshed when the packet is changed.
+     */
     prepare_spspps(p_hal, (RK_U64 *)&reg_ctx->spspps, sizeof(reg_ctx->spspps));
     prepare_framerps(p_hal, (RK_U64 *)&reg_ctx->rps, sizeof(reg_ctx->rps));
-    prepare_scanlist(p_hal, (RK_U64 *)&reg_ctx->sclst, sizeof(reg_ctx->sclst));
     set_registers(p_hal, reg_ctx->regs, task);
 
     //!< copy datas
-    RK_U32 i = 0;
-    for (i = 0; i < 256; i++) {
-        mpp_buffer_write(reg_ctx->spspps_buf,
-                         (sizeof(reg_ctx->spspps) * i), (void *)reg_ctx->spspps,
-                         sizeof(reg_ctx->spspps));
+    if (!hal_ps_cache_match(reg_ctx->spspps_cache, 0, reg_ctx->spspps,
+                            sizeof(reg_ctx->spspps))) {
+        RK_U8 *ptr = (RK_U8 *)mpp_buffer_get_ptr(reg_ctx->spspps_buf);
+        RK_U32 i = 0;
+
+        for (i = 0; i < 256; i++, ptr += sizeof(reg_ctx->spspps))
+            memcpy(ptr, reg_ctx->spspps, sizeof(reg_ctx->spspps));
     }
     reg_ctx->regs->sw42.pps_base = mpp_buffer_get_fd(reg_ctx->spspps_buf);
 
@@ -666,8 +683,13 @@ MPP_RET rkv_h264d_gen_regs(void *hal, HalTaskInfo *task)
                      (void *)reg_ctx->rps, sizeof(reg_ctx->rps));
     reg_ctx->regs->sw43.rps_base = mpp_buffer_get_fd(reg_ctx->rps_buf);
 
-    mpp_buffer_write(reg_ctx->sclst_buf, 0,
-                     (void *)reg_ctx->sclst, sizeof(reg_ctx->sclst));
+    if (!hal_ps_cache_match(reg_ctx->sclst_cache,
+                            p_hal->pp->scaleing_list_enable_flag,
+                            p_hal->qm, sizeof(*p_hal->qm))) {
+        prepare_scanlist(p_hal, (RK_U64 *)&reg_ctx->sclst, sizeof(reg_ctx->sclst));
+        mpp_buffer_write(reg_ctx->sclst_buf, 0,
+                         (void *)reg_ctx->sclst, sizeof(reg_ctx->sclst));
+    }
     reg_ctx->regs->sw75.errorinfo_base = mpp_buffer_get_fd(reg_ctx->errinfo_buf);
 
 __RETURN:
@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "mpp_env.h"
 #include "mpp_log.h"
@@ -38,6 +39,8 @@
 
 #include "mpp_device.h"
 #include "cabac.h"
+#include "hal_table.h"
+#include "hal_ps_cache.h"
 #include "hal_h265d_reg.h"
 #include "hal_h265d_api.h"
 #include "h265d_syntax.h"
@@ -55,6 +58,9 @@ typedef struct h265d_reg_buf {
     MppBuffer pps_data;
     MppBuffer rps_data;
     void*     hw_regs;
+    /* parameter set content in pps_data / scaling_list_data and rps_data */
+    HalPsCache pps_cache;
+    HalPsCache rps_cache;
 } h265d_reg_buf_t;
 typedef struct h265d_reg_context {
     MppBufSlots     slots;
@@ -65,6 +71,8 @@ typedef struct h265d_reg_context {
     MppBuffer       pps_data;
     MppBuffer       rps_data;
     void*           hw_regs;
+    HalPsCache      *pps_cache;
+    HalPsCache      *rps_cache;
     h265d_reg_buf_t g_buf[MAX_GEN_REG];
     RK_U32          fast_mode;
     IOInterruptCB   int_cb;
@@ -89,6 +97,43 @@ typedef struct ScalingFactor_Model {
     RK_U8 reserverd[4];           /*16Bytes align*/
 } scalingFactor_t;
 
+/*
+ * pps packet cache key, the syntax used by pps and scaling list packet
+ * sps part  - PicWidthInMinCbsY to wFormatAndSequenceInfoFlags
+ * sps ext   - sps_max_dec_pic_buffering_minus1 to init_qp_minus26
+ * pps part  - pps_cb_qp_offset to log2_parallel_merge_level_minus2
+ * IrapPicFlag / IdrPicFlag / IntraPicFlag (bit 16 ~ 18) change by picture
+ * and are masked out from the pps flags.
+ */
+#define H265D_KEY_SPS_SIZE      offsetof(DXVA_PicParams_HEVC, CurrPic)
+#define H265D_KEY_SPS_EXT_START offsetof(DXVA_PicParams_HEVC, sps_max_dec_pic_buffering_minus1)
+#define H265D_KEY_SPS_EXT_SIZE  (offsetof(DXVA_PicParams_HEVC, ucNumDeltaPocsOfRefRpsIdx) - \
+                                 H265D_KEY_SPS_EXT_START)
+#define H265D_KEY_PPS_START     offsetof(DXVA_PicParams_HEVC, pps_cb_qp_offset)
+#define H265D_KEY_PPS_SIZE      (offsetof(DXVA_PicParams_HEVC, CurrPicOrderCntVal) - \
+                                 H265D_KEY_PPS_START)
+#define H265D_PIC_FLAGS_MASK    (~(7 << 16))
+
+typedef struct h265d_pps_key {
+    RK_U8               sps[H265D_KEY_SPS_SIZE];
+    RK_U8               sps_ext[H265D_KEY_SPS_EXT_SIZE];
+    RK_U32              tool_flags;
+    RK_U32              pps_flags;
+    RK_U8               pps[H265D_KEY_PPS_SIZE];
+    RK_U32              vps_id;
+    RK_U32              sps_id;
+    RK_U32              scaling_list_data_present_flag;
+    RK_S32              scaling_fd;
+    DXVA_Qmatrix_HEVC   qm;
+} h265d_pps_key_t;
+
+/* hardware rps packet cache key, the rps sets in sps */
+typedef struct h265d_rps_key {
+    RK_U32              num_short_term_ref_pic_sets;
+    Short_SPS_RPS_HEVC  sps_st_rps[64];
+    LT_SPS_RPS_HEVC     sps_lt_rps[32];
+} h265d_rps_key_t;
+
 static RK_U8 hal_hevc_diag_scan4x4_x[16] = {
     0, 0, 1, 0,
     1, 2, 0, 1,
@@ -330,6 +375,8 @@ static MPP_RET hal_h265d_alloc_res(void *hal)
             return ret;
         }
 
+        reg_cxt->pps_cache = &reg_cxt->g_buf[0].pps_cache;
+        reg_cxt->rps_cache = &reg_cxt->g_buf[0].rps_cache;
     }
     return MPP_OK;
 }
@@ -339,6 +386,12 @@ static MPP_RET hal_h265d_release_res(void *hal)
     RK_S32 ret = 0;
     h265d_reg_context_t *reg_cxt = ( h265d_reg_context_t *)hal;
     RK_S32 i = 0;
+
+    for (i = 0; i < MAX_GEN_REG; i++) {
+        hal_ps_cache_deinit(&reg_cxt->g_buf[i].pps_cache);
+        hal_ps_cache_deinit(&reg_cxt->g_buf[i].rps_cache);
+    }
+
     if (reg_cxt->fast_mode) {
         for (i = 0; i < MAX_GEN_REG; i++) {
             if (reg_cxt->g_buf[i].scaling_list_data) {
@@ -463,18 +516,14 @@ MPP_RET hal_h265d_init(void *hal, MppHalCfg *cfg)
         }
     }
 
-    ret = mpp_buffer_get(reg_cxt->group, &reg_cxt->cabac_table_data, sizeof(cabac_table));
+    /* cabac table is constant and shared by all decoder instances */
+    ret = hal_table_get_const(&reg_cxt->cabac_table_data, MPP_CTX_DEC, MPP_VIDEO_CodingHEVC,
+                              0, cabac_table, sizeof(cabac_table));
     if (ret) {
         mpp_err("h265d cabac_table get buffer failed\n");
         return ret;
     }
 
-    ret = mpp_buffer_write(reg_cxt->cabac_table_data, 0, (void*)cabac_table, sizeof(cabac_table));
-    if (ret) {
-        mpp_err("h265d write cabac_table data failed\n");
-        return ret;
-    }
-
     ret = hal_h265d_alloc_res(hal);
     if (ret) {
         mpp_err("hal_h265d_alloc_res failed\n");
@@ -501,7 +550,7 @@ MPP_RET hal_h265d_deinit(void *hal)
             mpp_err("mpp_device_deinit failed. ret: %d\n", ret);
     }
 
-    ret = mpp_buffer_put(reg_cxt->cabac_table_data);
+    ret = hal_table_put(reg_cxt->cabac_table_data);
     if (ret) {
         mpp_err("h265d cabac_table free buffer failed\n");
         return ret;
@@ -1153,6 +1202,7 @@ static void hal_h265d_output_scalinglist_packet(void *hal, void *ptr, void *dxva
                 sl.sl_dc[1][i] =  dxva_cxt->qm.ucScalingListDCCoefSizeID3[i];
         }
         hal_record_scaling_list((scalingFactor_t *)reg_cxt->scaling_rk, &sl);
+        memcpy(reg_cxt->scaling_qm, &dxva_cxt->qm, sizeof(DXVA_Qmatrix_HEVC));
     }
     memcpy(ptr, reg_cxt->scaling_rk, sizeof(scalingFactor_t));
 }
@@ -1619,53 +1669,117 @@ static RK_S32 hal_h265d_output_pps_packet(void *hal, void *dxva)
     return 0;
 }
 
+/*
+ * Cut the slice header extension out of the slices in one forward pass.
+ * The kept bytes are moved down once and the slice location / size are
+ * updated for the compacted stream, so the cost is linear in stream size
+ * instead of one tail move per slice.
+ */
 static void update_stream_buffer(MppBuffer streambuf, HalTaskInfo *syn)
 {
     h265d_dxva2_picture_context_t *dxva_cxt =
         (h265d_dxva2_picture_context_t *)syn->dec.syntax.data;
     RK_U8 *ptr = (RK_U8*)mpp_buffer_get_ptr(streambuf);
-    RK_U8 bit_left = 0;
-    RK_U16 start_byte, end_byte, i = 0;
     RK_U32 stream_size = dxva_cxt->bitstream_size;
-    RK_U8 *buf = NULL;
-    RK_U8 *temp = NULL;
+    RK_U32 rd_pos = 0;
+    RK_U32 wr_pos = 0;
+    RK_U32 cut_size = 0;
+    RK_U32 i;
 
     for (i = 0; i < dxva_cxt->slice_count; i++) {
-        if (dxva_cxt->slice_cut_param[i].is_enable) {
-
-            bit_left = 8 - (dxva_cxt->slice_cut_param[i].start_bit & 0x7);
-            start_byte = dxva_cxt->slice_cut_param[i].start_bit >> 3;
-            end_byte = (dxva_cxt->slice_cut_param[i].end_bit + 7) >> 3;
-            buf = ptr + dxva_cxt->slice_short[i].BSNALunitDataLocation;
-            stream_size -= dxva_cxt->slice_short[i].BSNALunitDataLocation;
-            temp = buf + start_byte;
-
-            h265h_dbg(H265H_DBG_FUNCTION, "start bit %d start byte[%d] 0x%x end bit %d end byte[%d] 0x%x\n",
-                      dxva_cxt->slice_cut_param[i].start_bit, start_byte, buf[start_byte],
-                      dxva_cxt->slice_cut_param[i].end_bit, end_byte, buf[end_byte]);
-            if (bit_left < 8) {
-                *temp = (*temp >> bit_left) << bit_left;
-                *temp |= 1 << (bit_left - 1);
-            } else {
-                *temp = 0x80;
-            }
-            if ((dxva_cxt->slice_cut_param[i].end_bit & 0x7) == 0 && buf[end_byte] == 0x80)
-                end_byte += 1;
+        DXVA_Slice_HEVC_Short *slice = &dxva_cxt->slice_short[i];
+        DXVA_Slice_HEVC_Cut_Param *cut = &dxva_cxt->slice_cut_param[i];
+        RK_U32 location = slice->BSNALunitDataLocation;
+        RK_U32 start_byte, end_byte, bit_left, keep_end;
+        RK_U8 *buf = ptr + location;
 
-            h265h_dbg(H265H_DBG_FUNCTION, "i %d location %d count %d SliceBytesInBuffer %d bitstream_size %d\n",
-                      i, dxva_cxt->slice_short[i].BSNALunitDataLocation, dxva_cxt->slice_count,
-                      dxva_cxt->slice_short[i].SliceBytesInBuffer, dxva_cxt->bitstream_size);
+        slice->BSNALunitDataLocation = location - cut_size;
 
-            memcpy(buf + start_byte + 1, buf + end_byte, stream_size - end_byte);
+        if (!cut->is_enable)
+            continue;
 
-            stream_size -= dxva_cxt->slice_short[i].SliceBytesInBuffer;
-            dxva_cxt->slice_short[i].SliceBytesInBuffer -= (end_byte - start_byte - 1);
-            dxva_cxt->bitstream_size -= (end_byte - start_byte - 1);
-            ptr += dxva_cxt->slice_short[i].SliceBytesInBuffer;
+        bit_left = 8 - (cut->start_bit & 0x7);
+        start_byte = cut->start_bit >> 3;
+        end_byte = (cut->end_bit + 7) >> 3;
+
+        h265h_dbg(H265H_DBG_FUNCTION, "start bit %d start byte[%d] 0x%x end bit %d end byte[%d] 0x%x\n",
+                  cut->start_bit, start_byte, buf[start_byte],
+                  cut->end_bit, end_byte, buf[end_byte]);
+
+        /* the byte is not moved yet, wr_pos never passes rd_pos */
+        if (bit_left < 8) {
+            buf[start_byte] = (buf[start_byte] >> bit_left) << bit_left;
+            buf[start_byte] |= 1 << (bit_left - 1);
+        } else {
+            buf[start_byte] = 0x80;
         }
+        if ((cut->end_bit & 0x7) == 0 && buf[end_byte] == 0x80)
+            end_byte += 1;
+
+        keep_end = location + start_byte + 1;
+        if (end_byte <= start_byte + 1 || keep_end < rd_pos ||
+            location + end_byte > stream_size)
+            continue;
+
+        h265h_dbg(H265H_DBG_FUNCTION, "i %d location %d count %d SliceBytesInBuffer %d bitstream_size %d\n",
+                  i, location, dxva_cxt->slice_count,
+                  slice->SliceBytesInBuffer, dxva_cxt->bitstream_size);
+
+        if (wr_pos != rd_pos)
+            memmove(ptr + wr_pos, ptr + rd_pos, keep_end - rd_pos);
+        wr_pos += keep_end - rd_pos;
+        rd_pos = location + end_byte;
+
+        slice->SliceBytesInBuffer -= end_byte - start_byte - 1;
+        cut_size += end_byte - start_byte - 1;
     }
+
+    if (wr_pos != rd_pos)
+        memmove(ptr + wr_pos, ptr + rd_pos, stream_size - rd_pos);
+
+    dxva_cxt->bitstream_size -= cut_size;
+}
+
+/* return 1 when pps and scaling list buffer already hold current syntax */
+static RK_U32 hal_h265d_pps_cache_match(h265d_reg_context_t *reg_cxt,
+                                        h265d_dxva2_picture_context_t *dxva_cxt)
+{
+    DXVA_PicParams_HEVC *pp = &dxva_cxt->pp;
+    RK_U8 *src = (RK_U8 *)pp;
+    h265d_pps_key_t key;
+
+    /* clear padding for content compare */
+    memset(&key, 0, sizeof(key));
+    memcpy(key.sps, src, H265D_KEY_SPS_SIZE);
+    memcpy(key.sps_ext, src + H265D_KEY_SPS_EXT_START, H265D_KEY_SPS_EXT_SIZE);
+    key.tool_flags = pp->dwCodingParamToolFlags;
+    key.pps_flags = pp->dwCodingSettingPicturePropertyFlags & H265D_PIC_FLAGS_MASK;
+    memcpy(key.pps, src + H265D_KEY_PPS_START, H265D_KEY_PPS_SIZE);
+    key.vps_id = pp->vps_id;
+    key.sps_id = pp->sps_id;
+    key.scaling_list_data_present_flag = pp->scaling_list_data_present_flag;
+    key.scaling_fd = mpp_buffer_get_fd(reg_cxt->scaling_list_data);
+    memcpy(&key.qm, &dxva_cxt->qm, sizeof(key.qm));
+
+    return hal_ps_cache_match(reg_cxt->pps_cache, pp->pps_id, &key, sizeof(key));
 }
 
+#ifdef HW_RPS
+static RK_U32 hal_h265d_rps_cache_match(h265d_reg_context_t *reg_cxt,
+                                        h265d_dxva2_picture_context_t *dxva_cxt)
+{
+    DXVA_PicParams_HEVC *pp = &dxva_cxt->pp;
+    h265d_rps_key_t key;
+
+    memset(&key, 0, sizeof(key));
+    key.num_short_term_ref_pic_sets = pp->num_short_term_ref_pic_sets;
+    memcpy(key.sps_st_rps, pp->sps_st_rps, sizeof(key.sps_st_rps));
+    memcpy(key.sps_lt_rps, pp->sps_lt_rps, sizeof(key.sps_lt_rps));
+
+    return hal_ps_cache_match(reg_cxt->rps_cache, pp->sps_id, &key, sizeof(key));
+}
+#endif
+
 MPP_RET hal_h265d_gen_regs(void *hal,  HalTaskInfo *syn)
 {
     RK_S32 i = 0;
@@ -1702,6 +1816,8 @@ MPP_RET hal_h265d_gen_regs(void *hal,  HalTaskInfo *syn)
                     reg_cxt->g_buf[i].scaling_list_data;
                 reg_cxt->pps_data = reg_cxt->g_buf[i].pps_data;
                 reg_cxt->hw_regs = reg_cxt->g_buf[i].hw_regs;
+                reg_cxt->pps_cache = &reg_cxt->g_buf[i].pps_cache;
+                reg_cxt->rps_cache = &reg_cxt->g_buf[i].rps_cache;
                 reg_cxt->g_buf[i].use_flag = 1;
                 break;
             }
@@ -1724,9 +1840,10 @@ MPP_RET hal_h265d_gen_regs(void *hal,  HalTaskInfo *syn)
         return MPP_ERR_NULL_PTR;
     }
 
-    /* output pps */
-
-    if (reg_cxt->is_v345) {
+    /* output pps when the parameter sets in pps buffer are changed */
+    if (hal_h265d_pps_cache_match(reg_cxt, dxva_cxt)) {
+        h265h_dbg(H265H_DBG_PPS, "reuse pps %d packet\n", dxva_cxt->pp.pps_id);
+    } else if (reg_cxt->is_v345) {
         hal_h265d_v345_output_pps_packet(hal, syn->dec.syntax.data);
     } else {
         hal_h265d_output_pps_packet(hal, syn->dec.syntax.data);
@@ -1785,7 +1902,9 @@ MPP_RET hal_h265d_gen_regs(void *hal,  HalTaskInfo *syn)
 #ifdef HW_RPS
         hw_regs->sw_sysctrl.sw_wait_reset_en = 1;
         hw_regs->v345_reg_ends.reg064_mvc0.refp_layer_same_with_cur = 0xffff;
-        hal_h265d_slice_hw_rps(syn->dec.syntax.data, rps_ptr);
+        /* hardware rps only depends on sps */
+        if (!hal_h265d_rps_cache_match(reg_cxt, dxva_cxt))
+            hal_h265d_slice_hw_rps(syn->dec.syntax.data, rps_ptr);
 #else
         hw_regs->sw_sysctrl.sw_h26x_rps_mode = 1;
         hal_h265d_slice_output_rps(syn->dec.syntax.data, rps_ptr);
@@ -16,6 +16,7 @@
 
 #define MODULE_TAG  "vepu541_common"
 
+#include <stdint.h>
 #include <string.h>
 
 #include "mpp_log.h"
@@ -309,6 +310,39 @@ RK_S32 vepu541_get_roi_buf_size(RK_S32 w, RK_S32 h)
     return buf_size;
 }
 
+static MPP_RET vepu541_check_roi(MppEncROICfg *roi, RK_S32 w, RK_S32 h)
+{
+    MppEncROIRegion *region = roi->regions;
+    MPP_RET ret = MPP_OK;
+    RK_S32 i;
+
+    for (i = 0; i < (RK_S32)roi->number; i++, region++) {
+        if (region->x + region->w > w || region->y + region->h > h)
+            ret = MPP_NOK;
+
+        if (region->intra > 1 || region->qp_area_idx >= VEPU541_MAX_ROI_NUM ||
+            region->area_map_en > 1 || region->abs_qp_en > 1)
+            ret = MPP_NOK;
+
+        if ((region->abs_qp_en && region->quality > 51) ||
+            (!region->abs_qp_en && (region->quality > 51 || region->quality < -51)))
+            ret = MPP_NOK;
+
+        if (ret) {
+            mpp_err_f("region %d invalid param:\n", i);
+            mpp_err_f("position [%d:%d:%d:%d] vs [%d:%d]\n",
+                      region->x, region->y, region->w, region->h, w, h);
+            mpp_err_f("force intra %d qp area index %d\n",
+                      region->intra, region->qp_area_idx);
+            mpp_err_f("abs qp mode %d value %d\n",
+                      region->abs_qp_en, region->quality);
+            break;
+        }
+    }
+
+    return ret;
+}
+
 MPP_RET vepu541_set_roi(void *buf, MppEncROICfg *roi, RK_S32 w, RK_S32 h)
 {
     MppEncROIRegion *region = roi->regions;
@@ -348,32 +382,10 @@ MPP_RET vepu541_set_roi(void *buf, MppEncROICfg *roi, RK_S32 w, RK_S32 h)
     }
 
     /* check region config */
-    ret = MPP_OK;
-    for (i = 0; i < (RK_S32)roi->number; i++, region++) {
-        if (region->x + region->w > w || region->y + region->h > h)
-            ret = MPP_NOK;
-
-        if (region->intra > 1 || region->qp_area_idx >= VEPU541_MAX_ROI_NUM ||
-            region->area_map_en > 1 || region->abs_qp_en > 1)
-            ret = MPP_NOK;
-
-        if ((region->abs_qp_en && region->quality > 51) ||
-            (!region->abs_qp_en && (region->quality > 51 || region->quality < -51)))
-            ret = MPP_NOK;
-
-        if (ret) {
-            mpp_err_f("region %d invalid param:\n", i);
-            mpp_err_f("position [%d:%d:%d:%d] vs [%d:%d]\n",
-                      region->x, region->y, region->w, region->h, w, h);
-            mpp_err_f("force intra %d qp area index %d\n",
-                      region->intra, region->qp_area_idx);
-            mpp_err_f("abs qp mode %d value %d\n",
-                      region->abs_qp_en, region->quality);
-            goto DONE;
-        }
-    }
+    ret = vepu541_check_roi(roi, w, h);
+    if (ret)
+        goto DONE;
 
-    region = roi->regions;
     /* step 2. setup region for top to bottom */
     for (i = 0; i < (RK_S32)roi->number; i++, region++) {
         RK_S32 roi_width  = (region->w + 15) / 16;
@@ -413,6 +425,342 @@ DONE:
     return ret;
 }
 
+typedef struct Vepu541RoiImpl_t {
+    RK_S32          buf_cnt;
+    RK_U32          ctu64;
+
+    RK_S32          w;
+    RK_S32          h;
+    RK_S32          mb_w;
+    RK_S32          mb_h;
+    RK_S32          stride_h;
+    RK_S32          stride_v;
+
+    /* raster order Vepu541RoiCfg map of current config */
+    RK_U16          *map;
+    RK_U16          def_val;
+
+    /* config of current map */
+    RK_U32          roi_num;
+    MppEncROIRegion roi[VEPU541_MAX_ROI_NUM];
+    RK_U32          qp_map_en;
+    RK_S32          qp_map_w;
+    RK_S32          qp_map_h;
+    RK_S8           *qp_map;
+
+    /*
+     * row_ver records the version of each map row when it is rebuilt and
+     * buf_ver records the version of each row copied to each buffer.
+     */
+    RK_U32          version;
+    RK_U32          *row_ver;
+    RK_U32          *buf_ver;
+    RK_U8           *dirty;
+} Vepu541RoiImpl;
+
+static RK_U16 vepu541_roi_val(RK_U32 intra, RK_U32 area_idx, RK_S32 qp, RK_U32 abs_qp)
+{
+    Vepu541RoiCfg cfg;
+    RK_U16 val;
+
+    cfg.force_intra = intra;
+    cfg.reserved    = 0;
+    cfg.qp_area_idx = area_idx;
+    cfg.qp_area_en  = 1;
+    cfg.qp_adj      = qp;
+    cfg.qp_adj_mode = abs_qp;
+
+    memcpy(&val, &cfg, sizeof(val));
+    return val;
+}
+
+/* fill by 64bit word, memcpy keeps the store alias safe */
+static void vepu541_roi_fill(RK_U16 *dst, RK_U16 val, RK_S32 count)
+{
+    RK_U64 val64 = val * 0x0001000100010001ULL;
+
+    for (; count > 0 && ((intptr_t)dst & 7); count--)
+        *dst++ = val;
+
+    for (; count >= 4; count -= 4, dst += 4)
+        memcpy(dst, &val64, sizeof(val64));
+
+    for (; count > 0; count--)
+        *dst++ = val;
+}
+
+static void vepu541_roi_release(Vepu541RoiImpl *p)
+{
+    MPP_FREE(p->map);
+    MPP_FREE(p->qp_map);
+    MPP_FREE(p->row_ver);
+    MPP_FREE(p->buf_ver);
+    MPP_FREE(p->dirty);
+}
+
+static MPP_RET vepu541_roi_resize(Vepu541RoiImpl *p, RK_S32 w, RK_S32 h)
+{
+    RK_S32 i;
+
+    vepu541_roi_release(p);
+
+    p->w = w;
+    p->h = h;
+    p->mb_w = MPP_ALIGN(w, 16) / 16;
+    p->mb_h = MPP_ALIGN(h, 16) / 16;
+    p->stride_h = MPP_ALIGN(p->mb_w, 4);
+    p->stride_v = MPP_ALIGN(p->mb_h, 4);
+
+    p->map = mpp_malloc(RK_U16, p->stride_h * p->stride_v);
+    p->qp_map = mpp_calloc(RK_S8, p->mb_w * p->mb_h);
+    p->row_ver = mpp_malloc(RK_U32, p->stride_v);
+    p->buf_ver = mpp_calloc(RK_U32, p->stride_v * p->buf_cnt);
+    p->dirty = mpp_calloc(RK_U8, p->mb_h);
+
+    if (!p->map || !p->qp_map || !p->row_ver || !p->buf_ver || !p->dirty) {
+        mpp_err_f("failed to malloc roi map for %dx%d\n", w, h);
+        vepu541_roi_release(p);
+        p->w = 0;
+        p->h = 0;
+        return MPP_ERR_MALLOC;
+    }
+
+    /* all rows of all buffers should be written once */
+    vepu541_roi_fill(p->map, p->def_val, p->stride_h * p->stride_v);
+    p->version = 1;
+    for (i = 0; i < p->stride_v; i++)
+        p->row_ver[i] = p->version;
+
+    p->roi_num = 0;
+    p->qp_map_en = 0;
+    p->qp_map_w = 0;
+    p->qp_map_h = 0;
+
+    return MPP_OK;
+}
+
+static void vepu541_roi_mark(Vepu541RoiImpl *p, MppEncROIRegion *region, RK_U32 num)
+{
+    RK_U32 i;
+
+    for (i = 0; i < num; i++, region++) {
+        RK_S32 y0 = (region->y + 15) / 16;
+        RK_S32 y1 = MPP_MIN(y0 + (region->h + 15) / 16, p->mb_h);
+
+        if (y1 > y0)
+            memset(p->dirty + y0, 1, y1 - y0);
+    }
+}
+
+static void vepu541_roi_build_row(Vepu541RoiImpl *p, RK_S32 y)
+{
+    RK_U16 *row = p->map + y * p->stride_h;
+    MppEncROIRegion *region = p->roi;
+    RK_U32 i;
+
+    /* qp map is the base and regions are painted in order on top of it */
+    if (p->qp_map_en) {
+        RK_S8 *qp = p->qp_map + y * p->mb_w;
+        RK_S32 x;
+
+        for (x = 0; x < p->mb_w; x++)
+            row[x] = vepu541_roi_val(0, 0, mpp_clip(qp[x], -51, 51), 0);
+    } else
+        vepu541_roi_fill(row, p->def_val, p->mb_w);
+
+    for (i = 0; i < p->roi_num; i++, region++) {
+        RK_S32 y0 = (region->y + 15) / 16;
+        RK_S32 y1 = y0 + (region->h + 15) / 16;
+        RK_S32 x0 = (region->x + 15) / 16;
+        RK_S32 x1 = MPP_MIN(x0 + (region->w + 15) / 16, p->mb_w);
+
+        if (y < y0 || y >= y1 || x1 <= x0)
+            continue;
+
+        vepu541_roi_fill(row + x0, vepu541_roi_val(region->intra, region->qp_area_idx,
+                                                   region->quality, region->abs_qp_en),
+                         x1 - x0);
+    }
+}
+
+MPP_RET vepu541_roi_init(Vepu541RoiCtx *ctx, RK_S32 buf_cnt, RK_U32 ctu64)
+{
+    Vepu541RoiImpl *p = NULL;
+
+    if (NULL == ctx || buf_cnt <= 0) {
+        mpp_err_f("invalid ctx %p buf_cnt %d\n", ctx, buf_cnt);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    mpp_assert(sizeof(Vepu541RoiCfg) == sizeof(RK_U16));
+
+    p = mpp_calloc(Vepu541RoiImpl, 1);
+    if (NULL == p) {
+        *ctx = NULL;
+        return MPP_ERR_MALLOC;
+    }
+
+    p->buf_cnt = buf_cnt;
+    p->ctu64 = ctu64;
+    p->def_val = vepu541_roi_val(0, 0, 0, 0);
+
+    *ctx = p;
+    return MPP_OK;
+}
+
+MPP_RET vepu541_roi_deinit(Vepu541RoiCtx ctx)
+{
+    Vepu541RoiImpl *p = (Vepu541RoiImpl *)ctx;
+
+    if (p) {
+        vepu541_roi_release(p);
+        mpp_free(p);
+    }
+
+    return MPP_OK;
+}
+
+MPP_RET vepu541_roi_setup(Vepu541RoiCtx ctx, MppEncROICfg *roi, MppEncQpMap *qp_map,
+                          RK_S32 w, RK_S32 h)
+{
+    Vepu541RoiImpl *p = (Vepu541RoiImpl *)ctx;
+    MppEncROIRegion *regions = NULL;
+    RK_U32 roi_num = 0;
+    RK_U32 qp_map_en = 0;
+    MPP_RET ret = MPP_OK;
+    RK_S32 y;
+
+    if (NULL == p || w <= 0 || h <= 0) {
+        mpp_err_f("invalid ctx %p size [%d:%d]\n", p, w, h);
+        return MPP_ERR_VALUE;
+    }
+
+    if (w != p->w || h != p->h) {
+        ret = vepu541_roi_resize(p, w, h);
+        if (ret)
+            return ret;
+    }
+
+    if (roi && roi->number && roi->regions) {
+        if (roi->number > VEPU541_MAX_ROI_NUM) {
+            mpp_err_f("invalid region number %d\n", roi->number);
+            ret = MPP_NOK;
+        } else
+            ret = vepu541_check_roi(roi, w, h);
+
+        if (!ret) {
+            roi_num = roi->number;
+            regions = roi->regions;
+        }
+    }
+
+    if (qp_map && qp_map->qp_delta && qp_map->width > 0 && qp_map->height > 0)
+        qp_map_en = 1;
+
+    memset(p->dirty, 0, p->mb_h);
+
+    /* both the rows of old regions and the rows of new regions change */
+    if (roi_num != p->roi_num ||
+        (roi_num && memcmp(regions, p->roi, roi_num * sizeof(*regions)))) {
+        vepu541_roi_mark(p, p->roi, p->roi_num);
+        vepu541_roi_mark(p, regions, roi_num);
+
+        if (roi_num)
+            memcpy(p->roi, regions, roi_num * sizeof(*regions));
+        p->roi_num = roi_num;
+    }
+
+    if (qp_map_en) {
+        RK_S32 map_w = MPP_MIN(qp_map->width, p->mb_w);
+        RK_S32 map_h = MPP_MIN(qp_map->height, p->mb_h);
+
+        /* blocks out of a new sized map go back to zero delta */
+        if (!p->qp_map_en || map_w != p->qp_map_w || map_h != p->qp_map_h) {
+            memset(p->qp_map, 0, p->mb_w * p->mb_h);
+            memset(p->dirty, 1, p->mb_h);
+            p->qp_map_w = map_w;
+            p->qp_map_h = map_h;
+        }
+
+        for (y = 0; y < map_h; y++) {
+            RK_S8 *src = qp_map->qp_delta + y * qp_map->stride;
+            RK_S8 *dst = p->qp_map + y * p->mb_w;
+
+            if (memcmp(dst, src, map_w)) {
+                memcpy(dst, src, map_w);
+                p->dirty[y] = 1;
+            }
+        }
+    } else if (p->qp_map_en) {
+        memset(p->dirty, 1, p->mb_h);
+        p->qp_map_w = 0;
+        p->qp_map_h = 0;
+    }
+    p->qp_map_en = qp_map_en;
+
+    if (!memchr(p->dirty, 1, p->mb_h))
+        return ret;
+
+    p->version++;
+    for (y = 0; y < p->mb_h; y++) {
+        if (!p->dirty[y])
+            continue;
+
+        vepu541_roi_build_row(p, y);
+        p->row_ver[y] = p->version;
+    }
+
+    return ret;
+}
+
+MPP_RET vepu541_roi_flush(Vepu541RoiCtx ctx, void *buf, RK_S32 idx)
+{
+    Vepu541RoiImpl *p = (Vepu541RoiImpl *)ctx;
+    RK_U16 *dst = (RK_U16 *)buf;
+    RK_U32 *ver;
+    RK_S32 stride_h;
+    RK_S32 x, y, i;
+
+    if (NULL == p || NULL == buf || idx < 0 || idx >= p->buf_cnt || NULL == p->map) {
+        mpp_err_f("invalid ctx %p buf %p idx %d\n", p, buf, idx);
+        return MPP_ERR_VALUE;
+    }
+
+    ver = p->buf_ver + idx * p->stride_v;
+    stride_h = p->stride_h;
+
+    if (!p->ctu64) {
+        for (y = 0; y < p->stride_v; y++) {
+            if (ver[y] == p->row_ver[y])
+                continue;
+
+            memcpy(dst + y * stride_h, p->map + y * stride_h, stride_h * sizeof(*dst));
+            ver[y] = p->row_ver[y];
+        }
+
+        return MPP_OK;
+    }
+
+    /* h265 roi buffer is 16 blocks of each 64x64 ctu in ctu raster order */
+    for (y = 0; y < p->stride_v; y += 4) {
+        RK_U16 *ctu = dst + y * stride_h;
+
+        if (ver[y] == p->row_ver[y] && ver[y + 1] == p->row_ver[y + 1] &&
+            ver[y + 2] == p->row_ver[y + 2] && ver[y + 3] == p->row_ver[y + 3])
+            continue;
+
+        for (x = 0; x < stride_h; x += 4, ctu += 16) {
+            for (i = 0; i < 4; i++)
+                memcpy(ctu + i * 4, p->map + (y + i) * stride_h + x, 4 * sizeof(*dst));
+        }
+
+        for (i = 0; i < 4; i++)
+            ver[y + i] = p->row_ver[y + i];
+    }
+
+    return MPP_OK;
+}
+
 //TODO: open interface later
 #define ENC_DEFAULT_OSD_INV_THR         15
 #define VEPU541_OSD_ADDR_IDX_BASE       124
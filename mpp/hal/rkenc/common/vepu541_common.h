@@ -148,6 +148,29 @@ MPP_RET vepu541_set_fmt(VepuFmtCfg *cfg, MppFrameFormat format);
 RK_S32  vepu541_get_roi_buf_size(RK_S32 w, RK_S32 h);
 MPP_RET vepu541_set_roi(void *buf, MppEncROICfg *roi, RK_S32 w, RK_S32 h);
 
+/*
+ * incremental roi map
+ *
+ * vepu541_roi_init
+ * Create roi map context for buf_cnt hardware roi buffers. When ctu64 is set
+ * the output buffer is in 64x64 ctu scan order for h265 otherwise it is in
+ * raster order for h264.
+ *
+ * vepu541_roi_setup
+ * Update roi regions and qp map of next frame. Both can be NULL. Only the
+ * block rows covered by changed regions or changed qp map lines are rebuilt.
+ *
+ * vepu541_roi_flush
+ * Copy the rows which are changed since last flush of the idx-th buffer.
+ */
+typedef void* Vepu541RoiCtx;
+
+MPP_RET vepu541_roi_init(Vepu541RoiCtx *ctx, RK_S32 buf_cnt, RK_U32 ctu64);
+MPP_RET vepu541_roi_deinit(Vepu541RoiCtx ctx);
+MPP_RET vepu541_roi_setup(Vepu541RoiCtx ctx, MppEncROICfg *roi, MppEncQpMap *qp_map,
+                          RK_S32 w, RK_S32 h);
+MPP_RET vepu541_roi_flush(Vepu541RoiCtx ctx, void *buf, RK_S32 idx);
+
 MPP_RET vepu541_set_osd(Vepu541OsdCfg *cfg);
 
 #ifdef __cplusplus
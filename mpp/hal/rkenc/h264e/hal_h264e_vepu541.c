@@ -39,6 +39,13 @@
 #include "hal_h264e_vepu541_reg_l2.h"
 #include "vepu541_common.h"
 
+/*
+ * Max task count in hardware at the same time. Registers are sent to kernel
+ * on start and read back on wait one task by one task so only the buffers
+ * written by cpu for each task need to be duplicated.
+ */
+#define VEPU541_H264E_TASK_CNT      2
+
 typedef struct HalH264eVepu541Ctx_t {
     MppEncCfgSet            *cfg;
 
@@ -69,8 +76,10 @@ typedef struct HalH264eVepu541Ctx_t {
 
     /* roi */
     MppEncROICfg            *roi_data;
+    MppEncQpMap             *qp_map;
+    Vepu541RoiCtx           roi_ctx;
     MppBufferGroup          roi_grp;
-    MppBuffer               roi_buf;
+    MppBuffer               roi_buf[VEPU541_H264E_TASK_CNT];
     RK_S32                  roi_buf_size;
 
     /* osd */
@@ -106,6 +115,7 @@ static RK_U32 dump_l2_reg = 0;
 static MPP_RET hal_h264e_vepu541_deinit(void *hal)
 {
     HalH264eVepu541Ctx *p = (HalH264eVepu541Ctx *)hal;
+    RK_S32 i;
 
     hal_h264e_dbg_func("enter %p\n", p);
 
@@ -114,9 +124,11 @@ static MPP_RET hal_h264e_vepu541_deinit(void *hal)
         p->dev_ctx = NULL;
     }
 
-    if (p->roi_buf) {
-        mpp_buffer_put(p->roi_buf);
-        p->roi_buf = NULL;
+    for (i = 0; i < VEPU541_H264E_TASK_CNT; i++) {
+        if (p->roi_buf[i]) {
+            mpp_buffer_put(p->roi_buf[i]);
+            p->roi_buf[i] = NULL;
+        }
     }
 
     if (p->roi_grp) {
@@ -124,6 +136,11 @@ static MPP_RET hal_h264e_vepu541_deinit(void *hal)
         p->roi_grp = NULL;
     }
 
+    if (p->roi_ctx) {
+        vepu541_roi_deinit(p->roi_ctx);
+        p->roi_ctx = NULL;
+    }
+
     if (p->hw_recn) {
         hal_bufs_deinit(p->hw_recn);
         p->hw_recn = NULL;
@@ -148,6 +165,7 @@ static MPP_RET hal_h264e_vepu541_init(void *hal, MppEncHalCfg *cfg)
     hal_h264e_dbg_func("enter %p\n", p);
 
     p->cfg = cfg->cfg;
+    cfg->task_count = VEPU541_H264E_TASK_CNT;
 
     ret = mpp_device_init(&p->dev_ctx, &dev_cfg);
     if (ret) {
@@ -161,6 +179,13 @@ static MPP_RET hal_h264e_vepu541_init(void *hal, MppEncHalCfg *cfg)
         goto DONE;
     }
 
+    /* each task has its own roi buffer */
+    ret = vepu541_roi_init(&p->roi_ctx, VEPU541_H264E_TASK_CNT, 0);
+    if (ret) {
+        mpp_err_f("init roi context failed ret: %d\n", ret);
+        goto DONE;
+    }
+
     p->osd_cfg.reg_base = &p->regs_set;
     p->osd_cfg.dev = p->dev_ctx;
     p->osd_cfg.plt_cfg = &p->cfg->plt_cfg;
@@ -272,6 +297,7 @@ static MPP_RET hal_h264e_vepu541_get_task(void *hal, HalEncTask *task)
         MppMeta meta = mpp_frame_get_meta(task->frame);
 
         mpp_meta_get_ptr(meta, KEY_ROI_DATA, (void **)&ctx->roi_data);
+        mpp_meta_get_ptr(meta, KEY_QP_MAP_DATA, (void **)&ctx->qp_map);
         mpp_meta_get_ptr(meta, KEY_OSD_DATA, (void **)&ctx->osd_cfg.osd_data);
     }
     hal_h264e_dbg_func("leave %p\n", hal);
@@ -830,42 +856,53 @@ static void setup_vepu541_io_buf(Vepu541H264eRegSet *regs, RegExtraInfo *info,
 static void setup_vepu541_roi(Vepu541H264eRegSet *regs, HalH264eVepu541Ctx *ctx)
 {
     MppEncROICfg *roi = ctx->roi_data;
+    MppEncQpMap *qp_map = ctx->qp_map;
     RK_U32 w = ctx->sps->pic_width_in_mbs * 16;
     RK_U32 h = ctx->sps->pic_height_in_mbs * 16;
 
     hal_h264e_dbg_func("enter\n");
 
+    if (roi && (!roi->number || !roi->regions))
+        roi = NULL;
+    if (qp_map && !qp_map->qp_delta)
+        qp_map = NULL;
+
     /* roi setup */
-    if (roi && roi->number && roi->regions) {
+    if (roi || qp_map) {
         RK_S32 roi_buf_size = vepu541_get_roi_buf_size(w, h);
+        /* previous task may still be reading its roi buffer in hardware */
+        RK_S32 idx = ctx->frame_cnt % VEPU541_H264E_TASK_CNT;
+        RK_S32 i;
 
-        if (!ctx->roi_buf || roi_buf_size != ctx->roi_buf_size) {
-            if (NULL == ctx->roi_grp)
-                mpp_buffer_group_get_internal(&ctx->roi_grp, MPP_BUFFER_TYPE_ION);
-            else if (roi_buf_size != ctx->roi_buf_size) {
-                if (ctx->roi_buf) {
-                    mpp_buffer_put(ctx->roi_buf);
-                    ctx->roi_buf = NULL;
+        if (NULL == ctx->roi_grp)
+            mpp_buffer_group_get_internal(&ctx->roi_grp, MPP_BUFFER_TYPE_ION);
+        else if (roi_buf_size != ctx->roi_buf_size) {
+            for (i = 0; i < VEPU541_H264E_TASK_CNT; i++) {
+                if (ctx->roi_buf[i]) {
+                    mpp_buffer_put(ctx->roi_buf[i]);
+                    ctx->roi_buf[i] = NULL;
                 }
-                mpp_buffer_group_clear(ctx->roi_grp);
             }
+            mpp_buffer_group_clear(ctx->roi_grp);
+        }
 
-            mpp_assert(ctx->roi_grp);
+        mpp_assert(ctx->roi_grp);
 
-            if (NULL == ctx->roi_buf)
-                mpp_buffer_get(ctx->roi_grp, &ctx->roi_buf, roi_buf_size);
+        if (NULL == ctx->roi_buf[idx])
+            mpp_buffer_get(ctx->roi_grp, &ctx->roi_buf[idx], roi_buf_size);
 
-            ctx->roi_buf_size = roi_buf_size;
-        }
+        ctx->roi_buf_size = roi_buf_size;
 
-        mpp_assert(ctx->roi_buf);
-        RK_S32 fd = mpp_buffer_get_fd(ctx->roi_buf);
-        void *buf = mpp_buffer_get_ptr(ctx->roi_buf);
+        mpp_assert(ctx->roi_buf[idx]);
+        RK_S32 fd = mpp_buffer_get_fd(ctx->roi_buf[idx]);
+        void *buf = mpp_buffer_get_ptr(ctx->roi_buf[idx]);
 
         regs->reg013.roi_enc = 1;
         regs->reg073.roi_addr = fd;
 
-        vepu541_set_roi(buf, roi, w, h);
+        /* only the rows changed since last use of this buffer are written */
+        vepu541_roi_setup(ctx->roi_ctx, roi, qp_map, w, h);
+        vepu541_roi_flush(ctx->roi_ctx, buf, idx);
     } else {
         regs->reg013.roi_enc = 0;
         regs->reg073.roi_addr = 0;
@@ -85,7 +85,8 @@ typedef struct H265eV541HalContext_t {
     RK_U32              frame_cnt;
     Vepu541OsdCfg       osd_cfg;
     MppEncROICfg        *roi_data;
-    void                *roi_buf;
+    MppEncQpMap         *qp_map;
+    Vepu541RoiCtx       roi_ctx;
     MppEncCfgSet        *set;
     MppEncCfgSet        *cfg;
 
@@ -275,7 +276,10 @@ static MPP_RET h265e_rkv_allocate_buffers(H265eV541HalContext *ctx, H265eSyntax_
         }
 
         vepu541_h265_free_buffers(ctx);
-        MPP_FREE(ctx->roi_buf);
+        if (ctx->roi_ctx) {
+            vepu541_roi_deinit(ctx->roi_ctx);
+            ctx->roi_ctx = NULL;
+        }
         hal_bufs_deinit(ctx->dpb_bufs);
         hal_bufs_init(&ctx->dpb_bufs);
         fbc_header_len = MPP_ALIGN(((mb_wd64 * mb_h64) << 6), SZ_8K);
@@ -293,7 +297,10 @@ static MPP_RET h265e_rkv_allocate_buffers(H265eV541HalContext *ctx, H265eSyntax_
                 }
             }
         }
-        ctx->roi_buf = mpp_malloc(RK_U8, vepu541_get_roi_buf_size(syn->pp.pic_width, syn->pp.pic_height));
+        /* roi buffer is reallocated so the roi map is rewritten as a whole */
+        ret = vepu541_roi_init(&ctx->roi_ctx, 1, 1);
+        if (ret)
+            return ret;
         ctx->frame_size = frame_size;
     }
     h265e_hal_leave();
@@ -406,7 +413,10 @@ MPP_RET hal_h265e_v541_deinit(void *hal)
     MPP_FREE(ctx->ioctl_output);
     MPP_FREE(ctx->rc_hal_cfg);
     MPP_FREE(ctx->input_fmt);
-    MPP_FREE(ctx->roi_buf);
+    if (ctx->roi_ctx) {
+        vepu541_roi_deinit(ctx->roi_ctx);
+        ctx->roi_ctx = NULL;
+    }
     hal_bufs_deinit(ctx->dpb_bufs);
 
     if (ctx->buffers) {
@@ -500,54 +510,32 @@ vepu541_h265_set_patch_info(H265eV541IoctlExtraInfo *extra_info,
     return MPP_OK;
 }
 
-MPP_RET vepu541_h265_set_roi(void *dst_buf, void *src_buf, RK_S32 w, RK_S32 h)
-{
-    Vepu541RoiCfg *src = (Vepu541RoiCfg *)src_buf;
-    Vepu541RoiCfg *dst = (Vepu541RoiCfg *)dst_buf;
-    RK_S32 mb_w = MPP_ALIGN(w, 64) / 64;
-    RK_S32 mb_h = MPP_ALIGN(h, 64) / 64;
-    RK_S32 ctu_line = mb_w;
-    RK_S32 i, j, cu16cnt;
-
-    for (j = 0; j < mb_h; j++) {
-        for ( i = 0; i < mb_w; i++) {
-            RK_S32 ctu_addr = j * ctu_line + i;
-            RK_S32 cu16_num_line = ctu_line * 4;
-            for ( cu16cnt = 0; cu16cnt < 16; cu16cnt++) {
-                RK_S32 cu16_x;
-                RK_S32 cu16_y;
-                RK_S32 cu16_addr_in_frame;
-                cu16_x = cu16cnt & 3;
-                cu16_y = cu16cnt / 4;
-                cu16_x += i * 4;
-                cu16_y += j * 4;
-                cu16_addr_in_frame = cu16_x + cu16_y * cu16_num_line;
-                dst[ctu_addr * 16 + cu16cnt] = src[cu16_addr_in_frame];
-            }
-        }
-    }
-    return MPP_OK;
-}
-
 static MPP_RET
 vepu541_h265_set_roi_regs(H265eV541HalContext *ctx, H265eV541RegSet *regs)
 {
     MppEncROICfg *cfg = (MppEncROICfg*)ctx->roi_data;
+    MppEncQpMap *qp_map = ctx->qp_map;
     h265e_v541_buffers *bufs = (h265e_v541_buffers *)ctx->buffers;
     RK_U32 h =  ctx->cfg->prep.height;
     RK_U32 w = ctx->cfg->prep.width;
     RK_U8 *roi_base;
 
-    if (!cfg) {
+    if (cfg && (!cfg->number || !cfg->regions))
+        cfg = NULL;
+    if (qp_map && !qp_map->qp_delta)
+        qp_map = NULL;
+
+    if (!cfg && !qp_map) {
         return MPP_OK;
     }
 
-    if (cfg->number && cfg->regions) {
+    if (ctx->roi_ctx) {
         regs->enc_pic.roi_en = 1;
         regs->roi_addr_hevc = mpp_buffer_get_fd(bufs->hw_roi_buf[0]);
         roi_base = (RK_U8 *)mpp_buffer_get_ptr(bufs->hw_roi_buf[0]);
-        vepu541_set_roi(ctx->roi_buf, cfg, w, h);
-        vepu541_h265_set_roi(roi_base, ctx->roi_buf, w, h);
+        /* only the ctu rows changed since last frame are written */
+        vepu541_roi_setup(ctx->roi_ctx, cfg, qp_map, w, h);
+        vepu541_roi_flush(ctx->roi_ctx, roi_base, 0);
     }
     return MPP_OK;
 }
@@ -1383,6 +1371,7 @@ MPP_RET hal_h265e_v541_get_task(void *hal, HalEncTask *task)
     if (!frm_status->reencode && mpp_frame_has_meta(task->frame)) {
         MppMeta meta = mpp_frame_get_meta(frame);
         mpp_meta_get_ptr(meta, KEY_ROI_DATA, (void **)&ctx->roi_data);
+        mpp_meta_get_ptr(meta, KEY_QP_MAP_DATA, (void **)&ctx->qp_map);
         mpp_meta_get_ptr(meta, KEY_OSD_DATA, (void **)&ctx->osd_cfg.osd_data);
     }
 
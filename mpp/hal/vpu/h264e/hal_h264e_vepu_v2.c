@@ -22,6 +22,7 @@
 #include "mpp_buffer.h"
 
 #include "vepu_common.h"
+#include "hal_table.h"
 
 #include "h264e_slice.h"
 #include "hal_h264e_debug.h"
@@ -108,11 +109,15 @@ static void vepu_swap_endian(RK_U32 *buf, RK_S32 size_bytes)
     }
 }
 
-static void vepu_write_cabac_table(MppBuffer buf, RK_S32 cabac_init_idc)
+/* generate cabac table of one cabac_init_idc into shared table buffer */
+static void vepu_gen_cabac_table(void *buf, size_t size, RK_S32 cabac_init_idc)
 {
     const RK_S32(*context)[460][2];
     RK_S32 i, j, qp;
-    RK_U8 table[H264E_CABAC_TABLE_BUF_SIZE] = {0};
+    RK_U8 *table = (RK_U8 *)buf;
+
+    mpp_assert(size >= H264E_CABAC_TABLE_BUF_SIZE);
+    memset(table, 0, H264E_CABAC_TABLE_BUF_SIZE);
 
     for (qp = 0; qp < 52; qp++) { /* All QP values */
         for (j = 0; j < 2; j++) { /* Intra/Inter */
@@ -141,7 +146,6 @@ static void vepu_write_cabac_table(MppBuffer buf, RK_S32 cabac_init_idc)
     }
 
     vepu_swap_endian((RK_U32 *)table, H264E_CABAC_TABLE_BUF_SIZE);
-    mpp_buffer_write(buf, 0, table, H264E_CABAC_TABLE_BUF_SIZE);
 }
 
 MPP_RET h264e_vepu_buf_init(HalH264eVepuBufs *bufs)
@@ -170,7 +174,7 @@ MPP_RET h264e_vepu_buf_deinit(HalH264eVepuBufs *bufs)
     hal_h264e_dbg_buffer("enter %p\n", bufs);
 
     if (bufs->cabac_table)
-        mpp_buffer_put(bufs->cabac_table);
+        hal_table_put(bufs->cabac_table);
 
     if (bufs->nal_size_table)
         mpp_buffer_put(bufs->nal_size_table);
@@ -195,11 +199,16 @@ MPP_RET h264e_vepu_buf_set_cabac_idc(HalH264eVepuBufs *bufs, RK_S32 idc)
 {
     hal_h264e_dbg_buffer("enter %p\n", bufs);
 
-    if (idc >= 0 && !bufs->cabac_table)
-        mpp_buffer_get(bufs->group, &bufs->cabac_table, H264E_CABAC_TABLE_BUF_SIZE);
+    /* cabac table of each idc is shared by all encoder instances */
+    if (idc >= 0 && (idc != bufs->cabac_init_idc || !bufs->cabac_table)) {
+        if (bufs->cabac_table) {
+            hal_table_put(bufs->cabac_table);
+            bufs->cabac_table = NULL;
+        }
 
-    if (bufs->cabac_table && idc != bufs->cabac_init_idc && idc >= 0)
-        vepu_write_cabac_table(bufs->cabac_table, idc);
+        hal_table_get(&bufs->cabac_table, MPP_CTX_ENC, MPP_VIDEO_CodingAVC, idc,
+                      H264E_CABAC_TABLE_BUF_SIZE, vepu_gen_cabac_table);
+    }
 
     bufs->cabac_init_idc = idc;
 
@@ -747,6 +756,9 @@ static RK_S32 get_next_nal(RK_U8 *buf, RK_S32 *length)
     return consumed;
 }
 
+/* max bytes of prefix nal and slice header written by software for one slice */
+#define H264E_AMEND_HDR_SIZE    256
+
 MPP_RET h264e_vepu_stream_amend_init(HalH264eVepuStreamAmend *ctx)
 {
     memset(ctx, 0, sizeof(*ctx));
@@ -756,8 +768,8 @@ MPP_RET h264e_vepu_stream_amend_init(HalH264eVepuStreamAmend *ctx)
 
 MPP_RET h264e_vepu_stream_amend_deinit(HalH264eVepuStreamAmend *ctx)
 {
-    MPP_FREE(ctx->src_buf);
     MPP_FREE(ctx->dst_buf);
+    MPP_FREE(ctx->slices);
     return MPP_OK;
 }
 
@@ -772,13 +784,12 @@ MPP_RET h264e_vepu_stream_amend_config(HalH264eVepuStreamAmend *ctx,
         ctx->slice_enabled = 0;
 
         if (NULL == ctx->dst_buf)
-            ctx->dst_buf = mpp_calloc(RK_U8, ctx->buf_size);
-        if (NULL == ctx->src_buf)
-            ctx->src_buf = mpp_calloc(RK_U8, ctx->buf_size);
+            ctx->dst_buf = mpp_malloc(RK_U8, ctx->buf_size);
     } else {
         MPP_FREE(ctx->dst_buf);
-        MPP_FREE(ctx->src_buf);
+        MPP_FREE(ctx->slices);
         memset(ctx, 0, sizeof(*ctx));
+        ctx->buf_size = SZ_128K;
     }
 
     ctx->slice = slice;
@@ -791,153 +802,232 @@ MPP_RET h264e_vepu_stream_amend_config(HalH264eVepuStreamAmend *ctx,
     return MPP_OK;
 }
 
+static RK_S32 stream_amend_find_slices(HalH264eVepuStreamAmend *ctx, RK_U8 *p, RK_S32 len)
+{
+    RK_S32 multi = ctx->slice->is_multi_slice;
+    RK_S32 cnt = 0;
+    RK_S32 pos = 0;
+
+    while (len > 0) {
+        HalH264eVepuAmendSlice *s;
+        RK_S32 nal_len = multi ? get_next_nal(p + pos, &len) : len;
+
+        if (!multi || nal_len <= 0) {
+            nal_len = len;
+            len = 0;
+        }
+
+        if (cnt >= ctx->slice_max) {
+            RK_S32 max = ctx->slice_max ? ctx->slice_max * 2 : 8;
+            HalH264eVepuAmendSlice *slices = mpp_realloc(ctx->slices, HalH264eVepuAmendSlice, max);
+
+            if (NULL == slices) {
+                mpp_err_f("failed to realloc %d slices\n", max);
+                return cnt;
+            }
+
+            ctx->slices = slices;
+            ctx->slice_max = max;
+        }
+
+        s = &ctx->slices[cnt++];
+        s->src_pos = pos;
+        s->src_len = nal_len;
+        pos += nal_len;
+    }
+
+    return cnt;
+}
+
+/* slice data is copied first as the new header may cover the old slice data */
+static void stream_amend_put_slice(RK_U8 *dst, RK_U8 *src, HalH264eVepuAmendSlice *s)
+{
+    if (s->shifted) {
+        memcpy(dst + s->dst_pos, s->hdr, s->dst_len);
+        return;
+    }
+
+    memmove(dst + s->dst_pos + s->hdr_len, src + s->payload, s->dst_len - s->hdr_len);
+    memcpy(dst + s->dst_pos, s->hdr, s->hdr_len);
+}
+
 MPP_RET h264e_vepu_stream_amend_proc(HalH264eVepuStreamAmend *ctx)
 {
     H264ePrefixNal *prefix = ctx->prefix;
     H264eSlice *slice = ctx->slice;
     MppPacket pkt = ctx->packet;
-    RK_U8 *p = mpp_packet_get_pos(pkt);
-    RK_S32 size = mpp_packet_get_size(pkt);
     RK_S32 base = ctx->buf_base;
+    RK_U8 *p = (RK_U8 *)mpp_packet_get_pos(pkt) + base;
+    RK_S32 size = mpp_packet_get_size(pkt) - (p - (RK_U8 *)mpp_packet_get_data(pkt));
     RK_S32 len = ctx->old_length;
-    RK_S32 hw_len_bit = 0;
-    RK_S32 sw_len_bit = 0;
-    RK_S32 hw_len_byte = 0;
-    RK_S32 sw_len_byte = 0;
-    RK_S32 diff_size = 0;
-    RK_S32 tail_0bit = 0;
-    RK_U8  tail_byte = 0;
-    RK_U8  tail_tmp = 0;
-    RK_U8 *dst_buf = NULL;
-    RK_S32 buf_size;
+    RK_S32 slice_cnt;
+    RK_S32 need_size;
     RK_S32 final_len = 0;
-    RK_S32 last_slice = 0;
+    RK_S32 grow = 0;
+    RK_S32 shrink = 0;
+    RK_U8 *src = p;
+    RK_U8 *buf;
+    RK_S32 i;
+
+    ctx->new_length = len;
 
-    {
-        RK_S32 more_buf = 0;
-        while (len > ctx->buf_size - 16) {
+    slice_cnt = stream_amend_find_slices(ctx, p, len);
+    if (!slice_cnt)
+        return MPP_OK;
+
+    /*
+     * scratch buffer holds new headers, bit shifted slices with at most one
+     * 0x03 byte inserted for every two bytes and the stream copy for the
+     * rare reordering case. It is not cleared on use.
+     */
+    need_size = slice_cnt * H264E_AMEND_HDR_SIZE + len * 3 / 2 + len + 16;
+    if (need_size > ctx->buf_size || NULL == ctx->dst_buf) {
+        while (need_size > ctx->buf_size)
             ctx->buf_size *= 2;
-            more_buf = 1;
-        }
 
-        if (more_buf) {
-            MPP_FREE(ctx->src_buf);
-            MPP_FREE(ctx->dst_buf);
-            ctx->src_buf = mpp_malloc(RK_U8, ctx->buf_size);
-            ctx->dst_buf = mpp_malloc(RK_U8, ctx->buf_size);
+        MPP_FREE(ctx->dst_buf);
+        ctx->dst_buf = mpp_malloc(RK_U8, ctx->buf_size);
+        if (NULL == ctx->dst_buf) {
+            mpp_err_f("failed to malloc %d amend buffer\n", ctx->buf_size);
+            ctx->buf_size = SZ_128K;
+            return MPP_ERR_MALLOC;
         }
     }
 
-    memset(ctx->dst_buf, 0, ctx->buf_size);
-    memset(ctx->src_buf, 0, ctx->buf_size);
-    dst_buf = ctx->dst_buf;
-    buf_size = ctx->buf_size;
-    p += base;
-
-    do {
-        RK_U32 nal_len = 0;
-        tail_0bit = 0;
-        // copy hw stream to stream buffer first
-        if (slice->is_multi_slice) {
-            nal_len = get_next_nal(p, &len);
-
-            memcpy(ctx->src_buf, p, nal_len);
-            p += nal_len;
-            last_slice = (len == 0);
-        } else {
-            memcpy(ctx->src_buf, p, len);
-            nal_len = len;
-            last_slice = 1;
-        }
+    buf = ctx->dst_buf;
+
+    /* step 1. write new headers and get the new slice layout */
+    for (i = 0; i < slice_cnt; i++) {
+        HalH264eVepuAmendSlice *s = &ctx->slices[i];
+        RK_U8 *nal = p + s->src_pos;
+        RK_S32 nal_len = s->src_len;
+        RK_S32 prefix_byte = 0;
+        RK_S32 hw_len_bit, sw_len_bit;
+        RK_S32 hw_len_byte, sw_len_byte;
+        RK_S32 bit_r;
+        H264eSlice slice_rd;
 
         hal_h264e_dbg_amend("nal_len %d multi %d last %d prefix %p\n",
-                            nal_len, slice->is_multi_slice, last_slice, prefix);
+                            nal_len, slice->is_multi_slice, i == slice_cnt - 1, prefix);
 
+        s->hdr = buf;
         if (prefix) {
             /* add prefix for each slice */
-            RK_S32 prefix_bit = h264e_slice_write_prefix_nal_unit_svc(prefix, dst_buf, buf_size);
+            RK_S32 prefix_bit = h264e_slice_write_prefix_nal_unit_svc(prefix, buf, H264E_AMEND_HDR_SIZE);
 
-            prefix_bit = (prefix_bit + 7) / 8;
-
-            dst_buf += prefix_bit;
-            buf_size -= prefix_bit;
-            final_len += prefix_bit;
+            prefix_byte = (prefix_bit + 7) / 8;
+            buf += prefix_byte;
         }
 
-        H264eSlice slice_rd;
-
         memcpy(&slice_rd, slice, sizeof(slice_rd));
         slice_rd.log2_max_frame_num = 16;
         slice_rd.pic_order_cnt_type = 2;
 
-        hw_len_bit = h264e_slice_read(&slice_rd, ctx->src_buf, size);
+        hw_len_bit = h264e_slice_read(&slice_rd, nal, nal_len);
 
         // write new header to header buffer
         slice->qp_delta = slice_rd.qp_delta;
         slice->first_mb_in_slice = slice_rd.first_mb_in_slice;
-        sw_len_bit = h264e_slice_write(slice, dst_buf, buf_size);
+        sw_len_bit = h264e_slice_write(slice, buf, H264E_AMEND_HDR_SIZE - prefix_byte);
 
         hw_len_byte = (hw_len_bit + 7) / 8;
         sw_len_byte = (sw_len_bit + 7) / 8;
+        bit_r = sw_len_bit & 7;
 
-        tail_byte = ctx->src_buf[nal_len - 1];
-        tail_tmp = tail_byte;
+        mpp_assert(nal[nal_len - 1]);
 
-        while (!(tail_tmp & 1) && tail_0bit < 8) {
-            tail_tmp >>= 1;
-            tail_0bit++;
+        s->shifted = 1;
+        if (bit_r == (hw_len_bit & 7)) {
+            /*
+             * Same bit position in byte, the slice data bytes are kept.
+             * The last header byte is merged with the first slice data bits.
+             * When the bytes around the merged byte are all non-zero no
+             * emulation prevention byte can be changed.
+             */
+            if (!bit_r) {
+                s->shifted = 0;
+            } else {
+                RK_U8 mask = 0xff << (8 - bit_r);
+                RK_U8 merge = (buf[sw_len_byte - 1] & mask) | (nal[hw_len_byte - 1] & ~mask);
+
+                if (merge && buf[sw_len_byte - 2] && nal[hw_len_byte - 1] && nal[hw_len_byte - 2]) {
+                    buf[sw_len_byte - 1] = merge;
+                    s->shifted = 0;
+                }
+            }
         }
 
-        mpp_assert(tail_0bit < 8);
+        if (!s->shifted) {
+            s->payload = s->src_pos + hw_len_byte;
+            s->hdr_len = prefix_byte + sw_len_byte;
+            s->dst_len = s->hdr_len + nal_len - hw_len_byte;
+            buf += sw_len_byte;
 
-        // move the reset slice data from src buffer to dst buffer
-        diff_size = h264e_slice_move(dst_buf, ctx->src_buf,
-                                     sw_len_bit, hw_len_bit, nal_len);
+            hal_h264e_dbg_amend("frm %4d %c len %d bit hw %d sw %d byte move %d\n",
+                                slice->frame_num, (slice->idr_flag ? 'I' : 'P'),
+                                nal_len, hw_len_bit, sw_len_bit, s->dst_len);
+        } else {
+            RK_S32 tail_0bit = 0;
+            RK_U8 tail_byte = nal[nal_len - 1];
+            RK_S32 diff_size;
+            RK_S32 bit_len;
+            RK_S32 new_len;
+
+            while (!(tail_byte & 1) && tail_0bit < 8) {
+                tail_byte >>= 1;
+                tail_0bit++;
+            }
 
-        hal_h264e_dbg_amend("tail 0x%02x %d hw_hdr %d sw_hdr %d len %d hw_byte %d sw_byte %d diff %d\n",
-                            tail_byte, tail_0bit, hw_len_bit, sw_len_bit, nal_len, hw_len_byte, sw_len_byte, diff_size);
+            // move the rest slice data from hardware stream to scratch buffer
+            diff_size = h264e_slice_move(buf, nal, sw_len_bit, hw_len_bit, nal_len);
 
-        if (slice->entropy_coding_mode) {
-            memcpy(dst_buf + sw_len_byte, ctx->src_buf + hw_len_byte,
-                   nal_len - hw_len_byte);
-            final_len += nal_len - hw_len_byte + sw_len_byte;
-            nal_len = nal_len - hw_len_byte + sw_len_byte;
-        } else {
-            RK_S32 hdr_diff_bit = sw_len_bit - hw_len_bit;
-            RK_S32 bit_len = nal_len * 8 - tail_0bit + hdr_diff_bit;
-            RK_S32 new_len = (bit_len + diff_size * 8 + 7) / 8;
+            bit_len = nal_len * 8 - tail_0bit + sw_len_bit - hw_len_bit;
+            new_len = (bit_len + diff_size * 8 + 7) / 8;
 
             hal_h264e_dbg_amend("frm %4d %c len %d bit hw %d sw %d byte hw %d sw %d diff %d -> %d\n",
                                 slice->frame_num, (slice->idr_flag ? 'I' : 'P'),
                                 nal_len, hw_len_bit, sw_len_bit,
                                 hw_len_byte, sw_len_byte, diff_size, new_len);
 
-            hal_h264e_dbg_amend("%02x %02x %02x %02x -> %02x %02x %02x %02x\n",
-                                ctx->src_buf[nal_len - 4], ctx->src_buf[nal_len - 3],
-                                ctx->src_buf[nal_len - 2], ctx->src_buf[nal_len - 1],
-                                dst_buf[new_len - 4], dst_buf[new_len - 3],
-                                dst_buf[new_len - 2], dst_buf[new_len - 1]);
-            nal_len = new_len;
-            final_len += new_len;
+            s->hdr_len = prefix_byte + new_len;
+            s->dst_len = s->hdr_len;
+            /* writer may flush one more padding byte */
+            buf += sw_len_byte + (nal_len - hw_len_byte) * 3 / 2 + 2;
         }
 
-        if (last_slice) {
-            p = mpp_packet_get_pos(pkt);
-            p += base;
-            memcpy(p, ctx->dst_buf, final_len);
+        s->dst_pos = final_len;
+        final_len += s->dst_len;
 
-            if (slice->entropy_coding_mode) {
-                if (final_len < ctx->old_length)
-                    memset(p + final_len, 0,  ctx->old_length - final_len);
-            } else
-                p[final_len] = 0;
+        if (s->dst_pos > s->src_pos)
+            grow = 1;
+        if (s->dst_pos < s->src_pos)
+            shrink = 1;
+    }
 
-            break;
-        }
+    if (final_len + 1 > size) {
+        mpp_err_f("amend stream %d is larger than packet size %d\n", final_len, size);
+        return MPP_NOK;
+    }
 
-        dst_buf += nal_len;
-        buf_size -= nal_len;
-    } while (1);
+    /* step 2. place slices without overwriting slice data not moved yet */
+    if (grow && shrink) {
+        src = buf;
+        memcpy(src, p, len);
+    }
+
+    if (grow && !shrink) {
+        for (i = slice_cnt - 1; i >= 0; i--)
+            stream_amend_put_slice(p, src, &ctx->slices[i]);
+    } else {
+        for (i = 0; i < slice_cnt; i++)
+            stream_amend_put_slice(p, src, &ctx->slices[i]);
+    }
+
+    if (slice->entropy_coding_mode) {
+        if (final_len < len)
+            memset(p + final_len, 0, len - final_len);
+    } else
+        p[final_len] = 0;
 
     ctx->new_length = final_len;
 
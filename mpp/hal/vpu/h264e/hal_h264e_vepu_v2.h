@@ -156,16 +156,39 @@ typedef struct HalH264eVepuMbRc_t {
 
 typedef void *HalH264eVepuMbRcCtx;
 
+/*
+ * Position of one hardware slice in stream amend
+ *
+ * The new prefix nal and slice header are written to hdr. When the new
+ * header ends at the same bit position in byte as the hardware header the
+ * slice data is moved by bytes from payload in packet. Otherwise the whole
+ * bit shifted slice is in hdr.
+ */
+typedef struct HalH264eVepuAmendSlice_t {
+    RK_S32          src_pos;
+    RK_S32          src_len;
+    RK_S32          payload;
+    RK_S32          dst_pos;
+    RK_S32          dst_len;
+
+    RK_U8           *hdr;
+    RK_S32          hdr_len;
+    RK_S32          shifted;
+} HalH264eVepuAmendSlice;
+
 typedef struct HalH264eVepuStreamAmend_t {
     RK_S32          enable;
     H264eSlice      *slice;
     H264ePrefixNal  *prefix;
     RK_S32          slice_enabled;
 
-    RK_U8           *src_buf;
+    /* scratch buffer for new headers and bit shifted slices */
     RK_U8           *dst_buf;
     RK_S32          buf_size;
 
+    HalH264eVepuAmendSlice *slices;
+    RK_S32          slice_max;
+
     MppPacket       packet;
     RK_S32          buf_base;
     RK_S32          old_length;
@@ -0,0 +1,482 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "h264e_amend_test"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_time.h"
+#include "mpp_common.h"
+
+#include "h264e_slice.h"
+#include "hal_h264e_vepu_v2.h"
+
+/*
+ * h264e_vepu_stream_amend_proc check and benchmark
+ *
+ * A hardware like stream is generated with the vpu slice header (16 bit
+ * frame_num and poc type 2) and random escaped slice data. The stream is
+ * amended by the in-place amend and by the copy-based reference and the
+ * results are compared. Then frames with 1 to 32 slices are amended by both
+ * for the benchmark.
+ *
+ * usage: h264e_amend_test [bench frame size in KB]
+ */
+#define AMEND_CHECK_LOOP        300
+#define AMEND_CHECK_SIZE        (64 * 1024)
+#define AMEND_BENCH_SIZE        2048
+#define AMEND_BENCH_LOOP        20
+#define AMEND_MAX_SLICES        32
+#define AMEND_FRAME_MBS         8160
+#define AMEND_ZERO_RATIO        16
+
+typedef struct AmendTestCtx_t {
+    H264eSlice          hw;
+    H264eSlice          sw;
+    H264eReorderInfo    hw_reorder;
+    H264eReorderInfo    sw_reorder;
+    H264eMarkingInfo    hw_marking;
+    H264eMarkingInfo    sw_marking;
+    H264ePrefixNal      prefix;
+    RK_S32              use_prefix;
+
+    /* stream generated by hardware */
+    RK_U8               *stream;
+    RK_S32              length;
+    RK_S32              size;
+
+    /* reference buffers */
+    RK_U8               *ref_pkt;
+    RK_U8               *ref_src;
+    RK_U8               *ref_dst;
+    RK_S32              ref_size;
+
+    MppPacket           packet;
+    RK_U8               *pkt_buf;
+    HalH264eVepuStreamAmend amend;
+} AmendTestCtx;
+
+#define START_CODE 0x000001
+
+/* the nal search in hal_h264e_vepu_v2.c */
+static RK_S32 ref_get_next_nal(RK_U8 *buf, RK_S32 *length)
+{
+    RK_S32 i, consumed = 0;
+    RK_S32 len = *length;
+    RK_U8 *tmp_buf = buf;
+
+    while (len >= 4) {
+        if (tmp_buf[2] == 0) {
+            len--;
+            tmp_buf++;
+            continue;
+        }
+
+        if (tmp_buf[0] != 0 || tmp_buf[1] != 0 || tmp_buf[2] != 1) {
+            RK_U32 state = (RK_U32) - 1;
+            RK_S32 has_nal = 0;
+
+            for (i = 0; i < (RK_S32)len; i++) {
+                state = (state << 8) | tmp_buf[i];
+                if (((state >> 8) & 0xFFFFFF) == START_CODE) {
+                    has_nal = 1;
+                    i = i - 3;
+                    break;
+                }
+            }
+
+            if (has_nal) {
+                len -= i;
+                tmp_buf += i;
+                consumed = *length - len - 1;
+                break;
+            }
+
+            consumed = *length;
+            break;
+        }
+        tmp_buf   += 3;
+        len       -= 3;
+    }
+
+    *length = *length - consumed;
+    return consumed;
+}
+
+/* the copy-based stream amend before the in-place version */
+static RK_S32 ref_amend_proc(AmendTestCtx *ctx, RK_U8 *pkt, RK_S32 len)
+{
+    H264ePrefixNal *prefix = ctx->use_prefix ? &ctx->prefix : NULL;
+    H264eSlice *slice = &ctx->sw;
+    RK_U8 *src_buf = ctx->ref_src;
+    RK_U8 *dst_buf = ctx->ref_dst;
+    RK_S32 buf_size = ctx->ref_size;
+    RK_U8 *p = pkt;
+    RK_S32 final_len = 0;
+    RK_S32 last_slice = 0;
+
+    memset(ctx->ref_dst, 0, ctx->ref_size);
+    memset(ctx->ref_src, 0, ctx->ref_size);
+
+    do {
+        RK_S32 nal_len = 0;
+        RK_S32 hw_len_bit, sw_len_bit, hw_len_byte, sw_len_byte;
+        RK_S32 diff_size;
+        RK_S32 tail_0bit = 0;
+        RK_U8 tail_tmp;
+        H264eSlice slice_rd;
+
+        if (slice->is_multi_slice) {
+            nal_len = ref_get_next_nal(p, &len);
+            memcpy(src_buf, p, nal_len);
+            p += nal_len;
+            last_slice = (len == 0);
+        } else {
+            memcpy(src_buf, p, len);
+            nal_len = len;
+            last_slice = 1;
+        }
+
+        if (prefix) {
+            RK_S32 prefix_bit = h264e_slice_write_prefix_nal_unit_svc(prefix, dst_buf, buf_size);
+
+            prefix_bit = (prefix_bit + 7) / 8;
+            dst_buf += prefix_bit;
+            buf_size -= prefix_bit;
+            final_len += prefix_bit;
+        }
+
+        memcpy(&slice_rd, slice, sizeof(slice_rd));
+        slice_rd.log2_max_frame_num = 16;
+        slice_rd.pic_order_cnt_type = 2;
+
+        hw_len_bit = h264e_slice_read(&slice_rd, src_buf, nal_len);
+
+        slice->qp_delta = slice_rd.qp_delta;
+        slice->first_mb_in_slice = slice_rd.first_mb_in_slice;
+        sw_len_bit = h264e_slice_write(slice, dst_buf, buf_size);
+
+        hw_len_byte = (hw_len_bit + 7) / 8;
+        sw_len_byte = (sw_len_bit + 7) / 8;
+
+        tail_tmp = src_buf[nal_len - 1];
+        while (!(tail_tmp & 1) && tail_0bit < 8) {
+            tail_tmp >>= 1;
+            tail_0bit++;
+        }
+
+        diff_size = h264e_slice_move(dst_buf, src_buf, sw_len_bit, hw_len_bit, nal_len);
+
+        if (slice->entropy_coding_mode) {
+            memcpy(dst_buf + sw_len_byte, src_buf + hw_len_byte, nal_len - hw_len_byte);
+            final_len += nal_len - hw_len_byte + sw_len_byte;
+            nal_len = nal_len - hw_len_byte + sw_len_byte;
+        } else {
+            RK_S32 bit_len = nal_len * 8 - tail_0bit + sw_len_bit - hw_len_bit;
+            RK_S32 new_len = (bit_len + diff_size * 8 + 7) / 8;
+
+            nal_len = new_len;
+            final_len += new_len;
+        }
+
+        if (last_slice) {
+            memcpy(pkt, ctx->ref_dst, final_len);
+            if (!slice->entropy_coding_mode)
+                pkt[final_len] = 0;
+            break;
+        }
+
+        dst_buf += nal_len;
+        buf_size -= nal_len;
+    } while (1);
+
+    return final_len;
+}
+
+static void init_slice(H264eSlice *slice, H264eReorderInfo *reorder,
+                       H264eMarkingInfo *marking, RK_S32 cabac)
+{
+    h264e_slice_init(slice, reorder, marking);
+    h264e_reorder_init(reorder);
+    h264e_marking_init(marking);
+
+    slice->entropy_coding_mode = cabac;
+    slice->log2_max_frame_num = 16;
+    slice->log2_max_poc_lsb = 16;
+    slice->pic_order_cnt_type = 2;
+    slice->nal_reference_idc = 2;
+    slice->nalu_type = 1;
+    slice->slice_type = H264_P_SLICE;
+    slice->frame_num = 5;
+    slice->pic_order_cnt_lsb = 10;
+}
+
+static void set_reorder(H264eReorderInfo *reorder, RK_S32 abs_diff)
+{
+    H264eRplmo op;
+
+    h264e_reorder_wr_rewind(reorder);
+    if (abs_diff < 0)
+        return;
+
+    memset(&op, 0, sizeof(op));
+    op.modification_of_pic_nums_idc = 0;
+    op.abs_diff_pic_num_minus1 = abs_diff;
+    h264e_reorder_wr_op(reorder, &op);
+}
+
+/* hardware slice with random escaped slice data ending with stop bit */
+static RK_S32 gen_hw_slice(H264eSlice *hw, RK_U8 *buf, RK_S32 size, RK_S32 zero_ratio)
+{
+    RK_S32 len = (h264e_slice_write(hw, buf, size) + 7) / 8;
+    RK_S32 zero_cnt = 0;
+
+    while (zero_cnt < 2 && zero_cnt < len && !buf[len - 1 - zero_cnt])
+        zero_cnt++;
+
+    while (len < size - 2) {
+        RK_U8 byte = (rand() % zero_ratio) ? (RK_U8)(1 + rand() % 255) : 0;
+
+        if (zero_cnt == 2 && byte < 4) {
+            buf[len++] = 3;
+            zero_cnt = 0;
+        }
+
+        buf[len++] = byte;
+        zero_cnt = byte ? 0 : zero_cnt + 1;
+    }
+
+    buf[len++] = 0x80;
+    return len;
+}
+
+/*
+ * mode 0 - hardware header is shorter, slices grow
+ * mode 1 - hardware header is longer, slices shrink
+ * mode 2 - random per slice, slices grow and shrink
+ */
+static void gen_frame(AmendTestCtx *ctx, RK_S32 frame_size, RK_S32 slices,
+                      RK_S32 cabac, RK_S32 lsb_bits, RK_S32 mode)
+{
+    RK_S32 slice_size = frame_size / slices;
+    RK_S32 i;
+
+    init_slice(&ctx->hw, &ctx->hw_reorder, &ctx->hw_marking, cabac);
+    init_slice(&ctx->sw, &ctx->sw_reorder, &ctx->sw_marking, cabac);
+
+    ctx->sw.pic_order_cnt_type = 0;
+    ctx->sw.log2_max_poc_lsb = lsb_bits;
+    ctx->sw.is_multi_slice = slices > 1;
+    set_reorder(&ctx->sw_reorder, mode == 1 ? -1 : 0);
+
+    ctx->length = 0;
+    for (i = 0; i < slices; i++) {
+        RK_S32 hw_reorder = (mode == 1) ? 1 : (mode == 2) ? (rand() & 1) : 0;
+        RK_S32 size = slice_size;
+
+        if (mode == 2)
+            size = 16 + rand() % slice_size;
+
+        /* long abs_diff_pic_num_minus1 makes the hardware header longer */
+        set_reorder(&ctx->hw_reorder, hw_reorder ? 4000 : -1);
+        ctx->hw.first_mb_in_slice = i * AMEND_FRAME_MBS / slices;
+        ctx->hw.qp_delta = (mode == 2) ? rand() % 11 - 5 : 0;
+
+        ctx->length += gen_hw_slice(&ctx->hw, ctx->stream + ctx->length,
+                                    MPP_MAX(size, 64), AMEND_ZERO_RATIO);
+    }
+}
+
+static MPP_RET test_init(AmendTestCtx *ctx, RK_S32 frame_size)
+{
+    memset(ctx, 0, sizeof(*ctx));
+
+    /* room for the slice size variance of mode 2 and the amend growth */
+    ctx->size = frame_size * 2 + AMEND_MAX_SLICES * 256;
+    ctx->ref_size = ctx->size * 2;
+
+    ctx->stream = mpp_malloc(RK_U8, ctx->size);
+    ctx->pkt_buf = mpp_malloc(RK_U8, ctx->size * 2);
+    ctx->ref_pkt = mpp_malloc(RK_U8, ctx->size * 2);
+    ctx->ref_src = mpp_malloc(RK_U8, ctx->ref_size);
+    ctx->ref_dst = mpp_malloc(RK_U8, ctx->ref_size);
+
+    if (!ctx->stream || !ctx->pkt_buf || !ctx->ref_pkt || !ctx->ref_src || !ctx->ref_dst)
+        return MPP_ERR_MALLOC;
+
+    ctx->prefix.nal_ref_idc = 2;
+    ctx->prefix.priority_id = 1;
+    ctx->prefix.temporal_id = 1;
+
+    mpp_packet_init(&ctx->packet, ctx->pkt_buf, ctx->size * 2);
+    h264e_vepu_stream_amend_init(&ctx->amend);
+
+    return MPP_OK;
+}
+
+static void test_deinit(AmendTestCtx *ctx)
+{
+    h264e_vepu_stream_amend_deinit(&ctx->amend);
+    if (ctx->packet)
+        mpp_packet_deinit(&ctx->packet);
+
+    MPP_FREE(ctx->stream);
+    MPP_FREE(ctx->pkt_buf);
+    MPP_FREE(ctx->ref_pkt);
+    MPP_FREE(ctx->ref_src);
+    MPP_FREE(ctx->ref_dst);
+}
+
+static RK_S32 run_amend(AmendTestCtx *ctx)
+{
+    HalH264eVepuStreamAmend *amend = &ctx->amend;
+
+    amend->enable = 1;
+    amend->slice = &ctx->sw;
+    amend->prefix = ctx->use_prefix ? &ctx->prefix : NULL;
+    amend->packet = ctx->packet;
+    amend->buf_base = 0;
+    amend->old_length = ctx->length;
+
+    h264e_vepu_stream_amend_proc(amend);
+
+    return amend->new_length;
+}
+
+static MPP_RET amend_check(AmendTestCtx *ctx)
+{
+    RK_S32 loop;
+
+    for (loop = 0; loop < AMEND_CHECK_LOOP; loop++) {
+        RK_S32 slices = 1 + rand() % AMEND_MAX_SLICES;
+        RK_S32 cabac = rand() & 1;
+        RK_S32 lsb_bits = 4 + rand() % 13;
+        RK_S32 mode = rand() % 3;
+        RK_S32 len, ref_len;
+
+        ctx->use_prefix = rand() & 1;
+        gen_frame(ctx, 256 + rand() % AMEND_CHECK_SIZE, slices, cabac, lsb_bits, mode);
+
+        memcpy(ctx->ref_pkt, ctx->stream, ctx->length);
+        memcpy(ctx->pkt_buf, ctx->stream, ctx->length);
+
+        ref_len = ref_amend_proc(ctx, ctx->ref_pkt, ctx->length);
+        len = run_amend(ctx);
+
+        if (len != ref_len || memcmp(ctx->pkt_buf, ctx->ref_pkt, len)) {
+            mpp_err("loop %d slices %d cabac %d lsb %d mode %d prefix %d len %d -> %d mismatch ref %d\n",
+                    loop, slices, cabac, lsb_bits, mode, ctx->use_prefix,
+                    ctx->length, len, ref_len);
+            return MPP_NOK;
+        }
+    }
+
+    mpp_log("stream amend check pass\n");
+    return MPP_OK;
+}
+
+/* find the poc lsb bits to get the same or different header bit position in byte */
+static RK_S32 get_lsb_bits(AmendTestCtx *ctx, RK_S32 cabac, RK_S32 aligned)
+{
+    RK_U8 hdr[256];
+    RK_S32 bits;
+
+    for (bits = 4; bits <= 16; bits++) {
+        RK_S32 hw_bit, sw_bit;
+
+        gen_frame(ctx, 256, 1, cabac, bits, 0);
+        /* the amend keeps the hardware qp_delta and first_mb_in_slice */
+        ctx->sw.qp_delta = ctx->hw.qp_delta;
+        ctx->sw.first_mb_in_slice = ctx->hw.first_mb_in_slice;
+        hw_bit = h264e_slice_write(&ctx->hw, hdr, sizeof(hdr));
+        sw_bit = h264e_slice_write(&ctx->sw, hdr, sizeof(hdr));
+
+        if (((hw_bit & 7) == (sw_bit & 7)) == aligned)
+            return bits;
+    }
+
+    return 16;
+}
+
+static void amend_bench(AmendTestCtx *ctx, RK_S32 frame_size)
+{
+    static const char *name[] = { "cavlc shift", "cavlc align", "cabac" };
+    RK_S32 slices;
+    RK_S32 type;
+
+    ctx->use_prefix = 0;
+
+    for (type = 0; type < 3; type++) {
+        RK_S32 cabac = (type == 2);
+        RK_S32 lsb_bits = get_lsb_bits(ctx, cabac, type != 0);
+
+        for (slices = 1; slices <= AMEND_MAX_SLICES; slices *= 2) {
+            RK_S64 time = 0;
+            RK_S64 time_ref = 0;
+            RK_S64 start;
+            RK_S32 loop;
+
+            gen_frame(ctx, frame_size, slices, cabac, lsb_bits, 0);
+
+            for (loop = 0; loop < AMEND_BENCH_LOOP; loop++) {
+                memcpy(ctx->ref_pkt, ctx->stream, ctx->length);
+                memcpy(ctx->pkt_buf, ctx->stream, ctx->length);
+
+                start = mpp_time();
+                ref_amend_proc(ctx, ctx->ref_pkt, ctx->length);
+                time_ref += mpp_time() - start;
+
+                start = mpp_time();
+                run_amend(ctx);
+                time += mpp_time() - start;
+            }
+
+            mpp_log("%-11s %d bytes %2d slices: in-place %6lld us copy %6lld us per frame\n",
+                    name[type], ctx->length, slices,
+                    time / AMEND_BENCH_LOOP, time_ref / AMEND_BENCH_LOOP);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    RK_S32 frame_size = AMEND_BENCH_SIZE;
+    AmendTestCtx ctx;
+    MPP_RET ret;
+
+    if (argc > 1)
+        frame_size = atoi(argv[1]);
+    if (frame_size <= 0)
+        frame_size = AMEND_BENCH_SIZE;
+
+    frame_size = MPP_MAX(frame_size * 1024, AMEND_CHECK_SIZE);
+
+    mpp_log("h264e_amend_test start\n");
+
+    ret = test_init(&ctx, frame_size);
+    if (!ret)
+        ret = amend_check(&ctx);
+    if (!ret)
+        amend_bench(&ctx, frame_size);
+
+    test_deinit(&ctx);
+
+    mpp_log("h264e_amend_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
@@ -16,6 +16,7 @@
 
 #include "mpp_log.h"
 #include "mpp_mem.h"
+#include "mpp_bitwrite.h"
 
 #include "hal_jpege_hdr.h"
 
@@ -559,19 +560,10 @@ static const JpegeHuffmanTable ac_vij[162] = {
     {0xFA, 0xFA}
 };
 
-typedef struct {
-    RK_U8 *buffer;          /* Pointer to first byte of stream */
-    RK_U8 *stream;          /* Pointer to next byte of stream */
-    RK_U32 size;            /* Byte size of stream buffer */
-    RK_U32 byteCnt;         /* Byte counter */
-    RK_U32 bitCnt;          /* Bit counter */
-    RK_U32 byteBuffer;      /* Byte buffer */
-    RK_U32 bufferedBits;    /* Amount of bits in byte buffer, [0-7] */
-} JpegeBitsImpl;
-
+/* jpeg header has no emulation prevention, all bits are written as raw bits */
 void jpege_bits_init(JpegeBits *ctx)
 {
-    JpegeBitsImpl *impl = mpp_malloc(JpegeBitsImpl, 1);
+    MppWriteCtx *impl = mpp_malloc(MppWriteCtx, 1);
     *ctx = impl;
 }
 
@@ -583,93 +575,42 @@ void jpege_bits_deinit(JpegeBits ctx)
 
 void jpege_bits_setup(JpegeBits ctx, RK_U8 *buf, RK_S32 size)
 {
-    JpegeBitsImpl *impl = (JpegeBitsImpl *)ctx;
-
-    impl->buffer = buf;
-    impl->stream = buf;
-    impl->size = size;
-    impl->byteCnt = 0;
-    impl->bitCnt = 0;
-    impl->byteBuffer = 0;
-    impl->bufferedBits = 0;
+    mpp_writer_init((MppWriteCtx *)ctx, buf, size);
 }
 
 void jpege_bits_put(JpegeBits ctx, RK_U32 value, RK_S32 number)
 {
-    JpegeBitsImpl *impl = (JpegeBitsImpl *)ctx;
-
-    RK_U32 bits;
-    RK_U32 byteBuffer = impl->byteBuffer;
-    RK_U8 *stream = impl->stream;
-
-    /* Debug: value is too big */
-    mpp_assert(value < ((RK_U32) 1 << number));
-    mpp_assert(number < 25);
-
-    bits = number + impl->bufferedBits;
-
-    value <<= (32 - bits);
-    byteBuffer = (((RK_U32) stream[0]) << 24) | value;
-
-    while (bits > 7) {
-        *stream = (RK_U8) (byteBuffer >> 24);
-        bits -= 8;
-        byteBuffer <<= 8;
-        stream++;
-        impl->byteCnt++;
-    }
-
-    stream[0] = (RK_U8) (byteBuffer >> 24);
-    impl->stream = stream;
-    impl->bitCnt += number;
-    impl->byteBuffer = byteBuffer;
-    impl->bufferedBits = (RK_U8) bits;
+    mpp_writer_put_raw_bits((MppWriteCtx *)ctx, value, number);
 }
 
 void jpege_seek_bits(JpegeBits ctx, RK_S32 len)
 {
-    JpegeBitsImpl *impl = (JpegeBitsImpl*)ctx;
-    RK_U32 bits = len;
-    RK_U8 *stream = impl->stream;
+    MppWriteCtx *impl = (MppWriteCtx *)ctx;
 
-    mpp_assert(bits < impl->size);
+    mpp_assert((RK_U32)len < impl->size * 8);
 
-    while (bits > 7) {
-        stream++;
-        impl->byteCnt++;
-        bits -= 8;
-    }
-
-    impl->stream = stream;
-    impl->bitCnt += len;
-    impl->byteBuffer = (RK_U32)stream[0];
-    impl->bufferedBits = (RK_U8) bits;
+    mpp_writer_skip_bits(impl, len);
 }
 
 void jpege_bits_align_byte(JpegeBits ctx)
 {
-    JpegeBitsImpl *impl = (JpegeBitsImpl *)ctx;
-
-    if (impl->bitCnt & 7)
-        jpege_bits_put(ctx, 0, 8 - (impl->bitCnt & 7));
+    mpp_writer_align_zero((MppWriteCtx *)ctx);
 }
 
 RK_U8 *jpege_bits_get_buf(JpegeBits ctx)
 {
-    JpegeBitsImpl *impl = (JpegeBitsImpl *)ctx;
+    MppWriteCtx *impl = (MppWriteCtx *)ctx;
     return impl->buffer;
 }
 
 RK_S32  jpege_bits_get_bitpos(JpegeBits ctx)
 {
-    JpegeBitsImpl *impl = (JpegeBitsImpl *)ctx;
-    return impl->bitCnt;
+    return mpp_writer_bits((MppWriteCtx *)ctx);
 }
 
 RK_S32 jpege_bits_get_bytepos(JpegeBits ctx)
 {
-    JpegeBitsImpl *impl = (JpegeBitsImpl *)ctx;
-    return impl->byteCnt;
+    return mpp_writer_bits((MppWriteCtx *)ctx) >> 3;
 }
 
 static void write_jpeg_comment_header(JpegeBits *bits, JpegeSyntax *syntax)
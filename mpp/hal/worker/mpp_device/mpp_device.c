@@ -31,6 +31,7 @@
 #include "mpp_device.h"
 #include "mpp_device_msg.h"
 #include "mpp_platform.h"
+#include "mpp_device_sim.h"
 
 #include "vpu.h"
 
@@ -74,6 +75,7 @@ typedef struct MppDevCtxImpl_t {
     RK_U32 mmu_status;      // 0 disable, 1 enable
     RK_U32 pp_enable;       // postprocess, 0 disable, 1 enable
     RK_S32 vpu_fd;
+    MppDevSim sim;          // simulated mpp_service when no hardware
 
     RK_S64 time_start[MAX_TIME_RECORD];
     RK_S64 time_end[MAX_TIME_RECORD];
@@ -116,7 +118,15 @@ typedef struct MppDevCtxImpl_t {
 
 static RK_U32 mpp_device_debug = 0;
 
-static RK_U32 mpp_probe_hw_support(RK_S32 dev)
+static RK_S32 mpp_device_ioctl_v1(MppDevCtxImpl *p, RK_S32 dev, void *req)
+{
+    if (p->sim)
+        return mpp_dev_sim_ioctl(p->sim, req);
+
+    return (RK_S32)ioctl(dev, MPP_IOC_CFG_V1, req);
+}
+
+static RK_U32 mpp_probe_hw_support(MppDevCtxImpl *p, RK_S32 dev)
 {
     RK_S32 ret;
     RK_U32 flag = 0;
@@ -128,7 +138,7 @@ static RK_U32 mpp_probe_hw_support(RK_S32 dev)
     mpp_req.offset = 0;
     mpp_req.data_ptr = REQ_DATA_PTR(&flag);
 
-    ret = (RK_S32)ioctl(dev, MPP_IOC_CFG_V1, &mpp_req);
+    ret = mpp_device_ioctl_v1(p, dev, &mpp_req);
     if (ret) {
         mpp_err_f("probe hw support error %s.\n", strerror(errno));
         flag = 0;
@@ -140,7 +150,7 @@ static RK_U32 mpp_probe_hw_support(RK_S32 dev)
     return flag;
 }
 
-static RK_U32 mpp_get_hw_id(RK_S32 dev)
+static RK_U32 mpp_get_hw_id(MppDevCtxImpl *p, RK_S32 dev)
 {
     RK_S32 ret;
     RK_U32 flag = 0;
@@ -152,7 +162,7 @@ static RK_U32 mpp_get_hw_id(RK_S32 dev)
     mpp_req.offset = 0;
     mpp_req.data_ptr = REQ_DATA_PTR(&flag);
 
-    ret = (RK_S32)ioctl(dev, MPP_IOC_CFG_V1, &mpp_req);
+    ret = mpp_device_ioctl_v1(p, dev, &mpp_req);
     if (ret) {
         mpp_err_f("get hw id error %s.\n", strerror(errno));
         flag = 0;
@@ -177,7 +187,7 @@ static RK_S32 mpp_device_set_client_type(MppDevCtx ctx, int dev, RK_S32 client_t
         mpp_req.size = sizeof(client_data);
         mpp_req.offset = 0;
         mpp_req.data_ptr = REQ_DATA_PTR(&client_data);
-        ret = (RK_S32)ioctl(dev, MPP_IOC_CFG_V1, &mpp_req);
+        ret = mpp_device_ioctl_v1(p, dev, &mpp_req);
     } else {
         if (mpp_device_ioctl_version < 0) {
             ret = ioctl(dev, VPU_IOC_SET_CLIENT_TYPE, (unsigned long)client_type);
@@ -267,37 +277,48 @@ MPP_RET mpp_device_init(MppDevCtx *ctx, MppDevCfg *cfg)
     p->pp_enable = cfg->pp_enable;
     p->ioctl_version = mpp_get_ioctl_version();
 
-    if (p->platform)
-        name = mpp_get_platform_dev_name(p->type, p->coding, p->platform);
-    else
-        name = mpp_get_vcodec_dev_name(p->type, p->coding);
-    if (name) {
-        dev = open(name, O_RDWR);
-        if (dev > 0) {
-            RK_S32 client_type;
-            RK_S32 ret;
-
-            /* if ioctl_version is 1, query hw supprot*/
-            if (p->ioctl_version > 0)
-                mpp_probe_hw_support(dev);
-
-            client_type = mpp_device_get_client_type(p, p->type, p->coding);
-            ret = mpp_device_set_client_type(p, dev, client_type);
-            if (ret) {
-                close(dev);
-                dev = -2;
-            }
-            p->client_type = client_type;
+    if (mpp_get_device_sim()) {
+        if (mpp_dev_sim_open(&p->sim))
+            mpp_err_f("failed to open simulated device\n");
+    } else {
+        if (p->platform)
+            name = mpp_get_platform_dev_name(p->type, p->coding, p->platform);
+        else
+            name = mpp_get_vcodec_dev_name(p->type, p->coding);
+        if (name) {
+            dev = open(name, O_RDWR);
+            if (dev <= 0)
+                mpp_err_f("failed to open device %s, errno %d, error msg: %s\n",
+                          name, errno, strerror(errno));
         } else
-            mpp_err_f("failed to open device %s, errno %d, error msg: %s\n",
-                      name, errno, strerror(errno));
-    } else
-        mpp_err_f("failed to find device for coding %d type %d\n", p->coding, p->type);
+            mpp_err_f("failed to find device for coding %d type %d\n", p->coding, p->type);
+    }
+
+    if (dev > 0 || p->sim) {
+        RK_S32 client_type;
+        RK_S32 ret;
+
+        /* if ioctl_version is 1, query hw supprot*/
+        if (p->ioctl_version > 0)
+            mpp_probe_hw_support(p, dev);
+
+        client_type = mpp_device_get_client_type(p, p->type, p->coding);
+        ret = mpp_device_set_client_type(p, dev, client_type);
+        if (ret) {
+            if (p->sim) {
+                mpp_dev_sim_close(p->sim);
+                p->sim = NULL;
+            } else
+                close(dev);
+            dev = -2;
+        }
+        p->client_type = client_type;
+    }
 
     *ctx = p;
     p->vpu_fd = dev;
     if (p->ioctl_version > 0)
-        cfg->hw_id = mpp_get_hw_id(dev);
+        cfg->hw_id = mpp_get_hw_id(p, dev);
     else
         cfg->hw_id = 0;
 
@@ -318,7 +339,9 @@ MPP_RET mpp_device_deinit(MppDevCtx ctx)
 
     p = (MppDevCtxImpl *)ctx;
 
-    if (p->vpu_fd > 0) {
+    if (p->sim) {
+        mpp_dev_sim_close(p->sim);
+    } else if (p->vpu_fd > 0) {
         close(p->vpu_fd);
     } else {
         mpp_err_f("invalid negtive file handle,\n");
@@ -402,7 +425,7 @@ MPP_RET mpp_device_send_request(MppDevCtx ctx)
 
     mpp_dev_dbg_detail("enter %p cnt %d\n", ctx, p->req_cnt);
 
-    MPP_RET ret = (RK_S32)ioctl(p->vpu_fd, MPP_IOC_CFG_V1, &p->reqs[0]);
+    MPP_RET ret = mpp_device_ioctl_v1(p, p->vpu_fd, &p->reqs[0]);
     if (ret) {
         mpp_err_f("ioctl MPP_IOC_CFG_V1 failed ret %d errno %d %s\n",
                   ret, errno, strerror(errno));
@@ -433,7 +456,7 @@ MPP_RET mpp_device_send_single_request(MppDevCtx ctx, MppDevReqV1 *req)
         return MPP_ERR_PERM;
     }
 
-    ret = (RK_S32)ioctl(p->vpu_fd, MPP_IOC_CFG_V1, req);
+    ret = mpp_device_ioctl_v1(p, p->vpu_fd, req);
     if (ret) {
         mpp_err_f("ioctl MPP_IOC_CFG_V1 failed ret %d errno %d %s\n",
                   ret, errno, strerror(errno));
@@ -0,0 +1,509 @@
+/*
+ * Copyright 2020 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_dev_sim"
+
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mpp_env.h"
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_list.h"
+#include "mpp_time.h"
+#include "mpp_common.h"
+
+#include "mpp_device.h"
+#include "mpp_platform.h"
+#include "mpp_device_sim.h"
+
+#define SIM_MAX_REQ_NUM             16
+#define SIM_MAX_READ_NUM            16
+
+#define SIM_DBG_TIME                (0x00000020)
+
+/* same layout as struct mpp_request in mpp_service kernel driver */
+typedef struct MppDevSimReq_t {
+    RK_U32 cmd;
+    RK_U32 flag;
+    RK_U32 size;
+    RK_U32 offset;
+    RK_U64 data_ptr;
+} MppDevSimReq;
+
+#define SIM_REQ_DATA(req)           ((void *)(intptr_t)(req)->data_ptr)
+
+typedef struct SimRegRead_t {
+    RK_U8           *dst;
+    RK_U32          offset;
+    RK_U32          size;
+} SimRegRead;
+
+typedef struct SimTask_t {
+    /* link in service running list */
+    struct list_head service;
+    /* link in session submitted list */
+    struct list_head session;
+
+    RK_U8           *regs;
+    RK_U32          reg_size;
+
+    SimRegRead      reads[SIM_MAX_READ_NUM];
+    RK_S32          read_cnt;
+
+    RK_S32          client_type;
+    RK_S64          time_finish;
+    RK_S32          done;
+} SimTask;
+
+typedef struct SimCore_t {
+    RK_S64          busy_until;
+    RK_S32          running;
+    RK_S32          task_cnt;
+    RK_S64          busy_time;
+} SimCore;
+
+typedef struct SimSession_t {
+    RK_S32          client_type;
+    struct list_head tasks;
+} SimSession;
+
+typedef struct SimService_t {
+    pthread_t       thread;
+    pthread_cond_t  cond_work;
+    pthread_cond_t  cond_done;
+    RK_S32          thread_run;
+    RK_S32          session_cnt;
+
+    struct list_head running;
+    SimCore         cores[VPU_CLIENT_BUTT];
+
+    RK_U32          vcodec_type;
+    RK_U32          hw_id;
+    RK_U32          latency;
+    RK_U32          depth;
+    RK_U32          debug;
+} SimService;
+
+/* one simulated kernel driver shared by all sessions in the process */
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static SimService *sim_srv = NULL;
+
+static void *sim_service_thread(void *arg)
+{
+    SimService *srv = (SimService *)arg;
+
+    pthread_mutex_lock(&sim_lock);
+
+    while (srv->thread_run) {
+        SimTask *task, *n;
+        RK_S64 now = mpp_time();
+        RK_S64 next = INT64_MAX;
+        RK_S32 finished = 0;
+
+        list_for_each_entry_safe(task, n, &srv->running, SimTask, service) {
+            if (task->time_finish <= now) {
+                srv->cores[task->client_type].running--;
+                list_del_init(&task->service);
+                task->done = 1;
+                finished++;
+            } else if (task->time_finish < next) {
+                next = task->time_finish;
+            }
+        }
+
+        if (finished)
+            pthread_cond_broadcast(&srv->cond_done);
+
+        if (next == INT64_MAX) {
+            pthread_cond_wait(&srv->cond_work, &sim_lock);
+        } else {
+            struct timespec ts;
+            RK_S64 wait = next - now;
+
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += wait / 1000000;
+            ts.tv_nsec += (wait % 1000000) * 1000;
+            ts.tv_sec += ts.tv_nsec / 1000000000;
+            ts.tv_nsec %= 1000000000;
+
+            pthread_cond_timedwait(&srv->cond_work, &sim_lock, &ts);
+        }
+    }
+
+    pthread_mutex_unlock(&sim_lock);
+
+    return NULL;
+}
+
+static SimService *sim_service_get(void)
+{
+    SimService *srv = sim_srv;
+    pthread_condattr_t attr;
+
+    if (srv) {
+        srv->session_cnt++;
+        return srv;
+    }
+
+    srv = mpp_calloc(SimService, 1);
+    if (NULL == srv)
+        return NULL;
+
+    mpp_env_get_u32("mpp_device_sim_latency", &srv->latency, 0);
+    mpp_env_get_u32("mpp_device_sim_depth", &srv->depth, 4);
+    mpp_env_get_u32("mpp_device_sim_hw_id", &srv->hw_id, 0);
+    mpp_env_get_u32("mpp_device_debug", &srv->debug, 0);
+    srv->vcodec_type = mpp_get_vcodec_type();
+    if (!srv->depth)
+        srv->depth = 1;
+
+    INIT_LIST_HEAD(&srv->running);
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&srv->cond_work, &attr);
+    pthread_cond_init(&srv->cond_done, &attr);
+    pthread_condattr_destroy(&attr);
+
+    srv->thread_run = 1;
+    if (pthread_create(&srv->thread, NULL, sim_service_thread, srv)) {
+        mpp_err_f("failed to create service thread\n");
+        pthread_cond_destroy(&srv->cond_work);
+        pthread_cond_destroy(&srv->cond_done);
+        mpp_free(srv);
+        return NULL;
+    }
+
+    mpp_log("simulated device vcodec %08x latency %d us depth %d\n",
+            srv->vcodec_type, srv->latency, srv->depth);
+
+    srv->session_cnt = 1;
+    sim_srv = srv;
+    return srv;
+}
+
+static void sim_service_put(SimService *srv)
+{
+    RK_S32 i;
+
+    if (--srv->session_cnt)
+        return;
+
+    sim_srv = NULL;
+    srv->thread_run = 0;
+    pthread_cond_signal(&srv->cond_work);
+    pthread_mutex_unlock(&sim_lock);
+    pthread_join(srv->thread, NULL);
+    pthread_mutex_lock(&sim_lock);
+
+    if (srv->debug & SIM_DBG_TIME) {
+        for (i = 0; i < VPU_CLIENT_BUTT; i++) {
+            SimCore *core = &srv->cores[i];
+
+            if (!core->task_cnt)
+                continue;
+
+            mpp_log("client %2d task %d busy %lld us\n", i,
+                    core->task_cnt, core->busy_time);
+        }
+    }
+
+    pthread_cond_destroy(&srv->cond_work);
+    pthread_cond_destroy(&srv->cond_done);
+    mpp_free(srv);
+}
+
+static RK_S32 sim_task_write(SimTask *task, RK_U32 offset, void *data, RK_U32 size)
+{
+    RK_U32 end = offset + size;
+
+    if (NULL == data || end < offset) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (end > task->reg_size) {
+        RK_U32 reg_size = MPP_ALIGN(end, 4);
+        RK_U8 *regs = mpp_realloc(task->regs, RK_U8, reg_size);
+
+        if (NULL == regs) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        memset(regs + task->reg_size, 0, reg_size - task->reg_size);
+        task->regs = regs;
+        task->reg_size = reg_size;
+    }
+
+    memcpy(task->regs + offset, data, size);
+    return 0;
+}
+
+static RK_S32 sim_task_read(SimTask *task, RK_U32 offset, void *data, RK_U32 size)
+{
+    SimRegRead *read;
+
+    if (NULL == data || task->read_cnt >= SIM_MAX_READ_NUM) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    read = &task->reads[task->read_cnt++];
+    read->dst = (RK_U8 *)data;
+    read->offset = offset;
+    read->size = size;
+    return 0;
+}
+
+static void sim_task_free(SimTask *task)
+{
+    MPP_FREE(task->regs);
+    mpp_free(task);
+}
+
+static RK_S32 sim_task_submit(SimSession *session, SimTask *task)
+{
+    SimService *srv = sim_srv;
+    SimCore *core;
+    RK_S64 start;
+
+    if (session->client_type < 0 || session->client_type >= VPU_CLIENT_BUTT) {
+        mpp_err_f("invalid client type %d\n", session->client_type);
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+
+    core = &srv->cores[session->client_type];
+
+    /* hardware queue full then block like waiting for a free task slot */
+    while (core->running >= (RK_S32)srv->depth)
+        pthread_cond_wait(&srv->cond_done, &sim_lock);
+
+    /* tasks on one client run in order after the previous one is done */
+    start = MPP_MAX(mpp_time(), core->busy_until);
+    task->client_type = session->client_type;
+    task->time_finish = start + srv->latency;
+    core->busy_until = task->time_finish;
+    core->busy_time += srv->latency;
+    core->running++;
+    core->task_cnt++;
+
+    list_add_tail(&task->service, &srv->running);
+    list_add_tail(&task->session, &session->tasks);
+    pthread_cond_signal(&srv->cond_work);
+
+    pthread_mutex_unlock(&sim_lock);
+
+    return 0;
+}
+
+static RK_S32 sim_session_poll(SimSession *session)
+{
+    SimService *srv = sim_srv;
+    SimTask *task;
+    RK_S32 i;
+
+    pthread_mutex_lock(&sim_lock);
+
+    if (list_empty(&session->tasks)) {
+        pthread_mutex_unlock(&sim_lock);
+        mpp_err_f("poll without task\n");
+        errno = EINVAL;
+        return -1;
+    }
+
+    task = list_entry(session->tasks.next, SimTask, session);
+    while (!task->done)
+        pthread_cond_wait(&srv->cond_done, &sim_lock);
+
+    list_del_init(&task->session);
+
+    pthread_mutex_unlock(&sim_lock);
+
+    /* no real hardware behind so the written registers are read back */
+    for (i = 0; i < task->read_cnt; i++) {
+        SimRegRead *read = &task->reads[i];
+        RK_U32 size = 0;
+
+        if (read->offset < task->reg_size)
+            size = MPP_MIN(read->size, task->reg_size - read->offset);
+
+        if (size)
+            memcpy(read->dst, task->regs + read->offset, size);
+        if (size < read->size)
+            memset(read->dst + size, 0, read->size - size);
+    }
+
+    sim_task_free(task);
+    return 0;
+}
+
+MPP_RET mpp_dev_sim_open(MppDevSim *sim)
+{
+    SimSession *session;
+
+    if (NULL == sim) {
+        mpp_err_f("found NULL input\n");
+        return MPP_ERR_NULL_PTR;
+    }
+
+    *sim = NULL;
+
+    session = mpp_calloc(SimSession, 1);
+    if (NULL == session) {
+        mpp_err_f("failed to malloc session\n");
+        return MPP_ERR_MALLOC;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    if (NULL == sim_service_get()) {
+        pthread_mutex_unlock(&sim_lock);
+        mpp_free(session);
+        return MPP_NOK;
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    session->client_type = -1;
+    INIT_LIST_HEAD(&session->tasks);
+
+    *sim = session;
+    return MPP_OK;
+}
+
+MPP_RET mpp_dev_sim_close(MppDevSim sim)
+{
+    SimSession *session = (SimSession *)sim;
+    SimService *srv;
+    SimTask *task, *n;
+
+    if (NULL == session) {
+        mpp_err_f("found NULL input\n");
+        return MPP_ERR_NULL_PTR;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+
+    srv = sim_srv;
+
+    /* tasks not polled are still owned by hardware until they finish */
+    list_for_each_entry_safe(task, n, &session->tasks, SimTask, session) {
+        while (!task->done)
+            pthread_cond_wait(&srv->cond_done, &sim_lock);
+
+        list_del_init(&task->session);
+        sim_task_free(task);
+    }
+
+    sim_service_put(srv);
+
+    pthread_mutex_unlock(&sim_lock);
+
+    mpp_free(session);
+    return MPP_OK;
+}
+
+RK_S32 mpp_dev_sim_ioctl(MppDevSim sim, void *req)
+{
+    SimSession *session = (SimSession *)sim;
+    MppDevSimReq *reqs = (MppDevSimReq *)req;
+    SimTask *task = NULL;
+    RK_S32 ret = 0;
+    RK_S32 i;
+
+    if (NULL == session || NULL == reqs) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < SIM_MAX_REQ_NUM; i++) {
+        MppDevSimReq *r = &reqs[i];
+        void *data = SIM_REQ_DATA(r);
+
+        switch (r->cmd) {
+        case MPP_CMD_PROBE_HW_SUPPORT : {
+            *(RK_U32 *)data = sim_srv->vcodec_type;
+        } break;
+        case MPP_CMD_QUERY_HW_ID : {
+            *(RK_U32 *)data = sim_srv->hw_id;
+        } break;
+        case MPP_CMD_INIT_CLIENT_TYPE : {
+            session->client_type = *(RK_U32 *)data;
+        } break;
+        case MPP_CMD_SET_REG_WRITE :
+        case MPP_CMD_SET_REG_READ : {
+            if (NULL == task) {
+                task = mpp_calloc(SimTask, 1);
+                if (NULL == task) {
+                    errno = ENOMEM;
+                    ret = -1;
+                    break;
+                }
+                INIT_LIST_HEAD(&task->service);
+                INIT_LIST_HEAD(&task->session);
+            }
+
+            if (r->cmd == MPP_CMD_SET_REG_WRITE)
+                ret = sim_task_write(task, r->offset, data, r->size);
+            else
+                ret = sim_task_read(task, r->offset, data, r->size);
+        } break;
+        case MPP_CMD_POLL_HW_FINISH : {
+            ret = sim_session_poll(session);
+        } break;
+        case MPP_CMD_INIT_DRIVER_DATA :
+        case MPP_CMD_INIT_TRANS_TABLE :
+        case MPP_CMD_SET_REG_ADDR_OFFSET :
+        case MPP_CMD_RESET_SESSION :
+        case MPP_CMD_TRANS_FD_TO_IOVA : {
+            /* no iommu and no address translation on simulation */
+        } break;
+        default : {
+            mpp_err_f("unsupported cmd %x\n", r->cmd);
+            errno = EINVAL;
+            ret = -1;
+        } break;
+        }
+
+        if (ret)
+            break;
+
+        if (!(r->flag & MPP_FLAGS_MULTI_MSG) || (r->flag & MPP_FLAGS_LAST_MSG))
+            break;
+    }
+
+    if (task) {
+        if (!ret && !task->reg_size) {
+            mpp_err_f("register read without write\n");
+            errno = EINVAL;
+            ret = -1;
+        }
+
+        if (!ret)
+            ret = sim_task_submit(session, task);
+
+        if (ret)
+            sim_task_free(task);
+    }
+
+    return ret;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2020 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MPP_DEVICE_SIM_H__
+#define __MPP_DEVICE_SIM_H__
+
+#include "rk_type.h"
+
+/*
+ * User space emulation of /dev/mpp_service for hardware free running.
+ *
+ * Enabled by env mpp_device_sim=1. The simulated kernel accepts the same
+ * MPP_IOC_CFG_V1 request array as the real driver:
+ * - SET_REG_WRITE registers are copied into a task
+ * - SET_REG_READ buffers are recorded and filled on POLL_HW_FINISH
+ * - each hardware client runs its tasks in order with a fixed per frame
+ *   latency and a limited number of in-flight tasks
+ * - a service thread completes tasks asynchronously like the irq handler
+ *
+ * env options:
+ * mpp_device_sim_soc       - soc name for capability, default rk3399
+ * mpp_device_sim_latency   - hardware latency per frame in us, default 0
+ * mpp_device_sim_depth     - in-flight task limit per client, default 4
+ * mpp_device_sim_hw_id     - value returned by hardware id query, default 0
+ */
+typedef void* MppDevSim;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MPP_RET mpp_dev_sim_open(MppDevSim *sim);
+MPP_RET mpp_dev_sim_close(MppDevSim sim);
+
+/* same behavior as ioctl(fd, MPP_IOC_CFG_V1, req) including errno */
+RK_S32 mpp_dev_sim_ioctl(MppDevSim sim, void *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MPP_DEVICE_SIM_H__ */
@@ -0,0 +1,294 @@
+/*
+ * Copyright 2020 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_device_sim_test"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_time.h"
+#include "mpp_common.h"
+#include "mpp_platform.h"
+
+#include "mpp_device.h"
+#include "mpp_device_msg.h"
+
+/*
+ * simulated mpp_service check and throughput benchmark
+ *
+ * 1. register round trip and per frame software overhead without latency
+ * 2. sessions on one hardware client are serialized by the latency model
+ * 3. sessions on different clients run in parallel
+ * 4. pipelined submission with multi-message requests and the depth limit
+ */
+#define SIM_REG_NUM             128
+#define SIM_OVERHEAD_FRAMES     2000
+#define SIM_LATENCY             1000
+#define SIM_LATENCY_FRAMES      50
+#define SIM_PIPELINE_FRAMES     16
+#define SIM_PIPELINE_DEPTH      4
+
+typedef struct SimTestCtx_t {
+    MppCtxType      type;
+    MppCodingType   coding;
+    RK_U32          platform;
+    RK_S32          frames;
+    RK_S32          seed;
+    MPP_RET         ret;
+} SimTestCtx;
+
+static void set_sim_env(RK_U32 latency, RK_U32 depth)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%d", latency);
+    setenv("mpp_device_sim_latency", buf, 1);
+    snprintf(buf, sizeof(buf), "%d", depth);
+    setenv("mpp_device_sim_depth", buf, 1);
+}
+
+static void *sim_session_proc(void *arg)
+{
+    SimTestCtx *ctx = (SimTestCtx *)arg;
+    RK_U32 regs[SIM_REG_NUM];
+    MppDevCtx dev = NULL;
+    MppDevCfg cfg;
+    RK_S32 i, j;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.type = ctx->type;
+    cfg.coding = ctx->coding;
+    cfg.platform = ctx->platform;
+
+    ctx->ret = mpp_device_init(&dev, &cfg);
+    if (ctx->ret)
+        return NULL;
+
+    for (i = 0; i < ctx->frames; i++) {
+        for (j = 0; j < SIM_REG_NUM; j++)
+            regs[j] = ctx->seed + i * SIM_REG_NUM + j;
+
+        ctx->ret = mpp_device_send_reg(dev, regs, SIM_REG_NUM);
+        if (ctx->ret)
+            break;
+
+        memset(regs, 0, sizeof(regs));
+
+        ctx->ret = mpp_device_wait_reg(dev, regs, SIM_REG_NUM);
+        if (ctx->ret)
+            break;
+
+        for (j = 0; j < SIM_REG_NUM; j++) {
+            if (regs[j] != (RK_U32)(ctx->seed + i * SIM_REG_NUM + j)) {
+                mpp_err("frame %d reg %d mismatch %08x\n", i, j, regs[j]);
+                ctx->ret = MPP_NOK;
+                break;
+            }
+        }
+        if (ctx->ret)
+            break;
+    }
+
+    mpp_device_deinit(dev);
+    return NULL;
+}
+
+static MPP_RET sim_run_sessions(SimTestCtx *ctxs, RK_S32 count, RK_S64 *time)
+{
+    pthread_t threads[4];
+    RK_S64 start;
+    MPP_RET ret = MPP_OK;
+    RK_S32 i;
+
+    start = mpp_time();
+    for (i = 0; i < count; i++)
+        pthread_create(&threads[i], NULL, sim_session_proc, &ctxs[i]);
+    for (i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+        if (ctxs[i].ret)
+            ret = ctxs[i].ret;
+    }
+    *time = mpp_time() - start;
+
+    return ret;
+}
+
+static void sim_ctx_setup(SimTestCtx *ctx, MppCtxType type, RK_S32 frames,
+                          RK_S32 seed)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->type = type;
+    ctx->coding = MPP_VIDEO_CodingAVC;
+    ctx->platform = (type == MPP_CTX_DEC) ? HAVE_RKVDEC : HAVE_VEPU2;
+    ctx->frames = frames;
+    ctx->seed = seed;
+}
+
+static MPP_RET sim_overhead_test(void)
+{
+    SimTestCtx ctx;
+    RK_S64 time;
+    MPP_RET ret;
+
+    set_sim_env(0, SIM_PIPELINE_DEPTH);
+    sim_ctx_setup(&ctx, MPP_CTX_DEC, SIM_OVERHEAD_FRAMES, 0x1000);
+
+    ret = sim_run_sessions(&ctx, 1, &time);
+
+    mpp_log("overhead  : %d frames %.2f us per frame\n",
+            SIM_OVERHEAD_FRAMES, (float)time / SIM_OVERHEAD_FRAMES);
+    return ret;
+}
+
+static MPP_RET sim_latency_test(void)
+{
+    SimTestCtx ctxs[2];
+    RK_S64 expect = (RK_S64)SIM_LATENCY * SIM_LATENCY_FRAMES;
+    RK_S64 time;
+    MPP_RET ret;
+
+    set_sim_env(SIM_LATENCY, SIM_PIPELINE_DEPTH);
+
+    /* two decoder sessions share one rkvdec */
+    sim_ctx_setup(&ctxs[0], MPP_CTX_DEC, SIM_LATENCY_FRAMES, 0x2000);
+    sim_ctx_setup(&ctxs[1], MPP_CTX_DEC, SIM_LATENCY_FRAMES, 0x3000);
+
+    ret = sim_run_sessions(ctxs, 2, &time);
+    mpp_log("serial    : 2 x %d frames %lld us expect %lld us\n",
+            SIM_LATENCY_FRAMES, time, expect * 2);
+    if (ret || time < expect * 2) {
+        mpp_err("shared client is not serialized\n");
+        return MPP_NOK;
+    }
+
+    /* decoder and encoder run on different hardware */
+    sim_ctx_setup(&ctxs[0], MPP_CTX_DEC, SIM_LATENCY_FRAMES, 0x4000);
+    sim_ctx_setup(&ctxs[1], MPP_CTX_ENC, SIM_LATENCY_FRAMES, 0x5000);
+
+    ret = sim_run_sessions(ctxs, 2, &time);
+    mpp_log("parallel  : 2 x %d frames %lld us expect %lld us\n",
+            SIM_LATENCY_FRAMES, time, expect);
+    if (ret || time < expect) {
+        mpp_err("latency is not applied\n");
+        return MPP_NOK;
+    }
+
+    return MPP_OK;
+}
+
+static MPP_RET sim_pipeline_test(void)
+{
+    RK_U32 regs[SIM_PIPELINE_FRAMES][SIM_REG_NUM];
+    MppDevCtx dev = NULL;
+    MppDevCfg cfg;
+    MppDevReqV1 req;
+    RK_S64 start;
+    RK_S64 time;
+    MPP_RET ret;
+    RK_S32 i, j;
+
+    set_sim_env(SIM_LATENCY, SIM_PIPELINE_DEPTH);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.type = MPP_CTX_ENC;
+    cfg.coding = MPP_VIDEO_CodingAVC;
+    cfg.platform = HAVE_VEPU2;
+
+    ret = mpp_device_init(&dev, &cfg);
+    if (ret)
+        return ret;
+
+    start = mpp_time();
+
+    /* submit all frames first, the send blocks when the queue is full */
+    for (i = 0; i < SIM_PIPELINE_FRAMES && !ret; i++) {
+        for (j = 0; j < SIM_REG_NUM; j++)
+            regs[i][j] = (i << 16) | j;
+
+        memset(&req, 0, sizeof(req));
+        req.cmd = MPP_CMD_SET_REG_WRITE;
+        req.size = sizeof(regs[i]) / 2;
+        req.data = regs[i];
+        mpp_device_add_request(dev, &req);
+
+        req.offset = req.size;
+        req.data = &regs[i][SIM_REG_NUM / 2];
+        mpp_device_add_request(dev, &req);
+
+        req.cmd = MPP_CMD_SET_REG_READ;
+        req.offset = 0;
+        req.size = sizeof(regs[i]);
+        req.data = regs[i];
+        mpp_device_add_request(dev, &req);
+
+        ret = mpp_device_send_request(dev);
+    }
+
+    for (i = 0; i < SIM_PIPELINE_FRAMES && !ret; i++) {
+        memset(regs[i], 0, sizeof(regs[i]));
+        ret = mpp_device_wait_reg(dev, regs[i], SIM_REG_NUM);
+
+        for (j = 0; j < SIM_REG_NUM && !ret; j++) {
+            if (regs[i][j] != (RK_U32)((i << 16) | j)) {
+                mpp_err("frame %d reg %d mismatch %08x\n", i, j, regs[i][j]);
+                ret = MPP_NOK;
+            }
+        }
+    }
+
+    time = mpp_time() - start;
+    mpp_device_deinit(dev);
+
+    mpp_log("pipeline  : %d frames depth %d %lld us expect %lld us\n",
+            SIM_PIPELINE_FRAMES, SIM_PIPELINE_DEPTH, time,
+            (RK_S64)SIM_LATENCY * SIM_PIPELINE_FRAMES);
+
+    if (!ret && time < (RK_S64)SIM_LATENCY * SIM_PIPELINE_FRAMES) {
+        mpp_err("pipelined tasks are not serialized\n");
+        ret = MPP_NOK;
+    }
+
+    return ret;
+}
+
+int main()
+{
+    MPP_RET ret;
+
+    /* must be set before the platform is probed */
+    setenv("mpp_device_sim", "1", 1);
+    setenv("mpp_device_sim_soc", "rk3399", 1);
+
+    mpp_log("mpp_device_sim_test start\n");
+
+    if (!mpp_get_device_sim()) {
+        mpp_err("simulated device is not enabled\n");
+        return MPP_NOK;
+    }
+
+    ret = sim_overhead_test();
+    if (!ret)
+        ret = sim_latency_test();
+    if (!ret)
+        ret = sim_pipeline_test();
+
+    mpp_log("mpp_device_sim_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
@@ -18,6 +18,7 @@
 #define __MPP_H__
 
 #include "mpp_queue.h"
+#include "mpp_ring_queue.h"
 #include "mpp_task_impl.h"
 
 #include "mpp_dec.h"
@@ -50,6 +51,7 @@
 #define MPP_DEC_NOTIFY_TASK_HND_VALID       (0x00000100)
 #define MPP_DEC_NOTIFY_TASK_PREV_DONE       (0x00000200)
 #define MPP_DEC_NOTIFY_BUFFER_MATCH         (0x00000400)
+#define MPP_DEC_NOTIFY_TIMESTAMP_POP        (0x00000800)
 #define MPP_DEC_RESET                       (MPP_RESET)
 
 /* mpp enc event flags */
@@ -111,12 +113,14 @@ public:
     MPP_RET reset();
     MPP_RET control(MpiCmd cmd, MppParam param);
 
+    MPP_RET get_event_fd(MppPortType type, RK_S32 *fd);
+
     MPP_RET notify(RK_U32 flag);
     MPP_RET notify(MppBufferGroup group);
 
-    mpp_list        *mPackets;
-    mpp_list        *mFrames;
-    mpp_list        *mTimeStamps;
+    MppRingQueue    mPackets;
+    MppRingQueue    mFrames;
+    MppRingQueue    mTimeStamps;
     /* counters for debug */
     RK_U32          mPacketPutCount;
     RK_U32          mPacketGetCount;
@@ -162,6 +166,8 @@ private:
 
     RK_U32          mInitDone;
     RK_U32          mMultiFrame;
+    /* user waits on event fd and non-block get_frame does not sleep */
+    RK_U32          mEventFdMode;
 
     RK_U32          mStatus;
 
@@ -170,8 +176,11 @@ private:
     RK_U32          mParserNeedSplit;
     RK_U32          mParserInternalPts;     /* for MPEG2/MPEG4 */
     RK_U32          mImmediateOut;
+    RK_U32          mDecThreadPool;
     /* backup extra packet for seek */
     MppPacket       mExtraPacket;
+    /* put_packet and reset lock on packet queue and extra packet */
+    Mutex           mPacketLock;
 
     /* dump info for debug */
     MppDump         mDump;
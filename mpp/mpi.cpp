@@ -404,6 +404,30 @@ static MPP_RET mpi_control(MppCtx ctx, MpiCmd cmd, MppParam param)
     return ret;
 }
 
+static MPP_RET mpi_get_event_fd(MppCtx ctx, MppPortType type, RK_S32 *fd)
+{
+    MPP_RET ret = MPP_NOK;
+    MpiImpl *p = (MpiImpl *)ctx;
+
+    mpi_dbg_func("enter ctx %p type %d fd %p\n", ctx, type, fd);
+    do {
+        ret = check_mpp_ctx(p);
+        if (ret)
+            break;;
+
+        if (type >= MPP_PORT_BUTT || NULL == fd) {
+            mpp_err_f("invalid input type %d fd %p\n", type, fd);
+            ret = MPP_ERR_UNKNOW;
+            break;
+        }
+
+        ret = p->ctx->get_event_fd(type, fd);
+    } while (0);
+
+    mpi_dbg_func("leave ret %d\n", ret);
+    return ret;
+}
+
 static MppApi mpp_api = {
     sizeof(mpp_api),
     0,
@@ -421,6 +445,7 @@ static MppApi mpp_api = {
     mpi_enqueue,
     mpi_reset,
     mpi_control,
+    mpi_get_event_fd,
     {0},
 };
 
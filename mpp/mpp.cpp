@@ -23,7 +23,6 @@
 #include "mpp_log.h"
 #include "mpp_mem.h"
 #include "mpp_env.h"
-#include "mpp_time.h"
 #include "mpp_impl.h"
 
 #include "mpp.h"
@@ -37,6 +36,20 @@
 #define MPP_TEST_FRAME_SIZE     SZ_1M
 #define MPP_TEST_PACKET_SIZE    SZ_512K
 
+/*
+ * Input packet queue is limited to 4 packets by put_packet with extra room
+ * for extra data packet and eos packet. Output frame queue is limited by the
+ * frame buffer count and the frame producer blocks when it is full.
+ * Timestamp queue keeps one entry for each packet taken by parser until its
+ * frame is output. The frames held in decoder are limited by the frame buffer
+ * count so it is sized for a full frame queue plus the input packets and the
+ * parser waits for frame output when it is full.
+ */
+#define MPP_PACKET_QUEUE_SIZE   8
+#define MPP_PACKET_QUEUE_LIMIT  4
+#define MPP_FRAME_QUEUE_SIZE    64
+#define MPP_TS_QUEUE_SIZE       (MPP_FRAME_QUEUE_SIZE + MPP_PACKET_QUEUE_SIZE)
+
 static void mpp_notify_by_buffer_group(void *arg, void *group)
 {
     Mpp *mpp = (Mpp *)arg;
@@ -44,16 +57,18 @@ static void mpp_notify_by_buffer_group(void *arg, void *group)
     mpp->notify((MppBufferGroup) group);
 }
 
-static void *list_wraper_packet(void *arg)
+static void queue_release_packet(void *arg)
 {
-    mpp_packet_deinit((MppPacket *)arg);
-    return NULL;
+    MppPacket packet = (MppPacket)arg;
+
+    mpp_packet_deinit(&packet);
 }
 
-static void *list_wraper_frame(void *arg)
+static void queue_release_frame(void *arg)
 {
-    mpp_frame_deinit((MppFrame *)arg);
-    return NULL;
+    MppFrame frame = (MppFrame)arg;
+
+    mpp_frame_deinit(&frame);
 }
 
 Mpp::Mpp()
@@ -83,11 +98,13 @@ Mpp::Mpp()
       mCoding(MPP_VIDEO_CodingUnused),
       mInitDone(0),
       mMultiFrame(0),
+      mEventFdMode(0),
       mStatus(0),
       mParserFastMode(0),
       mParserNeedSplit(0),
       mParserInternalPts(0),
       mImmediateOut(0),
+      mDecThreadPool(0),
       mExtraPacket(NULL),
       mDump(NULL)
 {
@@ -97,7 +114,13 @@ Mpp::Mpp()
 
 MPP_RET Mpp::init(MppCtxType type, MppCodingType coding)
 {
-    if (mpp_check_support_format(type, coding)) {
+    RK_U32 dec_dummy = 0;
+
+    /* dummy decoder with CodingUnused is only enabled by test env mpp_dec_dummy */
+    if (type == MPP_CTX_DEC && coding == MPP_VIDEO_CodingUnused)
+        mpp_env_get_u32("mpp_dec_dummy", &dec_dummy, 0);
+
+    if (!dec_dummy && mpp_check_support_format(type, coding)) {
         mpp_err("unable to create unsupported type %d coding %d\n", type, coding);
         return MPP_NOK;
     }
@@ -112,9 +135,13 @@ MPP_RET Mpp::init(MppCtxType type, MppCodingType coding)
 
     switch (mType) {
     case MPP_CTX_DEC : {
-        mPackets    = new mpp_list(list_wraper_packet);
-        mFrames     = new mpp_list(list_wraper_frame);
-        mTimeStamps = new mpp_list(list_wraper_packet);
+        mpp_ring_queue_init(&mPackets, RING_QUEUE_MPMC, MPP_PACKET_QUEUE_SIZE,
+                            queue_release_packet);
+        mpp_ring_queue_init(&mFrames, RING_QUEUE_MPMC, MPP_FRAME_QUEUE_SIZE,
+                            queue_release_frame);
+        mpp_ring_queue_init(&mTimeStamps, RING_QUEUE_MPMC, MPP_TS_QUEUE_SIZE,
+                            queue_release_packet);
+        mpp_ring_queue_set_watermark(mPackets, MPP_PACKET_QUEUE_LIMIT);
 
         if (mInputTimeout == MPP_POLL_BUTT)
             mInputTimeout = MPP_POLL_NON_BLOCK;
@@ -142,6 +169,7 @@ MPP_RET Mpp::init(MppCtxType type, MppCodingType coding)
             mParserNeedSplit,
             mParserInternalPts,
             mImmediateOut,
+            mDecThreadPool,
             this,
         };
 
@@ -151,8 +179,9 @@ MPP_RET Mpp::init(MppCtxType type, MppCodingType coding)
         mInitDone = 1;
     } break;
     case MPP_CTX_ENC : {
-        mFrames     = new mpp_list(NULL);
-        mPackets    = new mpp_list(list_wraper_packet);
+        mpp_ring_queue_init(&mFrames, RING_QUEUE_MPMC, MPP_FRAME_QUEUE_SIZE, NULL);
+        mpp_ring_queue_init(&mPackets, RING_QUEUE_MPMC, MPP_PACKET_QUEUE_SIZE,
+                            queue_release_packet);
 
         if (mInputTimeout == MPP_POLL_BUTT)
             mInputTimeout = MPP_POLL_BLOCK;
@@ -257,15 +286,15 @@ void Mpp::clear()
     }
 
     if (mPackets) {
-        delete mPackets;
+        mpp_ring_queue_deinit(mPackets);
         mPackets = NULL;
     }
     if (mFrames) {
-        delete mFrames;
+        mpp_ring_queue_deinit(mFrames);
         mFrames = NULL;
     }
     if (mTimeStamps) {
-        delete mTimeStamps;
+        mpp_ring_queue_deinit(mTimeStamps);
         mTimeStamps = NULL;
     }
     if (mPacketGroup) {
@@ -285,20 +314,30 @@ MPP_RET Mpp::put_packet(MppPacket packet)
     if (!mInitDone)
         return MPP_ERR_INIT;
 
-    AutoMutex autoLock(mPackets->mutex());
+    AutoMutex autoLock(&mPacketLock);
+
     if (mExtraPacket) {
-        mPackets->add_at_tail(&mExtraPacket, sizeof(mExtraPacket));
+        if (mpp_ring_queue_push(mPackets, mExtraPacket, 0))
+            return MPP_ERR_BUFFER_FULL;
+
         mExtraPacket = NULL;
         mPacketPutCount++;
     }
 
     RK_U32 eos = mpp_packet_get_eos(packet);
-    if (mPackets->list_size() < 4 || eos) {
+    if (mpp_ring_queue_count(mPackets) < MPP_PACKET_QUEUE_LIMIT || eos) {
         MppPacket pkt;
+        /* packet with release callback is borrowed without data copy */
         if (MPP_OK != mpp_packet_copy_init(&pkt, packet))
             return MPP_NOK;
 
-        mPackets->add_at_tail(&pkt, sizeof(pkt));
+        if (mpp_ring_queue_push(mPackets, pkt, 0)) {
+            /* caller still owns the data and will put it again */
+            mpp_packet_drop_borrow(pkt);
+            mpp_packet_deinit(&pkt);
+            return MPP_ERR_BUFFER_FULL;
+        }
+
         mPacketPutCount++;
         // dump input packet
         mpp_ops_dec_put_pkt(mDump, packet);
@@ -318,39 +357,33 @@ MPP_RET Mpp::get_frame(MppFrame *frame)
     if (!mInitDone)
         return MPP_ERR_INIT;
 
-    AutoMutex autoFrameLock(mFrames->mutex());
     MppFrame first = NULL;
+    RK_S64 timeout = mOutputTimeout;
+    MPP_RET ret;
 
-    if (0 == mFrames->list_size()) {
-        if (mOutputTimeout) {
-            if (mOutputTimeout < 0) {
-                /* block wait */
-                mFrames->wait();
-            } else {
-                RK_S32 ret = mFrames->wait(mOutputTimeout);
-                if (ret) {
-                    if (ret == ETIMEDOUT)
-                        return MPP_ERR_TIMEOUT;
-                    else
-                        return MPP_NOK;
-                }
-            }
-        } else {
-            /* NOTE: in non-block mode the sleep is to avoid user's dead loop */
-            msleep(1);
-        }
+    /*
+     * NOTE: in non-block mode the 1ms wait is to avoid user's dead loop.
+     * User waiting on event fd only calls get_frame when it is readable.
+     */
+    if (mOutputTimeout == MPP_POLL_NON_BLOCK && !mEventFdMode)
+        timeout = 1;
+
+    ret = mpp_ring_queue_pop(mFrames, (void **)&first, timeout);
+    if (ret) {
+        /* non-block call returns without frame on empty queue */
+        if (mOutputTimeout != MPP_POLL_NON_BLOCK ||
+            (ret != MPP_NOK && ret != MPP_ERR_TIMEOUT))
+            return ret;
     }
 
-    if (mFrames->list_size()) {
-        mFrames->del_at_head(&first, sizeof(frame));
+    if (first) {
         mFrameGetCount++;
         notify(MPP_OUTPUT_DEQUEUE);
 
         if (mMultiFrame) {
             MppFrame prev = first;
             MppFrame next = NULL;
-            while (mFrames->list_size()) {
-                mFrames->del_at_head(&next, sizeof(frame));
+            while (!mpp_ring_queue_pop(mFrames, (void **)&next, 0)) {
                 mFrameGetCount++;
                 notify(MPP_OUTPUT_DEQUEUE);
                 mpp_frame_set_next(prev, next);
@@ -364,8 +397,7 @@ MPP_RET Mpp::get_frame(MppFrame *frame)
         // There is no way to wake up parser thread to continue decoding.
         // The put_packet only signal sem on may be it better to use sem on info
         // change too.
-        AutoMutex autoPacketLock(mPackets->mutex());
-        if (mPackets->list_size())
+        if (mpp_ring_queue_count(mPackets))
             notify(MPP_INPUT_ENQUEUE);
     }
 
@@ -642,10 +674,10 @@ MPP_RET Mpp::reset()
          * To avoid this case happen we need to save it on reset beginning
          * then restore it on reset end.
          */
-        mPackets->lock();
-        while (mPackets->list_size()) {
-            MppPacket pkt = NULL;
-            mPackets->del_at_head(&pkt, sizeof(pkt));
+        MppPacket pkt = NULL;
+
+        mPacketLock.lock();
+        while (!mpp_ring_queue_pop(mPackets, (void **)&pkt, 0)) {
             mPacketGetCount++;
 
             RK_U32 flags = mpp_packet_get_flag(pkt);
@@ -658,18 +690,13 @@ MPP_RET Mpp::reset()
                 mpp_packet_deinit(&pkt);
             }
         }
-        mPackets->flush();
-        mPackets->unlock();
+        mPacketLock.unlock();
 
         mpp_dec_reset(mDec);
 
-        mFrames->lock();
-        mFrames->flush();
-        mFrames->unlock();
+        mpp_ring_queue_flush(mFrames);
     } else {
-        mFrames->lock();
-        mFrames->flush();
-        mFrames->unlock();
+        mpp_ring_queue_flush(mFrames);
 
         if (mEncVersion) {
             mpp_enc_reset_v2(mEnc);
@@ -677,14 +704,37 @@ MPP_RET Mpp::reset()
             mpp_enc_reset(mEnc);
         }
 
-        mPackets->lock();
-        mPackets->flush();
-        mPackets->unlock();
+        mpp_ring_queue_flush(mPackets);
     }
 
     return MPP_OK;
 }
 
+MPP_RET Mpp::get_event_fd(MppPortType type, RK_S32 *fd)
+{
+    if (!mInitDone)
+        return MPP_ERR_INIT;
+
+    MPP_RET ret = MPP_NOK;
+
+    /* decoder except mjpeg works on packet / frame queue, others on task port */
+    if (mType == MPP_CTX_DEC && mCoding != MPP_VIDEO_CodingMJPEG) {
+        if (type == MPP_PORT_INPUT)
+            ret = mpp_ring_queue_get_fd(mPackets, RING_QUEUE_EVENT_PUSH, fd);
+        else
+            ret = mpp_ring_queue_get_fd(mFrames, RING_QUEUE_EVENT_POP, fd);
+    } else {
+        MppPort port = (type == MPP_PORT_INPUT) ? mInputPort : mOutputPort;
+
+        ret = mpp_port_get_fd(port, fd);
+    }
+
+    if (!ret)
+        mEventFdMode = 1;
+
+    return ret;
+}
+
 MPP_RET Mpp::control_mpp(MpiCmd cmd, MppParam param)
 {
     MPP_RET ret = MPP_OK;
@@ -810,9 +860,12 @@ MPP_RET Mpp::control_dec(MpiCmd cmd, MppParam param)
         mParserFastMode = flag;
         ret = MPP_OK;
     } break;
+    case MPP_DEC_SET_THREAD_POOL: {
+        mDecThreadPool = (param) ? (*((RK_U32 *)param)) : (1);
+        ret = MPP_OK;
+    } break;
     case MPP_DEC_GET_STREAM_COUNT: {
-        AutoMutex autoLock(mPackets->mutex());
-        *((RK_S32 *)param) = mPackets->list_size();
+        *((RK_S32 *)param) = mpp_ring_queue_count(mPackets);
         ret = MPP_OK;
     } break;
     case MPP_DEC_SET_IMMEDIATE_OUT: {
@@ -17,8 +17,7 @@
 
 #define MODULE_TAG "mpp_impl"
 
-#include <time.h>
-#include <stdarg.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
 
@@ -28,27 +27,103 @@
 #include "mpp_log.h"
 #include "mpp_mem.h"
 #include "mpp_time.h"
+#include "mpp_atomic.h"
 #include "mpp_thread.h"
 #include "mpp_common.h"
+#include "mpp_ring_queue.h"
 
+#include "mpp_frame.h"
+#include "mpp_packet.h"
 #include "mpp_impl.h"
 
 #define MAX_FILE_NAME_LEN   512
 #define MAX_DUMP_WIDTH      960
 #define MAX_DUMP_HEIGHT     540
+#define MAX_DUMP_QUEUE      16
 
-#define ops_log(fp, fmt, ...)   _ops_log(fp, fmt, ## __VA_ARGS__)
+#define DUMP_FILE_MAGIC     0x4450504d      /* "MPPD" */
+#define DUMP_INDEX_MAGIC    0x4950504d      /* "MPPI" */
+#define DUMP_FILE_VERSION   1
 
-typedef enum MppOpsType_e {
-    MPP_DEC_OPS_BASE        = 0,
-    MPP_DEC_INIT            = MPP_DEC_OPS_BASE,
-    MPP_DEC_SE
-} MppOpsType;
+/*
+ * Dump container file, one file per context written by a dump thread:
+ *
+ * MppDumpFileHdr
+ * MppDumpRecord + payload      repeated
+ * RK_U64 record offset         repeated, one for each record
+ * MppDumpIndex
+ *
+ * The index is at the end of file and can be found by MppDumpIndex size.
+ * All values are in host byte order.
+ *
+ * record arg by tag:
+ * INIT     - type, coding
+ * PKT_IN   - stream offset, length
+ * PKT_OUT  - stream offset, length
+ * FRM_IN   - fd, info_change, errinfo, discard, fmt, width, height
+ * FRM_OUT  - fd, info_change, errinfo, discard, fmt, width, height
+ * CTRL     - cmd
+ * RESET    - none
+ * Payload size is zero when the data is not dumped by sampling or by debug
+ * flag. Frame payload is resampled yuv420sp 8bit in width x height. Input
+ * frame is resampled on caller thread since caller may refill its buffer
+ * right after put_frame, output frame is resampled in dump thread.
+ */
+typedef enum MppDumpTag_e {
+    DUMP_TAG_INIT,
+    DUMP_TAG_PKT_IN,
+    DUMP_TAG_PKT_OUT,
+    DUMP_TAG_FRM_IN,
+    DUMP_TAG_FRM_OUT,
+    DUMP_TAG_CTRL,
+    DUMP_TAG_RESET,
+    DUMP_TAG_BUTT,
+} MppDumpTag;
+
+typedef struct MppDumpFileHdr_t {
+    RK_U32                  magic;
+    RK_U32                  version;
+    RK_U32                  type;
+    RK_U32                  coding;
+    RK_U32                  tid;
+    RK_U32                  record_size;
+} MppDumpFileHdr;
+
+typedef struct MppDumpRecord_t {
+    RK_U32                  tag;
+    RK_U32                  idx;
+    RK_S64                  time;       // us from dump init
+    RK_S64                  pts;
+    RK_U32                  size;       // payload size
+    RK_U32                  arg[7];
+} MppDumpRecord;
+
+typedef struct MppDumpIndex_t {
+    RK_U32                  magic;
+    RK_U32                  count;
+    RK_U64                  offset;     // offset of record offset table
+    RK_U32                  drop_data;
+    RK_U32                  drop_ops;
+} MppDumpIndex;
+
+/* dump queue node, data is referenced from packet or frame buffer */
+typedef struct MppDumpNode_t {
+    MppDumpRecord           rec;
+
+    MppBuffer               buffer;
+    RK_U8                   *data;
+    RK_U32                  copied;
+
+    /* frame info for resample in dump thread */
+    RK_U32                  fmt;
+    RK_U32                  width;
+    RK_U32                  height;
+    RK_U32                  hor_stride;
+    RK_U32                  ver_stride;
+} MppDumpNode;
 
 /* dump data */
 typedef struct MppDumpImpl_t {
-    Mutex                   *lock;
-    RK_U32                  log_version;
     RK_U32                  debug;
     pid_t                   tid;
     RK_S64                  time_base;
@@ -56,81 +131,36 @@ typedef struct MppDumpImpl_t {
     MppCtxType              type;
     MppCodingType           coding;
 
-    FILE                    *fp_in;    // file for MppPacket
-    FILE                    *fp_out;    // file for MppFrame
-    FILE                    *fp_ops;    // file for decoder / encoder extra info
+    FILE                    *fp;
+    MppRingQueue            queue;
+    MppThread               *thread;
 
-    RK_U8                   *fp_buf;    // for resample frame
+    /* sampling: every interval data and time window in ms from init */
+    RK_U32                  interval;
+    RK_U32                  window_start;
+    RK_U32                  window_end;
+    RK_U32                  data_cnt[2];
+
+    RK_U32                  idx;
     RK_U32                  pkt_offset;
+    RK_U32                  drop_data;
+    RK_U32                  drop_ops;
+
+    /* resample size, fixed on init */
     RK_U32                  dump_width;
     RK_U32                  dump_height;
     RK_U32                  dump_size;
 
-    RK_U32                  idx;
+    /* accessed by dump thread only */
+    RK_U8                   *fp_buf;    // for resample frame
+    RK_U64                  *offsets;
+    RK_U32                  offset_cnt;
+    RK_U32                  offset_max;
 } MppDumpImpl;
 
-typedef struct MppOpsInfo_t {
-    RK_U32                  idx;
-    RK_U32                  id;
-    RK_S64                  time;
-
-    union OpsArgs_u {
-        struct MppOpsInitArg_t {
-            MppCtxType      type;
-            MppCodingType   coding;
-        };
-
-        struct MppOpsPktArg_t {
-            RK_U32          offset;         // offset in packet file
-            RK_U32          length;         // pakcet length
-            RK_S64          pts;
-        };
-
-        struct MppOpsFrmArg_t {
-            RK_U32          fd;
-            RK_U32          info_change;
-            RK_U32          error;
-            RK_U32          discard;
-            RK_S64          pts;
-        };
-
-        struct MppOpCtrlArg_t {
-            MpiCmd          cmd;
-        };
-    };
-} MppOpsInfo;
-
-/*
- * decoder file dump:
- * dec_pkt - decoder input byte raw stream file
- * dec_cfg - decoder input stream offset and size info in format [u32 offset|u32 size]
- * dec_frm - decoder output frame file with snapshot method
- */
-static const char dec_pkt_path[] = "/data/mpp_dec_in.bin";
-static const char dec_ops_path[] = "/data/mpp_dec_ops.bin";
-static const char dec_frm_path[] = "/data/mpp_dec_out.bin";
-
-static const char enc_frm_path[] = "/data/mpp_enc_in.bin";
-static const char enc_ops_path[] = "/data/mpp_enc_ops.bin";
-static const char enc_pkt_path[] = "/data/mpp_enc_out.bin";
-
-static FILE *try_env_file(const char *env, const char *path, pid_t tid)
-{
-    const char *fname = NULL;
-    FILE *fp = NULL;
-    char name[MAX_FILE_NAME_LEN];
-
-    mpp_env_get_str(env, &fname, path);
-    if (fname == path) {
-        snprintf(name, sizeof(name), "%s-%d", path, tid);
-        fname = name;
-    }
-
-    fp = fopen(fname, "w+b");
-    mpp_log("open %s %p for dump\n", fname, fp);
-
-    return fp;
-}
+static RK_U32 dump_ctx_id = 0;
+/* queued after all records to stop the dump thread */
+static MppDumpNode dump_quit_node;
 
 static RK_U8 fetch_data(RK_U32 fmt, RK_U8 *line, RK_U32 num)
 {
@@ -150,15 +180,14 @@ static RK_U8 fetch_data(RK_U32 fmt, RK_U8 *line, RK_U32 num)
     return RK_U8(value);
 }
 
-static void dump_frame(FILE *fp, MppFrame frame, RK_U8 *tmp, RK_U32 w, RK_U32 h)
+static RK_U8 *dump_frame(MppDumpNode *node, RK_U8 *p_buf, RK_U8 *tmp, RK_U32 w, RK_U32 h)
 {
     RK_U32 i = 0, j = 0;
-    RK_U32 fmt = mpp_frame_get_fmt(frame);
-    RK_U32 width = mpp_frame_get_width(frame);
-    RK_U32 height = mpp_frame_get_height(frame);
-    RK_U32 hor_stride = mpp_frame_get_hor_stride(frame);
-    RK_U32 ver_stride = mpp_frame_get_ver_stride(frame);
-    RK_U8 *p_buf = (RK_U8 *) mpp_buffer_get_ptr(mpp_frame_get_buffer(frame));
+    RK_U32 fmt = node->fmt;
+    RK_U32 width = node->width;
+    RK_U32 height = node->height;
+    RK_U32 hor_stride = node->hor_stride;
+    RK_U32 ver_stride = node->ver_stride;
 
     RK_U8 *psrc = p_buf;
     RK_U8 *pdes = tmp;
@@ -209,30 +238,252 @@ static void dump_frame(FILE *fp, MppFrame frame, RK_U8 *tmp, RK_U32 w, RK_U32 h)
         width = hor_stride;
         height = ver_stride;
     }
-    mpp_log("dump_yuv: [%d:%d] pts %lld\n", width, height, mpp_frame_get_pts(frame));
-    fwrite(tmp, 1, width * height * 3 / 2, fp);
-    fflush(fp);
+
+    node->rec.arg[5] = width;
+    node->rec.arg[6] = height;
+    node->rec.size = width * height * 3 / 2;
+
+    return tmp;
+}
+
+static void dump_node_release(void *data)
+{
+    MppDumpNode *node = (MppDumpNode *)data;
+
+    if (node->buffer)
+        mpp_buffer_put(node->buffer);
+    if (node->copied)
+        MPP_FREE(node->data);
+
+    mpp_free(node);
+}
+
+static void dump_write_node(MppDumpImpl *p, MppDumpNode *node)
+{
+    RK_U8 *data = node->data;
+    long pos = ftell(p->fp);
+
+    if (node->rec.tag == DUMP_TAG_FRM_IN || node->rec.tag == DUMP_TAG_FRM_OUT) {
+        if (node->buffer) {
+            if (NULL == p->fp_buf)
+                p->fp_buf = mpp_malloc(RK_U8, p->dump_size);
+            if (p->fp_buf)
+                data = dump_frame(node, (RK_U8 *)mpp_buffer_get_ptr(node->buffer),
+                                  p->fp_buf, p->dump_width, p->dump_height);
+        }
+    }
+
+    if (p->offset_cnt >= p->offset_max) {
+        RK_U32 max = p->offset_max ? p->offset_max * 2 : 256;
+        RK_U64 *offsets = mpp_realloc(p->offsets, RK_U64, max);
+
+        if (NULL == offsets) {
+            mpp_err_f("failed to grow dump index to %d\n", max);
+            return;
+        }
+        p->offsets = offsets;
+        p->offset_max = max;
+    }
+
+    if (NULL == data)
+        node->rec.size = 0;
+
+    fwrite(&node->rec, 1, sizeof(node->rec), p->fp);
+    if (node->rec.size)
+        fwrite(data, 1, node->rec.size, p->fp);
+
+    p->offsets[p->offset_cnt++] = pos;
+}
+
+static void *dump_thread(void *arg)
+{
+    MppDumpImpl *p = (MppDumpImpl *)arg;
+
+    while (1) {
+        MppDumpNode *node = NULL;
+
+        if (mpp_ring_queue_pop(p->queue, (void **)&node, -1) || NULL == node)
+            continue;
+
+        if (node == &dump_quit_node)
+            break;
+
+        dump_write_node(p, node);
+        dump_node_release(node);
+    }
+
+    return NULL;
+}
+
+static MppDumpNode *dump_node_get(MppDumpImpl *p, MppDumpTag tag)
+{
+    MppDumpNode *node = mpp_calloc(MppDumpNode, 1);
+
+    if (NULL == node) {
+        MPP_FETCH_ADD(&p->drop_ops, 1);
+        return NULL;
+    }
+
+    node->rec.tag = tag;
+    node->rec.idx = MPP_FETCH_ADD(&p->idx, 1);
+    node->rec.time = mpp_time() - p->time_base;
+
+    return node;
+}
+
+static void dump_node_put(MppDumpImpl *p, MppDumpNode *node)
+{
+    /* never block the caller thread, drop when dump thread is too slow */
+    if (mpp_ring_queue_push(p->queue, node, 0)) {
+        if (node->buffer || node->data)
+            MPP_FETCH_ADD(&p->drop_data, 1);
+        else
+            MPP_FETCH_ADD(&p->drop_ops, 1);
+
+        dump_node_release(node);
+    }
+}
+
+/* check debug flag and sampling for data payload on input or output */
+static RK_U32 dump_data_check(MppDumpImpl *p, RK_U32 flag, RK_S64 time)
+{
+    RK_U32 cnt;
+
+    if (!(p->debug & flag))
+        return 0;
+
+    if (time < (RK_S64)p->window_start * 1000 ||
+        (p->window_end && time >= (RK_S64)p->window_end * 1000))
+        return 0;
+
+    cnt = p->data_cnt[flag == MPP_DBG_DUMP_OUT]++;
+
+    return (p->interval <= 1) || !(cnt % p->interval);
 }
 
-void _ops_log(FILE *fp, const char *fmt, ...)
+static RK_U32 dump_ops_check(MppDumpImpl *p, RK_U32 flag)
 {
-    struct tm tm_buf;
-    struct tm* ptm;
-    struct timespec tp;
-    char logs[64];
-    size_t len = 0;
-    va_list args;
-    va_start(args, fmt);
-
-    clock_gettime(CLOCK_REALTIME_COARSE, &tp);
-    ptm = localtime_r(&tp.tv_sec, &tm_buf);
-    len = strftime(logs, sizeof(logs), "%m-%d %H:%M:%S", ptm);
-    mpp_assert(len < sizeof(logs));
-    fprintf(fp, "%s.%03ld,", logs, tp.tv_nsec / 1000000);
-    vfprintf(fp, fmt, args);
-    fflush(fp);
-
-    va_end(args);
+    return p->fp && (p->debug & (flag | MPP_DBG_DUMP_CFG));
+}
+
+static MPP_RET dump_pkt(MppDumpImpl *p, MppDumpTag tag, RK_U32 flag, MppPacket pkt)
+{
+    if (!dump_ops_check(p, flag))
+        return MPP_OK;
+
+    MppDumpNode *node = dump_node_get(p, tag);
+    if (NULL == node)
+        return MPP_NOK;
+
+    RK_U32 length = mpp_packet_get_length(pkt);
+
+    node->rec.pts = mpp_packet_get_pts(pkt);
+    node->rec.arg[0] = MPP_FETCH_ADD(&p->pkt_offset, length);
+    node->rec.arg[1] = length;
+
+    if (length && dump_data_check(p, flag, node->rec.time)) {
+        MppBuffer buffer = mpp_packet_get_buffer(pkt);
+        RK_U8 *pos = (RK_U8 *)mpp_packet_get_pos(pkt);
+
+        if (buffer) {
+            /* keep the packet buffer alive until the dump thread is done */
+            mpp_buffer_inc_ref(buffer);
+            node->buffer = buffer;
+            node->data = pos;
+        } else {
+            /* memory without buffer is owned by caller and must be copied */
+            node->data = mpp_malloc(RK_U8, length);
+            if (node->data) {
+                memcpy(node->data, pos, length);
+                node->copied = 1;
+            }
+        }
+
+        if (node->data)
+            node->rec.size = length;
+    }
+
+    dump_node_put(p, node);
+
+    return MPP_OK;
+}
+
+static MPP_RET dump_frm(MppDumpImpl *p, MppDumpTag tag, RK_U32 flag, MppFrame frame)
+{
+    if (!dump_ops_check(p, flag))
+        return MPP_OK;
+
+    MppDumpNode *node = dump_node_get(p, tag);
+    if (NULL == node)
+        return MPP_NOK;
+
+    MppBuffer buf = mpp_frame_get_buffer(frame);
+    RK_S32 fd = (buf) ? mpp_buffer_get_fd(buf) : (-1);
+
+    node->rec.pts = mpp_frame_get_pts(frame);
+    node->rec.arg[0] = fd;
+    node->rec.arg[1] = mpp_frame_get_info_change(frame);
+    node->rec.arg[2] = mpp_frame_get_errinfo(frame);
+    node->rec.arg[3] = mpp_frame_get_discard(frame);
+    node->rec.arg[4] = mpp_frame_get_fmt(frame);
+
+    if (buf && dump_data_check(p, flag, node->rec.time)) {
+        node->fmt = mpp_frame_get_fmt(frame);
+        node->width = mpp_frame_get_width(frame);
+        node->height = mpp_frame_get_height(frame);
+        node->hor_stride = mpp_frame_get_hor_stride(frame);
+        node->ver_stride = mpp_frame_get_ver_stride(frame);
+
+        if (tag == DUMP_TAG_FRM_IN) {
+            /*
+             * input frame buffer is refilled by caller right after put_frame
+             * returns even when the buffer is still referenced. So resample
+             * it on caller thread instead of holding the buffer.
+             */
+            node->data = mpp_malloc(RK_U8, p->dump_size);
+            if (node->data) {
+                RK_U8 *data = dump_frame(node, (RK_U8 *)mpp_buffer_get_ptr(buf),
+                                         node->data, p->dump_width, p->dump_height);
+
+                if (data != node->data)
+                    memcpy(node->data, data, node->rec.size);
+                node->copied = 1;
+            }
+        } else {
+            /* output frame is resampled in dump thread on referenced buffer */
+            mpp_buffer_inc_ref(buf);
+            node->buffer = buf;
+        }
+    }
+
+    dump_node_put(p, node);
+
+    if (p->debug & MPP_DBG_DUMP_LOG) {
+        RK_S64 pts = mpp_frame_get_pts(frame);
+        RK_U32 width = mpp_frame_get_hor_stride(frame);
+        RK_U32 height = mpp_frame_get_ver_stride(frame);
+
+        mpp_log("yuv_info: [%d:%d] pts %lld", width, height, pts);
+    }
+
+    return MPP_OK;
+}
+
+static MPP_RET dump_ops(MppDumpImpl *p, MppDumpTag tag, RK_U32 arg0, RK_U32 arg1)
+{
+    if (!dump_ops_check(p, 0))
+        return MPP_OK;
+
+    MppDumpNode *node = dump_node_get(p, tag);
+    if (NULL == node)
+        return MPP_NOK;
+
+    node->rec.arg[0] = arg0;
+    node->rec.arg[1] = arg1;
+
+    dump_node_put(p, node);
+
+    return MPP_OK;
 }
 
 MPP_RET mpp_dump_init(MppDump *info)
@@ -246,12 +497,13 @@ MPP_RET mpp_dump_init(MppDump *info)
 
     mpp_env_get_u32("mpp_dump_width", &p->dump_width, MAX_DUMP_WIDTH);
     mpp_env_get_u32("mpp_dump_height", &p->dump_height, MAX_DUMP_HEIGHT);
+    mpp_env_get_u32("mpp_dump_interval", &p->interval, 1);
+    mpp_env_get_u32("mpp_dump_window_start", &p->window_start, 0);
+    mpp_env_get_u32("mpp_dump_window_end", &p->window_end, 0);
     p->dump_size = p->dump_width * p->dump_height * 3 / 2;
 
-    p->lock = new Mutex();
     p->debug = mpp_debug;
     p->tid = syscall(SYS_gettid);
-    p->log_version = 0;
     p->time_base = mpp_time();
 
     *info = p;
@@ -264,15 +516,39 @@ MPP_RET mpp_dump_deinit(MppDump *info)
     if (info && *info) {
         MppDumpImpl *p = (MppDumpImpl *)*info;
 
-        MPP_FCLOSE(p->fp_in);
-        MPP_FCLOSE(p->fp_out);
-        MPP_FCLOSE(p->fp_ops);
-        MPP_FREE(p->fp_buf);
+        if (p->thread) {
+            mpp_ring_queue_push(p->queue, &dump_quit_node, -1);
+            p->thread->stop();
+            delete p->thread;
+            p->thread = NULL;
+        }
+
+        if (p->queue) {
+            mpp_ring_queue_deinit(p->queue);
+            p->queue = NULL;
+        }
+
+        if (p->fp) {
+            MppDumpIndex index;
+
+            index.magic = DUMP_INDEX_MAGIC;
+            index.count = p->offset_cnt;
+            index.offset = ftell(p->fp);
+            index.drop_data = p->drop_data;
+            index.drop_ops = p->drop_ops;
 
-        if (p->lock) {
-            delete p->lock;
-            p->lock = NULL;
+            fwrite(p->offsets, sizeof(p->offsets[0]), p->offset_cnt, p->fp);
+            fwrite(&index, 1, sizeof(index), p->fp);
+
+            if (p->drop_data || p->drop_ops)
+                mpp_log("dump %d records drop data %d ops %d\n",
+                        p->offset_cnt, p->drop_data, p->drop_ops);
         }
+
+        MPP_FCLOSE(p->fp);
+        MPP_FREE(p->fp_buf);
+        MPP_FREE(p->offsets);
+        MPP_FREE(*info);
     }
 
     return MPP_OK;
@@ -284,37 +560,45 @@ MPP_RET mpp_ops_init(MppDump info, MppCtxType type, MppCodingType coding)
         return MPP_OK;
 
     MppDumpImpl *p = (MppDumpImpl *)info;
-    AutoMutex auto_lock(p->lock);
+    const char *path = NULL;
+    char name[MAX_FILE_NAME_LEN];
+    RK_U32 queue_size = 0;
+    MppDumpFileHdr hdr;
 
     p->type = type;
     p->coding = coding;
 
-    if (type == MPP_CTX_DEC) {
-        if (p->debug & MPP_DBG_DUMP_IN)
-            p->fp_in = try_env_file("mpp_dump_in", dec_pkt_path, p->tid);
-
-        if (p->debug & MPP_DBG_DUMP_OUT) {
-            p->fp_out = try_env_file("mpp_dump_out", dec_frm_path, p->tid);
-            p->fp_buf = mpp_malloc(RK_U8, p->dump_size);
-        }
+    mpp_env_get_str("mpp_dump_path", &path, "/data/mpp_dump");
+    mpp_env_get_u32("mpp_dump_queue", &queue_size, MAX_DUMP_QUEUE);
 
-        if (p->debug & MPP_DBG_DUMP_CFG)
-            p->fp_ops = try_env_file("mpp_dump_ops", dec_ops_path, p->tid);
-    } else {
-        if (p->debug & MPP_DBG_DUMP_IN) {
-            p->fp_in = try_env_file("mpp_dump_in", enc_frm_path, p->tid);
-            p->fp_buf = mpp_malloc(RK_U8, p->dump_size);
-        }
+    snprintf(name, sizeof(name), "%s_%s_%d_%d.bin", path,
+             (type == MPP_CTX_DEC) ? "dec" : "enc", p->tid,
+             MPP_FETCH_ADD(&dump_ctx_id, 1));
 
-        if (p->debug & MPP_DBG_DUMP_OUT)
-            p->fp_out = try_env_file("mpp_dump_out", enc_pkt_path, p->tid);
+    p->fp = fopen(name, "w+b");
+    mpp_log("open %s %p for dump\n", name, p->fp);
+    if (NULL == p->fp)
+        return MPP_OK;
 
-        if (p->debug & MPP_DBG_DUMP_CFG)
-            p->fp_ops = try_env_file("mpp_dump_ops", enc_ops_path, p->tid);
+    hdr.magic = DUMP_FILE_MAGIC;
+    hdr.version = DUMP_FILE_VERSION;
+    hdr.type = type;
+    hdr.coding = coding;
+    hdr.tid = p->tid;
+    hdr.record_size = sizeof(MppDumpRecord);
+    fwrite(&hdr, 1, sizeof(hdr), p->fp);
+
+    if (mpp_ring_queue_init(&p->queue, RING_QUEUE_MPMC, queue_size ? queue_size : 1,
+                            dump_node_release)) {
+        mpp_err_f("failed to init dump queue\n");
+        MPP_FCLOSE(p->fp);
+        return MPP_OK;
     }
 
-    if (p->fp_ops)
-        ops_log(p->fp_ops, "%d,%s,%d,%d\n", p->idx++, "init", type, coding);
+    p->thread = new MppThread(dump_thread, p, "mpp_dump");
+    p->thread->start();
+
+    dump_ops(p, DUMP_TAG_INIT, type, coding);
 
     return MPP_OK;
 }
@@ -325,79 +609,25 @@ MPP_RET mpp_ops_dec_put_pkt(MppDump info, MppPacket pkt)
     if (NULL == p || NULL == pkt)
         return MPP_OK;
 
-    RK_U32 length = mpp_packet_get_length(pkt);
-    AutoMutex auto_lock(p->lock);
-
-    if (p->fp_in) {
-        fwrite(mpp_packet_get_data(pkt), 1, length, p->fp_in);
-        fflush(p->fp_in);
-    }
-
-    if (p->fp_ops) {
-        ops_log(p->fp_ops, "%d,%s,%d,%d\n", p->idx++, "pkt", p->pkt_offset, length);
-
-        p->pkt_offset += length;
-    }
-
-    return MPP_OK;
+    return dump_pkt(p, DUMP_TAG_PKT_IN, MPP_DBG_DUMP_IN, pkt);
 }
 
 MPP_RET mpp_ops_dec_get_frm(MppDump info, MppFrame frame)
 {
     MppDumpImpl *p = (MppDumpImpl *)info;
-    if (NULL == p || NULL == frame || NULL == p->fp_out || NULL == p->fp_buf)
+    if (NULL == p || NULL == frame)
         return MPP_OK;
 
-    AutoMutex auto_lock(p->lock);
-
-    MppBuffer buf = mpp_frame_get_buffer(frame);
-    RK_S32 fd = (buf) ? mpp_buffer_get_fd(buf) : (-1);
-    RK_U32 info_change = mpp_frame_get_info_change(frame);
-    RK_U32 error = mpp_frame_get_errinfo(frame);
-    RK_U32 discard = mpp_frame_get_discard(frame);
-
-    if (p->fp_ops) {
-        ops_log(p->fp_ops, "%d,%s,%d,%d,%d,%d,%lld\n", p->idx, "frm", fd,
-                info_change, error, discard, mpp_frame_get_pts(frame));
-    }
-
-    if (NULL == buf || fd < 0) {
-        mpp_err("failed to dump frame\n");
-        return MPP_NOK;
-    }
-
-    dump_frame(p->fp_out, frame, p->fp_buf, p->dump_width, p->dump_height);
-
-    if (p->debug & MPP_DBG_DUMP_LOG) {
-        RK_S64 pts = mpp_frame_get_pts(frame);
-        RK_U32 width = mpp_frame_get_hor_stride(frame);
-        RK_U32 height = mpp_frame_get_ver_stride(frame);
-
-        mpp_log("yuv_info: [%d:%d] pts %lld", width, height, pts);
-    }
-
-    return MPP_OK;
+    return dump_frm(p, DUMP_TAG_FRM_OUT, MPP_DBG_DUMP_OUT, frame);
 }
 
 MPP_RET mpp_ops_enc_put_frm(MppDump info, MppFrame frame)
 {
     MppDumpImpl *p = (MppDumpImpl *)info;
-    if (NULL == p || NULL == frame || NULL == p->fp_out || NULL == p->fp_buf)
+    if (NULL == p || NULL == frame)
         return MPP_OK;
 
-    AutoMutex auto_lock(p->lock);
-
-    dump_frame(p->fp_out, frame, p->fp_buf, p->dump_width, p->dump_height);
-
-    if (p->debug & MPP_DBG_DUMP_LOG) {
-        RK_S64 pts = mpp_frame_get_pts(frame);
-        RK_U32 width = mpp_frame_get_hor_stride(frame);
-        RK_U32 height = mpp_frame_get_ver_stride(frame);
-
-        mpp_log("yuv_info: [%d:%d] pts %lld", width, height, pts);
-    }
-
-    return MPP_OK;
+    return dump_frm(p, DUMP_TAG_FRM_IN, MPP_DBG_DUMP_IN, frame);
 }
 
 MPP_RET mpp_ops_enc_get_pkt(MppDump info, MppPacket pkt)
@@ -406,15 +636,7 @@ MPP_RET mpp_ops_enc_get_pkt(MppDump info, MppPacket pkt)
     if (NULL == p || NULL == pkt)
         return MPP_OK;
 
-    RK_U32 length = mpp_packet_get_length(pkt);
-    AutoMutex auto_lock(p->lock);
-
-    if (p->fp_out) {
-        fwrite(mpp_packet_get_data(pkt), 1, length, p->fp_out);
-        fflush(p->fp_out);
-    }
-
-    return MPP_OK;
+    return dump_pkt(p, DUMP_TAG_PKT_OUT, MPP_DBG_DUMP_OUT, pkt);
 }
 
 MPP_RET mpp_ops_ctrl(MppDump info, MpiCmd cmd)
@@ -423,12 +645,7 @@ MPP_RET mpp_ops_ctrl(MppDump info, MpiCmd cmd)
     if (NULL == p)
         return MPP_OK;
 
-    AutoMutex auto_lock(p->lock);
-
-    if (p->fp_ops)
-        ops_log(p->fp_ops, "%d,%s,%d\n", p->idx, "ctrl", cmd);
-
-    return MPP_OK;
+    return dump_ops(p, DUMP_TAG_CTRL, cmd, 0);
 }
 
 MPP_RET mpp_ops_reset(MppDump info)
@@ -437,10 +654,5 @@ MPP_RET mpp_ops_reset(MppDump info)
     if (NULL == p)
         return MPP_OK;
 
-    AutoMutex auto_lock(p->lock);
-
-    if (p->fp_ops)
-        ops_log(p->fp_ops, "%d,%s\n", p->idx, "rst");
-
-    return MPP_OK;
+    return dump_ops(p, DUMP_TAG_RESET, 0, 0);
 }
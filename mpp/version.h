@@ -0,0 +1,33 @@
+/*
+ * Copyright 2010 Rockchip Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __VERSION_H__
+#define __VERSION_H__
+
+#define MPP_VERSION             "b8eaa1e author: agent          2026-10-17 [user-017] fix: stage kv config with all change flags cleared and no shared handles"
+#define MPP_VER_HIST_CNT        10
+#define MPP_VER_HIST_0          "b8eaa1e author: agent          2026-10-17 [user-017] fix: stage kv config with all change flags cleared and no shared handles  (HEAD -> master)"
+#define MPP_VER_HIST_1          "a67b428 author: agent          2026-10-17 [user-006] fix: replay drained tasks without the re-encode flag "
+#define MPP_VER_HIST_2          "2c6058a author: agent          2026-10-17 [user-009] fix: drop stray blank line in osal test list "
+#define MPP_VER_HIST_3          "fd8046e author: agent          2026-10-17 [user-009] fix: return frame queue errors and lock packet drain on reset "
+#define MPP_VER_HIST_4          "018ff07 author: agent          2026-10-17 [user-009] fix: never drop preset order timestamps "
+#define MPP_VER_HIST_5          "275f056 author: agent          2026-10-17 [user-003] fix: put h264d_parse_test in codec decoder test folder "
+#define MPP_VER_HIST_6          "9438de5 author: agent          2026-10-17 [user-003] fix: judge new frame only after svc nalu header and slice bytes "
+#define MPP_VER_HIST_7          "4a58c6d author: agent          2026-10-17 [user-002] fix: allow dummy decoder only behind test env mpp_dec_dummy "
+#define MPP_VER_HIST_8          "a90a4d3 author: agent          2026-10-17 [user-002] fix: wait hardware on a shared device waiter and never block pool jobs "
+#define MPP_VER_HIST_9          "ae166c0 author: agent          2026-10-17 [user-003] fix: check bulk start code scan through real parse_prepare"
+
+#endif /*__VERSION_H__*/
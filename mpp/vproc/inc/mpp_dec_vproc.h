@@ -36,6 +36,7 @@ extern "C" {
  * dec_vproc_init   - get context with cfg
  * dec_vproc_deinit - stop thread and destory context
  * dec_vproc_start  - start thread processing
+ * dec_vproc_get_task - wait until one idle task is available for new frame
  * dec_vproc_signal - signal thread that one frame has be pushed for process
  * dec_vproc_reset  - reset process thread and discard all input
  */
@@ -45,6 +46,7 @@ MPP_RET dec_vproc_deinit(MppDecVprocCtx ctx);
 
 MPP_RET dec_vproc_start(MppDecVprocCtx ctx);
 MPP_RET dec_vproc_stop(MppDecVprocCtx ctx);
+MPP_RET dec_vproc_get_task(MppDecVprocCtx ctx, HalTaskHnd *hnd);
 MPP_RET dec_vproc_signal(MppDecVprocCtx ctx);
 MPP_RET dec_vproc_reset(MppDecVprocCtx ctx);
 
@@ -20,6 +20,7 @@
 
 #include "mpp_env.h"
 #include "mpp_mem.h"
+#include "mpp_time.h"
 #include "mpp_common.h"
 
 #include "mpp_dec_impl.h"
@@ -52,6 +53,20 @@
 
 RK_U32 vproc_debug = 0;
 
+// for timing record
+typedef enum MppDecVprocTimingType_e {
+    VPROC_TOTAL,
+    VPROC_WAIT,
+    VPROC_PROC,
+    VPROC_TIMING_BUTT,
+} MppDecVprocTimingType;
+
+static const char *vproc_timing_str[VPROC_TIMING_BUTT] = {
+    "vproc thd ",
+    "vproc wait",
+    "vproc proc",
+};
+
 typedef struct MppDecVprocCtxImpl_t {
     Mpp                 *mpp;
     HalTaskGroup        task_group;
@@ -70,11 +85,19 @@ typedef struct MppDecVprocCtxImpl_t {
     MppFrame            prev_frm;
     RK_S32              curr_idx;
     MppFrame            curr_frm;
+
+    // statistics data
+    RK_U32              statistics_en;
+    MppClock            clocks[VPROC_TIMING_BUTT];
+    // time from task hand-off to task process start
+    RK_S64              queue_wait_sum;
+    RK_S64              queue_wait_max;
+    RK_S64              queue_wait_count;
 } MppDecVprocCtxImpl;
 
-static void dec_vproc_put_frame(Mpp *mpp, MppFrame frame, MppBuffer buf, RK_S64 pts)
+static void dec_vproc_put_frame(MppDecVprocCtxImpl *ctx, MppFrame frame, MppBuffer buf, RK_S64 pts)
 {
-    mpp_list *list = mpp->mFrames;
+    Mpp *mpp = ctx->mpp;
     MppFrame out = NULL;
     MppFrameImpl *impl = NULL;
 
@@ -86,15 +109,10 @@ static void dec_vproc_put_frame(Mpp *mpp, MppFrame frame, MppBuffer buf, RK_S64
     if (buf)
         impl->buffer = buf;
 
-    list->lock();
-    list->add_at_tail(&out, sizeof(out));
-
     if (mpp_debug & MPP_DBG_PTS)
         mpp_log("output frame pts %lld\n", mpp_frame_get_pts(out));
 
-    mpp->mFramePutCount++;
-    list->signal();
-    list->unlock();
+    mpp_dec_push_out_frame(mpp, out, ctx->thd);
 }
 
 static void dec_vproc_clr_prev(MppDecVprocCtxImpl *ctx)
@@ -121,6 +139,20 @@ static void dec_vproc_clr_prev(MppDecVprocCtxImpl *ctx)
     ctx->prev_frm = NULL;
 }
 
+static void dec_vproc_put_task(MppDecVprocCtxImpl *ctx, HalTaskHnd task)
+{
+    MppThread *thd = ctx->thd;
+
+    // wake up decoder thread waiting for idle task
+    thd->lock(THREAD_INPUT);
+    hal_task_hnd_set_status(task, TASK_IDLE);
+    thd->signal(THREAD_INPUT);
+    thd->unlock(THREAD_INPUT);
+
+    // decoder hal job does not wait but stops output in thread pool mode
+    mpp_dec_signal_output(ctx->mpp);
+}
+
 static void dec_vproc_set_img_fmt(IepImg *img, MppFrame frm)
 {
     memset(img, 0, sizeof(*img));
@@ -246,11 +278,11 @@ static void dec_vproc_set_dei_v1(MppDecVprocCtxImpl *ctx, MppFrame frm)
 
         // NOTE: we need to process pts here
         if (mode & MPP_FRAME_FLAG_TOP_FIRST) {
-            dec_vproc_put_frame(mpp, frm, dst0, first_pts);
-            dec_vproc_put_frame(mpp, frm, dst1, curr_pts);
+            dec_vproc_put_frame(ctx, frm, dst0, first_pts);
+            dec_vproc_put_frame(ctx, frm, dst1, curr_pts);
         } else {
-            dec_vproc_put_frame(mpp, frm, dst1, first_pts);
-            dec_vproc_put_frame(mpp, frm, dst0, curr_pts);
+            dec_vproc_put_frame(ctx, frm, dst1, first_pts);
+            dec_vproc_put_frame(ctx, frm, dst0, curr_pts);
         }
     } else {
         // 2 in 1 out case
@@ -271,7 +303,7 @@ static void dec_vproc_set_dei_v1(MppDecVprocCtxImpl *ctx, MppFrame frm)
 
         // start hardware
         dec_vproc_start_dei(ctx, mode);
-        dec_vproc_put_frame(mpp, frm, dst0, -1);
+        dec_vproc_put_frame(ctx, frm, dst0, -1);
     }
 }
 
@@ -351,8 +383,8 @@ static void dec_vproc_set_dei_v2(MppDecVprocCtxImpl *ctx, MppFrame frm)
         dec_vproc_start_dei(ctx, mode);
 
         // NOTE: we need to process pts here
-        dec_vproc_put_frame(mpp, frm, dst0, first_pts);
-        dec_vproc_put_frame(mpp, frm, dst1, curr_pts);
+        dec_vproc_put_frame(ctx, frm, dst0, first_pts);
+        dec_vproc_put_frame(ctx, frm, dst1, curr_pts);
     } else {
         struct iep2_api_params params;
 
@@ -375,7 +407,7 @@ static void dec_vproc_set_dei_v2(MppDecVprocCtxImpl *ctx, MppFrame frm)
 
         // start hardware
         dec_vproc_start_dei(ctx, mode);
-        dec_vproc_put_frame(mpp, frm, dst0, -1);
+        dec_vproc_put_frame(ctx, frm, dst0, -1);
     }
 }
 
@@ -393,6 +425,7 @@ static void *dec_vproc_thread(void *data)
     HalDecVprocTask *task_vproc = &task_info.dec_vproc;
 
     mpp_dbg(MPP_DBG_INFO, "mpp_dec_post_proc_thread started\n");
+    mpp_clock_start(ctx->clocks[VPROC_TOTAL]);
 
     while (1) {
         MPP_RET ret = MPP_OK;
@@ -417,7 +450,9 @@ static void *dec_vproc_thread(void *data)
                     }
                 }
 
+                mpp_clock_start(ctx->clocks[VPROC_WAIT]);
                 thd->wait();
+                mpp_clock_pause(ctx->clocks[VPROC_WAIT]);
                 continue;
             }
         }
@@ -430,6 +465,17 @@ static void *dec_vproc_thread(void *data)
 
             mpp_assert(ret == MPP_OK);
 
+            if (ctx->statistics_en) {
+                RK_S64 wait = mpp_time() - task_vproc->time;
+
+                ctx->queue_wait_sum += wait;
+                ctx->queue_wait_count++;
+                if (wait > ctx->queue_wait_max)
+                    ctx->queue_wait_max = wait;
+            }
+
+            mpp_clock_start(ctx->clocks[VPROC_PROC]);
+
             RK_S32 index = task_vproc->input;
             RK_U32 eos = task_vproc->flags.eos;
             RK_U32 change = task_vproc->flags.info_change;
@@ -440,11 +486,12 @@ static void *dec_vproc_thread(void *data)
 
                 mpp_frame_init(&frm);
                 mpp_frame_set_eos(frm, eos);
-                dec_vproc_put_frame(mpp, frm, NULL, -1);
+                dec_vproc_put_frame(ctx, frm, NULL, -1);
                 dec_vproc_clr_prev(ctx);
                 mpp_frame_deinit(&frm);
 
-                hal_task_hnd_set_status(task, TASK_IDLE);
+                mpp_clock_pause(ctx->clocks[VPROC_PROC]);
+                dec_vproc_put_task(ctx, task);
                 continue;
             }
 
@@ -452,10 +499,11 @@ static void *dec_vproc_thread(void *data)
 
             if (change) {
                 vproc_dbg_status("info change\n");
-                dec_vproc_put_frame(mpp, frm, NULL, -1);
+                dec_vproc_put_frame(ctx, frm, NULL, -1);
                 dec_vproc_clr_prev(ctx);
 
-                hal_task_hnd_set_status(task, TASK_IDLE);
+                mpp_clock_pause(ctx->clocks[VPROC_PROC]);
+                dec_vproc_put_task(ctx, task);
                 continue;
             }
 
@@ -492,9 +540,11 @@ static void *dec_vproc_thread(void *data)
                 }
             }
 
-            hal_task_hnd_set_status(task, TASK_IDLE);
+            mpp_clock_pause(ctx->clocks[VPROC_PROC]);
+            dec_vproc_put_task(ctx, task);
         }
     }
+    mpp_clock_pause(ctx->clocks[VPROC_TOTAL]);
     mpp_dbg(MPP_DBG_INFO, "mpp_dec_post_proc_thread exited\n");
 
     return NULL;
@@ -586,6 +636,13 @@ MPP_RET dec_vproc_init(MppDecVprocCtx *ctx, MppDecVprocCfg *cfg)
         p->prev_frm = NULL;
         p->curr_idx = -1;
         p->curr_frm = NULL;
+
+        p->statistics_en = ((MppDecImpl *)p->mpp->mDec)->statistics_en;
+        for (RK_S32 i = 0; i < VPROC_TIMING_BUTT; i++) {
+            p->clocks[i] = mpp_clock_get(vproc_timing_str[i]);
+            mpp_assert(p->clocks[i]);
+            mpp_clock_enable(p->clocks[i], p->statistics_en);
+        }
     }
 
     *ctx = p;
@@ -622,6 +679,34 @@ MPP_RET dec_vproc_deinit(MppDecVprocCtx ctx)
         p->com_ctx = NULL;
     }
 
+    if (p->statistics_en) {
+        RK_S64 total = mpp_clock_get_sum(p->clocks[VPROC_TOTAL]);
+
+        for (RK_S32 i = 0; i < VPROC_TIMING_BUTT; i++) {
+            MppClock timer = p->clocks[i];
+            RK_S64 time = mpp_clock_get_sum(timer);
+
+            if (!time || !total)
+                continue;
+
+            mpp_log("%p %s - %6.2f %-12lld avg %-12lld\n", p,
+                    mpp_clock_get_name(timer), time * 100.0 / total, time,
+                    time / mpp_clock_get_count(timer));
+        }
+
+        if (p->queue_wait_count)
+            mpp_log("%p queue wait - %lld frames avg %-12lld max %-12lld\n", p,
+                    p->queue_wait_count, p->queue_wait_sum / p->queue_wait_count,
+                    p->queue_wait_max);
+    }
+
+    for (RK_S32 i = 0; i < VPROC_TIMING_BUTT; i++) {
+        if (p->clocks[i]) {
+            mpp_clock_put(p->clocks[i]);
+            p->clocks[i] = NULL;
+        }
+    }
+
     sem_destroy(&p->reset_sem);
     mpp_free(p);
 
@@ -667,6 +752,27 @@ MPP_RET dec_vproc_stop(MppDecVprocCtx ctx)
     return MPP_OK;
 }
 
+MPP_RET dec_vproc_get_task(MppDecVprocCtx ctx, HalTaskHnd *hnd)
+{
+    if (NULL == ctx || NULL == hnd) {
+        mpp_err_f("found NULL input ctx %p hnd %p\n", ctx, hnd);
+        return MPP_ERR_NULL_PTR;
+    }
+    vproc_dbg_func("in\n");
+
+    MppDecVprocCtxImpl *p = (MppDecVprocCtxImpl *)ctx;
+    MppThread *thd = p->thd;
+
+    // block until vproc thread returns one task to idle
+    thd->lock(THREAD_INPUT);
+    while (hal_task_get_hnd(p->task_group, TASK_IDLE, hnd))
+        thd->wait(THREAD_INPUT);
+    thd->unlock(THREAD_INPUT);
+
+    vproc_dbg_func("out\n");
+    return MPP_OK;
+}
+
 MPP_RET dec_vproc_signal(MppDecVprocCtx ctx)
 {
     if (NULL == ctx) {
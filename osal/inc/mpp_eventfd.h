@@ -0,0 +1,52 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MPP_EVENTFD_H__
+#define __MPP_EVENTFD_H__
+
+#include "rk_type.h"
+#include "mpp_err.h"
+
+/*
+ * Level triggered readiness file descriptor
+ *
+ * The fd is readable (POLLIN) while the event is set and can be waited with
+ * poll / select / epoll together with other fds. The owner of the event
+ * updates the ready state, the user only waits on the fd and must not read
+ * or close it.
+ *
+ * Update only does a syscall on ready state change. The caller should
+ * serialize the updates on one event.
+ *
+ * It is implemented by eventfd on linux and not supported on other platform.
+ */
+typedef void* MppEventFd;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MPP_RET mpp_eventfd_init(MppEventFd *event);
+MPP_RET mpp_eventfd_deinit(MppEventFd event);
+
+RK_S32  mpp_eventfd_get_fd(MppEventFd event);
+void    mpp_eventfd_update(MppEventFd event, RK_S32 ready);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__MPP_EVENTFD_H__*/
@@ -88,6 +88,7 @@ extern "C" {
 MppIoctlVersion mpp_get_ioctl_version(void);
 const char *mpp_get_soc_name(void);
 RK_U32 mpp_get_vcodec_type(void);
+RK_U32 mpp_get_device_sim(void);
 RK_U32 mpp_get_2d_hw_flag(void);
 RK_U32 mpp_refresh_vcodec_type(RK_U32 vcodec_type);
 const char *mpp_get_platform_dev_name(MppCtxType type, MppCodingType coding, RK_U32 platform);
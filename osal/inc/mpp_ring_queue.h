@@ -0,0 +1,91 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MPP_RING_QUEUE_H__
+#define __MPP_RING_QUEUE_H__
+
+#include "rk_type.h"
+#include "mpp_err.h"
+
+/*
+ * Fixed capacity lock-free pointer queue
+ *
+ * The queue stores pointers in a power of two ring. Push and pop do not take
+ * any lock and do not allocate memory. Reader and writer indexes are kept on
+ * separate cache lines.
+ *
+ * RING_QUEUE_SPSC  - one producer thread and one consumer thread
+ * RING_QUEUE_MPMC  - any number of producer and consumer threads
+ *
+ * The timeout of push / pop follows MppPollType:
+ * 0    - non-block, return MPP_ERR_BUFFER_FULL on full and MPP_NOK on empty
+ * -1   - block until the operation is done
+ * > 0  - wait in millisecond, return MPP_ERR_TIMEOUT on timeout
+ *
+ * The waiting thread sleeps on a condition which is only signaled when the
+ * other side finds a waiter, so there is no lock on the fast path.
+ *
+ * The release function is called on the remaining pointers on flush and
+ * deinit.
+ *
+ * mpp_ring_queue_get_fd returns a level triggered readiness fd for epoll:
+ * RING_QUEUE_EVENT_PUSH    - readable while count is below the watermark
+ * RING_QUEUE_EVENT_POP     - readable while queue is not empty
+ * After the first fd is created each push / pop also updates the readiness
+ * under the queue lock.
+ */
+typedef void* MppRingQueue;
+typedef void (*MppRingQueueRelease)(void *data);
+
+typedef enum MppRingQueueType_e {
+    RING_QUEUE_SPSC,
+    RING_QUEUE_MPMC,
+    RING_QUEUE_TYPE_BUTT,
+} MppRingQueueType;
+
+typedef enum MppRingQueueEvent_e {
+    RING_QUEUE_EVENT_PUSH,
+    RING_QUEUE_EVENT_POP,
+    RING_QUEUE_EVENT_BUTT,
+} MppRingQueueEvent;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* size will be aligned up to power of two */
+MPP_RET mpp_ring_queue_init(MppRingQueue *queue, MppRingQueueType type,
+                            RK_S32 size, MppRingQueueRelease release);
+MPP_RET mpp_ring_queue_deinit(MppRingQueue queue);
+
+MPP_RET mpp_ring_queue_push(MppRingQueue queue, void *data, RK_S64 timeout);
+MPP_RET mpp_ring_queue_pop(MppRingQueue queue, void **data, RK_S64 timeout);
+/* pop all pointers and release them */
+MPP_RET mpp_ring_queue_flush(MppRingQueue queue);
+
+/* pointer count in queue, it is a snapshot when other threads are working */
+RK_S32  mpp_ring_queue_count(MppRingQueue queue);
+RK_S32  mpp_ring_queue_size(MppRingQueue queue);
+
+MPP_RET mpp_ring_queue_get_fd(MppRingQueue queue, MppRingQueueEvent event, RK_S32 *fd);
+/* push readiness watermark, default is the queue size */
+MPP_RET mpp_ring_queue_set_watermark(MppRingQueue queue, RK_S32 count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__MPP_RING_QUEUE_H__*/
@@ -144,6 +144,7 @@ public:
     RK_S32 timedwait(Mutex& mutex, RK_S64 timeout);
     RK_S32 timedwait(Mutex* mutex, RK_S64 timeout);
     RK_S32 signal();
+    RK_S32 broadcast();
 
 private:
     pthread_cond_t mCond;
@@ -187,6 +188,10 @@ inline RK_S32 Condition::signal()
 {
     return pthread_cond_signal(&mCond);
 }
+inline RK_S32 Condition::broadcast()
+{
+    return pthread_cond_broadcast(&mCond);
+}
 
 class MppMutexCond
 {
@@ -197,6 +202,7 @@ public:
     void lock()     { mLock.lock(); }
     void unlock()   { mLock.unlock(); }
     void wait()     { mCondition.wait(mLock); }
+    RK_S32 timedwait(RK_S64 timeout) { return mCondition.timedwait(mLock, timeout); }
     void signal()   { mCondition.signal(); }
     Mutex *mutex()  { return &mLock; }
 
@@ -252,6 +258,19 @@ public:
             mStatus[id] = status;
     }
 
+    /* wait with timeout in millisecond */
+    void timedwait(RK_S64 timeout, MppThreadSignal id = THREAD_WORK) {
+        mpp_assert(id < THREAD_SIGNAL_BUTT);
+        MppThreadStatus status = mStatus[id];
+
+        mStatus[id] = MPP_THREAD_WAITING;
+        mMutexCond[id].timedwait(timeout);
+
+        // check the status is not changed then restore status
+        if (mStatus[id] == MPP_THREAD_WAITING)
+            mStatus[id] = status;
+    }
+
     void signal(MppThreadSignal id = THREAD_WORK) {
         mpp_assert(id < THREAD_SIGNAL_BUTT);
         mMutexCond[id].signal();
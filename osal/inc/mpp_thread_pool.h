@@ -0,0 +1,60 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MPP_THREAD_POOL_H__
+#define __MPP_THREAD_POOL_H__
+
+#include "rk_type.h"
+#include "mpp_err.h"
+
+/*
+ * Process-wide worker thread pool
+ *
+ * A job is a function which is run on one of the shared worker threads
+ * each time the job is signaled. The pool guarantees that one job is never
+ * run on two workers at the same time so the job function does not need
+ * extra protection against itself. Different jobs run in parallel.
+ *
+ * The job function return value decides the next step:
+ * non-zero - job has more work to do and will be queued again
+ * zero     - job is idle and will sleep until next mpp_job_signal
+ *
+ * Signal on a running job will make it run again after current run.
+ *
+ * Worker count is the online cpu count by default and can be changed by
+ * env mpp_thread_pool_size before the first job is created. Each worker
+ * has its own job queue. A job is queued on the worker which run it last
+ * time for cache locality and idle workers steal jobs from other queues.
+ */
+typedef void* MppJob;
+typedef RK_S32 (*MppJobFunc)(void *ctx);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MPP_RET mpp_job_get(MppJob *job, const char *name, MppJobFunc func, void *ctx);
+/* wait until the job goes idle then release it */
+MPP_RET mpp_job_put(MppJob job);
+MPP_RET mpp_job_signal(MppJob job);
+
+RK_S32  mpp_thread_pool_size(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__MPP_THREAD_POOL_H__*/
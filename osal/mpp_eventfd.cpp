@@ -0,0 +1,119 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_eventfd"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "mpp_mem.h"
+#include "mpp_log.h"
+#include "mpp_eventfd.h"
+
+typedef struct MppEventFdImpl_t {
+    RK_S32              fd;
+    RK_S32              ready;
+} MppEventFdImpl;
+
+#if defined(__linux__)
+MPP_RET mpp_eventfd_init(MppEventFd *event)
+{
+    MppEventFdImpl *p = NULL;
+
+    if (NULL == event) {
+        mpp_err_f("invalid NULL input\n");
+        return MPP_ERR_NULL_PTR;
+    }
+
+    *event = NULL;
+    p = mpp_calloc(MppEventFdImpl, 1);
+    if (NULL == p) {
+        mpp_err_f("failed to malloc event\n");
+        return MPP_ERR_MALLOC;
+    }
+
+    p->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (p->fd < 0) {
+        mpp_err_f("failed to create eventfd\n");
+        mpp_free(p);
+        return MPP_NOK;
+    }
+
+    *event = p;
+    return MPP_OK;
+}
+
+MPP_RET mpp_eventfd_deinit(MppEventFd event)
+{
+    MppEventFdImpl *p = (MppEventFdImpl *)event;
+
+    if (NULL == p) {
+        mpp_err_f("invalid NULL input\n");
+        return MPP_ERR_NULL_PTR;
+    }
+
+    close(p->fd);
+    mpp_free(p);
+    return MPP_OK;
+}
+
+void mpp_eventfd_update(MppEventFd event, RK_S32 ready)
+{
+    MppEventFdImpl *p = (MppEventFdImpl *)event;
+    eventfd_t val = 1;
+
+    ready = !!ready;
+    if (NULL == p || p->ready == ready)
+        return;
+
+    if (ready)
+        eventfd_write(p->fd, val);
+    else
+        eventfd_read(p->fd, &val);
+
+    p->ready = ready;
+}
+#else
+MPP_RET mpp_eventfd_init(MppEventFd *event)
+{
+    if (event)
+        *event = NULL;
+
+    mpp_err_f("eventfd is not supported on this platform\n");
+    return MPP_NOK;
+}
+
+MPP_RET mpp_eventfd_deinit(MppEventFd event)
+{
+    (void)event;
+    return MPP_OK;
+}
+
+void mpp_eventfd_update(MppEventFd event, RK_S32 ready)
+{
+    (void)event;
+    (void)ready;
+}
+#endif
+
+RK_S32 mpp_eventfd_get_fd(MppEventFd event)
+{
+    MppEventFdImpl *p = (MppEventFdImpl *)event;
+
+    return (p) ? p->fd : -1;
+}
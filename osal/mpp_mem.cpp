@@ -25,6 +25,7 @@
 #include "mpp_env.h"
 #include "mpp_mem.h"
 #include "mpp_list.h"
+#include "mpp_atomic.h"
 #include "mpp_common.h"
 
 #include "os_mem.h"
@@ -50,6 +51,21 @@
 #define MEM_HEAD_MASK           (0xab)
 #define MEM_TAIL_MASK           (0xcd)
 
+// thread cache size class config
+#define MEM_CACHE_CLASS_CNT     14
+#define MEM_CACHE_MAX_SIZE      4096
+#define MEM_CACHE_DIRECT        (0xff)
+// max free bytes kept by one thread cache in each class
+#define MEM_CACHE_CLASS_BYTES   (32 * 1024)
+#define MEM_CACHE_CLASS_MIN     8
+
+#if defined(__SANITIZE_ADDRESS__)
+// keep every free visible to address sanitizer
+#define MEM_CACHE_DEFAULT       0
+#else
+#define MEM_CACHE_DEFAULT       1
+#endif
+
 #define MPP_MEM_ASSERT(cond) \
     do { \
         if (!(cond)) { \
@@ -124,6 +140,7 @@ public:
 
     Mutex       lock;
     RK_U32      debug;
+    RK_U32      no_cache;
 
 private:
     // data for node record and delay free check
@@ -195,6 +212,7 @@ static void set_mem_ext_room(void *p, size_t size)
 
 MppMemService::MppMemService()
     : debug(0),
+      no_cache(0),
       nodes_max(MEM_NODE_MAX),
       nodes_idx(0),
       nodes_cnt(0),
@@ -210,7 +228,11 @@ MppMemService::MppMemService()
       logs(NULL),
       total_size(0)
 {
+    RK_U32 cache = 0;
+
     mpp_env_get_u32("mpp_mem_debug", &debug, 0);
+    mpp_env_get_u32("mpp_mem_cache", &cache, MEM_CACHE_DEFAULT);
+    no_cache = !cache;
 
     // add more flag if debug enabled
     if (debug)
@@ -634,8 +656,231 @@ void MppMemService::dump(const char *caller)
     }
 }
 
+/*
+ * Thread caching allocator for non-debug mode
+ *
+ * Small block is allocated in size class and freed block is kept in the cache
+ * of the thread which allocated it, so malloc / free on one thread takes no
+ * lock. Free from other thread is pushed to the remote list of the owner cache
+ * by CAS and the owner takes the whole list back when its class is empty.
+ * Cache of exited thread goes to the orphan list and is reused by new thread
+ * so the blocks on its remote list are not lost.
+ *
+ * Each block has a MEM_ALIGN size head before user pointer. Large block and
+ * all blocks when env mpp_mem_cache is 0 go to os_malloc directly.
+ */
+typedef struct MppMemCache_t MppMemCache;
+
+typedef struct MppMemHead_t {
+    MppMemCache             *cache;
+    struct MppMemHead_t     *next;
+    size_t                  size;
+    RK_U32                  index;
+} MppMemHead;
+
+struct MppMemCache_t {
+    MppMemHead              *free[MEM_CACHE_CLASS_CNT];
+    RK_S32                  count[MEM_CACHE_CLASS_CNT];
+    MppMemHead * volatile   remote;
+    MppMemCache             *next;
+};
+
+static const RK_U32 mem_class_size[MEM_CACHE_CLASS_CNT] = {
+    32, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+};
+
+static pthread_key_t mem_cache_key;
+static pthread_once_t mem_cache_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t mem_orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static MppMemCache *mem_orphans = NULL;
+
+/* 32 byte step below 128 then two classes on each power of two */
+static inline RK_U32 mem_size_to_class(size_t size)
+{
+    RK_U32 n = (size) ? (RK_U32)(size - 1) : 0;
+    RK_U32 p;
+
+    if (n < 128)
+        return n >> 5;
+
+    p = 31 - __builtin_clz(n);
+    return 4 + (p - 7) * 2 + (n >= (3U << (p - 1)));
+}
+
+static void mem_cache_release(void *arg)
+{
+    MppMemCache *cache = (MppMemCache *)arg;
+
+    pthread_mutex_lock(&mem_orphan_lock);
+    cache->next = mem_orphans;
+    mem_orphans = cache;
+    pthread_mutex_unlock(&mem_orphan_lock);
+}
+
+static void mem_cache_key_init(void)
+{
+    pthread_key_create(&mem_cache_key, mem_cache_release);
+}
+
+static MppMemCache *mem_cache_get(void)
+{
+    MppMemCache *cache = NULL;
+
+    pthread_once(&mem_cache_once, mem_cache_key_init);
+
+    cache = (MppMemCache *)pthread_getspecific(mem_cache_key);
+    if (cache)
+        return cache;
+
+    pthread_mutex_lock(&mem_orphan_lock);
+    cache = mem_orphans;
+    if (cache)
+        mem_orphans = cache->next;
+    pthread_mutex_unlock(&mem_orphan_lock);
+
+    if (NULL == cache) {
+        os_malloc((void **)&cache, MEM_ALIGN, sizeof(*cache));
+        if (NULL == cache)
+            return NULL;
+
+        memset(cache, 0, sizeof(*cache));
+    }
+
+    cache->next = NULL;
+    pthread_setspecific(mem_cache_key, cache);
+    return cache;
+}
+
+/* move blocks freed by other threads to local free list */
+static void mem_cache_collect(MppMemCache *cache)
+{
+    MppMemHead *head = cache->remote;
+
+    while (!MPP_BOOL_CAS(&cache->remote, head, NULL))
+        head = cache->remote;
+
+    while (head) {
+        MppMemHead *next = head->next;
+        RK_U32 index = head->index;
+
+        head->next = cache->free[index];
+        cache->free[index] = head;
+        cache->count[index]++;
+        head = next;
+    }
+}
+
+static void *mem_direct_malloc(size_t size)
+{
+    MppMemHead *head = NULL;
+
+    os_malloc((void **)&head, MEM_ALIGN, MEM_ALIGN + size);
+    if (NULL == head)
+        return NULL;
+
+    head->cache = NULL;
+    head->size = size;
+    head->index = MEM_CACHE_DIRECT;
+    return (RK_U8 *)head + MEM_ALIGN;
+}
+
+static void *mem_cache_malloc(size_t size)
+{
+    MppMemCache *cache = NULL;
+    MppMemHead *head = NULL;
+    RK_U32 index;
+
+    if (size > MEM_CACHE_MAX_SIZE || service.no_cache)
+        return mem_direct_malloc(size);
+
+    cache = mem_cache_get();
+    if (NULL == cache)
+        return mem_direct_malloc(size);
+
+    index = mem_size_to_class(size);
+    head = cache->free[index];
+    if (NULL == head && cache->remote) {
+        mem_cache_collect(cache);
+        head = cache->free[index];
+    }
+
+    if (head) {
+        cache->free[index] = head->next;
+        cache->count[index]--;
+        return (RK_U8 *)head + MEM_ALIGN;
+    }
+
+    os_malloc((void **)&head, MEM_ALIGN, MEM_ALIGN + mem_class_size[index]);
+    if (NULL == head)
+        return NULL;
+
+    head->cache = cache;
+    head->size = mem_class_size[index];
+    head->index = index;
+    return (RK_U8 *)head + MEM_ALIGN;
+}
+
+static void mem_cache_free(void *ptr)
+{
+    MppMemHead *head = (MppMemHead *)((RK_U8 *)ptr - MEM_ALIGN);
+    MppMemCache *owner = head->cache;
+    RK_U32 index = head->index;
+
+    if (index == MEM_CACHE_DIRECT) {
+        os_free(head);
+        return;
+    }
+
+    if (owner == pthread_getspecific(mem_cache_key)) {
+        if (owner->count[index] * mem_class_size[index] >= MEM_CACHE_CLASS_BYTES &&
+            owner->count[index] >= MEM_CACHE_CLASS_MIN) {
+            os_free(head);
+            return;
+        }
+
+        head->next = owner->free[index];
+        owner->free[index] = head;
+        owner->count[index]++;
+        return;
+    }
+
+    do {
+        head->next = owner->remote;
+    } while (!MPP_BOOL_CAS(&owner->remote, head->next, head));
+}
+
+static void *mem_cache_realloc(void *ptr, size_t size)
+{
+    MppMemHead *head = (MppMemHead *)((RK_U8 *)ptr - MEM_ALIGN);
+    void *ret = NULL;
+
+    if (head->index == MEM_CACHE_DIRECT && (size > MEM_CACHE_MAX_SIZE || service.no_cache)) {
+        os_realloc(head, &ret, MEM_ALIGN, MEM_ALIGN + size);
+        if (NULL == ret)
+            return NULL;
+
+        head = (MppMemHead *)ret;
+        head->size = size;
+        return (RK_U8 *)head + MEM_ALIGN;
+    }
+
+    if (head->index != MEM_CACHE_DIRECT && size <= head->size)
+        return ptr;
+
+    ret = mem_cache_malloc(size);
+    if (ret) {
+        memcpy(ret, ptr, MPP_MIN(head->size, size));
+        mem_cache_free(ptr);
+    }
+
+    return ret;
+}
+
 void *mpp_osal_malloc(const char *caller, size_t size)
 {
+    if (!service.debug)
+        return mem_cache_malloc(size);
+
     AutoMutex auto_lock(&service.lock);
     RK_U32 debug = service.debug;
     size_t size_align = MEM_ALIGNED(size);
@@ -671,10 +916,6 @@ void *mpp_osal_calloc(const char *caller, size_t size)
 
 void *mpp_osal_realloc(const char *caller, void *ptr, size_t size)
 {
-    AutoMutex auto_lock(&service.lock);
-    RK_U32 debug = service.debug;
-    void *ret;
-
     if (NULL == ptr)
         return mpp_osal_malloc(caller, size);
 
@@ -683,6 +924,19 @@ void *mpp_osal_realloc(const char *caller, void *ptr, size_t size)
         return NULL;
     }
 
+    if (!service.debug) {
+        void *ret = mem_cache_realloc(ptr, size);
+
+        if (NULL == ret)
+            mpp_err("mpp_realloc ptr %p to size %d failed\n", ptr, size);
+
+        return ret;
+    }
+
+    AutoMutex auto_lock(&service.lock);
+    RK_U32 debug = service.debug;
+    void *ret;
+
     size_t size_align = MEM_ALIGNED(size);
     size_t size_real = (debug & MEM_EXT_ROOM) ? (size_align + 2 * MEM_ALIGN) :
                        (size_align);
@@ -710,16 +964,16 @@ void *mpp_osal_realloc(const char *caller, void *ptr, size_t size)
 
 void mpp_osal_free(const char *caller, void *ptr)
 {
-    AutoMutex auto_lock(&service.lock);
-    RK_U32 debug = service.debug;
     if (NULL == ptr)
         return;
 
-    if (!debug) {
-        os_free(ptr);
-        return ;
+    if (!service.debug) {
+        mem_cache_free(ptr);
+        return;
     }
 
+    AutoMutex auto_lock(&service.lock);
+    RK_U32 debug = service.debug;
     size_t size = 0;
 
     if (debug & MEM_POISON) {
@@ -742,7 +996,8 @@ void mpp_osal_free(const char *caller, void *ptr)
 /* dump memory status */
 void mpp_show_mem_status()
 {
-    AutoMutex auto_lock(&service.lock);
-    if (service.debug & MEM_DEBUG_EN)
+    if (service.debug & MEM_DEBUG_EN) {
+        AutoMutex auto_lock(&service.lock);
         service.dump(__FUNCTION__);
+    }
 }
@@ -154,6 +154,9 @@ private:
     RockchipSocType soc_type;
     RK_U32          vcodec_type;
     RK_U32          vcodec_capability;
+    RK_U32          device_sim;
+
+    void            init_device_sim();
 
 public:
     static MppPlatformService *get_instance() {
@@ -167,18 +170,26 @@ public:
     RK_U32          get_vcodec_type() { return vcodec_type; };
     void            set_vcodec_type(RK_U32 val) { vcodec_type = val; };
     RK_U32          get_vcodec_capability() { return vcodec_capability; };
+    RK_U32          get_device_sim() { return device_sim; };
 };
 
 MppPlatformService::MppPlatformService()
     : ioctl_version(IOCTL_VCODEC_SERVICE),
       soc_name(NULL),
       vcodec_type(0),
-      vcodec_capability(0)
+      vcodec_capability(0),
+      device_sim(0)
 {
     /* judge vdpu support version */
     RK_S32 fd = -1;
 
     mpp_env_get_u32("mpp_debug", &mpp_debug, 0);
+    mpp_env_get_u32("mpp_device_sim", &device_sim, 0);
+
+    if (device_sim) {
+        init_device_sim();
+        return;
+    }
 
     /* set vpu1 defalut for old chip without dts */
     vcodec_type = HAVE_VDPU1 | HAVE_VEPU1;
@@ -280,6 +291,39 @@ __return:
     mpp_dbg(MPP_DBG_PLATFORM, "vcodec type %08x\n", vcodec_type);
 }
 
+/*
+ * Simulated device for running without hardware. The soc name is taken from
+ * env instead of device tree and all clients share the emulated mpp_service.
+ */
+void MppPlatformService::init_device_sim()
+{
+    const char *name = NULL;
+    RK_U32 i;
+
+    mpp_env_get_str("mpp_device_sim_soc", &name, "rk3399");
+
+    ioctl_version = IOCTL_MPP_SERVICE_V1;
+    soc_type = ROCKCHIP_SOC_AUTO;
+    vcodec_type = HAVE_VDPU2 | HAVE_VEPU2 | HAVE_RKVDEC;
+
+    soc_name = mpp_malloc_size(char, MAX_SOC_NAME_LENGTH);
+    if (soc_name)
+        snprintf(soc_name, MAX_SOC_NAME_LENGTH, "%s", name);
+
+    for (i = 0; i < MPP_ARRAY_ELEMS(mpp_vpu_version); i++) {
+        if (strstr(name, mpp_vpu_version[i].compatible)) {
+            vcodec_type = mpp_vpu_version[i].vcodec_type;
+            soc_type = mpp_vpu_version[i].soc_type;
+            break;
+        }
+    }
+
+    if (i >= MPP_ARRAY_ELEMS(mpp_vpu_version))
+        mpp_log("can not found match soc name: %s\n", name);
+
+    mpp_log("simulated device on %s vcodec type %08x\n", name, vcodec_type);
+}
+
 MppPlatformService::~MppPlatformService()
 {
     MPP_FREE(soc_name);
@@ -311,6 +355,11 @@ RK_U32 mpp_get_vcodec_type(void)
     return vcodec_type;
 }
 
+RK_U32 mpp_get_device_sim(void)
+{
+    return MppPlatformService::get_instance()->get_device_sim();
+}
+
 RK_U32 mpp_get_2d_hw_flag(void)
 {
     RK_U32 flag = 0;
@@ -0,0 +1,418 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_ring_queue"
+
+#include "mpp_mem.h"
+#include "mpp_log.h"
+#include "mpp_atomic.h"
+#include "mpp_thread.h"
+#include "mpp_eventfd.h"
+#include "mpp_ring_queue.h"
+
+#define RING_QUEUE_CACHE_LINE       64
+#define RING_QUEUE_MAX_SIZE         (1 << 20)
+
+/*
+ * MPMC queue cell with sequence number:
+ * seq == pos           - cell is free for the writer on pos
+ * seq == pos + 1       - cell is written and ready for the reader on pos
+ * SPSC queue only uses the data.
+ */
+typedef struct MppRingCell_t {
+    volatile RK_U32     seq;
+    void                *data;
+} MppRingCell;
+
+/* writer or reader index with the other side index cached by SPSC queue */
+typedef struct MppRingIndex_t {
+    volatile RK_U32     pos;
+    RK_U32              peer;
+    RK_U8               pad[RING_QUEUE_CACHE_LINE - 2 * sizeof(RK_U32)];
+} MppRingIndex;
+
+typedef struct MppRingQueueImpl_t {
+    MppRingQueueType    type;
+    RK_U32              size;
+    RK_U32              mask;
+    MppRingCell         *cells;
+    MppRingQueueRelease release;
+    RK_U8               pad[RING_QUEUE_CACHE_LINE];
+
+    MppRingIndex        head;
+    MppRingIndex        tail;
+
+    // waiter count is checked by the other side after each operation
+    volatile RK_S32     wait_push;
+    volatile RK_S32     wait_pop;
+    Mutex               *lock;
+    Condition           *cond_push;
+    Condition           *cond_pop;
+
+    // readiness fd created on request
+    volatile RK_S32     event_on;
+    RK_S32              watermark;
+    MppEventFd          events[RING_QUEUE_EVENT_BUTT];
+} MppRingQueueImpl;
+
+static MPP_RET spsc_push(MppRingQueueImpl *p, void *data)
+{
+    RK_U32 pos = p->head.pos;
+
+    if (pos - p->head.peer >= p->size) {
+        p->head.peer = MPP_LOAD_ACQUIRE(&p->tail.pos);
+        if (pos - p->head.peer >= p->size)
+            return MPP_ERR_BUFFER_FULL;
+    }
+
+    p->cells[pos & p->mask].data = data;
+    MPP_STORE_RELEASE(&p->head.pos, pos + 1);
+    return MPP_OK;
+}
+
+static MPP_RET spsc_pop(MppRingQueueImpl *p, void **data)
+{
+    RK_U32 pos = p->tail.pos;
+
+    if (pos == p->tail.peer) {
+        p->tail.peer = MPP_LOAD_ACQUIRE(&p->head.pos);
+        if (pos == p->tail.peer)
+            return MPP_NOK;
+    }
+
+    *data = p->cells[pos & p->mask].data;
+    MPP_STORE_RELEASE(&p->tail.pos, pos + 1);
+    return MPP_OK;
+}
+
+static MPP_RET mpmc_push(MppRingQueueImpl *p, void *data)
+{
+    RK_U32 pos = p->head.pos;
+    MppRingCell *cell;
+
+    while (1) {
+        RK_S32 diff;
+
+        cell = &p->cells[pos & p->mask];
+        diff = (RK_S32)(MPP_LOAD_ACQUIRE(&cell->seq) - pos);
+
+        if (!diff) {
+            if (MPP_BOOL_CAS(&p->head.pos, pos, pos + 1))
+                break;
+            pos = p->head.pos;
+        } else if (diff < 0) {
+            return MPP_ERR_BUFFER_FULL;
+        } else
+            pos = p->head.pos;
+    }
+
+    cell->data = data;
+    MPP_STORE_RELEASE(&cell->seq, pos + 1);
+    return MPP_OK;
+}
+
+static MPP_RET mpmc_pop(MppRingQueueImpl *p, void **data)
+{
+    RK_U32 pos = p->tail.pos;
+    MppRingCell *cell;
+
+    while (1) {
+        RK_S32 diff;
+
+        cell = &p->cells[pos & p->mask];
+        diff = (RK_S32)(MPP_LOAD_ACQUIRE(&cell->seq) - (pos + 1));
+
+        if (!diff) {
+            if (MPP_BOOL_CAS(&p->tail.pos, pos, pos + 1))
+                break;
+            pos = p->tail.pos;
+        } else if (diff < 0) {
+            return MPP_NOK;
+        } else
+            pos = p->tail.pos;
+    }
+
+    *data = cell->data;
+    MPP_STORE_RELEASE(&cell->seq, pos + p->mask + 1);
+    return MPP_OK;
+}
+
+static MPP_RET ring_push(MppRingQueueImpl *p, void *data)
+{
+    return (p->type == RING_QUEUE_SPSC) ? spsc_push(p, data) : mpmc_push(p, data);
+}
+
+static MPP_RET ring_pop(MppRingQueueImpl *p, void **data)
+{
+    return (p->type == RING_QUEUE_SPSC) ? spsc_pop(p, data) : mpmc_pop(p, data);
+}
+
+/*
+ * The waiter count is increased before the final retry under lock and the
+ * other side checks it after a full barrier. So either the retry sees the
+ * new data or the other side sees the waiter and signals it under lock.
+ */
+static void ring_wake(MppRingQueueImpl *p, volatile RK_S32 *waiter, Condition *cond)
+{
+    MPP_SYNC();
+    if (*waiter) {
+        AutoMutex autoLock(p->lock);
+        cond->signal();
+    }
+}
+
+static void ring_update_event(MppRingQueueImpl *p)
+{
+    RK_S32 count = mpp_ring_queue_count(p);
+
+    mpp_eventfd_update(p->events[RING_QUEUE_EVENT_PUSH], count < p->watermark);
+    mpp_eventfd_update(p->events[RING_QUEUE_EVENT_POP], count > 0);
+}
+
+static void ring_sync_event(MppRingQueueImpl *p)
+{
+    AutoMutex autoLock(p->lock);
+
+    ring_update_event(p);
+}
+
+static MPP_RET ring_wait_push(MppRingQueueImpl *p, void *data, RK_S64 timeout)
+{
+    AutoMutex autoLock(p->lock);
+    MPP_RET ret = MPP_OK;
+
+    MPP_FETCH_ADD(&p->wait_push, 1);
+    while (1) {
+        ret = ring_push(p, data);
+        if (!ret)
+            break;
+
+        if (timeout < 0) {
+            p->cond_push->wait(p->lock);
+        } else if (p->cond_push->timedwait(p->lock, timeout)) {
+            ret = ring_push(p, data);
+            if (ret)
+                ret = MPP_ERR_TIMEOUT;
+            break;
+        }
+    }
+    MPP_FETCH_SUB(&p->wait_push, 1);
+
+    return ret;
+}
+
+static MPP_RET ring_wait_pop(MppRingQueueImpl *p, void **data, RK_S64 timeout)
+{
+    AutoMutex autoLock(p->lock);
+    MPP_RET ret = MPP_OK;
+
+    MPP_FETCH_ADD(&p->wait_pop, 1);
+    while (1) {
+        ret = ring_pop(p, data);
+        if (!ret)
+            break;
+
+        if (timeout < 0) {
+            p->cond_pop->wait(p->lock);
+        } else if (p->cond_pop->timedwait(p->lock, timeout)) {
+            ret = ring_pop(p, data);
+            if (ret)
+                ret = MPP_ERR_TIMEOUT;
+            break;
+        }
+    }
+    MPP_FETCH_SUB(&p->wait_pop, 1);
+
+    return ret;
+}
+
+MPP_RET mpp_ring_queue_init(MppRingQueue *queue, MppRingQueueType type,
+                            RK_S32 size, MppRingQueueRelease release)
+{
+    MppRingQueueImpl *p = NULL;
+    RK_U32 count = 1;
+    RK_U32 i;
+
+    if (NULL == queue || type >= RING_QUEUE_TYPE_BUTT ||
+        size <= 0 || size > RING_QUEUE_MAX_SIZE) {
+        mpp_err_f("invalid queue %p type %d size %d\n", queue, type, size);
+        return MPP_ERR_VALUE;
+    }
+
+    while (count < (RK_U32)size)
+        count <<= 1;
+
+    *queue = NULL;
+    p = mpp_calloc(MppRingQueueImpl, 1);
+    if (p)
+        p->cells = mpp_calloc(MppRingCell, count);
+
+    if (NULL == p || NULL == p->cells) {
+        mpp_err_f("failed to malloc queue size %d\n", count);
+        if (p)
+            mpp_free(p);
+        return MPP_ERR_MALLOC;
+    }
+
+    for (i = 0; i < count; i++)
+        p->cells[i].seq = i;
+
+    p->type = type;
+    p->size = count;
+    p->mask = count - 1;
+    p->release = release;
+    p->watermark = count;
+    p->lock = new Mutex();
+    p->cond_push = new Condition();
+    p->cond_pop = new Condition();
+
+    *queue = p;
+    return MPP_OK;
+}
+
+MPP_RET mpp_ring_queue_deinit(MppRingQueue queue)
+{
+    MppRingQueueImpl *p = (MppRingQueueImpl *)queue;
+    RK_S32 i;
+
+    if (NULL == p) {
+        mpp_err_f("found NULL input queue\n");
+        return MPP_ERR_NULL_PTR;
+    }
+
+    mpp_ring_queue_flush(queue);
+
+    for (i = 0; i < RING_QUEUE_EVENT_BUTT; i++)
+        if (p->events[i])
+            mpp_eventfd_deinit(p->events[i]);
+
+    delete p->cond_pop;
+    delete p->cond_push;
+    delete p->lock;
+    mpp_free(p->cells);
+    mpp_free(p);
+
+    return MPP_OK;
+}
+
+MPP_RET mpp_ring_queue_push(MppRingQueue queue, void *data, RK_S64 timeout)
+{
+    MppRingQueueImpl *p = (MppRingQueueImpl *)queue;
+    MPP_RET ret = ring_push(p, data);
+
+    if (ret && timeout)
+        ret = ring_wait_push(p, data, timeout);
+
+    if (!ret) {
+        ring_wake(p, &p->wait_pop, p->cond_pop);
+        if (p->event_on)
+            ring_sync_event(p);
+    }
+
+    return ret;
+}
+
+MPP_RET mpp_ring_queue_pop(MppRingQueue queue, void **data, RK_S64 timeout)
+{
+    MppRingQueueImpl *p = (MppRingQueueImpl *)queue;
+    MPP_RET ret = ring_pop(p, data);
+
+    if (ret && timeout)
+        ret = ring_wait_pop(p, data, timeout);
+
+    if (!ret) {
+        ring_wake(p, &p->wait_push, p->cond_push);
+        if (p->event_on)
+            ring_sync_event(p);
+    }
+
+    return ret;
+}
+
+MPP_RET mpp_ring_queue_flush(MppRingQueue queue)
+{
+    MppRingQueueImpl *p = (MppRingQueueImpl *)queue;
+    void *data = NULL;
+
+    while (!mpp_ring_queue_pop(queue, &data, 0)) {
+        if (p->release)
+            p->release(data);
+    }
+
+    return MPP_OK;
+}
+
+RK_S32 mpp_ring_queue_count(MppRingQueue queue)
+{
+    MppRingQueueImpl *p = (MppRingQueueImpl *)queue;
+    RK_U32 tail = MPP_LOAD_ACQUIRE(&p->tail.pos);
+    RK_S32 count = (RK_S32)(MPP_LOAD_ACQUIRE(&p->head.pos) - tail);
+
+    if (count < 0)
+        count = 0;
+    if (count > (RK_S32)p->size)
+        count = p->size;
+
+    return count;
+}
+
+RK_S32 mpp_ring_queue_size(MppRingQueue queue)
+{
+    MppRingQueueImpl *p = (MppRingQueueImpl *)queue;
+
+    return p->size;
+}
+
+MPP_RET mpp_ring_queue_get_fd(MppRingQueue queue, MppRingQueueEvent event, RK_S32 *fd)
+{
+    MppRingQueueImpl *p = (MppRingQueueImpl *)queue;
+
+    if (NULL == p || NULL == fd || event >= RING_QUEUE_EVENT_BUTT) {
+        mpp_err_f("invalid queue %p event %d fd %p\n", queue, event, fd);
+        return MPP_ERR_VALUE;
+    }
+
+    AutoMutex autoLock(p->lock);
+
+    if (NULL == p->events[event]) {
+        MPP_RET ret = mpp_eventfd_init(&p->events[event]);
+        if (ret)
+            return ret;
+
+        p->event_on = 1;
+        MPP_SYNC();
+        ring_update_event(p);
+    }
+
+    *fd = mpp_eventfd_get_fd(p->events[event]);
+    return MPP_OK;
+}
+
+MPP_RET mpp_ring_queue_set_watermark(MppRingQueue queue, RK_S32 count)
+{
+    MppRingQueueImpl *p = (MppRingQueueImpl *)queue;
+
+    if (NULL == p || count <= 0 || count > (RK_S32)p->size) {
+        mpp_err_f("invalid queue %p watermark %d\n", queue, count);
+        return MPP_ERR_VALUE;
+    }
+
+    AutoMutex autoLock(p->lock);
+
+    p->watermark = count;
+    ring_update_event(p);
+    return MPP_OK;
+}
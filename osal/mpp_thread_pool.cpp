@@ -0,0 +1,416 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_thread_pool"
+
+#include <string.h>
+
+#include "mpp_env.h"
+#include "mpp_log.h"
+#include "mpp_list.h"
+#include "mpp_common.h"
+#include "mpp_atomic.h"
+#include "mpp_thread.h"
+#include "mpp_thread_pool.h"
+
+#define MPP_THREAD_POOL_DBG_FLOW        (0x00000001)
+#define MPP_THREAD_POOL_DBG_JOB         (0x00000002)
+#define MPP_THREAD_POOL_DBG_STATS       (0x00000010)
+
+#define pool_dbg(flag, fmt, ...)        _mpp_dbg(mpp_thread_pool_debug, flag, fmt, ## __VA_ARGS__)
+#define pool_dbg_flow(fmt, ...)         pool_dbg(MPP_THREAD_POOL_DBG_FLOW, fmt, ## __VA_ARGS__)
+#define pool_dbg_job(fmt, ...)          pool_dbg(MPP_THREAD_POOL_DBG_JOB, fmt, ## __VA_ARGS__)
+
+#define MPP_THREAD_POOL_MAX_WORKER      64
+
+/*
+ * job status transition:
+ *
+ * IDLE    -> QUEUED    signal on idle job
+ * QUEUED  -> RUNNING   worker takes job from queue
+ * RUNNING -> RERUN     signal on running job
+ * RUNNING -> IDLE      job function returns zero
+ * RUNNING -> QUEUED    job function returns non-zero
+ * RERUN   -> QUEUED    job function returns
+ * IDLE    -> STOPPED   job put
+ */
+typedef enum MppJobStatus_e {
+    JOB_IDLE,
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_RERUN,
+    JOB_STOPPED,
+} MppJobStatus;
+
+typedef struct MppJobImpl_t {
+    char                name[THREAD_NAME_LEN];
+    MppJobFunc          func;
+    void                *ctx;
+
+    volatile RK_S32     status;
+    // worker run this job last time
+    RK_S32              worker;
+    struct list_head    list;
+
+    // for mpp_job_put waiting job to be idle
+    Mutex               *lock;
+    Condition           *cond;
+    RK_U32              waiting;
+
+    RK_S64              run_count;
+} MppJobImpl;
+
+typedef struct MppPoolWorker_t {
+    RK_S32              id;
+    pthread_t           thd;
+    Mutex               *lock;
+    struct list_head    queue;
+
+    RK_S64              run_count;
+    RK_S64              steal_count;
+} MppPoolWorker;
+
+static RK_U32 mpp_thread_pool_debug = 0;
+
+class MppThreadPool
+{
+private:
+    // avoid any unwanted function
+    MppThreadPool();
+    ~MppThreadPool();
+    MppThreadPool(const MppThreadPool &);
+    MppThreadPool &operator=(const MppThreadPool &);
+
+    static void *worker_loop(void *arg);
+
+    MppJobImpl *dequeue(MppPoolWorker *worker);
+    void run(MppPoolWorker *worker, MppJobImpl *job);
+
+    RK_S32              mCount;
+    MppPoolWorker       mWorkers[MPP_THREAD_POOL_MAX_WORKER];
+    RK_U32              mNext;
+
+    // idle worker wait on this lock and condition
+    Mutex               mLock;
+    Condition           mCond;
+    RK_S32              mIdle;
+    RK_S32              mQuit;
+    volatile RK_S32     mPending;
+
+public:
+    static MppThreadPool *get_instance() {
+        static MppThreadPool instance;
+        return &instance;
+    }
+
+    RK_S32 get_count() { return mCount; }
+    void enqueue(MppJobImpl *job);
+};
+
+MppThreadPool::MppThreadPool()
+    : mCount(0),
+      mNext(0),
+      mIdle(0),
+      mQuit(0),
+      mPending(0)
+{
+    RK_U32 count = 0;
+    RK_S32 i;
+
+    mpp_env_get_u32("mpp_thread_pool_debug", &mpp_thread_pool_debug, 0);
+    mpp_env_get_u32("mpp_thread_pool_size", &count, 0);
+
+    if (!count) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        count = (cpus > 0) ? (RK_U32)cpus : 1;
+    }
+
+    mCount = MPP_MIN(count, MPP_THREAD_POOL_MAX_WORKER);
+
+    for (i = 0; i < mCount; i++) {
+        MppPoolWorker *worker = &mWorkers[i];
+        char name[THREAD_NAME_LEN];
+
+        worker->id = i;
+        worker->lock = new Mutex();
+        worker->run_count = 0;
+        worker->steal_count = 0;
+        INIT_LIST_HEAD(&worker->queue);
+
+        if (pthread_create(&worker->thd, NULL, worker_loop, worker)) {
+            mpp_err("failed to create worker %d\n", i);
+            delete worker->lock;
+            break;
+        }
+
+        snprintf(name, sizeof(name), "mpp_pool_%d", (RK_U8)i);
+#ifndef ARMLINUX
+        pthread_setname_np(worker->thd, name);
+#endif
+    }
+
+    mCount = i;
+    pool_dbg_flow("thread pool start with %d workers\n", mCount);
+}
+
+MppThreadPool::~MppThreadPool()
+{
+    RK_S32 i;
+
+    mLock.lock();
+    mQuit = 1;
+    mCond.broadcast();
+    mLock.unlock();
+
+    for (i = 0; i < mCount; i++) {
+        MppPoolWorker *worker = &mWorkers[i];
+
+        pthread_join(worker->thd, NULL);
+
+        if (!list_empty(&worker->queue))
+            mpp_err("worker %d quit with job queued\n", i);
+
+        pool_dbg(MPP_THREAD_POOL_DBG_STATS, "worker %2d run %lld steal %lld\n",
+                 i, worker->run_count, worker->steal_count);
+
+        delete worker->lock;
+    }
+}
+
+void MppThreadPool::enqueue(MppJobImpl *job)
+{
+    RK_S32 idx = job->worker;
+    MppPoolWorker *worker;
+
+    if (idx < 0) {
+        idx = MPP_FETCH_ADD(&mNext, 1) % mCount;
+        job->worker = idx;
+    }
+
+    worker = &mWorkers[idx];
+
+    worker->lock->lock();
+    list_add_tail(&job->list, &worker->queue);
+    worker->lock->unlock();
+
+    MPP_ADD_FETCH(&mPending, 1);
+
+    // take the lock to avoid missing a worker going to sleep
+    mLock.lock();
+    if (mIdle)
+        mCond.signal();
+    mLock.unlock();
+}
+
+MppJobImpl *MppThreadPool::dequeue(MppPoolWorker *worker)
+{
+    MppJobImpl *job = NULL;
+    RK_S32 i;
+
+    if (!mPending)
+        return NULL;
+
+    worker->lock->lock();
+    if (!list_empty(&worker->queue)) {
+        job = list_entry(worker->queue.next, MppJobImpl, list);
+        list_del_init(&job->list);
+    }
+    worker->lock->unlock();
+
+    // steal from other worker starting from the next one
+    for (i = 1; !job && i < mCount; i++) {
+        MppPoolWorker *victim = &mWorkers[(worker->id + i) % mCount];
+
+        victim->lock->lock();
+        if (!list_empty(&victim->queue)) {
+            job = list_entry(victim->queue.next, MppJobImpl, list);
+            list_del_init(&job->list);
+            job->worker = worker->id;
+            worker->steal_count++;
+        }
+        victim->lock->unlock();
+    }
+
+    if (job)
+        MPP_SUB_FETCH(&mPending, 1);
+
+    return job;
+}
+
+void MppThreadPool::run(MppPoolWorker *worker, MppJobImpl *job)
+{
+    RK_S32 ret;
+
+    mpp_assert(job->status == JOB_QUEUED);
+    job->status = JOB_RUNNING;
+    job->run_count++;
+    worker->run_count++;
+
+    pool_dbg_job("worker %d run job %s\n", worker->id, job->name);
+
+    ret = job->func(job->ctx);
+
+    if (!ret) {
+        AutoMutex autolock(job->lock);
+
+        // job can be released once it is idle so do not touch it after unlock
+        if (MPP_BOOL_CAS(&job->status, JOB_RUNNING, JOB_IDLE)) {
+            if (job->waiting)
+                job->cond->signal();
+            return ;
+        }
+    }
+
+    job->status = JOB_QUEUED;
+    enqueue(job);
+}
+
+void *MppThreadPool::worker_loop(void *arg)
+{
+    MppPoolWorker *worker = (MppPoolWorker *)arg;
+    MppThreadPool *pool = get_instance();
+
+    while (1) {
+        MppJobImpl *job = pool->dequeue(worker);
+
+        if (job) {
+            pool->run(worker, job);
+            continue;
+        }
+
+        AutoMutex autolock(pool->mLock);
+
+        if (pool->mQuit)
+            break;
+
+        if (pool->mPending)
+            continue;
+
+        pool->mIdle++;
+        pool->mCond.wait(pool->mLock);
+        pool->mIdle--;
+    }
+
+    return NULL;
+}
+
+MPP_RET mpp_job_get(MppJob *job, const char *name, MppJobFunc func, void *ctx)
+{
+    MppThreadPool *pool = MppThreadPool::get_instance();
+    MppJobImpl *p = NULL;
+
+    if (NULL == job || NULL == func) {
+        mpp_err_f("invalid input job %p func %p\n", job, func);
+        return MPP_ERR_NULL_PTR;
+    }
+
+    *job = NULL;
+
+    if (!pool->get_count()) {
+        mpp_err_f("no worker available\n");
+        return MPP_NOK;
+    }
+
+    p = new MppJobImpl();
+    if (NULL == p) {
+        mpp_err_f("failed to create job\n");
+        return MPP_ERR_MALLOC;
+    }
+
+    memset(p->name, 0, sizeof(p->name));
+    strncpy(p->name, name ? name : "mpp_job", sizeof(p->name) - 1);
+    p->func = func;
+    p->ctx = ctx;
+    p->status = JOB_IDLE;
+    p->worker = -1;
+    INIT_LIST_HEAD(&p->list);
+    p->lock = new Mutex();
+    p->cond = new Condition();
+    p->waiting = 0;
+    p->run_count = 0;
+
+    pool_dbg_job("job %s get %p\n", p->name, p);
+
+    *job = p;
+    return MPP_OK;
+}
+
+MPP_RET mpp_job_put(MppJob job)
+{
+    MppJobImpl *p = (MppJobImpl *)job;
+
+    if (NULL == p) {
+        mpp_err_f("invalid NULL job\n");
+        return MPP_ERR_NULL_PTR;
+    }
+
+    p->lock->lock();
+    p->waiting = 1;
+    while (!MPP_BOOL_CAS(&p->status, JOB_IDLE, JOB_STOPPED))
+        p->cond->wait(p->lock);
+    p->lock->unlock();
+
+    pool_dbg_job("job %s put %p run %lld times\n", p->name, p, p->run_count);
+
+    delete p->lock;
+    delete p->cond;
+    delete p;
+
+    return MPP_OK;
+}
+
+MPP_RET mpp_job_signal(MppJob job)
+{
+    MppJobImpl *p = (MppJobImpl *)job;
+
+    if (NULL == p) {
+        mpp_err_f("invalid NULL job\n");
+        return MPP_ERR_NULL_PTR;
+    }
+
+    while (1) {
+        RK_S32 status = p->status;
+
+        switch (status) {
+        case JOB_IDLE : {
+            if (MPP_BOOL_CAS(&p->status, JOB_IDLE, JOB_QUEUED)) {
+                MppThreadPool::get_instance()->enqueue(p);
+                return MPP_OK;
+            }
+        } break;
+        case JOB_RUNNING : {
+            if (MPP_BOOL_CAS(&p->status, JOB_RUNNING, JOB_RERUN))
+                return MPP_OK;
+        } break;
+        case JOB_STOPPED : {
+            mpp_err_f("job %s signal after stopped\n", p->name);
+            return MPP_NOK;
+        } break;
+        default : {
+            // job is already queued or marked to rerun
+            return MPP_OK;
+        } break;
+        }
+    }
+
+    return MPP_OK;
+}
+
+RK_S32 mpp_thread_pool_size(void)
+{
+    return MppThreadPool::get_instance()->get_count();
+}
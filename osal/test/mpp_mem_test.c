@@ -13,35 +13,264 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-
 #define MODULE_TAG "mpp_mem_test"
 
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
 #include "mpp_log.h"
 #include "mpp_env.h"
 #include "mpp_mem.h"
+#include "mpp_time.h"
+#include "mpp_common.h"
+
+/*
+ * mpp_mem function check and multi-thread allocation benchmark
+ *
+ * The benchmark compares three allocators at 1 to 32 threads:
+ * mpp     - mpp_malloc / mpp_free
+ * locked  - posix_memalign / free under one global mutex as old mpp_mem
+ * system  - posix_memalign / free
+ *
+ * Each thread keeps a window of live blocks with random small size. In cross
+ * mode the blocks are freed by the neighbour thread.
+ *
+ * usage: mpp_mem_test [loop count per thread]
+ */
+#define MEM_TEST_LOOP           50000
+#define MEM_TEST_WINDOW         64
+#define MEM_TEST_MAX_SIZE       2048
+#define MEM_TEST_MAX_THREADS    32
+
+typedef enum MemTestAlloc_e {
+    MEM_TEST_MPP,
+    MEM_TEST_LOCKED,
+    MEM_TEST_SYSTEM,
+    MEM_TEST_BUTT,
+} MemTestAlloc;
+
+typedef struct MemTestCtx_t {
+    MemTestAlloc        type;
+    RK_S32              loop;
+    RK_U32              seed;
+    /* blocks handed to the neighbour thread in cross mode */
+    void                *ptrs[MEM_TEST_WINDOW];
+    pthread_mutex_t     lock;
+    struct MemTestCtx_t *next;
+} MemTestCtx;
+
+static const char *alloc_name[] = {
+    "mpp",
+    "locked",
+    "system",
+};
+
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *test_malloc(MemTestAlloc type, size_t size)
+{
+    void *ptr = NULL;
+
+    switch (type) {
+    case MEM_TEST_MPP : {
+        ptr = mpp_malloc_size(void, size);
+    } break;
+    case MEM_TEST_LOCKED : {
+        pthread_mutex_lock(&global_lock);
+        if (posix_memalign(&ptr, 32, size))
+            ptr = NULL;
+        pthread_mutex_unlock(&global_lock);
+    } break;
+    default : {
+        if (posix_memalign(&ptr, 32, size))
+            ptr = NULL;
+    } break;
+    }
+
+    return ptr;
+}
 
-// TODO: need to add pressure test case and parameter scan case
+static void test_free(MemTestAlloc type, void *ptr)
+{
+    switch (type) {
+    case MEM_TEST_MPP : {
+        mpp_free(ptr);
+    } break;
+    case MEM_TEST_LOCKED : {
+        pthread_mutex_lock(&global_lock);
+        free(ptr);
+        pthread_mutex_unlock(&global_lock);
+    } break;
+    default : {
+        free(ptr);
+    } break;
+    }
+}
 
-int main()
+static void *mem_test_local(void *arg)
 {
-    void *tmp = NULL;
-
-    tmp = mpp_calloc(int, 100);
-    if (tmp) {
-        mpp_log("calloc  success ptr 0x%p\n", tmp);
-    } else {
-        mpp_log("calloc  failed\n");
-    }
-    if (tmp) {
-        tmp = mpp_realloc(tmp, int, 200);
-        if (tmp) {
-            mpp_log("realloc success ptr 0x%p\n", tmp);
-        } else {
-            mpp_log("realloc failed\n");
+    MemTestCtx *ctx = (MemTestCtx *)arg;
+    void *ptrs[MEM_TEST_WINDOW];
+    RK_U32 seed = ctx->seed;
+    RK_S32 i;
+
+    memset(ptrs, 0, sizeof(ptrs));
+
+    for (i = 0; i < ctx->loop; i++) {
+        RK_S32 idx = i % MEM_TEST_WINDOW;
+        size_t size = rand_r(&seed) % MEM_TEST_MAX_SIZE + 1;
+
+        if (ptrs[idx])
+            test_free(ctx->type, ptrs[idx]);
+
+        ptrs[idx] = test_malloc(ctx->type, size);
+        if (ptrs[idx])
+            memset(ptrs[idx], i, 8);
+    }
+
+    for (i = 0; i < MEM_TEST_WINDOW; i++)
+        test_free(ctx->type, ptrs[i]);
+
+    return NULL;
+}
+
+/* allocate on this thread and free the block put by the previous thread */
+static void *mem_test_cross(void *arg)
+{
+    MemTestCtx *ctx = (MemTestCtx *)arg;
+    MemTestCtx *next = ctx->next;
+    RK_U32 seed = ctx->seed;
+    RK_S32 i;
+
+    for (i = 0; i < ctx->loop; i++) {
+        RK_S32 idx = i % MEM_TEST_WINDOW;
+        size_t size = rand_r(&seed) % MEM_TEST_MAX_SIZE + 1;
+        void *ptr = test_malloc(ctx->type, size);
+        void *old = NULL;
+
+        pthread_mutex_lock(&next->lock);
+        old = next->ptrs[idx];
+        next->ptrs[idx] = ptr;
+        pthread_mutex_unlock(&next->lock);
+
+        if (old)
+            test_free(ctx->type, old);
+    }
+
+    return NULL;
+}
+
+static RK_S64 mem_test_run(MemTestAlloc type, RK_S32 count, RK_S32 loop, RK_S32 cross)
+{
+    MemTestCtx ctxs[MEM_TEST_MAX_THREADS];
+    pthread_t threads[MEM_TEST_MAX_THREADS];
+    RK_S64 start;
+    RK_S32 i, j;
+
+    memset(ctxs, 0, sizeof(ctxs));
+    for (i = 0; i < count; i++) {
+        ctxs[i].type = type;
+        ctxs[i].loop = loop;
+        ctxs[i].seed = i + 1;
+        ctxs[i].next = &ctxs[(i + 1) % count];
+        pthread_mutex_init(&ctxs[i].lock, NULL);
+    }
+
+    start = mpp_time();
+    for (i = 0; i < count; i++)
+        pthread_create(&threads[i], NULL, cross ? mem_test_cross : mem_test_local, &ctxs[i]);
+
+    for (i = 0; i < count; i++)
+        pthread_join(threads[i], NULL);
+    start = mpp_time() - start;
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < MEM_TEST_WINDOW; j++)
+            test_free(type, ctxs[i].ptrs[j]);
+
+        pthread_mutex_destroy(&ctxs[i].lock);
+    }
+
+    return start;
+}
+
+static MPP_RET mem_check_basic(void)
+{
+    static const size_t sizes[] = { 1, 31, 32, 33, 128, 129, 1000, 4096, 4097, 100000 };
+    MPP_RET ret = MPP_NOK;
+    RK_U8 *buf = NULL;
+    RK_U8 *tmp = NULL;
+    RK_U32 i, j;
+
+    for (i = 0; i < MPP_ARRAY_ELEMS(sizes); i++) {
+        buf = mpp_malloc(RK_U8, sizes[i]);
+        if (NULL == buf || ((intptr_t)buf & 15))
+            goto DONE;
+
+        memset(buf, i, sizes[i]);
+        /* grow across size class and large block boundary */
+        tmp = mpp_realloc(buf, RK_U8, sizes[i] * 3);
+        if (NULL == tmp)
+            goto DONE;
+
+        buf = tmp;
+        for (j = 0; j < sizes[i]; j++)
+            if (buf[j] != (RK_U8)i)
+                goto DONE;
+
+        mpp_free(buf);
+        buf = NULL;
+    }
+
+    buf = mpp_calloc(RK_U8, 100);
+    for (i = 0; buf && i < 100; i++)
+        if (buf[i])
+            goto DONE;
+
+    ret = buf ? MPP_OK : MPP_NOK;
+DONE:
+    MPP_FREE(buf);
+    mpp_log("basic check %s\n", ret ? "failed" : "pass");
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    RK_S32 loop = MEM_TEST_LOOP;
+    RK_S32 count;
+    RK_S32 cross;
+    MPP_RET ret;
+
+    if (argc > 1)
+        loop = atoi(argv[1]);
+    if (loop <= 0)
+        loop = MEM_TEST_LOOP;
+
+    mpp_log("mpp_mem_test start\n");
+
+    ret = mem_check_basic();
+    if (ret)
+        goto DONE;
+
+    for (cross = 0; cross <= 1; cross++) {
+        mpp_log("%s free avg ns per malloc / free pair:\n", cross ? "cross" : "local");
+
+        for (count = 1; count <= MEM_TEST_MAX_THREADS; count *= 2) {
+            RK_S64 time[MEM_TEST_BUTT];
+            RK_S32 type;
+
+            for (type = 0; type < MEM_TEST_BUTT; type++)
+                time[type] = mem_test_run((MemTestAlloc)type, count, loop, cross);
+
+            mpp_log("threads %2d %s %5lld %s %5lld %s %5lld\n", count,
+                    alloc_name[0], time[0] * 1000 / ((RK_S64)loop * count),
+                    alloc_name[1], time[1] * 1000 / ((RK_S64)loop * count),
+                    alloc_name[2], time[2] * 1000 / ((RK_S64)loop * count));
         }
     }
-    mpp_free(tmp);
-    mpp_log("mpp_mem_test done\n");
 
-    return 0;
+DONE:
+    mpp_log("mpp_mem_test %s\n", ret ? "failed" : "success");
+    return ret;
 }
@@ -0,0 +1,328 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpp_ring_queue_test"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpp_log.h"
+#include "mpp_list.h"
+#include "mpp_time.h"
+#include "mpp_atomic.h"
+#include "mpp_ring_queue.h"
+
+/*
+ * ring queue function check and benchmark against mpp_list
+ *
+ * The benchmark runs the packet / frame queue usage in mpp:
+ * single   - push and pop one pointer on one thread
+ * threaded - one producer and one consumer thread with blocking wait
+ *
+ * usage: mpp_ring_queue_test [loop count]
+ */
+#define RING_TEST_LOOP          1000000
+#define RING_TEST_SIZE          8
+/* mpp_list has no size limit so use a large ring on threaded benchmark */
+#define RING_BENCH_SIZE         1024
+#define RING_TEST_THREADS       2
+#define RING_TEST_BLOCK         (-1)
+
+static const char *type_name[] = {
+    "spsc",
+    "mpmc",
+};
+
+typedef struct RingTestCtx_t {
+    MppRingQueue        queue;
+    mpp_list            *list;
+    RK_S32              loop;
+    RK_S32              check_order;
+    RK_S32              error;
+    volatile RK_S64     sum;
+} RingTestCtx;
+
+static volatile RK_S32 release_cnt = 0;
+
+static void ring_test_release(void *data)
+{
+    (void)data;
+    release_cnt++;
+}
+
+static MPP_RET ring_check_basic(MppRingQueueType type)
+{
+    MppRingQueue queue = NULL;
+    void *data = NULL;
+    MPP_RET ret = MPP_NOK;
+    RK_S32 i;
+
+    if (mpp_ring_queue_init(&queue, type, RING_TEST_SIZE - 3, ring_test_release))
+        return MPP_NOK;
+
+    /* size is aligned to power of two */
+    if (mpp_ring_queue_size(queue) != RING_TEST_SIZE)
+        goto DONE;
+
+    if (mpp_ring_queue_pop(queue, &data, 0) != MPP_NOK)
+        goto DONE;
+    if (mpp_ring_queue_pop(queue, &data, 10) != MPP_ERR_TIMEOUT)
+        goto DONE;
+
+    for (i = 0; i < RING_TEST_SIZE; i++)
+        if (mpp_ring_queue_push(queue, (void *)(intptr_t)(i + 1), 0))
+            goto DONE;
+
+    if (mpp_ring_queue_count(queue) != RING_TEST_SIZE)
+        goto DONE;
+    if (mpp_ring_queue_push(queue, &data, 0) != MPP_ERR_BUFFER_FULL)
+        goto DONE;
+    if (mpp_ring_queue_push(queue, &data, 10) != MPP_ERR_TIMEOUT)
+        goto DONE;
+
+    /* FIFO order and wrap around */
+    for (i = 0; i < RING_TEST_SIZE * 3; i++) {
+        if (mpp_ring_queue_pop(queue, &data, 0) || data != (void *)(intptr_t)(i + 1))
+            goto DONE;
+        if (mpp_ring_queue_push(queue, (void *)(intptr_t)(i + 1 + RING_TEST_SIZE), 0))
+            goto DONE;
+    }
+
+    release_cnt = 0;
+    mpp_ring_queue_flush(queue);
+    if (release_cnt != RING_TEST_SIZE || mpp_ring_queue_count(queue))
+        goto DONE;
+
+    ret = MPP_OK;
+DONE:
+    mpp_ring_queue_deinit(queue);
+    mpp_log("%s basic check %s\n", type_name[type], ret ? "failed" : "pass");
+    return ret;
+}
+
+static void *ring_producer(void *arg)
+{
+    RingTestCtx *ctx = (RingTestCtx *)arg;
+    RK_S32 i;
+
+    for (i = 1; i <= ctx->loop; i++)
+        mpp_ring_queue_push(ctx->queue, (void *)(intptr_t)i, RING_TEST_BLOCK);
+
+    return NULL;
+}
+
+static void *ring_consumer(void *arg)
+{
+    RingTestCtx *ctx = (RingTestCtx *)arg;
+    RK_S64 sum = 0;
+    intptr_t last = 0;
+    RK_S32 i;
+
+    for (i = 0; i < ctx->loop; i++) {
+        void *data = NULL;
+        intptr_t val;
+
+        mpp_ring_queue_pop(ctx->queue, &data, RING_TEST_BLOCK);
+        val = (intptr_t)data;
+        /* single producer pushes in increasing order */
+        if (ctx->check_order && val != last + 1)
+            ctx->error = 1;
+
+        last = val;
+        sum += val;
+    }
+
+    MPP_FETCH_ADD(&ctx->sum, sum);
+    return NULL;
+}
+
+static RK_S64 ring_run_threads(RingTestCtx *ctx, RK_S32 count)
+{
+    pthread_t producer[RING_TEST_THREADS];
+    pthread_t consumer[RING_TEST_THREADS];
+    RK_S64 start = mpp_time();
+    RK_S32 i;
+
+    for (i = 0; i < count; i++) {
+        pthread_create(&producer[i], NULL, ring_producer, ctx);
+        pthread_create(&consumer[i], NULL, ring_consumer, ctx);
+    }
+
+    for (i = 0; i < count; i++) {
+        pthread_join(producer[i], NULL);
+        pthread_join(consumer[i], NULL);
+    }
+
+    return mpp_time() - start;
+}
+
+static MPP_RET ring_check_threads(MppRingQueueType type, RK_S32 loop)
+{
+    RingTestCtx ctx;
+    RK_S32 count = (type == RING_QUEUE_SPSC) ? 1 : RING_TEST_THREADS;
+    RK_S64 expect = (RK_S64)loop * (loop + 1) / 2 * count;
+    MPP_RET ret = MPP_NOK;
+    RK_S64 time;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.loop = loop;
+    ctx.check_order = (count == 1);
+    if (mpp_ring_queue_init(&ctx.queue, type, RING_TEST_SIZE, NULL))
+        return MPP_NOK;
+
+    time = ring_run_threads(&ctx, count);
+    if (!ctx.error && ctx.sum == expect && !mpp_ring_queue_count(ctx.queue))
+        ret = MPP_OK;
+
+    mpp_ring_queue_deinit(ctx.queue);
+    mpp_log("%s %d thread pair check %s avg %lld ns\n", type_name[type], count,
+            ret ? "failed" : "pass", time * 1000 / ((RK_S64)loop * count));
+    return ret;
+}
+
+static void *list_producer(void *arg)
+{
+    RingTestCtx *ctx = (RingTestCtx *)arg;
+    mpp_list *list = ctx->list;
+    RK_S32 i;
+
+    for (i = 1; i <= ctx->loop; i++) {
+        void *data = (void *)(intptr_t)i;
+
+        list->lock();
+        list->add_at_tail(&data, sizeof(data));
+        list->signal();
+        list->unlock();
+    }
+
+    return NULL;
+}
+
+static void *list_consumer(void *arg)
+{
+    RingTestCtx *ctx = (RingTestCtx *)arg;
+    mpp_list *list = ctx->list;
+    RK_S64 sum = 0;
+    RK_S32 i;
+
+    for (i = 0; i < ctx->loop; i++) {
+        void *data = NULL;
+
+        list->lock();
+        while (!list->list_size())
+            list->wait();
+        list->del_at_head(&data, sizeof(data));
+        list->unlock();
+        sum += (intptr_t)data;
+    }
+
+    ctx->sum = sum;
+    return NULL;
+}
+
+static void ring_bench(RK_S32 loop)
+{
+    RingTestCtx ctx;
+    MppRingQueue queue = NULL;
+    mpp_list *list = new mpp_list(NULL);
+    pthread_t producer;
+    pthread_t consumer;
+    void *data = NULL;
+    RK_S64 time_list;
+    RK_S64 time_ring[RING_QUEUE_TYPE_BUTT];
+    RK_S64 start;
+    RK_S32 type;
+    RK_S32 i;
+
+    start = mpp_time();
+    for (i = 0; i < loop; i++) {
+        list->lock();
+        list->add_at_tail(&list, sizeof(list));
+        list->unlock();
+        list->lock();
+        list->del_at_head(&data, sizeof(data));
+        list->unlock();
+    }
+    time_list = mpp_time() - start;
+
+    for (type = 0; type < RING_QUEUE_TYPE_BUTT; type++) {
+        mpp_ring_queue_init(&queue, (MppRingQueueType)type, RING_TEST_SIZE, NULL);
+
+        start = mpp_time();
+        for (i = 0; i < loop; i++) {
+            mpp_ring_queue_push(queue, list, 0);
+            mpp_ring_queue_pop(queue, &data, 0);
+        }
+        time_ring[type] = mpp_time() - start;
+
+        mpp_ring_queue_deinit(queue);
+    }
+
+    mpp_log("single   avg ns: mpp_list %lld spsc %lld mpmc %lld\n",
+            time_list * 1000 / loop, time_ring[0] * 1000 / loop,
+            time_ring[1] * 1000 / loop);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.list = list;
+    ctx.loop = loop;
+
+    start = mpp_time();
+    pthread_create(&producer, NULL, list_producer, &ctx);
+    pthread_create(&consumer, NULL, list_consumer, &ctx);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    time_list = mpp_time() - start;
+    delete list;
+
+    for (type = 0; type < RING_QUEUE_TYPE_BUTT; type++) {
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.loop = loop;
+        mpp_ring_queue_init(&ctx.queue, (MppRingQueueType)type, RING_BENCH_SIZE, NULL);
+        time_ring[type] = ring_run_threads(&ctx, 1);
+        mpp_ring_queue_deinit(ctx.queue);
+    }
+
+    mpp_log("threaded avg ns: mpp_list %lld spsc %lld mpmc %lld\n",
+            time_list * 1000 / loop, time_ring[0] * 1000 / loop,
+            time_ring[1] * 1000 / loop);
+}
+
+int main(int argc, char **argv)
+{
+    RK_S32 loop = RING_TEST_LOOP;
+    MPP_RET ret = MPP_OK;
+
+    if (argc > 1)
+        loop = atoi(argv[1]);
+    if (loop <= 0)
+        loop = RING_TEST_LOOP;
+
+    mpp_log("mpp_ring_queue_test start\n");
+
+    ret = ring_check_basic(RING_QUEUE_SPSC);
+    if (!ret)
+        ret = ring_check_basic(RING_QUEUE_MPMC);
+    if (!ret)
+        ret = ring_check_threads(RING_QUEUE_SPSC, loop / 10);
+    if (!ret)
+        ret = ring_check_threads(RING_QUEUE_MPMC, loop / 10);
+    if (!ret)
+        ring_bench(loop);
+
+    mpp_log("mpp_ring_queue_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
@@ -0,0 +1,414 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpi_dec_pool_test"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "rk_mpi.h"
+
+#include "mpp_env.h"
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_time.h"
+#include "mpp_common.h"
+
+/*
+ * decoder thread mode / thread pool mode benchmark
+ *
+ * Each context runs dummy decoder (MPP_VIDEO_CodingUnused) with dummy hal so
+ * only the mpp framework scheduling cost is measured. The dummy decoder is a
+ * test-only path enabled by env mpp_dec_dummy. One driver thread per context
+ * puts one packet then waits for its frame. Frame latency is the time between
+ * put_packet and get_frame which is carried by pts.
+ *
+ * The epoll mode uses thread pool decoder and drives all contexts from one
+ * thread which waits on the output event fd of all contexts.
+ *
+ * usage: mpi_dec_pool_test [frame count per context]
+ */
+#define MPI_DEC_POOL_MAX_CTX        64
+#define MPI_DEC_POOL_FRAME_COUNT    200
+#define MPI_DEC_POOL_STREAM_SIZE    (SZ_1K)
+#define MPI_DEC_POOL_TIMEOUT        1000
+
+typedef enum MpiDecPoolMode_e {
+    DEC_POOL_THREAD,
+    DEC_POOL_POOL,
+    DEC_POOL_EPOLL,
+    DEC_POOL_MODE_BUTT,
+} MpiDecPoolMode;
+
+static const char *pool_mode_str[] = {
+    "thread",
+    "pool",
+    "epoll",
+};
+
+typedef struct MpiDecPoolCtx_t {
+    MppCtx          ctx;
+    MppApi          *mpi;
+    MppPacket       packet;
+    RK_U8           *buf;
+
+    RK_S32          frame_count;
+    RK_S32          frame_out;
+    RK_S64          *latency;
+    RK_S32          error;
+    RK_S32          eos;
+} MpiDecPoolCtx;
+
+static RK_S32 pool_test_frame_count = MPI_DEC_POOL_FRAME_COUNT;
+
+static void *dec_pool_loop(void *arg)
+{
+    MpiDecPoolCtx *p = (MpiDecPoolCtx *)arg;
+    MppCtx ctx = p->ctx;
+    MppApi *mpi = p->mpi;
+    MppFrame frame = NULL;
+    MPP_RET ret;
+    RK_S32 i;
+
+    for (i = 0; i < p->frame_count; i++) {
+        RK_S32 got = 0;
+
+        mpp_packet_set_pos(p->packet, p->buf);
+        mpp_packet_set_length(p->packet, MPI_DEC_POOL_STREAM_SIZE);
+        mpp_packet_set_pts(p->packet, mpp_time());
+
+        ret = mpi->decode_put_packet(ctx, p->packet);
+        if (ret) {
+            // packet queue is full just retry
+            i--;
+            msleep(1);
+            continue;
+        }
+
+        while (!got) {
+            frame = NULL;
+            ret = mpi->decode_get_frame(ctx, &frame);
+            if (ret || NULL == frame) {
+                mpp_err("ctx %p get frame %d failed ret %d\n", ctx, i, ret);
+                p->error++;
+                return NULL;
+            }
+
+            if (mpp_frame_get_info_change(frame)) {
+                mpi->control(ctx, MPP_DEC_SET_INFO_CHANGE_READY, NULL);
+            } else {
+                p->latency[p->frame_out++] = mpp_time() - mpp_frame_get_pts(frame);
+                got = 1;
+            }
+
+            mpp_frame_deinit(&frame);
+        }
+    }
+
+    /* send eos to let dummy decoder release all its reference */
+    mpp_packet_set_pos(p->packet, p->buf);
+    mpp_packet_set_length(p->packet, 0);
+    mpp_packet_set_eos(p->packet);
+
+    while (mpi->decode_put_packet(ctx, p->packet))
+        msleep(1);
+
+    do {
+        RK_U32 eos;
+
+        frame = NULL;
+        ret = mpi->decode_get_frame(ctx, &frame);
+        if (ret || NULL == frame) {
+            mpp_err("ctx %p get eos frame failed ret %d\n", ctx, ret);
+            p->error++;
+            break;
+        }
+
+        eos = mpp_frame_get_eos(frame);
+        mpp_frame_deinit(&frame);
+        if (eos)
+            break;
+    } while (1);
+
+    /* decoder need a reset to restart after eos */
+    ret = mpi->reset(ctx);
+    if (ret) {
+        mpp_err("ctx %p reset failed ret %d\n", ctx, ret);
+        p->error++;
+    }
+
+    return NULL;
+}
+
+static void dec_epoll_put_packet(MpiDecPoolCtx *p)
+{
+    mpp_packet_set_pos(p->packet, p->buf);
+    if (p->frame_out < p->frame_count) {
+        mpp_packet_set_length(p->packet, MPI_DEC_POOL_STREAM_SIZE);
+        mpp_packet_set_pts(p->packet, mpp_time());
+    } else {
+        mpp_packet_set_length(p->packet, 0);
+        mpp_packet_set_eos(p->packet);
+    }
+
+    while (p->mpi->decode_put_packet(p->ctx, p->packet))
+        msleep(1);
+}
+
+/* return non-zero when the context is finished */
+static RK_S32 dec_epoll_get_frame(MpiDecPoolCtx *p)
+{
+    MppFrame frame = NULL;
+    MPP_RET ret = MPP_OK;
+
+    do {
+        frame = NULL;
+        ret = p->mpi->decode_get_frame(p->ctx, &frame);
+        if (ret) {
+            mpp_err("ctx %p get frame failed ret %d\n", p->ctx, ret);
+            p->error++;
+            return 1;
+        }
+
+        if (NULL == frame)
+            break;
+
+        if (mpp_frame_get_info_change(frame)) {
+            p->mpi->control(p->ctx, MPP_DEC_SET_INFO_CHANGE_READY, NULL);
+        } else if (mpp_frame_get_eos(frame)) {
+            p->eos = 1;
+        } else if (!p->eos) {
+            p->latency[p->frame_out++] = mpp_time() - mpp_frame_get_pts(frame);
+            dec_epoll_put_packet(p);
+        }
+
+        mpp_frame_deinit(&frame);
+    } while (!p->eos);
+
+    if (p->eos) {
+        ret = p->mpi->reset(p->ctx);
+        if (ret) {
+            mpp_err("ctx %p reset failed ret %d\n", p->ctx, ret);
+            p->error++;
+        }
+    }
+
+    return p->eos;
+}
+
+static void *dec_epoll_loop(void *arg)
+{
+    MpiDecPoolCtx *ctxs = (MpiDecPoolCtx *)arg;
+    struct epoll_event events[MPI_DEC_POOL_MAX_CTX];
+    RK_S32 ctx_count = 0;
+    RK_S32 epfd = epoll_create1(EPOLL_CLOEXEC);
+    RK_S32 running = 0;
+    RK_S32 i;
+
+    for (i = 0; i < MPI_DEC_POOL_MAX_CTX && ctxs[i].ctx; i++) {
+        MpiDecPoolCtx *p = &ctxs[i];
+        struct epoll_event ev;
+        RK_S32 fd = -1;
+
+        if (p->mpi->get_event_fd(p->ctx, MPP_PORT_OUTPUT, &fd)) {
+            mpp_err("ctx %p get event fd failed\n", p->ctx);
+            p->error++;
+            continue;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = p;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        dec_epoll_put_packet(p);
+        running++;
+    }
+    ctx_count = i;
+
+    while (running) {
+        RK_S32 count = epoll_wait(epfd, events, ctx_count, MPI_DEC_POOL_TIMEOUT);
+
+        if (count <= 0) {
+            mpp_err("epoll wait timeout with %d context running\n", running);
+            for (i = 0; i < ctx_count; i++)
+                if (!ctxs[i].eos)
+                    ctxs[i].error++;
+            break;
+        }
+
+        for (i = 0; i < count; i++) {
+            MpiDecPoolCtx *p = (MpiDecPoolCtx *)events[i].data.ptr;
+            RK_S32 fd = -1;
+
+            if (!dec_epoll_get_frame(p))
+                continue;
+
+            p->mpi->get_event_fd(p->ctx, MPP_PORT_OUTPUT, &fd);
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+            running--;
+        }
+    }
+
+    close(epfd);
+    return NULL;
+}
+
+static int cmp_latency(const void *a, const void *b)
+{
+    RK_S64 x = *(const RK_S64 *)a;
+    RK_S64 y = *(const RK_S64 *)b;
+
+    return (x > y) - (x < y);
+}
+
+static MPP_RET dec_pool_run(RK_S32 ctx_count, MpiDecPoolMode mode)
+{
+    RK_U32 thread_pool = (mode != DEC_POOL_THREAD);
+    MpiDecPoolCtx ctxs[MPI_DEC_POOL_MAX_CTX];
+    pthread_t threads[MPI_DEC_POOL_MAX_CTX];
+    RK_S64 *latency = NULL;
+    RK_S64 time_start;
+    RK_S64 time_end;
+    RK_S64 total = 0;
+    RK_S64 sum = 0;
+    RK_S32 timeout = (mode == DEC_POOL_EPOLL) ? 0 : MPI_DEC_POOL_TIMEOUT;
+    MPP_RET ret = MPP_OK;
+    RK_S32 i, j;
+
+    memset(ctxs, 0, sizeof(ctxs));
+    memset(threads, 0, sizeof(threads));
+
+    latency = mpp_calloc(RK_S64, ctx_count * pool_test_frame_count);
+    if (NULL == latency) {
+        mpp_err("failed to malloc latency record\n");
+        return MPP_ERR_MALLOC;
+    }
+
+    for (i = 0; i < ctx_count; i++) {
+        MpiDecPoolCtx *p = &ctxs[i];
+
+        p->frame_count = pool_test_frame_count;
+        p->latency = latency + i * pool_test_frame_count;
+        p->buf = mpp_calloc(RK_U8, MPI_DEC_POOL_STREAM_SIZE);
+        if (NULL == p->buf) {
+            ret = MPP_ERR_MALLOC;
+            goto DONE;
+        }
+
+        mpp_packet_init(&p->packet, p->buf, MPI_DEC_POOL_STREAM_SIZE);
+
+        ret = mpp_create(&p->ctx, &p->mpi);
+        if (ret) {
+            mpp_err("mpp_create failed ret %d\n", ret);
+            goto DONE;
+        }
+
+        p->mpi->control(p->ctx, MPP_DEC_SET_THREAD_POOL, &thread_pool);
+
+        ret = mpp_init(p->ctx, MPP_CTX_DEC, MPP_VIDEO_CodingUnused);
+        if (ret) {
+            mpp_err("mpp_init failed ret %d\n", ret);
+            goto DONE;
+        }
+
+        p->mpi->control(p->ctx, MPP_SET_OUTPUT_TIMEOUT, &timeout);
+    }
+
+    time_start = mpp_time();
+
+    if (mode == DEC_POOL_EPOLL) {
+        pthread_create(&threads[0], NULL, dec_epoll_loop, ctxs);
+        pthread_join(threads[0], NULL);
+    } else {
+        for (i = 0; i < ctx_count; i++)
+            pthread_create(&threads[i], NULL, dec_pool_loop, &ctxs[i]);
+
+        for (i = 0; i < ctx_count; i++)
+            pthread_join(threads[i], NULL);
+    }
+
+    time_end = mpp_time();
+
+    for (i = 0; i < ctx_count; i++) {
+        MpiDecPoolCtx *p = &ctxs[i];
+
+        if (p->error)
+            ret = MPP_NOK;
+
+        /* compact latency record for sorting */
+        for (j = 0; j < p->frame_out; j++) {
+            sum += p->latency[j];
+            latency[total++] = p->latency[j];
+        }
+    }
+
+    if (total) {
+        qsort(latency, total, sizeof(latency[0]), cmp_latency);
+
+        mpp_log("%-6s ctx %2d frames %6lld fps %9.2f latency avg %6lld p99 %6lld max %6lld us\n",
+                pool_mode_str[mode], ctx_count, total,
+                (float)total * 1000000 / MPP_MAX(time_end - time_start, 1),
+                sum / total, latency[(total * 99 - 1) / 100], latency[total - 1]);
+    }
+
+DONE:
+    for (i = 0; i < ctx_count; i++) {
+        MpiDecPoolCtx *p = &ctxs[i];
+
+        if (p->ctx)
+            mpp_destroy(p->ctx);
+        if (p->packet)
+            mpp_packet_deinit(&p->packet);
+        MPP_FREE(p->buf);
+    }
+    MPP_FREE(latency);
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    RK_S32 ctx_counts[] = { 1, 8, 64 };
+    MPP_RET ret = MPP_OK;
+    RK_U32 i;
+    RK_U32 mode;
+
+    if (argc > 1)
+        pool_test_frame_count = atoi(argv[1]);
+
+    if (pool_test_frame_count <= 0)
+        pool_test_frame_count = MPI_DEC_POOL_FRAME_COUNT;
+
+    mpp_log("mpi_dec_pool_test start with %d frames per context\n",
+            pool_test_frame_count);
+
+    mpp_env_set_u32("mpp_dec_dummy", 1);
+
+    for (i = 0; i < MPP_ARRAY_ELEMS(ctx_counts); i++) {
+        for (mode = 0; mode < DEC_POOL_MODE_BUTT; mode++) {
+            ret = dec_pool_run(ctx_counts[i], (MpiDecPoolMode)mode);
+            if (ret)
+                goto DONE;
+        }
+    }
+
+DONE:
+    mpp_env_set_u32("mpp_dec_dummy", 0);
+    mpp_log("mpi_dec_pool_test %s\n", ret ? "failed" : "success");
+    return ret;
+}
@@ -0,0 +1,370 @@
+/*
+ * Copyright 2015 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define MODULE_TAG "mpi_enc_pipe_test"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rk_mpi.h"
+#include "mpp_rc_api.h"
+
+#include "mpp_env.h"
+#include "mpp_log.h"
+#include "mpp_mem.h"
+#include "mpp_common.h"
+
+/*
+ * encoder pipeline re-encode test
+ *
+ * H.264 encoder runs on the simulated vepu541 device with pipe depth 2 and
+ * re-encode enabled. A test rate control requests one re-encode on every
+ * MPI_ENC_PIPE_REENC_GAP frames and records the rc calls of each frame.
+ *
+ * When a frame is re-encoded the next frame is already in hardware. It is
+ * replayed after the re-encode, and the replay must look like a normal start
+ * to rc and hal:
+ * - frm_start is called once for each frame
+ * - hal_start / hal_end / frm_end are called once more for re-encoded frame
+ * - frm.reencode is only set in the re-encode of the frame itself
+ * - packets are output in input order
+ */
+#define MPI_ENC_PIPE_WIDTH          320
+#define MPI_ENC_PIPE_HEIGHT         240
+#define MPI_ENC_PIPE_FRAME_COUNT    60
+#define MPI_ENC_PIPE_REENC_GAP      5
+#define MPI_ENC_PIPE_HW_LATENCY     "2000"
+
+typedef struct MpiEncPipeStat_t {
+    RK_S32          frm_start[MPI_ENC_PIPE_FRAME_COUNT];
+    RK_S32          hal_start[MPI_ENC_PIPE_FRAME_COUNT];
+    RK_S32          hal_end[MPI_ENC_PIPE_FRAME_COUNT];
+    RK_S32          frm_end[MPI_ENC_PIPE_FRAME_COUNT];
+    RK_S32          reenc[MPI_ENC_PIPE_FRAME_COUNT];
+    /* re-encode with the next frame in hardware */
+    RK_S32          replay;
+    RK_S32          error;
+} MpiEncPipeStat;
+
+typedef struct MpiEncPipeCtx_t {
+    MppCtx          ctx;
+    MppApi          *mpi;
+    MppBuffer       bufs[MPI_ENC_PIPE_FRAME_COUNT];
+    RK_S32          frame_in;
+    RK_S32          error;
+} MpiEncPipeCtx;
+
+static MpiEncPipeStat pipe_stat;
+
+/* frame index is carried by input frame pts */
+static RK_S32 pipe_rc_frame_idx(EncRcTask *task, const char *stage)
+{
+    RK_S32 seq = (RK_S32)mpp_frame_get_pts(task->frame);
+
+    if (seq < 0 || seq >= MPI_ENC_PIPE_FRAME_COUNT) {
+        mpp_err("%s invalid frame %d\n", stage, seq);
+        pipe_stat.error++;
+        return -1;
+    }
+
+    return seq;
+}
+
+/* reencode flag is cleared by encoder before frm_end so check it on others */
+static RK_S32 pipe_rc_check(EncRcTask *task, const char *stage)
+{
+    EncFrmStatus *frm = &task->frm;
+    RK_S32 seq = pipe_rc_frame_idx(task, stage);
+
+    if (seq >= 0 && frm->reencode != (frm->reencode_times > 0)) {
+        mpp_err("%s frame %d reencode %d with reencode times %d\n", stage,
+                seq, frm->reencode, frm->reencode_times);
+        pipe_stat.error++;
+    }
+
+    return seq;
+}
+
+static MPP_RET pipe_rc_frm_start(void *ctx, EncRcTask *task)
+{
+    RK_S32 seq = pipe_rc_check(task, "frm_start");
+
+    (void)ctx;
+    if (seq >= 0)
+        pipe_stat.frm_start[seq]++;
+
+    return MPP_OK;
+}
+
+static MPP_RET pipe_rc_hal_start(void *ctx, EncRcTask *task)
+{
+    EncRcTaskInfo *info = &task->info;
+    RK_S32 seq = pipe_rc_check(task, "hal_start");
+
+    (void)ctx;
+    if (seq >= 0)
+        pipe_stat.hal_start[seq]++;
+
+    info->bit_target = 10000;
+    info->bit_max = 20000;
+    info->bit_min = 5000;
+    info->quality_target = 26 + task->frm.reencode_times;
+    info->quality_max = 51;
+    info->quality_min = 10;
+
+    return MPP_OK;
+}
+
+static MPP_RET pipe_rc_hal_end(void *ctx, EncRcTask *task)
+{
+    RK_S32 seq = pipe_rc_check(task, "hal_end");
+
+    (void)ctx;
+    if (seq >= 0)
+        pipe_stat.hal_end[seq]++;
+
+    return MPP_OK;
+}
+
+static MPP_RET pipe_rc_frm_end(void *ctx, EncRcTask *task)
+{
+    EncFrmStatus *frm = &task->frm;
+    RK_S32 seq = pipe_rc_frame_idx(task, "frm_end");
+
+    (void)ctx;
+    if (seq < 0)
+        return MPP_OK;
+
+    pipe_stat.frm_end[seq]++;
+
+    if (seq % MPI_ENC_PIPE_REENC_GAP == 1 && !frm->reencode_times) {
+        frm->reencode = 1;
+        pipe_stat.reenc[seq] = 1;
+        if (seq + 1 < MPI_ENC_PIPE_FRAME_COUNT && pipe_stat.hal_start[seq + 1])
+            pipe_stat.replay++;
+    }
+
+    return MPP_OK;
+}
+
+static const RcImplApi pipe_rc_api = {
+    "mpi_enc_pipe_test",
+    MPP_VIDEO_CodingAVC,
+    sizeof(RK_S32),
+    NULL,
+    NULL,
+    NULL,
+    pipe_rc_frm_start,
+    pipe_rc_frm_end,
+    pipe_rc_hal_start,
+    pipe_rc_hal_end,
+};
+
+static void *enc_pipe_put_loop(void *arg)
+{
+    MpiEncPipeCtx *p = (MpiEncPipeCtx *)arg;
+    RK_S32 i;
+
+    for (i = 0; i < MPI_ENC_PIPE_FRAME_COUNT; i++) {
+        MppFrame frame = NULL;
+        MPP_RET ret;
+
+        mpp_frame_init(&frame);
+        mpp_frame_set_width(frame, MPI_ENC_PIPE_WIDTH);
+        mpp_frame_set_height(frame, MPI_ENC_PIPE_HEIGHT);
+        mpp_frame_set_hor_stride(frame, MPI_ENC_PIPE_WIDTH);
+        mpp_frame_set_ver_stride(frame, MPI_ENC_PIPE_HEIGHT);
+        mpp_frame_set_fmt(frame, MPP_FMT_YUV420SP);
+        mpp_frame_set_pts(frame, i);
+        /* each frame has its own buffer which is kept until its packet */
+        mpp_frame_set_buffer(frame, p->bufs[i]);
+
+        ret = p->mpi->encode_put_frame(p->ctx, frame);
+        mpp_frame_deinit(&frame);
+        if (ret) {
+            mpp_err("put frame %d failed ret %d\n", i, ret);
+            p->error++;
+            break;
+        }
+        p->frame_in++;
+    }
+
+    return NULL;
+}
+
+static MPP_RET enc_pipe_setup(MpiEncPipeCtx *p)
+{
+    MppEncCfg cfg = NULL;
+    RcApiBrief brief;
+    MPP_RET ret;
+
+    ret = mpp_enc_cfg_init(&cfg);
+    if (ret)
+        return ret;
+
+    mpp_enc_cfg_set_s32(cfg, "prep:width", MPI_ENC_PIPE_WIDTH);
+    mpp_enc_cfg_set_s32(cfg, "prep:height", MPI_ENC_PIPE_HEIGHT);
+    mpp_enc_cfg_set_s32(cfg, "prep:hor_stride", MPI_ENC_PIPE_WIDTH);
+    mpp_enc_cfg_set_s32(cfg, "prep:ver_stride", MPI_ENC_PIPE_HEIGHT);
+    mpp_enc_cfg_set_s32(cfg, "prep:format", MPP_FMT_YUV420SP);
+    mpp_enc_cfg_set_s32(cfg, "rc:mode", MPP_ENC_RC_MODE_CBR);
+    mpp_enc_cfg_set_s32(cfg, "rc:bps_target", 300000);
+    mpp_enc_cfg_set_s32(cfg, "rc:bps_max", 320000);
+    mpp_enc_cfg_set_s32(cfg, "rc:bps_min", 280000);
+    mpp_enc_cfg_set_s32(cfg, "rc:fps_in_num", 30);
+    mpp_enc_cfg_set_s32(cfg, "rc:fps_in_denorm", 1);
+    mpp_enc_cfg_set_s32(cfg, "rc:fps_out_num", 30);
+    mpp_enc_cfg_set_s32(cfg, "rc:fps_out_denorm", 1);
+    mpp_enc_cfg_set_s32(cfg, "rc:gop", 30);
+    mpp_enc_cfg_set_u32(cfg, "rc:max_reenc_times", 1);
+    mpp_enc_cfg_set_s32(cfg, "base:pipe_depth", 2);
+    mpp_enc_cfg_set_s32(cfg, "codec:type", MPP_VIDEO_CodingAVC);
+
+    ret = p->mpi->control(p->ctx, MPP_ENC_SET_CFG, cfg);
+    mpp_enc_cfg_deinit(cfg);
+    if (ret) {
+        mpp_err("set encoder cfg failed ret %d\n", ret);
+        return ret;
+    }
+
+    ret = p->mpi->control(p->ctx, MPP_ENC_SET_RC_API_CFG, (void *)&pipe_rc_api);
+    if (ret)
+        return ret;
+
+    brief.name = pipe_rc_api.name;
+    brief.type = pipe_rc_api.type;
+
+    return p->mpi->control(p->ctx, MPP_ENC_SET_RC_API_CURRENT, &brief);
+}
+
+static MPP_RET enc_pipe_check(void)
+{
+    RK_S32 i;
+
+    for (i = 0; i < MPI_ENC_PIPE_FRAME_COUNT; i++) {
+        RK_S32 count = 1 + pipe_stat.reenc[i];
+
+        if (pipe_stat.frm_start[i] != 1 || pipe_stat.hal_start[i] != count ||
+            pipe_stat.hal_end[i] != count || pipe_stat.frm_end[i] != count) {
+            mpp_err("frame %d rc call frm_start %d hal_start %d hal_end %d frm_end %d expect %d\n",
+                    i, pipe_stat.frm_start[i], pipe_stat.hal_start[i],
+                    pipe_stat.hal_end[i], pipe_stat.frm_end[i], count);
+            pipe_stat.error++;
+        }
+    }
+
+    if (!pipe_stat.replay) {
+        mpp_err("no re-encode happened with later frame in hardware\n");
+        pipe_stat.error++;
+    }
+
+    return pipe_stat.error ? MPP_NOK : MPP_OK;
+}
+
+int main()
+{
+    MpiEncPipeCtx ctx;
+    MpiEncPipeCtx *p = &ctx;
+    pthread_t thd;
+    RK_S32 frame_size = MPI_ENC_PIPE_WIDTH * MPI_ENC_PIPE_HEIGHT * 3 / 2;
+    RK_S32 timeout = MPP_POLL_BLOCK;
+    RK_S32 packet_out = 0;
+    MPP_RET ret = MPP_OK;
+    RK_S32 i;
+
+    mpp_log("mpi_enc_pipe_test start\n");
+
+    memset(p, 0, sizeof(*p));
+    memset(&pipe_stat, 0, sizeof(pipe_stat));
+
+    /* run on simulated vepu541 which has two hardware tasks */
+    mpp_env_set_u32("mpp_device_sim", 1);
+    mpp_env_set_str("mpp_device_sim_soc", (char *)"rv1126");
+    mpp_env_set_str("mpp_device_sim_latency", (char *)MPI_ENC_PIPE_HW_LATENCY);
+
+    for (i = 0; i < MPI_ENC_PIPE_FRAME_COUNT; i++) {
+        ret = mpp_buffer_get(NULL, &p->bufs[i], frame_size);
+        if (ret) {
+            mpp_err("failed to get frame buffer ret %d\n", ret);
+            goto DONE;
+        }
+        memset(mpp_buffer_get_ptr(p->bufs[i]), i, frame_size);
+    }
+
+    ret = mpp_create(&p->ctx, &p->mpi);
+    if (ret) {
+        mpp_err("mpp_create failed ret %d\n", ret);
+        goto DONE;
+    }
+
+    p->mpi->control(p->ctx, MPP_SET_OUTPUT_TIMEOUT, &timeout);
+
+    ret = mpp_init(p->ctx, MPP_CTX_ENC, MPP_VIDEO_CodingAVC);
+    if (ret) {
+        mpp_err("mpp_init failed ret %d\n", ret);
+        goto DONE;
+    }
+
+    ret = enc_pipe_setup(p);
+    if (ret) {
+        mpp_err("encoder setup failed ret %d\n", ret);
+        goto DONE;
+    }
+
+    pthread_create(&thd, NULL, enc_pipe_put_loop, p);
+
+    for (i = 0; i < MPI_ENC_PIPE_FRAME_COUNT; i++) {
+        MppPacket packet = NULL;
+
+        ret = p->mpi->encode_get_packet(p->ctx, &packet);
+        if (ret || NULL == packet) {
+            mpp_err("get packet %d failed ret %d\n", i, ret);
+            ret = MPP_NOK;
+            break;
+        }
+
+        if (mpp_packet_get_pts(packet) != i) {
+            mpp_err("packet %d out of order with pts %lld\n", i,
+                    mpp_packet_get_pts(packet));
+            pipe_stat.error++;
+        }
+
+        packet_out++;
+        mpp_packet_deinit(&packet);
+    }
+
+    pthread_join(thd, NULL);
+
+    if (!ret)
+        ret = p->error ? MPP_NOK : enc_pipe_check();
+
+    mpp_log("frames %d packets %d re-encode with replay %d\n",
+            p->frame_in, packet_out, pipe_stat.replay);
+
+DONE:
+    if (p->ctx) {
+        p->mpi->reset(p->ctx);
+        mpp_destroy(p->ctx);
+    }
+
+    for (i = 0; i < MPI_ENC_PIPE_FRAME_COUNT; i++)
+        if (p->bufs[i])
+            mpp_buffer_put(p->bufs[i]);
+
+    mpp_log("mpi_enc_pipe_test %s\n", ret ? "failed" : "success");
+    return ret;
+}